@@ -17,11 +17,12 @@ const gen_all = get_switch_exist("--all");
 const to_generate = {
     interpreter: gen_all || table_arg === "interpreter",
     interpreter0f: gen_all || table_arg === "interpreter0f",
+    interpreter_decoded: gen_all || table_arg === "interpreter_decoded",
 };
 
 assert(
     Object.keys(to_generate).some(k => to_generate[k]),
-    "Pass --table [interpreter|interpreter0f] or --all to pick which tables to generate"
+    "Pass --table [interpreter|interpreter0f|interpreter_decoded] or --all to pick which tables to generate"
 );
 
 gen_table();
@@ -31,7 +32,7 @@ function wrap_imm_call(imm)
     return `match ${imm} { Ok(o) => o, Err(()) => return }`;
 }
 
-function gen_read_imm_call(op, size_variant)
+function get_imm_type(op, size_variant)
 {
     let size = (op.os || op.opcode % 2 === 1) ? size_variant : 8;
 
@@ -39,18 +40,18 @@ function gen_read_imm_call(op, size_variant)
     {
         if(op.imm8)
         {
-            return wrap_imm_call("read_imm8()");
+            return "imm8";
         }
         else if(op.imm8s)
         {
-            return wrap_imm_call("read_imm8s()");
+            return "imm8s";
         }
         else
         {
             if(op.immaddr)
             {
                 // immaddr: depends on address size
-                return wrap_imm_call("read_moffs()");
+                return "moffs";
             }
             else
             {
@@ -58,12 +59,12 @@ function gen_read_imm_call(op, size_variant)
 
                 if(op.imm1632 && size === 16 || op.imm16)
                 {
-                    return wrap_imm_call("read_imm16()");
+                    return "imm16";
                 }
                 else
                 {
                     assert(op.imm1632 && size === 32 || op.imm32);
-                    return wrap_imm_call("read_imm32s()");
+                    return "imm32";
                 }
             }
         }
@@ -74,6 +75,38 @@ function gen_read_imm_call(op, size_variant)
     }
 }
 
+function gen_read_imm_call(op, size_variant)
+{
+    const imm_type = get_imm_type(op, size_variant);
+    if(imm_type === undefined)
+    {
+        return undefined;
+    }
+    return wrap_imm_call({
+        imm8: "read_imm8()",
+        imm8s: "read_imm8s()",
+        moffs: "read_moffs()",
+        imm16: "read_imm16()",
+        imm32: "read_imm32s()",
+    }[imm_type]);
+}
+
+function gen_decode_imm_call(op, size_variant)
+{
+    const imm_type = get_imm_type(op, size_variant);
+    if(imm_type === undefined)
+    {
+        return undefined;
+    }
+    return {
+        imm8: "cpu.read_imm8() as i32",
+        imm8s: "cpu.read_imm8s() as i32",
+        moffs: "cpu.read_moffs() as i32",
+        imm16: "cpu.read_imm16() as i32",
+        imm32: "cpu.read_imm32() as i32",
+    }[imm_type];
+}
+
 function gen_call(name, args)
 {
     args = args || [];
@@ -224,17 +257,17 @@ function gen_instruction_body_after_prefix(encodings, size)
     }
 }
 
-function gen_instruction_body_after_fixed_g(encoding, size)
+function ends_interpreted_block(encoding)
 {
-    const instruction_prefix = [];
-    const instruction_postfix =
-        (encoding.block_boundary && !encoding.no_block_boundary_in_interpreted) ||
-        (!encoding.custom && encoding.e) ?
-        ["after_block_boundary();"] : [];
+    return (encoding.block_boundary && !encoding.no_block_boundary_in_interpreted) ||
+        (!encoding.custom && encoding.e);
+}
 
+function gen_task_switch_test(encoding)
+{
     if(encoding.task_switch_test || encoding.sse)
     {
-        instruction_prefix.push(
+        return [
             {
                 type: "if-else",
                 if_blocks: [
@@ -243,8 +276,16 @@ function gen_instruction_body_after_fixed_g(encoding, size)
                         body: ["return;"],
                     }
                 ],
-            });
+            },
+        ];
     }
+    return [];
+}
+
+function gen_instruction_body_after_fixed_g(encoding, size)
+{
+    const instruction_prefix = gen_task_switch_test(encoding);
+    const instruction_postfix = ends_interpreted_block(encoding) ? ["after_block_boundary();"] : [];
 
     const imm_read = gen_read_imm_call(encoding, size);
     const instruction_name = make_instruction_name(encoding, size);
@@ -344,6 +385,204 @@ function gen_instruction_body_after_fixed_g(encoding, size)
     }
 }
 
+/*
+ * Pre-decoded instructions (see interpreter_cache.rs): decode reads the operands of an instruction
+ * without a prefix once and picks one of the handlers of run, which doesn't read the instruction
+ * stream. Instructions that decode doesn't handle are left to the interpreter
+ */
+function gen_decode_body(encodings, size, handlers)
+{
+    const encoding = encodings[0];
+
+    if(encoding.prefix)
+    {
+        if((encoding.opcode & 0xFF) === 0x0F)
+        {
+            const opcode0f = size === 32 ? "cpu.read_imm8() as u32 | 0x100" : "cpu.read_imm8() as u32";
+            return [`decode0f(${opcode0f}, cpu, instruction)`];
+        }
+        return ["DecodeResult::Unsupported"];
+    }
+
+    encodings = encodings.filter(e =>
+        (e.opcode >>> 16) !== 0x66 &&
+        (e.opcode >>> 8 & 0xFF) !== 0xF2 && (e.opcode >>> 16) !== 0xF2 &&
+        (e.opcode >>> 8 & 0xFF) !== 0xF3 && (e.opcode >>> 16) !== 0xF3
+    );
+
+    const code = [];
+
+    if(encoding.e)
+    {
+        code.push("let modrm_byte = cpu.read_imm8();");
+        code.push("instruction.modrm_byte = modrm_byte;");
+    }
+
+    if(encoding.fixed_g !== undefined)
+    {
+        const cases = encodings.slice().sort((e1, e2) => e1.fixed_g - e2.fixed_g);
+
+        return code.concat({
+            type: "switch",
+            condition: "modrm_byte >> 3 & 7",
+            cases: cases.map(case_ => ({
+                conditions: [case_.fixed_g],
+                body: gen_decode_body_after_fixed_g(case_, size, handlers),
+            })),
+            default_case: {
+                body: ["DecodeResult::Unsupported"],
+            },
+        });
+    }
+    else
+    {
+        assert(encodings.length === 1);
+        return code.concat(gen_decode_body_after_fixed_g(encodings[0], size, handlers));
+    }
+}
+
+function gen_decode_body_after_fixed_g(encoding, size, handlers)
+{
+    if(encoding.custom_modrm_resolve || encoding.custom_sti)
+    {
+        // these read from the instruction stream themselves
+        return ["DecodeResult::Unsupported"];
+    }
+
+    const result = ends_interpreted_block(encoding) || encoding.no_next_instruction ?
+        "DecodeResult::BlockEnd" : "DecodeResult::Next";
+    const instruction_prefix = gen_task_switch_test(encoding);
+    const instruction_postfix = ends_interpreted_block(encoding) ? ["after_block_boundary();"] : [];
+    const instruction_name = make_instruction_name(encoding, size);
+    const imm_read = gen_decode_imm_call(encoding, size);
+
+    function add_handler(name, args)
+    {
+        handlers.push([].concat(instruction_prefix, gen_call(name, args), instruction_postfix));
+        return handlers.length - 1;
+    }
+
+    if(encoding.e)
+    {
+        if(encoding.ignore_mod)
+        {
+            assert(!imm_read, "Unexpected instruction (ignore mod with immediate value)");
+
+            const handler = add_handler(instruction_name, [
+                "instruction.modrm_byte as i32 & 7",
+                "instruction.modrm_byte as i32 >> 3 & 7",
+            ]);
+            return [`instruction.handler = ${handler};`, result];
+        }
+
+        const mem_args = ["match modrm::resolve(&instruction.modrm) { Ok(a) => a, Err(()) => return }"];
+        const reg_args = ["instruction.modrm_byte as i32 & 7"];
+
+        if(encoding.fixed_g === undefined)
+        {
+            mem_args.push("instruction.modrm_byte as i32 >> 3 & 7");
+            reg_args.push("instruction.modrm_byte as i32 >> 3 & 7");
+        }
+
+        if(imm_read)
+        {
+            mem_args.push("instruction.imm");
+            reg_args.push("instruction.imm");
+        }
+
+        const mem_handler = add_handler(`${instruction_name}_mem`, mem_args);
+        const reg_handler = add_handler(`${instruction_name}_reg`, reg_args);
+
+        return [].concat(
+            {
+                type: "if-else",
+                if_blocks: [
+                    {
+                        condition: "modrm_byte < 0xC0",
+                        body: [
+                            "instruction.modrm = modrm::decode(cpu, modrm_byte);",
+                            `instruction.handler = ${mem_handler};`,
+                        ],
+                    }
+                ],
+                else_block: {
+                    body: [`instruction.handler = ${reg_handler};`],
+                },
+            },
+            imm_read ? [`instruction.imm = ${imm_read};`] : [],
+            result
+        );
+    }
+    else
+    {
+        const code = [];
+        const args = [];
+
+        if(imm_read)
+        {
+            code.push(`instruction.imm = ${imm_read};`);
+            args.push("instruction.imm");
+        }
+
+        if(encoding.extra_imm16)
+        {
+            assert(imm_read);
+            code.push("instruction.imm2 = cpu.read_imm16() as i32;");
+            args.push("instruction.imm2");
+        }
+        else if(encoding.extra_imm8)
+        {
+            assert(imm_read);
+            code.push("instruction.imm2 = cpu.read_imm8() as i32;");
+            args.push("instruction.imm2");
+        }
+
+        const handler = add_handler(instruction_name, args);
+
+        return code.concat(`instruction.handler = ${handler};`, result);
+    }
+}
+
+function gen_decode_table(by_opcode, handlers)
+{
+    const cases = [];
+    for(let opcode = 0; opcode < 0x100; opcode++)
+    {
+        let encoding = by_opcode[opcode];
+        assert(encoding && encoding.length);
+
+        let opcode_hex = hex(opcode, 2);
+        let opcode_high_hex = hex(opcode | 0x100, 2);
+
+        if(encoding[0].os)
+        {
+            cases.push({
+                conditions: [`0x${opcode_hex}`],
+                body: gen_decode_body(encoding, 16, handlers),
+            });
+            cases.push({
+                conditions: [`0x${opcode_high_hex}`],
+                body: gen_decode_body(encoding, 32, handlers),
+            });
+        }
+        else
+        {
+            cases.push({
+                conditions: [`0x${opcode_hex}`, `0x${opcode_high_hex}`],
+                body: gen_decode_body(encoding, undefined, handlers),
+            });
+        }
+    }
+    return {
+        type: "switch",
+        condition: "opcode",
+        cases,
+        default_case: {
+            body: ["DecodeResult::Unsupported"]
+        },
+    };
+}
+
 function gen_table()
 {
     let by_opcode = Object.create(null);
@@ -489,4 +728,47 @@ function gen_table()
             rust_ast.print_syntax_tree([].concat(code)).join("\n") + "\n"
         );
     }
+
+    if(to_generate.interpreter_decoded)
+    {
+        const handlers = [];
+        const decode_table = gen_decode_table(by_opcode, handlers);
+        const decode_table0f = gen_decode_table(by_opcode0f, handlers);
+
+        const code = [
+            "#![cfg_attr(rustfmt, rustfmt_skip)]",
+
+            "use cpu::cpu::{after_block_boundary, task_switch_test, task_switch_test_mmx};",
+            "use cpu::instructions;",
+            "use cpu::instructions_0f;",
+            "use cpu_context::CpuContext;",
+            "use interpreter_cache::{DecodeResult, DecodedInstruction};",
+            "use modrm;",
+
+            "pub fn decode(opcode: u32, cpu: &mut CpuContext, instruction: &mut DecodedInstruction) -> DecodeResult {",
+            decode_table,
+            "}",
+
+            "fn decode0f(opcode: u32, cpu: &mut CpuContext, instruction: &mut DecodedInstruction) -> DecodeResult {",
+            decode_table0f,
+            "}",
+
+            "pub unsafe fn run(instruction: &DecodedInstruction) {",
+            {
+                type: "switch",
+                condition: "instruction.handler",
+                cases: handlers.map((body, handler) => ({ conditions: [handler], body, })),
+                default_case: {
+                    body: ["assert!(false);"]
+                },
+            },
+            "}",
+        ];
+
+        finalize_table_rust(
+            OUT_DIR,
+            "interpreter_decoded.rs",
+            rust_ast.print_syntax_tree([].concat(code)).join("\n") + "\n"
+        );
+    }
 }
@@ -1398,6 +1398,7 @@
 
         $("memory_dump").onclick = function()
         {
+            emulator.v86.cpu.materialize_all_pages();
             const mem8 = emulator.v86.cpu.mem8;
             dump_file(new Uint8Array(mem8.buffer, mem8.byteOffset, mem8.length), "v86memory.bin");
             $("memory_dump").blur();
@@ -13,19 +13,32 @@ const print_stats = {
 
         const stat_names = [
             "COMPILE",
+            "COMPILE_BASELINE",
+            "COMPILE_TIER_UP",
+            "COMPILE_QUEUED",
+            "COMPILE_QUEUE_DROPPED",
+            "JIT_PROFILE_PAGE_USED",
+            "JIT_PROFILE_PAGE_CHANGED",
             "COMPILE_SKIPPED_NO_NEW_ENTRY_POINTS",
             "COMPILE_SUCCESS",
             "COMPILE_WRONG_ADDRESS_SPACE",
             "COMPILE_CUT_OFF_AT_END_OF_PAGE",
+            "COMPILE_LOOP_TOO_LARGE_FOR_FUNCTION",
             "COMPILE_WITH_LOOP_SAFETY",
             "COMPILE_PAGE",
             "COMPILE_PAGE/COMPILE_SUCCESS",
             "COMPILE_PAGE_SKIPPED_NO_NEW_ENTRY_POINTS",
             "COMPILE_BASIC_BLOCK",
             "COMPILE_DUPLICATED_BASIC_BLOCK",
+            "COMPILE_DEAD_FLAG_STORES",
+            "COMPILE_FLAGS_IN_LOCALS",
+            "COMPILE_FPU_RUN",
+            "COMPILE_FPU_RUN_INSTRUCTIONS",
+            "COMPILE_FPU_RUN_INSTRUCTIONS/COMPILE_FPU_RUN",
             "COMPILE_WASM_BLOCK",
             "COMPILE_WASM_LOOP",
             "COMPILE_DISPATCHER",
+            "COMPILE_FUNCTION",
             "COMPILE_ENTRY_POINT",
             "COMPILE_WASM_TOTAL_BYTES",
             "COMPILE_WASM_TOTAL_BYTES/COMPILE_PAGE",
@@ -38,13 +51,26 @@ const print_stats = {
             "RUN_INTERPRETED_MISSED_COMPILED_ENTRY_RUN_INTERPRETED",
             "RUN_INTERPRETED_MISSED_COMPILED_ENTRY_LOOKUP",
             "RUN_INTERPRETED_STEPS",
+            "RUN_INTERPRETED_DECODED_STEPS",
+            "RUN_INTERPRETED_DECODED_STEPS/RUN_INTERPRETED_STEPS",
+            "DECODE_BLOCK",
+            "DECODED_BLOCKS_FULL",
             "RUN_FROM_CACHE",
             "RUN_FROM_CACHE_STEPS",
             "RUN_FROM_CACHE_STEPS/RUN_FROM_CACHE",
             "RUN_FROM_CACHE_STEPS/RUN_INTERPRETED_STEPS",
+            "RUN_FROM_CACHE_CHAINED_STEPS",
+            "RUN_FROM_CACHE_CHAINED_STEPS/RUN_FROM_CACHE_STEPS",
+            "ENTRY_CACHE_LOOKUP",
+            "ENTRY_CACHE_PROBE",
+            "ENTRY_CACHE_PROBE/ENTRY_CACHE_LOOKUP",
             "DIRECT_EXIT",
             "INDIRECT_JUMP",
             "INDIRECT_JUMP_NO_ENTRY",
+            "INDIRECT_JUMP_NO_ENTRY/INDIRECT_JUMP",
+            "CHAINED_EXIT",
+            "LINK_EXIT_SITE",
+            "CALL_OTHER_FUNCTION",
             "NORMAL_PAGE_CHANGE",
             "NORMAL_FALLTHRU",
             "NORMAL_FALLTHRU_WITH_TARGET_BLOCK",
@@ -64,11 +90,14 @@ const print_stats = {
             "CONDITION_OPTIMISED",
             "CONDITION_UNOPTIMISED",
             "FAILED_PAGE_CHANGE",
+            "FPU_RUN",
+            "FPU_RUN_GUARD_FAILED",
             "SAFE_READ_FAST",
             "SAFE_READ_SLOW_PAGE_CROSSED",
             "SAFE_READ_SLOW_NOT_VALID",
             "SAFE_READ_SLOW_NOT_USER",
             "SAFE_READ_SLOW_IN_MAPPED_RANGE",
+            "SAFE_READ_SLOW_NO_EXECUTE",
             "SAFE_WRITE_FAST",
             "SAFE_WRITE_SLOW_PAGE_CROSSED",
             "SAFE_WRITE_SLOW_NOT_VALID",
@@ -94,7 +123,9 @@ const print_stats = {
             "INVALIDATE_MODULE_DIRTY_PAGE",
             "INVALIDATE_PAGE_HAD_CODE",
             "INVALIDATE_PAGE_HAD_ENTRY_POINTS",
+            "INVALIDATE_PAGE_HAD_DECODED_BLOCKS",
             "DIRTY_PAGE_DID_NOT_HAVE_CODE",
+            "DIRTY_PAGE_OUTSIDE_OF_CODE",
             "RUN_FROM_CACHE_EXIT_SAME_PAGE",
             "RUN_FROM_CACHE_EXIT_NEAR_END_OF_PAGE",
             "RUN_FROM_CACHE_EXIT_DIFFERENT_PAGE",
@@ -102,6 +133,9 @@ const print_stats = {
             "FULL_CLEAR_TLB",
             "TLB_FULL",
             "TLB_GLOBAL_FULL",
+            "ADDRESS_SPACE_CACHE_HIT",
+            "ADDRESS_SPACE_CACHE_MISS",
+            "ADDRESS_SPACE_CACHE_DROPPED",
             "MODRM_SIMPLE_REG",
             "MODRM_SIMPLE_REG_WITH_OFFSET",
             "MODRM_SIMPLE_CONST_OFFSET",
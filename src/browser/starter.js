@@ -8,7 +8,7 @@
  * Options can have the following properties (all optional, default in parenthesis):
  *
  * - `memory_size number` (16 * 1024 * 1024) - The memory size in bytes, should
- *   be a power of 2.
+ *   be a power of 2. At most 3 GiB.
  * - `vga_memory_size number` (8 * 1024 * 1024) - VGA memory size in bytes.
  *
  * - `autostart boolean` (false) - If emulation should be started when emulator
@@ -35,6 +35,21 @@
  *
  * - `initial_state Object` (Normal boot) - An initial state to load, see
  *   [`restore_state`](#restore_statearraybuffer-state) and below.
+ * - `initial_jit_profile Object` (No profile) - A jit profile to load, see
+ *   [`save_jit_profile`](#save_jit_profile-arraybuffer) and below.
+ * - `lazy_memory boolean` (false) - When restoring a state, copy each page of
+ *   memory from the state when the guest first accesses it, so that the guest
+ *   resumes without waiting for its memory to be restored. The memory of a
+ *   compressed state is decompressed as it's accessed.
+ * - `fill_lazy_memory boolean` (true) - With `lazy_memory`, copy in the pages
+ *   that the guest hasn't accessed yet in the background. If disabled, the
+ *   memory of an uncompressed state is shared by all instances that restore
+ *   the same ArrayBuffer, so that many instances booted from one state only
+ *   use memory for the pages they touch.
+ * - `compress_state boolean` (false) - Compress the states returned by
+ *   `save_state` with zstd while saving, without creating the uncompressed
+ *   state. They can be restored like uncompressed states (but not shared with
+ *   `lazy_memory`).
  *
  * - `filesystem Object` (No 9p filesystem) - A 9p filesystem, see
  *   [filesystem.md](filesystem.md).
@@ -133,6 +148,7 @@ function V86Starter(options)
         "mmap_write128": function(addr, value0, value1, value2, value3) {
             cpu.mmap_write128(addr, value0, value1, value2, value3);
         },
+        "materialize_page": function(page) { cpu.materialize_page(page); },
 
         "log_from_wasm": function(offset, len) {
             const str = v86util.read_sized_string_from_mem(wasm_memory, offset, len);
@@ -263,6 +279,9 @@ V86Starter.prototype.continue_init = async function(emulator, options)
     settings.uart3 = options["uart3"];
     settings.cmdline = options["cmdline"];
     settings.preserve_mac_from_state_image = options["preserve_mac_from_state_image"];
+    settings.lazy_memory = options["lazy_memory"];
+    settings.fill_lazy_memory = options["fill_lazy_memory"];
+    settings.compress_state = options["compress_state"];
 
     if(options["network_adapter"])
     {
@@ -351,6 +370,9 @@ V86Starter.prototype.continue_init = async function(emulator, options)
             case "initial_state":
                 settings.initial_state = buffer.buffer;
                 break;
+            case "initial_jit_profile":
+                settings.initial_jit_profile = buffer.buffer;
+                break;
             case "fs9p_json":
                 settings.fs9p_json = buffer;
                 break;
@@ -388,8 +410,8 @@ V86Starter.prototype.continue_init = async function(emulator, options)
         };
 
         if(name === "bios" || name === "vga_bios" ||
-            name === "initial_state" || name === "multiboot" ||
-            name === "bzimage" || name === "initrd")
+            name === "initial_state" || name === "initial_jit_profile" ||
+            name === "multiboot" || name === "bzimage" || name === "initrd")
         {
             // Ignore async for these because they must be available before boot.
             // This should make result.buffer available after the object is loaded
@@ -478,7 +500,7 @@ V86Starter.prototype.continue_init = async function(emulator, options)
     var image_names = [
         "bios", "vga_bios",
         "cdrom", "hda", "hdb", "fda", "fdb",
-        "initial_state", "multiboot",
+        "initial_state", "initial_jit_profile", "multiboot",
         "bzimage", "initrd",
     ];
 
@@ -645,6 +667,12 @@ V86Starter.prototype.continue_init = async function(emulator, options)
                 settings.initial_state = undefined;
             }
 
+            if(settings.initial_jit_profile)
+            {
+                emulator.load_jit_profile(settings.initial_jit_profile);
+                settings.initial_jit_profile = undefined;
+            }
+
             if(options["autostart"])
             {
                 this.bus.send("cpu-run");
@@ -773,6 +801,9 @@ V86Starter.prototype.remove_listener = function(event, listener)
  * Different versions of the emulator might use a different format for the
  * state buffer.
  *
+ * With the `lazy_memory` option, the state keeps being used after this call
+ * (until all pages have been filled in) and must not be modified.
+ *
  * @param {ArrayBuffer} state
  * @export
  */
@@ -790,6 +821,31 @@ V86Starter.prototype.restore_state = function(state)
  * @export
  */
 V86Starter.prototype.save_state = function(callback)
+{
+    this.save_state_internal(false, callback);
+};
+
+/**
+ * Like [`save_state`](#save_statefunctionobject-arraybuffer-callback), but
+ * only contains the pages of memory that were written since the last state
+ * was saved or restored, which makes frequent checkpoints of big guests cheap.
+ * Restore it with [`restore_state`](#restore_statearraybuffer-state) right
+ * after restoring (or saving) the state it's based on. If there is no such
+ * state, a full state is saved.
+ *
+ * Written pages are only tracked from the first call on, which therefore
+ * always saves a full state. Tracking makes the first write to each page
+ * after a save or restore take a page walk.
+ *
+ * @param {function(Object, ArrayBuffer)} callback
+ * @export
+ */
+V86Starter.prototype.save_state_incremental = function(callback)
+{
+    this.save_state_internal(true, callback);
+};
+
+V86Starter.prototype.save_state_internal = function(incremental, callback)
 {
     // Might become asynchronous at some point
 
@@ -797,7 +853,7 @@ V86Starter.prototype.save_state = function(callback)
     {
         try
         {
-            callback(null, this.v86.save_state());
+            callback(null, this.v86.save_state(incremental));
         }
         catch(e)
         {
@@ -806,6 +862,36 @@ V86Starter.prototype.save_state = function(callback)
     }.bind(this), 0);
 };
 
+/**
+ * Return the jit profile of the running emulator: The guest code pages that
+ * have been compiled, with a hash of their contents. Pass it as the
+ * `initial_jit_profile` option or to
+ * [`load_jit_profile`](#load_jit_profilearraybuffer-profile) to compile these
+ * pages as soon as the guest runs them, rather than after a warm-up. The
+ * profile can be stored anywhere, e.g. in a file or in IndexedDB.
+ *
+ * @return {ArrayBuffer}
+ * @export
+ */
+V86Starter.prototype.save_jit_profile = function()
+{
+    return this.v86.save_jit_profile();
+};
+
+/**
+ * Load a jit profile returned by
+ * [`save_jit_profile`](#save_jit_profile-arraybuffer). Pages whose contents
+ * differ from the profile are ignored, so a profile from a different guest is
+ * harmless.
+ *
+ * @param {ArrayBuffer} profile
+ * @export
+ */
+V86Starter.prototype.load_jit_profile = function(profile)
+{
+    this.v86.load_jit_profile(profile);
+};
+
 /**
  * Return an object with several statistics. Return value looks similar to
  * (but can be subject to change in future versions or different
@@ -118,6 +118,15 @@ var
     /** @const */
     MMAP_BLOCK_SIZE = 1 << MMAP_BLOCK_BITS;
 
+/**
+ * The largest supported memory size. The physical address space above it is left to
+ * memory-mapped devices (such as the vga framebuffer at 0xE0000000), and the 4 GiB wasm memory
+ * holding the guest memory also needs space for the emulator itself.
+ *
+ * @const
+ */
+var MEMORY_SIZE_MAX = 0xC0000000;
+
 /** @const */
 var CR0_PG = 1 << 31;
 
@@ -26,6 +26,24 @@ function CPU(bus, wm)
     this.mem8 = new Uint8Array(0);
     this.mem32s = new Int32Array(this.mem8.buffer);
 
+    // Restore memory lazily from the state, see set_lazy_memory
+    this.lazy_memory = false;
+    this.lazy_memory_image = null;
+    this.lazy_memory_pages = null;
+    // Copy in the remaining pages between runs of the main loop, see fill_lazy_memory
+    this.fill_lazy_memory_pages = true;
+    // Decompresses the memory image while it's being accessed, see restore_state
+    this.lazy_memory_decoder = null;
+
+    // Identifies the last saved or restored state, which an incremental state is based on
+    this.state_id = 0;
+    this.save_incremental_state = false;
+    // Enabled by the first incremental state, as it costs a page walk for the first write to each
+    // page after every save and restore
+    this.dirty_page_tracking = false;
+
+    this.compress_saved_state = false;
+
     this.segment_is_null = v86util.view(Uint8Array, memory, 724, 8);
     this.segment_offsets = v86util.view(Int32Array, memory, 736, 8);
     this.segment_limits = v86util.view(Uint32Array, memory, 768, 8);
@@ -148,6 +166,9 @@ function CPU(bus, wm)
     this.fpu_dp_selector = v86util.view(Int32Array, memory, 1060, 1);
     this.fpu_dp_selector[0] = 0;
 
+    this.efer = v86util.view(Int32Array, memory, 1064, 1);
+    this.efer[0] = 0;
+
     this.reg_xmm32s = v86util.view(Int32Array, memory, 832, 8 * 4);
 
     this.mxcsr = v86util.view(Int32Array, memory, 824, 1);
@@ -195,6 +216,7 @@ CPU.prototype.create_jit_imports = function()
     const jit_imports = Object.create(null);
 
     jit_imports["m"] = this.wm.exports["memory"];
+    jit_imports["t"] = this.wm.wasm_table;
 
     for(let name of Object.keys(this.wm.exports))
     {
@@ -253,6 +275,19 @@ CPU.prototype.wasm_patch = function()
     this.clear_tlb = get_import("clear_tlb");
     this.full_clear_tlb = get_import("full_clear_tlb");
 
+    this.set_all_pages_lazy = get_import("set_all_pages_lazy");
+    this.clear_lazy_pages = get_import("clear_lazy_pages");
+    this.materialize_range = get_import("materialize_range");
+    this.materialize_all_pages = get_import("materialize_all_pages");
+    this.materialize_next_pages = get_import("materialize_next_pages");
+    this.pack_memory_scan = get_import("pack_memory_scan");
+    this.pack_memory_scan_free = get_import("pack_memory_scan_free");
+
+    this.get_dirty_pages_bitmap = get_import("get_dirty_pages_bitmap");
+    this.clear_dirty_pages = get_import("clear_dirty_pages");
+    this.set_dirty_page_tracking = get_import("set_dirty_page_tracking");
+    this.mark_dirty_range = get_import("mark_dirty_range");
+
     this.set_tsc = get_import("set_tsc");
     this.store_current_tsc = get_import("store_current_tsc");
 
@@ -265,6 +300,11 @@ CPU.prototype.wasm_patch = function()
     this.jit_dirty_cache = get_import("jit_dirty_cache");
     this.codegen_finalize_finished = get_import("codegen_finalize_finished");
 
+    this.jit_profile_save = get_import("jit_profile_save");
+    this.jit_profile_buffer = get_import("jit_profile_buffer");
+    this.jit_profile_allocate = get_import("jit_profile_allocate");
+    this.jit_profile_load = get_import("jit_profile_load");
+
     this.allocate_memory = get_import("allocate_memory");
     this.zero_memory = get_import("zero_memory");
 
@@ -273,6 +313,12 @@ CPU.prototype.wasm_patch = function()
     this.zstd_free_ctx = get_import("zstd_free_ctx");
     this.zstd_read = get_import("zstd_read");
     this.zstd_read_free = get_import("zstd_read_free");
+
+    this.zstd_create_cctx = get_import("zstd_create_cctx");
+    this.zstd_get_cctx_src_ptr = get_import("zstd_get_cctx_src_ptr");
+    this.zstd_compress = get_import("zstd_compress");
+    this.zstd_get_cctx_dst_ptr = get_import("zstd_get_cctx_dst_ptr");
+    this.zstd_free_cctx = get_import("zstd_free_cctx");
 };
 
 CPU.prototype.jit_force_generate = function(addr)
@@ -286,6 +332,29 @@ CPU.prototype.jit_force_generate = function(addr)
     this.jit_force_generate_unsafe(addr);
 };
 
+/**
+ * @return {ArrayBuffer}
+ */
+CPU.prototype.save_jit_profile = function()
+{
+    const len = this.jit_profile_save();
+    return new Uint8Array(this.wasm_memory.buffer, this.jit_profile_buffer(), len).slice().buffer;
+};
+
+/**
+ * @param {ArrayBuffer} profile
+ */
+CPU.prototype.load_jit_profile = function(profile)
+{
+    const ptr = this.jit_profile_allocate(profile.byteLength);
+    new Uint8Array(this.wasm_memory.buffer, ptr, profile.byteLength).set(new Uint8Array(profile));
+
+    if(!this.jit_profile_load())
+    {
+        dbg_log("Ignored jit profile: Invalid or from a different version");
+    }
+};
+
 CPU.prototype.jit_clear_func = function(index)
 {
     dbg_assert(index >= 0 && index < WASM_TABLE_SIZE);
@@ -381,19 +450,47 @@ CPU.prototype.get_state = function()
     state[74] = this.fpu_dp_selector[0];
     state[75] = this.fpu_opcode[0];
 
-    const { packed_memory, bitmap } = this.pack_memory();
-    state[77] = packed_memory;
+    const parent_state_id = this.save_incremental_state && this.dirty_page_tracking ? this.state_id : 0;
+    const { packed_memory, bitmap, duplicates } = this.pack_memory(parent_state_id !== 0);
+    state[76] = duplicates;
     state[78] = new Uint8Array(bitmap.get_buffer());
 
     state[79] = this.devices.uart1;
     state[80] = this.devices.uart2;
     state[81] = this.devices.uart3;
 
+    state[82] = this.efer[0];
+
+    if(this.save_incremental_state && !this.dirty_page_tracking)
+    {
+        // The next incremental state is based on this one
+        this.dirty_page_tracking = true;
+        this.set_dirty_page_tracking(true);
+    }
+    else
+    {
+        this.clear_dirty_pages();
+    }
+    this.state_id = v86util.get_rand_int() || 1;
+    state[83] = this.state_id;
+    state[84] = parent_state_id;
+
+    // Saved last, so that it can be decompressed after everything else has been restored (see
+    // restore_state). Older states have it at index 77
+    state[85] = packed_memory;
+
     return state;
 };
 
 CPU.prototype.set_state = function(state)
 {
+    const parent_state_id = state[84] || 0;
+
+    if(parent_state_id !== 0 && parent_state_id !== this.state_id)
+    {
+        throw new StateLoadError("Incremental state must be restored on top of the state it's based on");
+    }
+
     this.memory_size[0] = state[0];
 
     if(this.mem8.length !== this.memory_size[0])
@@ -480,82 +577,292 @@ CPU.prototype.set_state = function(state)
     this.fpu_dp_selector[0] = state[74];
     this.fpu_opcode[0] = state[75];
 
+    this.efer[0] = state[82];
+
     const bitmap = new v86util.Bitmap(state[78].buffer);
-    const packed_memory = state[77];
-    this.unpack_memory(bitmap, packed_memory);
+    const packed_memory = state[85] || state[77];
+    const duplicates = state[76] || null;
+
+    if(parent_state_id !== 0)
+    {
+        dbg_assert(!duplicates);
+        this.unpack_memory_incremental(bitmap, packed_memory);
+    }
+    else if(this.lazy_memory)
+    {
+        this.set_lazy_memory(bitmap, packed_memory, duplicates);
+    }
+    else
+    {
+        this.unpack_memory(bitmap, packed_memory, duplicates);
+    }
 
     this.full_clear_tlb();
 
+    this.state_id = state[83] || 0;
+    this.clear_dirty_pages();
+
     this.jit_clear_cache();
 };
 
-CPU.prototype.pack_memory = function()
+/**
+ * @param {boolean} incremental Only pack the pages that were written since the last state was
+ *                              saved or restored, including those that are zero now
+ */
+CPU.prototype.pack_memory = function(incremental)
 {
     dbg_assert((this.mem8.length & 0xFFF) === 0);
 
-    const page_count = this.mem8.length >> 12;
-    const nonzero_pages = [];
+    const page_count = this.mem8.length >>> 12;
 
-    for(let page = 0; page < page_count; page++)
+    if(incremental)
     {
-        const offset = page << 12;
-        const view = this.mem32s.subarray(offset >> 2, offset + 0x1000 >> 2);
-        let is_zero = true;
+        const dirty_pages = new Int32Array(this.wasm_memory.buffer, this.get_dirty_pages_bitmap(), page_count + 31 >> 5);
+        const bitmap = new v86util.Bitmap(dirty_pages.slice().buffer);
+        const pages = [];
 
-        for(let i = 0; i < view.length; i++)
+        for(let page = 0; page < page_count; page++)
         {
-            if(view[i] !== 0)
+            if(bitmap.get(page))
             {
-                is_zero = false;
-                break;
+                pages.push(page);
             }
         }
 
-        if(!is_zero)
+        const packed_memory = new Uint8Array(pages.length << 12 >>> 0);
+
+        for(let [i, page] of pages.entries())
         {
-            nonzero_pages.push(page);
+            const offset = page << 12 >>> 0;
+            packed_memory.set(this.mem8.subarray(offset, offset + 0x1000), i << 12 >>> 0);
         }
+
+        return { bitmap, packed_memory, duplicates: null };
     }
 
+    this.materialize_all_pages();
+    this.release_lazy_memory();
+
+    // Zero pages aren't saved, and pages with the same contents as an earlier page are saved as
+    // pairs of (page, earlier page), see pack_memory_scan
+    const pages = new Int32Array(this.wasm_memory.buffer, this.pack_memory_scan() >>> 0, page_count);
     const bitmap = new v86util.Bitmap(page_count);
-    const packed_memory = new Uint8Array(nonzero_pages.length << 12);
+    const duplicates = [];
+    let packed_page_count = 0;
 
-    for(let [i, page] of nonzero_pages.entries())
+    for(let page = 0; page < page_count; page++)
     {
-        bitmap.set(page, 1);
+        if(pages[page] === page)
+        {
+            bitmap.set(page, 1);
+            packed_page_count++;
+        }
+        else if(pages[page] !== -1)
+        {
+            duplicates.push(page, pages[page]);
+        }
+    }
+
+    const packed_memory = new Uint8Array(packed_page_count << 12 >>> 0);
+    let packed_page = 0;
 
-        const offset = page << 12;
-        const page_contents = this.mem8.subarray(offset, offset + 0x1000);
-        packed_memory.set(page_contents, i << 12);
+    for(let page = 0; page < page_count; )
+    {
+        if(pages[page] !== page)
+        {
+            page++;
+            continue;
+        }
+
+        // copy runs of saved pages at once
+        let end = page + 1;
+        while(end < page_count && pages[end] === end)
+        {
+            end++;
+        }
+
+        packed_memory.set(this.mem8.subarray(page << 12 >>> 0, end << 12 >>> 0), packed_page << 12 >>> 0);
+        packed_page += end - page;
+        page = end;
     }
 
-    return { bitmap, packed_memory };
+    dbg_assert(packed_page === packed_page_count);
+    this.pack_memory_scan_free();
+
+    return { bitmap, packed_memory, duplicates: new Int32Array(duplicates) };
 };
 
-CPU.prototype.unpack_memory = function(bitmap, packed_memory)
+CPU.prototype.unpack_memory = function(bitmap, packed_memory, duplicates)
 {
+    this.release_lazy_memory();
     this.zero_memory(this.memory_size[0]);
 
-    const page_count = this.memory_size[0] >> 12;
+    const page_count = this.memory_size[0] >>> 12;
     let packed_page = 0;
 
     for(let page = 0; page < page_count; page++)
     {
         if(bitmap.get(page))
         {
-            let offset = packed_page << 12;
+            let offset = packed_page << 12 >>> 0;
             let view = packed_memory.subarray(offset, offset + 0x1000);
-            this.mem8.set(view, page << 12);
+            this.mem8.set(view, page << 12 >>> 0);
+            packed_page++;
+        }
+    }
+
+    if(duplicates)
+    {
+        for(let i = 0; i < duplicates.length; i += 2)
+        {
+            const page = duplicates[i];
+            const source = duplicates[i + 1];
+            this.mem8.copyWithin(page << 12 >>> 0, source << 12 >>> 0, source + 1 << 12 >>> 0);
+        }
+    }
+};
+
+/**
+ * Apply the pages of an incremental state on top of the current memory
+ */
+CPU.prototype.unpack_memory_incremental = function(bitmap, packed_memory)
+{
+    const page_count = this.memory_size[0] >>> 12;
+    let packed_page = 0;
+
+    for(let page = 0; page < page_count; page++)
+    {
+        if(bitmap.get(page))
+        {
+            const offset = page << 12 >>> 0;
+            const packed_offset = packed_page << 12 >>> 0;
+            this.materialize_range(offset, 0x1000);
+            this.mem8.set(packed_memory.subarray(packed_offset, packed_offset + 0x1000), offset);
             packed_page++;
         }
     }
 };
 
+/**
+ * Like unpack_memory, but instead of copying the whole image, pages are copied when they're first
+ * accessed (by materialize_page, called from wasm), so the guest can start running right away.
+ * The remaining pages are copied in the background by fill_lazy_memory. If that's disabled, the
+ * image is kept, so it's shared by all instances that were restored from the same state, and wasm
+ * pages that the guest doesn't touch are never committed.
+ */
+CPU.prototype.set_lazy_memory = function(bitmap, packed_memory, duplicates)
+{
+    this.release_lazy_memory();
+
+    const page_count = this.memory_size[0] >>> 12;
+    const pages = new Int32Array(page_count);
+    let packed_page = 0;
+
+    for(let page = 0; page < page_count; page++)
+    {
+        pages[page] = bitmap.get(page) ? packed_page++ : -1;
+    }
+
+    if(duplicates)
+    {
+        for(let i = 0; i < duplicates.length; i += 2)
+        {
+            pages[duplicates[i]] = pages[duplicates[i + 1]];
+        }
+    }
+
+    this.lazy_memory_image = packed_memory;
+    this.lazy_memory_pages = pages;
+    this.set_all_pages_lazy();
+};
+
+CPU.prototype.materialize_page = function(page)
+{
+    const offset = page << 12 >>> 0;
+    const packed_page = this.lazy_memory_pages[page];
+
+    if(packed_page === -1)
+    {
+        this.mem8.fill(0, offset, offset + 0x1000);
+    }
+    else
+    {
+        const packed_offset = packed_page << 12 >>> 0;
+
+        if(this.lazy_memory_decoder)
+        {
+            this.decode_lazy_memory(packed_offset + 0x1000);
+        }
+
+        this.mem8.set(this.lazy_memory_image.subarray(packed_offset, packed_offset + 0x1000), offset);
+    }
+};
+
+/**
+ * Decompress the memory image of the restored state up to the given offset. Decompression is
+ * sequential, but the image is mostly accessed in order, by fill_lazy_memory
+ */
+CPU.prototype.decode_lazy_memory = function(end)
+{
+    const decoder = this.lazy_memory_decoder;
+    const CHUNK_SIZE = 256 * 1024;
+
+    while(decoder.decoded < end)
+    {
+        const to_read = Math.min(decoder.buffer.length - decoder.decoded, CHUNK_SIZE);
+        dbg_assert(to_read > 0);
+
+        const ptr = this.zstd_read(decoder.ctx, to_read);
+        decoder.buffer.set(new Uint8Array(this.wasm_memory.buffer, ptr, to_read), decoder.decoded);
+        this.zstd_read_free(ptr, to_read);
+
+        decoder.decoded += to_read;
+    }
+
+    if(decoder.decoded === decoder.buffer.length)
+    {
+        this.zstd_free_ctx(decoder.ctx);
+        this.lazy_memory_decoder = null;
+    }
+};
+
+/**
+ * Copy in some of the pages that haven't been accessed yet, so that the guest eventually doesn't
+ * depend on the state anymore
+ */
+CPU.prototype.fill_lazy_memory = function()
+{
+    const LAZY_MEMORY_FILL_PAGES = 256;
+
+    if(this.materialize_next_pages(LAZY_MEMORY_FILL_PAGES) === 0)
+    {
+        this.release_lazy_memory();
+    }
+};
+
+CPU.prototype.release_lazy_memory = function()
+{
+    this.clear_lazy_pages();
+    this.lazy_memory_image = null;
+    this.lazy_memory_pages = null;
+
+    if(this.lazy_memory_decoder)
+    {
+        this.zstd_free_ctx(this.lazy_memory_decoder.ctx);
+        this.lazy_memory_decoder = null;
+    }
+};
+
 /**
  * @return {number} time in ms until this method should becalled again
  */
 CPU.prototype.main_run = function()
 {
+    if(this.lazy_memory_image && this.fill_lazy_memory_pages)
+    {
+        this.fill_lazy_memory();
+    }
+
     if(this.in_hlt[0])
     {
         //if(false)
@@ -595,6 +902,8 @@ CPU.prototype.reboot_internal = function()
 
 CPU.prototype.reset_memory = function()
 {
+    this.state_id = 0;
+    this.release_lazy_memory();
     this.mem8.fill(0);
 };
 
@@ -605,20 +914,26 @@ CPU.prototype.create_memory = function(size)
     {
         size = 1024 * 1024;
     }
-    else if((size | 0) < 0)
+    else if(size > MEMORY_SIZE_MAX)
     {
-        size = Math.pow(2, 31) - MMAP_BLOCK_SIZE;
+        dbg_log("Memory size limited to " + (MEMORY_SIZE_MAX >>> 20) + "M");
+        size = MEMORY_SIZE_MAX;
     }
 
-    size = ((size - 1) | (MMAP_BLOCK_SIZE - 1)) + 1 | 0;
-    dbg_assert((size | 0) > 0);
+    size = ((size - 1) | (MMAP_BLOCK_SIZE - 1)) + 1 >>> 0;
+    dbg_assert(size > 0 && size <= MEMORY_SIZE_MAX);
     dbg_assert((size & MMAP_BLOCK_SIZE - 1) === 0);
 
     console.assert(this.memory_size[0] === 0, "Expected uninitialised memory");
 
     this.memory_size[0] = size;
 
-    const memory_offset = this.allocate_memory(size);
+    const memory_offset = this.allocate_memory(size) >>> 0;
+
+    if(memory_offset === 0)
+    {
+        throw new Error("Could not allocate " + (size >>> 20) + "M of memory");
+    }
 
     this.mem8 = v86util.view(Uint8Array, this.wasm_memory, memory_offset, size);
     this.mem32s = v86util.view(Uint32Array, this.wasm_memory, memory_offset, size >> 2);
@@ -636,6 +951,9 @@ CPU.prototype.init = function(settings, device_bus)
         settings.memory_size : 1024 * 1024 * 64);
 
     this.acpi_enabled[0] = +settings.acpi;
+    this.lazy_memory = !!settings.lazy_memory;
+    this.fill_lazy_memory_pages = settings.fill_lazy_memory !== false;
+    this.compress_saved_state = !!settings.compress_state;
 
     this.reset_cpu();
 
@@ -1098,7 +1416,7 @@ CPU.prototype.fill_cmos = function(rtc, settings)
     var memory_above_1m = 0; // in k
     if(this.memory_size[0] >= 1024 * 1024)
     {
-        memory_above_1m = (this.memory_size[0] - 1024 * 1024) >> 10;
+        memory_above_1m = (this.memory_size[0] - 1024 * 1024) >>> 10;
         memory_above_1m = Math.min(memory_above_1m, 0xFFFF);
     }
 
@@ -1110,7 +1428,7 @@ CPU.prototype.fill_cmos = function(rtc, settings)
     var memory_above_16m = 0; // in 64k blocks
     if(this.memory_size[0] >= 16 * 1024 * 1024)
     {
-        memory_above_16m = (this.memory_size[0] - 16 * 1024 * 1024) >> 16;
+        memory_above_16m = (this.memory_size[0] - 16 * 1024 * 1024) >>> 16;
         memory_above_16m = Math.min(memory_above_16m, 0xFFFF);
     }
     rtc.cmos_write(CMOS_MEM_EXTMEM2_LOW, memory_above_16m & 0xFF);
@@ -1183,11 +1501,14 @@ CPU.prototype.load_bios = function()
         function(addr)
         {
             addr &= 0xFFFFF;
+            this.materialize_range(addr, 1);
             return this.mem8[addr];
         }.bind(this),
         function(addr, value)
         {
             addr &= 0xFFFFF;
+            this.materialize_range(addr, 1);
+            this.mark_dirty_range(addr, 1);
             this.mem8[addr] = value;
         }.bind(this));
 };
@@ -1297,10 +1618,10 @@ CPU.prototype.codegen_finalize = function(wasm_table_index, start, state_flags,
         const result = new WebAssembly.Instance(module, { "e": this.jit_imports });
         const f = result.exports["f"];
 
-        this.codegen_finalize_finished(wasm_table_index, start, state_flags);
-
         this.wm.wasm_table.set(wasm_table_index + WASM_TABLE_OFFSET, f);
 
+        this.codegen_finalize_finished(wasm_table_index, start, state_flags);
+
         if(this.test_hook_did_finalize_wasm)
         {
             this.test_hook_did_finalize_wasm(code);
@@ -1309,16 +1630,22 @@ CPU.prototype.codegen_finalize = function(wasm_table_index, start, state_flags,
         return;
     }
 
+    // Several modules may be compiled at the same time, and the output buffer is reused for the
+    // next module (instantiate copies the code before returning)
+    // Note: codegen_finalize_finished may free this table index or start compiling queued
+    // modules, so the function must be installed before calling it
+    const code_copy = this.test_hook_did_finalize_wasm ? code.slice() : null;
+
     const result = WebAssembly.instantiate(code, { "e": this.jit_imports }).then(result => {
         const f = result.instance.exports["f"];
 
-        this.codegen_finalize_finished(wasm_table_index, start, state_flags);
-
         this.wm.wasm_table.set(wasm_table_index + WASM_TABLE_OFFSET, f);
 
+        this.codegen_finalize_finished(wasm_table_index, start, state_flags);
+
         if(this.test_hook_did_finalize_wasm)
         {
-            this.test_hook_did_finalize_wasm(code);
+            this.test_hook_did_finalize_wasm(code_copy);
         }
     });
 
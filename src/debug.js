@@ -574,7 +574,7 @@ CPU.prototype.debug_init = function()
             start = 0;
         }
 
-        return cpu.mem8.slice(start, start + count).buffer;
+        return cpu.read_blob(start, count).slice().buffer;
     }
 
 
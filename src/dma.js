@@ -342,7 +342,7 @@ DMA.prototype.do_write = function(buffer, start, len, channel, fn)
         }
 
         buffer.set(start,
-                this.cpu.mem8.subarray(addr, addr + read_bytes),
+                this.cpu.read_blob(addr, read_bytes),
                 () =>
                 {
                     if(want_more && autoinit)
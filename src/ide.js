@@ -1777,7 +1777,7 @@ IDEInterface.prototype.do_ata_write_sectors_dma = function()
 
         dbg_log("dma write transfer dest=" + h(prd_addr) + " prd_count=" + h(prd_count), LOG_DISK);
 
-        var slice = this.cpu.mem8.subarray(prd_addr, prd_addr + prd_count);
+        var slice = this.cpu.read_blob(prd_addr, prd_count);
         dbg_assert(slice.length === prd_count);
 
         buffer.set(slice, offset);
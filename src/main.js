@@ -183,10 +183,10 @@ else
 
 v86.prototype.next_tick = next_tick;
 
-v86.prototype.save_state = function()
+v86.prototype.save_state = function(incremental)
 {
     // TODO: Should be implemented here, not on cpu
-    return this.cpu.save_state();
+    return this.cpu.save_state(incremental);
 };
 
 v86.prototype.restore_state = function(state)
@@ -195,6 +195,16 @@ v86.prototype.restore_state = function(state)
     return this.cpu.restore_state(state);
 };
 
+v86.prototype.save_jit_profile = function()
+{
+    return this.cpu.save_jit_profile();
+};
+
+v86.prototype.load_jit_profile = function(profile)
+{
+    this.cpu.load_jit_profile(profile);
+};
+
 
 if(typeof performance === "object" && performance.now)
 {
@@ -77,6 +77,8 @@ CPU.prototype.write_blob = function(blob, offset)
         dbg_assert(!this.in_mapped_range(offset));
         dbg_assert(!this.in_mapped_range(offset + blob.length - 1));
 
+        this.materialize_range(offset, blob.length);
+        this.mark_dirty_range(offset, blob.length);
         this.jit_dirty_cache(offset, offset + blob.length);
         this.mem8.set(blob, offset);
     }
@@ -88,6 +90,7 @@ CPU.prototype.read_blob = function(offset, length)
     {
         dbg_assert(!this.in_mapped_range(offset));
         dbg_assert(!this.in_mapped_range(offset + length - 1));
+        this.materialize_range(offset, length);
     }
     return this.mem8.subarray(offset, offset + length);
 };
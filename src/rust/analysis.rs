@@ -1,5 +1,6 @@
 #![allow(non_snake_case)]
 
+use cpu::memory;
 use cpu_context::CpuContext;
 use prefix::{PREFIX_66, PREFIX_67, PREFIX_F2, PREFIX_F3};
 use regs::{CS, DS, ES, FS, GS, SS};
@@ -97,3 +98,172 @@ pub fn instr_F3_analyze(cpu: &mut CpuContext, analysis: &mut Analysis) {
 }
 
 pub fn modrm_analyze(ctx: &mut CpuContext, modrm_byte: u8) { ::modrm::skip(ctx, modrm_byte); }
+
+/// How an instruction affects the lazy flags (last_op1, last_result, last_op_size and
+/// flags_changed), see jit_flags
+#[derive(Copy, Clone, PartialEq, Eq)]
+pub enum FlagsEffect {
+    /// Writes all lazy flags without reading them or faulting
+    Overwrite(FlagsProducer),
+    /// Neither reads nor writes the lazy flags and can't fault. Includes jumps, the condition of
+    /// a conditional jump is read at the end of its basic block
+    Unused,
+    Other,
+}
+
+/// The kind of jit::Instruction that an instruction with FlagsEffect::Overwrite leaves in
+/// ctx.last_instruction, which decides the conditions that a following jump can compute without
+/// the lazy flags in memory
+#[derive(Copy, Clone, PartialEq, Eq)]
+pub enum FlagsProducer {
+    Arithmetic,
+    Sub,
+    Cmp,
+}
+
+/// Conservative classification of the instruction at cpu.eip. Only register forms of the 32-bit
+/// arithmetic instructions are recognised, for which the jit doesn't call any helpers that read
+/// the flags
+pub fn flags_effect(cpu: &CpuContext) -> FlagsEffect {
+    if cpu.prefixes != 0 || !cpu.osize_32() {
+        return FlagsEffect::Other;
+    }
+    let opcode = memory::read8(cpu.eip) as u8;
+    let modrm_byte = || memory::read8(cpu.eip + 1) as u8;
+    let producer = |opcode: u8| match opcode >> 3 {
+        5 => FlagsProducer::Sub,
+        7 => FlagsProducer::Cmp,
+        _ => FlagsProducer::Arithmetic,
+    };
+    match opcode {
+        0x01 | 0x03 | 0x09 | 0x0B | 0x21 | 0x23 | 0x29 | 0x2B | 0x31 | 0x33 | 0x39 | 0x3B
+        | 0x85
+            if modrm_byte() >> 6 == 3 =>
+        {
+            FlagsEffect::Overwrite(producer(opcode))
+        },
+        0x05 | 0x0D | 0x25 | 0x2D | 0x35 | 0x3D | 0xA9 => FlagsEffect::Overwrite(producer(opcode)),
+        // adc and sbb (/2 and /3) read CF
+        0x81 | 0x83 if modrm_byte() >> 6 == 3 && (modrm_byte() >> 3 & 7) & !1 != 2 => {
+            FlagsEffect::Overwrite(producer(modrm_byte() & 0x38))
+        },
+        0x89 | 0x8B if modrm_byte() >> 6 == 3 => FlagsEffect::Unused,
+        0x8D if modrm_byte() >> 6 != 3 => FlagsEffect::Unused,
+        0x90 | 0xB8..=0xBF => FlagsEffect::Unused,
+        0x70..=0x7F | 0xE9 | 0xEB => FlagsEffect::Unused,
+        // jcc rel32
+        0x0F if modrm_byte() & 0xF0 == 0x80 => FlagsEffect::Unused,
+        _ => FlagsEffect::Other,
+    }
+}
+
+/// Operand of an x87 instruction handled by jit_fpu: A memory operand of the given type or st(i)
+#[derive(Copy, Clone, PartialEq, Eq)]
+pub enum FpuOperand {
+    M32,
+    M64,
+    I16,
+    I32,
+    I64,
+    Reg(u32),
+}
+
+#[derive(Copy, Clone, PartialEq, Eq)]
+pub enum FpuArith {
+    Add,
+    Mul,
+    Sub,
+    SubR,
+    Div,
+    DivR,
+}
+
+#[derive(Copy, Clone, PartialEq, Eq)]
+pub enum FpuOp {
+    /// fld, fild: Push the operand
+    Load(FpuOperand),
+    /// fst, fist and with pop set fstp, fistp: Store st0 into the operand
+    Store(FpuOperand, bool),
+    Xchg(u32),
+    LoadOne,
+    LoadZero,
+    Chs,
+    Abs,
+    /// st(target) = st0 op operand, followed by a pop for faddp etc.
+    Arith {
+        op: FpuArith,
+        operand: FpuOperand,
+        target: u32,
+        pop: bool,
+    },
+}
+
+/// Classification of the x87 instruction at cpu.eip for jit_fpu. Only the data movement and
+/// arithmetic instructions that do nothing but read and write stack registers and memory are
+/// recognised, everything else (comparisons, control instructions, transcendentals) is None
+pub fn fpu_op(cpu: &CpuContext) -> Option<FpuOp> {
+    if cpu.prefixes != 0 {
+        return None;
+    }
+    let opcode = memory::read8(cpu.eip) as u8;
+    if opcode < 0xD8 || opcode > 0xDF {
+        return None;
+    }
+    let modrm_byte = memory::read8(cpu.eip + 1) as u8;
+    let reg = modrm_byte >> 3 & 7;
+    let rm = (modrm_byte & 7) as u32;
+    let is_mem = modrm_byte < 0xC0;
+    let arith = match reg {
+        0 => Some(FpuArith::Add),
+        1 => Some(FpuArith::Mul),
+        4 => Some(FpuArith::Sub),
+        5 => Some(FpuArith::SubR),
+        6 => Some(FpuArith::Div),
+        7 => Some(FpuArith::DivR),
+        _ => None,
+    };
+    let arith = |operand, target, pop| {
+        arith.map(|op| FpuOp::Arith {
+            op,
+            operand,
+            target,
+            pop,
+        })
+    };
+    match (opcode, is_mem, reg) {
+        (0xD8, true, _) => arith(FpuOperand::M32, 0, false),
+        (0xD8, false, _) => arith(FpuOperand::Reg(rm), 0, false),
+        (0xDC, true, _) => arith(FpuOperand::M64, 0, false),
+        (0xDC, false, _) => arith(FpuOperand::Reg(rm), rm, false),
+        (0xDE, true, _) => arith(FpuOperand::I16, 0, false),
+        (0xDE, false, _) => arith(FpuOperand::Reg(rm), rm, true),
+
+        (0xD9, true, 0) => Some(FpuOp::Load(FpuOperand::M32)),
+        (0xD9, true, 2) => Some(FpuOp::Store(FpuOperand::M32, false)),
+        (0xD9, true, 3) => Some(FpuOp::Store(FpuOperand::M32, true)),
+        (0xD9, false, 0) => Some(FpuOp::Load(FpuOperand::Reg(rm))),
+        (0xD9, false, 1) => Some(FpuOp::Xchg(rm)),
+        (0xD9, false, 4) if rm == 0 => Some(FpuOp::Chs),
+        (0xD9, false, 4) if rm == 1 => Some(FpuOp::Abs),
+        (0xD9, false, 5) if rm == 0 => Some(FpuOp::LoadOne),
+        (0xD9, false, 5) if rm == 6 => Some(FpuOp::LoadZero),
+
+        (0xDB, true, 0) => Some(FpuOp::Load(FpuOperand::I32)),
+        (0xDB, true, 2) => Some(FpuOp::Store(FpuOperand::I32, false)),
+        (0xDB, true, 3) => Some(FpuOp::Store(FpuOperand::I32, true)),
+
+        (0xDD, true, 0) => Some(FpuOp::Load(FpuOperand::M64)),
+        (0xDD, true, 2) => Some(FpuOp::Store(FpuOperand::M64, false)),
+        (0xDD, true, 3) => Some(FpuOp::Store(FpuOperand::M64, true)),
+        (0xDD, false, 2) => Some(FpuOp::Store(FpuOperand::Reg(rm), false)),
+        (0xDD, false, 3) => Some(FpuOp::Store(FpuOperand::Reg(rm), true)),
+
+        (0xDF, true, 0) => Some(FpuOp::Load(FpuOperand::I16)),
+        (0xDF, true, 2) => Some(FpuOp::Store(FpuOperand::I16, false)),
+        (0xDF, true, 3) => Some(FpuOp::Store(FpuOperand::I16, true)),
+        (0xDF, true, 5) => Some(FpuOp::Load(FpuOperand::I64)),
+        (0xDF, true, 7) => Some(FpuOp::Store(FpuOperand::I64, true)),
+
+        _ => None,
+    }
+}
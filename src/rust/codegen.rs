@@ -1,15 +1,20 @@
 use cpu::cpu::{
     tlb_data, FLAG_CARRY, FLAG_OVERFLOW, FLAG_SIGN, FLAG_ZERO, OPSIZE_8, OPSIZE_16, OPSIZE_32,
-    TLB_GLOBAL, TLB_HAS_CODE, TLB_NO_USER, TLB_READONLY, TLB_VALID,
+    TLB_GLOBAL, TLB_HAS_CODE, TLB_NO_EXECUTE, TLB_NO_USER, TLB_READONLY, TLB_SLOTS, TLB_VALID,
+    WASM_TABLE_OFFSET,
 };
 use cpu::global_pointers;
 use cpu::memory;
-use jit::{Instruction, InstructionOperand, JitContext};
+use jit::{Instruction, InstructionOperand, JitContext, WasmTableIndex, MAX_CHAIN_DEPTH};
+use jit_cache;
+use jit_cache::{DispatchTable, ExitLinks};
+use jit_flags;
+use jit_flags::FlagLocals;
 use modrm;
 use modrm::ModrmByte;
 use profiler;
 use regs;
-use wasmgen::wasm_builder::{WasmBuilder, WasmLocal, WasmLocalI64};
+use wasmgen::wasm_builder::{Label, WasmBuilder, WasmLocal, WasmLocalI64};
 
 pub fn gen_add_cs_offset(ctx: &mut JitContext) {
     ctx.builder
@@ -113,6 +118,232 @@ pub fn gen_page_switch_check(
     }
 }
 
+pub fn gen_indirect_jump_dispatch(
+    ctx: &mut JitContext,
+    table: &DispatchTable,
+    function_entries: Option<(u16, u16)>,
+    found_label: Label,
+    target_block: &WasmLocal,
+) -> WasmLocal {
+    // After an indirect jump (ret, jmp r/m, call r/m), look up the physical eip in the dispatch
+    // table of this module. If it's found, set target_block to the entry's initial state and
+    // branch to found_label, otherwise fall through, leaving the physical eip in the returned
+    // local (to be freed by the caller)
+    // Same probe sequence as DispatchTable::get
+    // In modules with several functions, function_entries is the range (first, count) of
+    // initial states of the entries in the current function. Other entries count as not found
+
+    gen_profiler_stat_increment(ctx.builder, profiler::stat::INDIRECT_JUMP);
+
+    gen_get_eip(ctx.builder);
+    let address_local = ctx.builder.set_new_local();
+    gen_get_phys_eip(ctx, &address_local);
+    ctx.builder.free_local(address_local);
+    let phys_eip = ctx.builder.tee_new_local();
+
+    ctx.builder.const_i32(jit_cache::HASH_MULTIPLIER as i32);
+    ctx.builder.mul_i32();
+    ctx.builder.const_i32(table.shift() as i32);
+    ctx.builder.shr_u_i32();
+    ctx.builder.const_i32(3);
+    ctx.builder.shl_i32();
+    let slot_offset = ctx.builder.set_new_local();
+
+    let not_found = ctx.builder.block_void();
+    let probe = ctx.builder.loop_void();
+
+    ctx.builder.get_local(&slot_offset);
+    ctx.builder.load_aligned_i32(table.address());
+    let key = ctx.builder.tee_new_local();
+    ctx.builder.const_i32(jit_cache::EMPTY as i32);
+    ctx.builder.eq_i32();
+    ctx.builder.br_if(not_found);
+
+    ctx.builder.get_local(&key);
+    ctx.builder.get_local(&phys_eip);
+    ctx.builder.eq_i32();
+    ctx.builder.if_void();
+    ctx.builder.get_local(&slot_offset);
+    ctx.builder.load_aligned_i32(table.address() + 4);
+    match function_entries {
+        None => {
+            ctx.builder.set_local(target_block);
+            ctx.builder.br(found_label);
+        },
+        Some((first, count)) => {
+            ctx.builder.const_i32(first as i32);
+            ctx.builder.sub_i32();
+            ctx.builder.set_local(target_block);
+            ctx.builder.get_local(target_block);
+            ctx.builder.const_i32(count as i32);
+            ctx.builder.ltu_i32();
+            ctx.builder.br_if(found_label);
+            ctx.builder.br(not_found);
+        },
+    }
+    ctx.builder.block_end();
+
+    ctx.builder.get_local(&slot_offset);
+    ctx.builder.const_i32(8);
+    ctx.builder.add_i32();
+    ctx.builder.const_i32((table.mask() << 3) as i32);
+    ctx.builder.and_i32();
+    ctx.builder.set_local(&slot_offset);
+    ctx.builder.br(probe);
+
+    ctx.builder.block_end();
+    ctx.builder.block_end();
+
+    ctx.builder.free_local(key);
+    ctx.builder.free_local(slot_offset);
+
+    gen_profiler_stat_increment(ctx.builder, profiler::stat::INDIRECT_JUMP_NO_ENTRY);
+
+    phys_eip
+}
+
+pub fn gen_chained_exit(
+    ctx: &mut JitContext,
+    exit_links: &mut ExitLinks,
+    wasm_table_index: WasmTableIndex,
+    phys_eip: Option<&WasmLocal>,
+) {
+    // At an exit of this module, with eip already updated: If the exit site is linked to the
+    // physical eip (see ExitLinks), call the linked module directly and return when it's done.
+    // Otherwise record the exit site, so that the main loop can link it, and fall through to the
+    // exit. Without phys_eip, only the fast path of the tlb is checked
+    // The call depth is limited by jit_chain_depth, as the linked modules may chain again
+
+    let (site, link_address) = match exit_links.allocate() {
+        Some(s) => s,
+        None => {
+            dbg_assert!(false);
+            return;
+        },
+    };
+    let exit_site = (wasm_table_index.to_u16() as u32) << 16 | site as u32;
+
+    let no_chain = ctx.builder.block_void();
+
+    let owns_phys_eip = phys_eip.is_none();
+    let phys_eip = match phys_eip {
+        Some(phys_eip) => phys_eip.unsafe_clone(),
+        None => {
+            gen_get_eip(ctx.builder);
+            let eip = ctx.builder.set_new_local();
+            gen_get_tlb_entry(ctx.builder, &eip);
+            let entry = ctx.builder.tee_new_local();
+            ctx.builder.const_i32(gen_get_phys_eip_tlb_mask(ctx));
+            ctx.builder.and_i32();
+            ctx.builder.const_i32(TLB_VALID as i32);
+            ctx.builder.ne_i32();
+            ctx.builder.br_if(no_chain);
+
+            ctx.builder.get_local(&entry);
+            ctx.builder.const_i32(!0xFFF);
+            ctx.builder.and_i32();
+            ctx.builder.get_local(&eip);
+            ctx.builder.xor_i32();
+            ctx.builder.free_local(entry);
+            ctx.builder.free_local(eip);
+            ctx.builder.set_new_local()
+        },
+    };
+
+    // The address of the slot is in the offset of the loads, so the expect tests normalise it
+    ctx.builder.get_local(&phys_eip);
+    ctx.builder.const_i32(0);
+    ctx.builder.load_aligned_i32(link_address);
+    ctx.builder.ne_i32();
+    ctx.builder.br_if(no_chain);
+    if owns_phys_eip {
+        ctx.builder.free_local(phys_eip);
+    }
+
+    ctx.builder
+        .load_fixed_i32(global_pointers::jit_chain_depth as u32);
+    let depth = ctx.builder.tee_new_local();
+    ctx.builder.const_i32(MAX_CHAIN_DEPTH as i32);
+    ctx.builder.geu_i32();
+    ctx.builder.br_if(no_chain);
+
+    gen_profiler_stat_increment(ctx.builder, profiler::stat::CHAINED_EXIT);
+
+    ctx.builder.const_i32(global_pointers::previous_ip as i32);
+    gen_get_eip(ctx.builder);
+    ctx.builder.store_aligned_i32(0);
+
+    gen_move_registers_from_locals_to_memory(ctx);
+    gen_update_instruction_counter(ctx);
+    ctx.builder
+        .load_fixed_i32(global_pointers::instruction_counter as u32);
+    let instruction_counter = ctx.builder.set_new_local();
+
+    ctx.builder
+        .const_i32(global_pointers::jit_chain_depth as i32);
+    ctx.builder.get_local(&depth);
+    ctx.builder.const_i32(1);
+    ctx.builder.add_i32();
+    ctx.builder.store_aligned_i32(0);
+
+    ctx.builder.const_i32(0);
+    ctx.builder.load_aligned_i32(link_address + 4);
+    let target = ctx.builder.tee_new_local();
+    ctx.builder.const_i32(16);
+    ctx.builder.shr_u_i32();
+    ctx.builder.get_local(&target);
+    ctx.builder.const_i32(0xFFFF);
+    ctx.builder.and_i32();
+    ctx.builder.const_i32(WASM_TABLE_OFFSET as i32);
+    ctx.builder.add_i32();
+    ctx.builder.call_indirect_fn1();
+    ctx.builder.free_local(target);
+
+    ctx.builder
+        .const_i32(global_pointers::jit_chain_depth as i32);
+    ctx.builder.get_local(&depth);
+    ctx.builder.store_aligned_i32(0);
+
+    // Called from the main loop: Tell it how many of the instructions were run by the linked
+    // modules, so that they aren't counted towards the hotness of this module
+    ctx.builder.get_local(&depth);
+    ctx.builder.eqz_i32();
+    ctx.builder.if_void();
+    ctx.builder
+        .const_i32(global_pointers::jit_chained_instructions as i32);
+    ctx.builder
+        .load_fixed_i32(global_pointers::jit_chained_instructions as u32);
+    ctx.builder
+        .load_fixed_i32(global_pointers::instruction_counter as u32);
+    ctx.builder.get_local(&instruction_counter);
+    ctx.builder.sub_i32();
+    ctx.builder.add_i32();
+    ctx.builder.store_aligned_i32(0);
+    ctx.builder.block_end();
+    ctx.builder.free_local(instruction_counter);
+    ctx.builder.free_local(depth);
+
+    ctx.builder.return_();
+
+    ctx.builder.block_end();
+
+    ctx.builder.const_i32(global_pointers::jit_exit_site as i32);
+    ctx.builder.const_i32(exit_site as i32);
+    ctx.builder.store_aligned_i32(0);
+}
+
+pub fn gen_call_function(ctx: &mut JitContext, function: u16, initial_state: i32) {
+    // Continue at a block in a later function of this module: The callee loads the registers
+    // from memory and counts its own instructions, so return right after it's done
+
+    gen_profiler_stat_increment(ctx.builder, profiler::stat::CALL_OTHER_FUNCTION);
+    gen_move_registers_from_locals_to_memory(ctx);
+    gen_update_instruction_counter(ctx);
+    ctx.builder.const_i32(initial_state);
+    ctx.builder.call_function(function);
+    ctx.builder.return_();
+}
+
 pub fn gen_update_instruction_counter(ctx: &mut JitContext) {
     ctx.builder
         .const_i32(global_pointers::instruction_counter as i32);
@@ -541,6 +772,39 @@ pub fn gen_safe_write128(
     )
 }
 
+/// Push the tlb entry of the page of the given address, or 0 if the page isn't in the tlb (see
+/// cpu::tlb_get)
+fn gen_get_tlb_entry(builder: &mut WasmBuilder, address_local: &WasmLocal) {
+    builder.get_local(address_local);
+    builder.const_i32(12);
+    builder.shr_u_i32();
+
+    if cfg!(feature = "small_tlb") {
+        //   slot <- (page & (TLB_SLOTS - 1)) << 3
+        //   tlb_data[slot + 1] if tlb_data[slot] == page else 0
+        let page = builder.tee_new_local();
+        builder.const_i32(TLB_SLOTS as i32 - 1);
+        builder.and_i32();
+        builder.const_i32(3);
+        builder.shl_i32();
+        let slot = builder.tee_new_local();
+        builder.load_aligned_i32(unsafe { &tlb_data[1] as *const i32 as u32 });
+        builder.const_i32(0);
+        builder.get_local(&slot);
+        builder.load_aligned_i32(unsafe { &tlb_data[0] as *const i32 as u32 });
+        builder.get_local(&page);
+        builder.eq_i32();
+        builder.select();
+        builder.free_local(slot);
+        builder.free_local(page);
+    }
+    else {
+        builder.const_i32(2);
+        builder.shl_i32();
+        builder.load_aligned_i32(unsafe { &tlb_data[0] as *const i32 as u32 });
+    }
+}
+
 fn gen_safe_read(
     ctx: &mut JitContext,
     bits: BitSize,
@@ -550,31 +814,17 @@ fn gen_safe_read(
     // Execute a virtual memory read. All slow paths (memory-mapped IO, tlb miss, page fault and
     // read across page boundary are handled in safe_read_jit_slow
 
-    //   entry <- tlb_data[addr >> 12 << 2]
+    //   entry <- tlb_get(addr >> 12)
     //   if entry & MASK == TLB_VALID && (addr & 0xFFF) <= 0x1000 - bytes: goto fast
     //   entry <- safe_read_jit_slow(addr, instruction_pointer)
     //   if page_fault: goto exit-with-pagefault
     //   fast: mem[(entry & ~0xFFF) ^ addr]
 
     let cont = ctx.builder.block_void();
-    ctx.builder.get_local(&address_local);
-
-    ctx.builder.const_i32(12);
-    ctx.builder.shr_u_i32();
-    ctx.builder.const_i32(2);
-    ctx.builder.shl_i32();
-
-    ctx.builder
-        .load_aligned_i32(unsafe { &tlb_data[0] as *const i32 as u32 });
+    gen_get_tlb_entry(ctx.builder, address_local);
     let entry_local = ctx.builder.tee_new_local();
 
-    ctx.builder.const_i32(
-        (0xFFF
-            & !TLB_READONLY
-            & !TLB_GLOBAL
-            & !TLB_HAS_CODE
-            & !(if ctx.cpu.cpl3() { 0 } else { TLB_NO_USER })) as i32,
-    );
+    ctx.builder.const_i32(gen_safe_read_tlb_mask(ctx));
     ctx.builder.and_i32();
 
     ctx.builder.const_i32(TLB_VALID as i32);
@@ -683,6 +933,24 @@ fn gen_safe_read(
     ctx.builder.free_local(entry_local);
 }
 
+fn gen_get_phys_eip_tlb_mask(ctx: &JitContext) -> i32 {
+    // Bits of the tlb entry that must be exactly TLB_VALID for a fast lookup of the physical eip
+    // (including TLB_NO_EXECUTE, which faults in get_phys_eip_slow_jit)
+    (0xFFF
+        & !TLB_READONLY
+        & !TLB_GLOBAL
+        & !TLB_HAS_CODE
+        & !(if ctx.cpu.cpl3() { 0 } else { TLB_NO_USER })) as i32
+}
+
+fn gen_safe_read_tlb_mask(ctx: &JitContext) -> i32 {
+    gen_get_phys_eip_tlb_mask(ctx) & !TLB_NO_EXECUTE
+}
+
+fn gen_safe_write_tlb_mask(ctx: &JitContext) -> i32 {
+    (0xFFF & !TLB_GLOBAL & !TLB_NO_EXECUTE & !(if ctx.cpu.cpl3() { 0 } else { TLB_NO_USER })) as i32
+}
+
 pub fn gen_get_phys_eip(ctx: &mut JitContext, address_local: &WasmLocal) {
     // Similar to gen_safe_read, but return the physical eip rather than reading from memory
     // Does not (need to) handle mapped memory
@@ -690,24 +958,10 @@ pub fn gen_get_phys_eip(ctx: &mut JitContext, address_local: &WasmLocal) {
     //      already correct (pointing at the current instruction)
 
     let cont = ctx.builder.block_void();
-    ctx.builder.get_local(&address_local);
-
-    ctx.builder.const_i32(12);
-    ctx.builder.shr_u_i32();
-    ctx.builder.const_i32(2);
-    ctx.builder.shl_i32();
-
-    ctx.builder
-        .load_aligned_i32(unsafe { &tlb_data[0] as *const i32 as u32 });
+    gen_get_tlb_entry(ctx.builder, address_local);
     let entry_local = ctx.builder.tee_new_local();
 
-    ctx.builder.const_i32(
-        (0xFFF
-            & !TLB_READONLY
-            & !TLB_GLOBAL
-            & !TLB_HAS_CODE
-            & !(if ctx.cpu.cpl3() { 0 } else { TLB_NO_USER })) as i32,
-    );
+    ctx.builder.const_i32(gen_get_phys_eip_tlb_mask(ctx));
     ctx.builder.and_i32();
 
     ctx.builder.const_i32(TLB_VALID as i32);
@@ -761,26 +1015,17 @@ fn gen_safe_write(
     // Execute a virtual memory write. All slow paths (memory-mapped IO, tlb miss, page fault,
     // write across page boundary and page containing jitted code are handled in safe_write_jit_slow
 
-    //   entry <- tlb_data[addr >> 12 << 2]
+    //   entry <- tlb_get(addr >> 12)
     //   if entry & MASK == TLB_VALID && (addr & 0xFFF) <= 0x1000 - bytes: goto fast
     //   entry <- safe_write_jit_slow(addr, value, instruction_pointer)
     //   if page_fault: goto exit-with-pagefault
     //   fast: mem[(entry & ~0xFFF) ^ addr] <- value
 
     let cont = ctx.builder.block_void();
-    ctx.builder.get_local(&address_local);
-
-    ctx.builder.const_i32(12);
-    ctx.builder.shr_u_i32();
-    ctx.builder.const_i32(2);
-    ctx.builder.shl_i32();
-
-    ctx.builder
-        .load_aligned_i32(unsafe { &tlb_data[0] as *const i32 as u32 });
+    gen_get_tlb_entry(ctx.builder, address_local);
     let entry_local = ctx.builder.tee_new_local();
 
-    ctx.builder
-        .const_i32((0xFFF & !TLB_GLOBAL & !(if ctx.cpu.cpl3() { 0 } else { TLB_NO_USER })) as i32);
+    ctx.builder.const_i32(gen_safe_write_tlb_mask(ctx));
     ctx.builder.and_i32();
 
     ctx.builder.const_i32(TLB_VALID as i32);
@@ -908,7 +1153,7 @@ pub fn gen_safe_read_write(
     // write across page boundary and page containing jitted code are handled in
     // safe_read_write_jit_slow
 
-    //   entry <- tlb_data[addr >> 12 << 2]
+    //   entry <- tlb_get(addr >> 12)
     //   can_use_fast_path <- entry & MASK == TLB_VALID && (addr & 0xFFF) <= 0x1000 - bytes
     //   if can_use_fast_path: goto fast
     //   entry <- safe_read_write_jit_slow(addr, instruction_pointer)
@@ -918,19 +1163,10 @@ pub fn gen_safe_read_write(
     //   mem[(entry & ~0xFFF) ^ addr] <- value
 
     let cont = ctx.builder.block_void();
-    ctx.builder.get_local(address_local);
-
-    ctx.builder.const_i32(12);
-    ctx.builder.shr_u_i32();
-    ctx.builder.const_i32(2);
-    ctx.builder.shl_i32();
-
-    ctx.builder
-        .load_aligned_i32(unsafe { &tlb_data[0] as *const i32 as u32 });
+    gen_get_tlb_entry(ctx.builder, address_local);
     let entry_local = ctx.builder.tee_new_local();
 
-    ctx.builder
-        .const_i32((0xFFF & !TLB_GLOBAL & !(if ctx.cpu.cpl3() { 0 } else { TLB_NO_USER })) as i32);
+    ctx.builder.const_i32(gen_safe_write_tlb_mask(ctx));
     ctx.builder.and_i32();
 
     ctx.builder.const_i32(TLB_VALID as i32);
@@ -1531,13 +1767,27 @@ pub enum ConditionNegate {
     False,
 }
 
+/// last_result for the optimised conditions, which read it right after the instruction that set it
+fn gen_get_lazy_last_result(builder: &mut WasmBuilder, flag_locals: &Option<FlagLocals>) {
+    match flag_locals {
+        Some(flag_locals) if flag_locals.current => builder.get_local(&flag_locals.last_result),
+        _ => gen_get_last_result(builder),
+    }
+}
+fn gen_get_lazy_last_op1(builder: &mut WasmBuilder, flag_locals: &Option<FlagLocals>) {
+    match flag_locals {
+        Some(flag_locals) if flag_locals.current => builder.get_local(&flag_locals.last_op1),
+        _ => gen_get_last_op1(builder),
+    }
+}
+
 pub fn gen_getzf(ctx: &mut JitContext, negate: ConditionNegate) {
     match &ctx.last_instruction {
         Instruction::Cmp { .. } | Instruction::Sub { .. } => {
             gen_profiler_stat_increment(ctx.builder, profiler::stat::CONDITION_OPTIMISED);
             // TODO: Could use local for cmp x, 0; sub x, y
             // TODO: Could use eq(local, local) for cmp x, y
-            gen_get_last_result(ctx.builder);
+            gen_get_lazy_last_result(ctx.builder, &ctx.flag_locals);
             if negate == ConditionNegate::False {
                 ctx.builder.eqz_i32();
             }
@@ -1547,7 +1797,7 @@ pub fn gen_getzf(ctx: &mut JitContext, negate: ConditionNegate) {
             // Note: Necessary because test{8,16} don't mask their neither last_result nor any of their operands
             // TODO: Use local instead of last_result for inc/dec/sub/add/and/or/xor
             if opsize == OPSIZE_32 {
-                gen_get_last_result(ctx.builder);
+                gen_get_lazy_last_result(ctx.builder, &ctx.flag_locals);
             }
             else if opsize == OPSIZE_16 {
                 ctx.builder
@@ -1605,8 +1855,8 @@ pub fn gen_getcf(ctx: &mut JitContext, negate: ConditionNegate) {
             // TODO: add/sub
             gen_profiler_stat_increment(ctx.builder, profiler::stat::CONDITION_OPTIMISED);
             if source == &InstructionOperand::Other || *opsize != OPSIZE_32 {
-                gen_get_last_op1(ctx.builder);
-                gen_get_last_result(ctx.builder);
+                gen_get_lazy_last_op1(ctx.builder, &ctx.flag_locals);
+                gen_get_lazy_last_result(ctx.builder, &ctx.flag_locals);
             }
             else {
                 match dest {
@@ -1614,7 +1864,7 @@ pub fn gen_getcf(ctx: &mut JitContext, negate: ConditionNegate) {
                         ctx.builder.get_local(l);
                     },
                     InstructionOperand::Other => {
-                        gen_get_last_op1(ctx.builder);
+                        gen_get_lazy_last_op1(ctx.builder, &ctx.flag_locals);
                     },
                     &InstructionOperand::Immediate(_) => panic!(),
                 }
@@ -1688,7 +1938,7 @@ pub fn gen_getsf(ctx: &mut JitContext) {
             // TODO:
             // Could use local for cmp x, 0; sub; test x, x
             // Could only load 8-bit
-            gen_get_last_result(ctx.builder);
+            gen_get_lazy_last_result(ctx.builder, &ctx.flag_locals);
             ctx.builder.const_i32(if opsize == OPSIZE_32 {
                 0x8000_0000u32 as i32
             }
@@ -1788,7 +2038,7 @@ pub fn gen_test_be(ctx: &mut JitContext, negate: ConditionNegate) {
                 },
                 &InstructionOperand::Immediate(_) => panic!(),
                 InstructionOperand::Other => {
-                    gen_get_last_op1(ctx.builder);
+                    gen_get_lazy_last_op1(ctx.builder, &ctx.flag_locals);
                 },
             }
             match source {
@@ -1801,8 +2051,8 @@ pub fn gen_test_be(ctx: &mut JitContext, negate: ConditionNegate) {
                     }
                 },
                 InstructionOperand::Other => {
-                    gen_get_last_op1(ctx.builder);
-                    gen_get_last_result(ctx.builder);
+                    gen_get_lazy_last_op1(ctx.builder, &ctx.flag_locals);
+                    gen_get_lazy_last_result(ctx.builder, &ctx.flag_locals);
                     ctx.builder.sub_i32();
                     if *opsize == OPSIZE_8 || *opsize == OPSIZE_16 {
                         ctx.builder
@@ -1825,10 +2075,10 @@ pub fn gen_test_be(ctx: &mut JitContext, negate: ConditionNegate) {
         Instruction::Sub { opsize } => {
             gen_profiler_stat_increment(ctx.builder, profiler::stat::CONDITION_OPTIMISED);
 
-            gen_get_last_op1(ctx.builder);
+            gen_get_lazy_last_op1(ctx.builder, &ctx.flag_locals);
             // Note: Can only use register if it's different from dest (being lazy here and just using op1 and result)
-            gen_get_last_op1(ctx.builder);
-            gen_get_last_result(ctx.builder);
+            gen_get_lazy_last_op1(ctx.builder, &ctx.flag_locals);
+            gen_get_lazy_last_result(ctx.builder, &ctx.flag_locals);
             ctx.builder.sub_i32();
             if *opsize == OPSIZE_8 || *opsize == OPSIZE_16 {
                 ctx.builder
@@ -1873,7 +2123,7 @@ pub fn gen_test_l(ctx: &mut JitContext, negate: ConditionNegate) {
                     }
                 },
                 InstructionOperand::Other => {
-                    gen_get_last_op1(ctx.builder);
+                    gen_get_lazy_last_op1(ctx.builder, &ctx.flag_locals);
                     if *opsize == OPSIZE_8 || *opsize == OPSIZE_16 {
                         ctx.builder
                             .const_i32(if *opsize == OPSIZE_8 { 24 } else { 16 });
@@ -1892,8 +2142,8 @@ pub fn gen_test_l(ctx: &mut JitContext, negate: ConditionNegate) {
                     }
                 },
                 InstructionOperand::Other => {
-                    gen_get_last_op1(ctx.builder);
-                    gen_get_last_result(ctx.builder);
+                    gen_get_lazy_last_op1(ctx.builder, &ctx.flag_locals);
+                    gen_get_lazy_last_result(ctx.builder, &ctx.flag_locals);
                     ctx.builder.sub_i32();
                     if *opsize == OPSIZE_8 || *opsize == OPSIZE_16 {
                         ctx.builder
@@ -1949,7 +2199,7 @@ pub fn gen_test_le(ctx: &mut JitContext, negate: ConditionNegate) {
                     }
                 },
                 InstructionOperand::Other => {
-                    gen_get_last_op1(ctx.builder);
+                    gen_get_lazy_last_op1(ctx.builder, &ctx.flag_locals);
                     if *opsize == OPSIZE_8 || *opsize == OPSIZE_16 {
                         ctx.builder
                             .const_i32(if *opsize == OPSIZE_8 { 24 } else { 16 });
@@ -1968,8 +2218,8 @@ pub fn gen_test_le(ctx: &mut JitContext, negate: ConditionNegate) {
                     }
                 },
                 InstructionOperand::Other => {
-                    gen_get_last_op1(ctx.builder);
-                    gen_get_last_result(ctx.builder);
+                    gen_get_lazy_last_op1(ctx.builder, &ctx.flag_locals);
+                    gen_get_lazy_last_result(ctx.builder, &ctx.flag_locals);
                     ctx.builder.sub_i32();
                     if *opsize == OPSIZE_8 || *opsize == OPSIZE_16 {
                         ctx.builder
@@ -2135,6 +2385,12 @@ pub fn gen_trigger_gp(ctx: &mut JitContext, error_code: u32) {
 }
 
 pub fn gen_condition_fn(ctx: &mut JitContext, condition: u8) {
+    if jit_flags::in_locals(ctx)
+        && !jit_flags::condition_from_locals(&ctx.last_instruction, condition)
+    {
+        jit_flags::gen_store_flags(ctx);
+        ctx.flag_locals.as_mut().unwrap().current = false;
+    }
     if condition & 0xF0 == 0x00 || condition & 0xF0 == 0x70 || condition & 0xF0 == 0x80 {
         match condition & 0xF {
             0x0 => {
@@ -1,4 +1,18 @@
 pub const LOG_PAGE_FAULTS: bool = false;
 pub const FORCE_DISABLE_JIT: bool = false;
 
+// Generate wasm simd instructions for sse instructions, if this module uses simd itself, so that
+// generated code runs wherever it does (v86-fallback.wasm is built without simd)
+pub const JIT_USE_SIMD: bool = cfg!(target_feature = "simd128");
+
+// Keep the x87 stack in locals across runs of consecutive x87 instructions, see jit_fpu.rs
+pub const JIT_FPU_STACK_IN_LOCALS: bool = true;
+
+// Copy rep movsd with at most this many elements in generated code instead of calling movsd_rep,
+// for the small copies done by the memcpy of kernels
+pub const JIT_REP_MOVSD_INLINE_MAX: i32 = 16;
+
+// Run interpreted code of warm pages from pre-decoded blocks, see interpreter_cache.rs
+pub const INTERPRETER_DECODED_BLOCKS: bool = true;
+
 pub const VMWARE_HYPERVISOR_PORT: bool = true;
@@ -1,7 +1,8 @@
 use std::collections::{HashMap, HashSet};
 use std::iter;
 
-use jit::{BasicBlock, BasicBlockType, MAX_EXTRA_BASIC_BLOCKS};
+use jit::{BasicBlock, BasicBlockType};
+use page::Page;
 use profiler;
 
 const ENTRY_NODE_ID: u32 = 0xffff_ffff;
@@ -123,6 +124,29 @@ impl WasmStructure {
         result
     }
 
+    pub fn basic_blocks(&self, result: &mut Vec<u32>) {
+        match self {
+            Self::BasicBlock(addr) => result.push(*addr),
+            Self::Dispatcher(_) => {},
+            Self::Loop(children) | Self::Block(children) => {
+                for c in children.iter() {
+                    c.basic_blocks(result);
+                }
+            },
+        }
+    }
+
+    /// Number of basic blocks, counting those duplicated by loopify once per copy
+    pub fn basic_block_count(&self) -> usize {
+        match self {
+            Self::BasicBlock(_) => 1,
+            Self::Dispatcher(_) => 0,
+            Self::Loop(children) | Self::Block(children) => {
+                children.iter().map(|c| c.basic_block_count()).sum()
+            },
+        }
+    }
+
     pub fn head(&self) -> Box<dyn iter::Iterator<Item = u32> + '_> {
         match self {
             Self::BasicBlock(addr) => Box::new(iter::once(*addr)),
@@ -229,7 +253,10 @@ fn scc(edges: &Graph, rev_edges: &Graph) -> Vec<Vec<u32>> {
     assignment
 }
 
-pub fn loopify(nodes: &Graph) -> Vec<WasmStructure> {
+/// Turn the graph into loops and basic blocks in topological order, preceded by a dispatcher for
+/// the entries. Loops with several entries are duplicated once per entry, as long as this adds at
+/// most max_extra_basic_blocks basic blocks
+pub fn loopify(nodes: &Graph, max_extra_basic_blocks: usize) -> Vec<WasmStructure> {
     let rev_nodes = rev_graph_edges(nodes);
     let groups = scc(nodes, &rev_nodes);
 
@@ -272,7 +299,7 @@ pub fn loopify(nodes: &Graph) -> Vec<WasmStructure> {
                 );
             }
 
-            if entries_to_group.len() * group.len() > MAX_EXTRA_BASIC_BLOCKS {
+            if entries_to_group.len() * group.len() > max_extra_basic_blocks {
                 let mut subgroup_edges: Graph = Graph::new();
                 for elem in group {
                     subgroup_edges.insert(
@@ -292,7 +319,7 @@ pub fn loopify(nodes: &Graph) -> Vec<WasmStructure> {
                     );
                 }
 
-                let mut loop_nodes = loopify(&subgroup_edges);
+                let mut loop_nodes = loopify(&subgroup_edges, max_extra_basic_blocks);
 
                 if entries_to_group.len() > 1 {
                     loop_nodes.insert(0, WasmStructure::Dispatcher(entries_to_group));
@@ -322,7 +349,7 @@ pub fn loopify(nodes: &Graph) -> Vec<WasmStructure> {
                                     .collect(),
                             );
                         }
-                        let loop_nodes = loopify(&subgroup_edges);
+                        let loop_nodes = loopify(&subgroup_edges, max_extra_basic_blocks);
                         WasmStructure::Loop(loop_nodes)
                     })
                     .collect();
@@ -333,6 +360,113 @@ pub fn loopify(nodes: &Graph) -> Vec<WasmStructure> {
         .collect();
 }
 
+pub struct ModuleFunction {
+    pub structure: Vec<WasmStructure>,
+    /// The dispatcher at the start of structure first lists the entries of the module that are
+    /// located in this function, then the targets of branches from previous functions
+    pub module_entry_count: usize,
+}
+
+/// The number of pages of the largest top-level element of the result of loopify, i.e. the
+/// smallest number of pages per function that split_functions can achieve
+pub fn max_pages_of_element(structure: &Vec<WasmStructure>) -> usize {
+    structure
+        .iter()
+        .map(|element| {
+            let mut blocks = Vec::new();
+            element.basic_blocks(&mut blocks);
+            blocks.iter().map(|&addr| Page::page_of(addr)).collect::<HashSet<Page>>().len()
+        })
+        .max()
+        .unwrap_or(0)
+}
+
+/// Split the result of loopify into several functions, each covering at most max_pages pages.
+/// Single elements must not be larger (see max_pages_of_element)
+///
+/// The top-level elements are in topological order, so branches between functions only go
+/// forwards and the functions can call each other without recursing. Each function starts with
+/// its own dispatcher.
+pub fn split_functions(
+    structure: Vec<WasmStructure>,
+    nodes: &Graph,
+    max_pages: usize,
+) -> Vec<ModuleFunction> {
+    let mut elements = structure.into_iter();
+    let module_entries = match elements.next() {
+        Some(WasmStructure::Dispatcher(entries)) => entries,
+        _ => {
+            dbg_assert!(false);
+            return Vec::new();
+        },
+    };
+
+    let mut groups: Vec<(Vec<WasmStructure>, Vec<u32>)> = Vec::new();
+    let mut group_pages = HashSet::new();
+    for element in elements {
+        let mut blocks = Vec::new();
+        element.basic_blocks(&mut blocks);
+        let pages: HashSet<Page> = blocks.iter().map(|&addr| Page::page_of(addr)).collect();
+        dbg_assert!(pages.len() <= max_pages);
+
+        if let Some((group, group_blocks)) = groups.last_mut() {
+            if group_pages.union(&pages).count() <= max_pages {
+                group.push(element);
+                group_blocks.extend(blocks);
+                group_pages.extend(pages);
+                continue;
+            }
+        }
+        groups.push((vec![element], blocks));
+        group_pages = pages;
+    }
+
+    let mut function_of_addr = HashMap::new();
+    for (i, (_, blocks)) in groups.iter().enumerate() {
+        for &addr in blocks {
+            function_of_addr.insert(addr, i);
+        }
+    }
+
+    let mut targets: Vec<Vec<u32>> = vec![Vec::new(); groups.len()];
+    for (i, (_, blocks)) in groups.iter().enumerate() {
+        for addr in blocks {
+            for target in nodes.get(addr).unwrap() {
+                if let Some(&j) = function_of_addr.get(target) {
+                    dbg_assert!(j >= i);
+                    if j != i && !targets[j].contains(target) {
+                        targets[j].push(*target);
+                    }
+                }
+            }
+        }
+    }
+
+    groups
+        .into_iter()
+        .zip(targets)
+        .enumerate()
+        .map(|(i, ((group, _), mut targets))| {
+            let mut entries: Vec<u32> = module_entries
+                .iter()
+                .filter(|addr| function_of_addr.get(addr) == Some(&i))
+                .copied()
+                .collect();
+            let module_entry_count = entries.len();
+            targets.retain(|addr| !entries.contains(addr));
+            targets.sort();
+            entries.extend(targets);
+
+            let mut structure = vec![WasmStructure::Dispatcher(entries)];
+            structure.extend(group);
+            ModuleFunction {
+                structure,
+                module_entry_count,
+            }
+        })
+        .collect()
+}
+
 pub fn blockify(blocks: &mut Vec<WasmStructure>, edges: &Graph) {
     let mut cached_branches: Vec<HashSet<u32>> = Vec::new();
     for i in 0..blocks.len() {
@@ -29,6 +29,7 @@ use cpu::misc_instr::{
     push16, push32,
 };
 use cpu::modrm::{resolve_modrm16, resolve_modrm32};
+use interpreter_cache;
 use jit;
 use jit::is_near_end_of_page;
 use page::Page;
@@ -208,6 +209,8 @@ pub const MSR_IA32_FEAT_CTL: i32 = 0x3a;
 pub const IA32_PAT: i32 = 0x277;
 pub const IA32_MCG_CAP: i32 = 377;
 pub const IA32_KERNEL_GS_BASE: i32 = 0xC0000101u32 as i32;
+pub const IA32_EFER: i32 = 0xC0000080u32 as i32;
+pub const IA32_EFER_NXE: i32 = 1 << 11;
 pub const MSR_PKG_C2_RESIDENCY: i32 = 1549;
 pub const IA32_APIC_BASE_BSP: i32 = 1 << 8;
 pub const IA32_APIC_BASE_EXTD: i32 = 1 << 10;
@@ -232,6 +235,7 @@ pub const MXCSR_FZ: i32 = 1 << 15;
 pub const MXCSR_DAZ: i32 = 1 << 6;
 pub const MXCSR_RC_SHIFT: i32 = 13;
 
+#[cfg(not(feature = "small_tlb"))]
 pub const VALID_TLB_ENTRY_MAX: i32 = 10000;
 pub const TLB_VALID: i32 = 1 << 0;
 pub const TLB_READONLY: i32 = 1 << 1;
@@ -239,6 +243,7 @@ pub const TLB_NO_USER: i32 = 1 << 2;
 pub const TLB_IN_MAPPED_RANGE: i32 = 1 << 3;
 pub const TLB_GLOBAL: i32 = 1 << 4;
 pub const TLB_HAS_CODE: i32 = 1 << 5;
+pub const TLB_NO_EXECUTE: i32 = 1 << 6;
 pub const IVT_SIZE: u32 = 0x400;
 pub const CPU_EXCEPTION_DE: i32 = 0;
 pub const CPU_EXCEPTION_DB: i32 = 1;
@@ -272,10 +277,138 @@ pub static mut rdtsc_imprecision_offset: u64 = 0;
 pub static mut rdtsc_last_value: u64 = 0;
 pub static mut tsc_offset: u64 = 0;
 
+// The tlb maps virtual pages to entries of the form `physical_page << 12 ^ virtual_page << 12 |
+// TLB_*`, with 0 for pages that aren't in the tlb. By default, it's a flat array indexed by
+// the virtual page (16 MiB), with a list of the valid entries for clearing it. With the
+// small_tlb feature, it's a direct-mapped array of (virtual page, entry) pairs indexed by the low
+// bits of the virtual page (32 KiB), which is cleared by walking all of it.
+#[cfg(not(feature = "small_tlb"))]
 pub static mut tlb_data: [i32; 0x400000] = [0; 0x400000];
-pub static mut valid_tlb_entries: [i32; 10000] = [0; 10000];
+#[cfg(not(feature = "small_tlb"))]
+pub static mut valid_tlb_entries: [i32; VALID_TLB_ENTRY_MAX as usize] =
+    [0; VALID_TLB_ENTRY_MAX as usize];
+#[cfg(not(feature = "small_tlb"))]
 pub static mut valid_tlb_entries_count: i32 = 0;
 
+pub const TLB_SLOTS: u32 = 0x1000;
+#[cfg(feature = "small_tlb")]
+pub static mut tlb_data: [i32; 2 * TLB_SLOTS as usize] = [0; 2 * TLB_SLOTS as usize];
+
+#[cfg(not(feature = "small_tlb"))]
+#[inline(always)]
+pub fn tlb_get(page: u32) -> i32 { unsafe { tlb_data[page as usize] } }
+
+#[cfg(feature = "small_tlb")]
+#[inline(always)]
+pub fn tlb_get(page: u32) -> i32 {
+    let slot = (page & (TLB_SLOTS - 1)) as usize;
+    unsafe {
+        if tlb_data[2 * slot] == page as i32 {
+            tlb_data[2 * slot + 1]
+        }
+        else {
+            0
+        }
+    }
+}
+
+#[cfg(not(feature = "small_tlb"))]
+pub fn tlb_invalidate(page: u32) { unsafe { tlb_data[page as usize] = 0 } }
+
+#[cfg(feature = "small_tlb")]
+pub fn tlb_invalidate(page: u32) {
+    let slot = (page & (TLB_SLOTS - 1)) as usize;
+    unsafe {
+        if tlb_data[2 * slot] == page as i32 {
+            tlb_data[2 * slot + 1] = 0
+        }
+    }
+}
+
+#[cfg(not(feature = "small_tlb"))]
+unsafe fn tlb_insert(page: u32, entry: i32) {
+    if entry != 0 && tlb_data[page as usize] == 0 {
+        if valid_tlb_entries_count == VALID_TLB_ENTRY_MAX {
+            profiler::stat_increment(TLB_FULL);
+            clear_tlb();
+            // also clear global entries if tlb is almost full after clearing non-global pages
+            if valid_tlb_entries_count > VALID_TLB_ENTRY_MAX * 3 / 4 {
+                profiler::stat_increment(TLB_GLOBAL_FULL);
+                full_clear_tlb();
+            }
+        }
+        dbg_assert!(valid_tlb_entries_count < VALID_TLB_ENTRY_MAX);
+        valid_tlb_entries[valid_tlb_entries_count as usize] = page as i32;
+        valid_tlb_entries_count += 1;
+    // TODO: Check that there are no duplicates in valid_tlb_entries
+    // XXX: There will probably be duplicates due to invlpg deleting
+    // entries from tlb_data but not from valid_tlb_entries
+    }
+    else if CHECK_TLB_INVARIANTS && entry != 0 {
+        let mut found: bool = false;
+        for i in 0..valid_tlb_entries_count {
+            if valid_tlb_entries[i as usize] == page as i32 {
+                found = true;
+                break;
+            }
+        }
+        dbg_assert!(found);
+    }
+    tlb_data[page as usize] = entry;
+}
+
+#[cfg(feature = "small_tlb")]
+unsafe fn tlb_insert(page: u32, entry: i32) {
+    let slot = (page & (TLB_SLOTS - 1)) as usize;
+    if tlb_data[2 * slot + 1] != 0 && tlb_data[2 * slot] != page as i32 {
+        // evicting another page
+        profiler::stat_increment(TLB_FULL);
+    }
+    tlb_data[2 * slot] = page as i32;
+    tlb_data[2 * slot + 1] = entry;
+}
+
+/// Replace each valid entry of the tlb by `f(virtual_page, entry)`
+#[cfg(not(feature = "small_tlb"))]
+unsafe fn tlb_update_entries<F: FnMut(u32, i32) -> i32>(mut f: F) {
+    let mut kept = 0;
+    for i in 0..valid_tlb_entries_count {
+        let page = valid_tlb_entries[i as usize];
+        let entry = tlb_data[page as usize];
+        if entry == 0 {
+            // removed by invlpg
+            continue;
+        }
+        let new_entry = f(page as u32, entry);
+        tlb_data[page as usize] = new_entry;
+        if new_entry != 0 {
+            valid_tlb_entries[kept as usize] = page;
+            kept += 1;
+        }
+    }
+    valid_tlb_entries_count = kept;
+}
+
+#[cfg(feature = "small_tlb")]
+unsafe fn tlb_update_entries<F: FnMut(u32, i32) -> i32>(mut f: F) {
+    for slot in 0..TLB_SLOTS as usize {
+        let entry = tlb_data[2 * slot + 1];
+        if entry != 0 {
+            tlb_data[2 * slot + 1] = f(tlb_data[2 * slot] as u32, entry);
+        }
+    }
+}
+
+/// All entries of the tlb, including stale ones that tlb_update_entries skips
+unsafe fn tlb_all_entries() -> Vec<i32> {
+    if cfg!(feature = "small_tlb") {
+        tlb_data.iter().skip(1).step_by(2).cloned().collect()
+    }
+    else {
+        tlb_data.to_vec()
+    }
+}
+
 pub static mut in_jit: bool = false;
 
 pub static mut jit_fault: Option<(i32, Option<i32>)> = None;
@@ -1703,9 +1836,8 @@ pub unsafe fn do_task_switch(selector: i32, error_code: Option<i32>) {
     *segment_limits.offset(TR as isize) = descriptor.effective_limit();
     *sreg.offset(TR as isize) = selector.raw;
 
-    *cr.offset(3) = new_cr3;
-    dbg_assert!((*cr.offset(3) & 0xFFF) == 0);
-    clear_tlb();
+    dbg_assert!((new_cr3 & 0xFFF) == 0);
+    set_cr3(new_cr3);
 
     *cr.offset(0) |= CR0_TS;
 
@@ -1743,7 +1875,7 @@ pub unsafe fn get_eflags() -> i32 {
 pub unsafe fn get_eflags_no_arith() -> i32 { return *flags; }
 
 pub fn translate_address_read_no_side_effects(address: i32) -> Option<u32> {
-    let entry = unsafe { tlb_data[(address as u32 >> 12) as usize] };
+    let entry = tlb_get(address as u32 >> 12);
     let user = unsafe { *cpl } == 3;
     if entry & (TLB_VALID | if user { TLB_NO_USER } else { 0 }) == TLB_VALID {
         Some((entry & !0xFFF ^ address) as u32)
@@ -1757,7 +1889,7 @@ pub fn translate_address_read_no_side_effects(address: i32) -> Option<u32> {
 }
 
 pub fn translate_address_read(address: i32) -> OrPageFault<u32> {
-    let entry = unsafe { tlb_data[(address as u32 >> 12) as usize] };
+    let entry = tlb_get(address as u32 >> 12);
     let user = unsafe { *cpl == 3 };
     if entry & (TLB_VALID | if user { TLB_NO_USER } else { 0 }) == TLB_VALID {
         Ok((entry & !0xFFF ^ address) as u32)
@@ -1767,8 +1899,23 @@ pub fn translate_address_read(address: i32) -> OrPageFault<u32> {
     }
 }
 
+/// Like translate_address_read, but returns None instead of triggering a page fault
+pub unsafe fn translate_address_read_no_fault(address: i32) -> Option<u32> {
+    let entry = tlb_get(address as u32 >> 12);
+    let user = *cpl == 3;
+    if entry & (TLB_VALID | if user { TLB_NO_USER } else { 0 }) == TLB_VALID {
+        Some((entry & !0xFFF ^ address) as u32)
+    }
+    else {
+        match do_page_walk(address, false, user, true) {
+            Ok(phys_addr_high) => Some((phys_addr_high | address & 0xFFF) as u32),
+            Err(_pagefault) => None,
+        }
+    }
+}
+
 pub unsafe fn translate_address_read_jit(address: i32) -> OrPageFault<u32> {
-    let entry = tlb_data[(address as u32 >> 12) as usize];
+    let entry = tlb_get(address as u32 >> 12);
     let user = *cpl == 3;
     if entry & (TLB_VALID | if user { TLB_NO_USER } else { 0 }) == TLB_VALID {
         Ok((entry & !0xFFF ^ address) as u32)
@@ -1784,11 +1931,64 @@ pub unsafe fn translate_address_read_jit(address: i32) -> OrPageFault<u32> {
     }
 }
 
+/// Like translate_address_read, but for instruction fetches, which also fault on no-execute pages
+pub fn translate_address_execute(address: i32) -> OrPageFault<u32> {
+    let entry = tlb_get(address as u32 >> 12);
+    let user = unsafe { *cpl == 3 };
+    if entry & (TLB_VALID | if user { TLB_NO_USER } else { 0 } | TLB_NO_EXECUTE) == TLB_VALID {
+        Ok((entry & !0xFFF ^ address) as u32)
+    }
+    else {
+        match unsafe { do_page_walk_execute(address, user) } {
+            Ok(phys_addr_high) => Ok((phys_addr_high | address & 0xFFF) as u32),
+            Err(pagefault) => {
+                unsafe { trigger_pagefault(pagefault) };
+                Err(())
+            },
+        }
+    }
+}
+
+pub unsafe fn translate_address_execute_jit(address: i32) -> OrPageFault<u32> {
+    let entry = tlb_get(address as u32 >> 12);
+    let user = *cpl == 3;
+    if entry & (TLB_VALID | if user { TLB_NO_USER } else { 0 } | TLB_NO_EXECUTE) == TLB_VALID {
+        Ok((entry & !0xFFF ^ address) as u32)
+    }
+    else {
+        match do_page_walk_execute(address, user) {
+            Ok(phys_addr_high) => Ok((phys_addr_high | address & 0xFFF) as u32),
+            Err(pagefault) => {
+                trigger_pagefault_jit(pagefault);
+                Err(())
+            },
+        }
+    }
+}
+
+unsafe fn do_page_walk_execute(addr: i32, user: bool) -> Result<i32, PageFault> {
+    match do_page_walk(addr, false, user, true) {
+        Ok(_) if tlb_get(addr as u32 >> 12) & TLB_NO_EXECUTE != 0 => Err(PageFault {
+            addr,
+            for_writing: false,
+            user,
+            present: true,
+            instruction_fetch: true,
+        }),
+        Ok(phys_addr_high) => Ok(phys_addr_high),
+        Err(pagefault) => Err(PageFault {
+            instruction_fetch: true,
+            ..pagefault
+        }),
+    }
+}
+
 pub struct PageFault {
     addr: i32,
     for_writing: bool,
     user: bool,
     present: bool,
+    instruction_fetch: bool,
 }
 
 #[inline(never)]
@@ -1808,9 +2008,46 @@ pub unsafe fn do_page_walk(
     user: bool,
     side_effects: bool,
 ) -> Result<i32, PageFault> {
+    if *cr & CR0_PG != 0 {
+        profiler::stat_increment(TLB_MISS);
+    }
+    let page = addr as u32 >> 12;
+    let (mut entry, _) = page_walk(addr, for_writing, user, side_effects)?;
+    let high = entry & !0xFFF ^ (page << 12) as i32;
+    if entry & TLB_IN_MAPPED_RANGE == 0 {
+        let phys_page = high as u32 >> 12;
+        memory::materialize(phys_page);
+        if for_writing {
+            memory::mark_dirty(phys_page);
+        }
+        else if memory::dirty_page_tracking && !memory::is_dirty(phys_page) {
+            // the first write walks again, which marks the page dirty
+            entry |= TLB_READONLY;
+        }
+    }
+    if side_effects {
+        let has_code = entry & TLB_IN_MAPPED_RANGE == 0
+            && (jit::jit_page_has_code(Page::page_of(high as u32))
+                || is_tracked_page_table(high as u32 >> 12));
+        tlb_insert(page, entry | if has_code { TLB_HAS_CODE } else { 0 })
+    }
+    return Ok(high);
+}
+
+/// Walk the page tables for the given address, returning its tlb entry (without TLB_HAS_CODE)
+/// and whether the accessed and dirty bits were already set. Only writes these bits if
+/// side_effects is set
+unsafe fn page_walk(
+    addr: i32,
+    for_writing: bool,
+    user: bool,
+    side_effects: bool,
+) -> Result<(i32, bool), PageFault> {
+    let mut accessed = true;
     let mut can_write: bool = true;
     let global;
     let mut allow_user: bool = true;
+    let mut no_execute = false;
     let page = (addr as u32 >> 12) as i32;
     let high;
     if *cr & CR0_PG == 0 {
@@ -1819,10 +2056,27 @@ pub unsafe fn do_page_walk(
         global = false
     }
     else {
-        profiler::stat_increment(TLB_MISS);
-
-        let page_dir_addr = (*cr.offset(3) as u32 >> 2).wrapping_add((page >> 10) as u32) as i32;
-        let page_dir_entry = read_aligned32(page_dir_addr as u32);
+        let pae = *cr.offset(4) & CR4_PAE != 0;
+        let nxe = pae && *efer & IA32_EFER_NXE != 0;
+        let page_dir_addr;
+        if pae {
+            // The four page directory pointers are loaded on cr3 writes (see load_pae_pdpte)
+            let pdpte = pae_pdpte[(page >> 18) as usize];
+            if 0 == pdpte & PAGE_TABLE_PRESENT_MASK {
+                return Err(PageFault {
+                    addr,
+                    for_writing,
+                    user,
+                    present: false,
+                    instruction_fetch: false,
+                });
+            }
+            page_dir_addr = ((pdpte as u32 & 0xFFFFF000) >> 2) + ((page as u32 >> 9 & 0x1FF) << 1);
+        }
+        else {
+            page_dir_addr = ((*cr.offset(3) as u32 & 0xFFFFF000) >> 2) + (page >> 10) as u32;
+        }
+        let page_dir_entry = read_aligned32(page_dir_addr);
         // XXX
         let kernel_write_override = !user && 0 == *cr & CR0_WP;
         if 0 == page_dir_entry & PAGE_TABLE_PRESENT_MASK {
@@ -1836,6 +2090,7 @@ pub unsafe fn do_page_walk(
                 for_writing,
                 user,
                 present: false,
+                instruction_fetch: false,
             });
         }
         if page_dir_entry & PAGE_TABLE_RW_MASK == 0 && !kernel_write_override {
@@ -1846,6 +2101,7 @@ pub unsafe fn do_page_walk(
                     for_writing,
                     user,
                     present: true,
+                    instruction_fetch: false,
                 });
             }
         }
@@ -1858,10 +2114,19 @@ pub unsafe fn do_page_walk(
                     for_writing,
                     user,
                     present: true,
+                    instruction_fetch: false,
                 });
             }
         }
-        if 0 != page_dir_entry & PAGE_TABLE_PSE_MASK && 0 != *cr.offset(4) & CR4_PSE {
+        if pae {
+            let page_dir_entry_high = read_aligned32(page_dir_addr + 1);
+            dbg_assert!(
+                page_dir_entry_high & 0xFFFFF == 0,
+                "physical address above 4 GiB"
+            );
+            no_execute = nxe && page_dir_entry_high < 0;
+        }
+        if 0 != page_dir_entry & PAGE_TABLE_PSE_MASK && (pae || 0 != *cr.offset(4) & CR4_PSE) {
             // size bit is set
             // set the accessed and dirty bits
 
@@ -1869,23 +2134,36 @@ pub unsafe fn do_page_walk(
                 | PAGE_TABLE_ACCESSED_MASK
                 | if for_writing { PAGE_TABLE_DIRTY_MASK } else { 0 };
 
-            if side_effects && page_dir_entry != new_page_dir_entry {
-                write_aligned32(page_dir_addr as u32, new_page_dir_entry);
+            if page_dir_entry != new_page_dir_entry {
+                accessed = false;
+                if side_effects {
+                    write_aligned32(page_dir_addr, new_page_dir_entry);
+                }
             }
 
-            high = (page_dir_entry as u32 & 0xFFC00000 | (addr & 0x3FF000) as u32) as i32;
+            if pae {
+                high = (page_dir_entry as u32 & 0xFFE00000 | (addr & 0x1FF000) as u32) as i32;
+            }
+            else {
+                high = (page_dir_entry as u32 & 0xFFC00000 | (addr & 0x3FF000) as u32) as i32;
+            }
             global = page_dir_entry & PAGE_TABLE_GLOBAL_MASK == PAGE_TABLE_GLOBAL_MASK
         }
         else {
-            let page_table_addr = ((page_dir_entry as u32 & 0xFFFFF000) >> 2)
-                .wrapping_add((page & 1023) as u32) as i32;
-            let page_table_entry = read_aligned32(page_table_addr as u32);
+            let page_table_addr = if pae {
+                ((page_dir_entry as u32 & 0xFFFFF000) >> 2) + ((page & 0x1FF) << 1) as u32
+            }
+            else {
+                ((page_dir_entry as u32 & 0xFFFFF000) >> 2) + (page & 1023) as u32
+            };
+            let page_table_entry = read_aligned32(page_table_addr);
             if page_table_entry & PAGE_TABLE_PRESENT_MASK == 0 {
                 return Err(PageFault {
                     addr,
                     for_writing,
                     user,
                     present: false,
+                    instruction_fetch: false,
                 });
             }
             if page_table_entry & PAGE_TABLE_RW_MASK == 0 && !kernel_write_override {
@@ -1896,6 +2174,7 @@ pub unsafe fn do_page_walk(
                         for_writing,
                         user,
                         present: true,
+                        instruction_fetch: false,
                     });
                 }
             }
@@ -1907,6 +2186,7 @@ pub unsafe fn do_page_walk(
                         for_writing,
                         user,
                         present: true,
+                        instruction_fetch: false,
                     });
                 }
             }
@@ -1914,60 +2194,238 @@ pub unsafe fn do_page_walk(
             // Set the accessed and dirty bits
             // Note: dirty bit is only set on the page table entry
             let new_page_dir_entry = page_dir_entry | PAGE_TABLE_ACCESSED_MASK;
-            if side_effects && new_page_dir_entry != page_dir_entry {
-                write_aligned32(page_dir_addr as u32, new_page_dir_entry);
+            if new_page_dir_entry != page_dir_entry {
+                accessed = false;
+                if side_effects {
+                    write_aligned32(page_dir_addr, new_page_dir_entry);
+                }
+            }
+            if pae {
+                let page_table_entry_high = read_aligned32(page_table_addr + 1);
+                dbg_assert!(
+                    page_table_entry_high & 0xFFFFF == 0,
+                    "physical address above 4 GiB"
+                );
+                no_execute |= nxe && page_table_entry_high < 0;
             }
             let new_page_table_entry = page_table_entry
                 | PAGE_TABLE_ACCESSED_MASK
                 | if for_writing { PAGE_TABLE_DIRTY_MASK } else { 0 };
-            if side_effects && page_table_entry != new_page_table_entry {
-                write_aligned32(page_table_addr as u32, new_page_table_entry);
+            if page_table_entry != new_page_table_entry {
+                accessed = false;
+                if side_effects {
+                    write_aligned32(page_table_addr, new_page_table_entry);
+                }
             }
 
             high = (page_table_entry as u32 & 0xFFFFF000) as i32;
             global = page_table_entry & PAGE_TABLE_GLOBAL_MASK == PAGE_TABLE_GLOBAL_MASK
         }
     }
-    if side_effects && tlb_data[page as usize] == 0 {
-        if valid_tlb_entries_count == VALID_TLB_ENTRY_MAX {
-            profiler::stat_increment(TLB_FULL);
-            clear_tlb();
-            // also clear global entries if tlb is almost full after clearing non-global pages
-            if valid_tlb_entries_count > VALID_TLB_ENTRY_MAX * 3 / 4 {
-                profiler::stat_increment(TLB_GLOBAL_FULL);
-                full_clear_tlb();
-            }
-        }
-        dbg_assert!(valid_tlb_entries_count < VALID_TLB_ENTRY_MAX);
-        valid_tlb_entries[valid_tlb_entries_count as usize] = page;
-        valid_tlb_entries_count += 1;
-    // TODO: Check that there are no duplicates in valid_tlb_entries
-    // XXX: There will probably be duplicates due to invlpg deleting
-    // entries from tlb_data but not from valid_tlb_entries
-    }
-    else if CHECK_TLB_INVARIANTS {
-        let mut found: bool = false;
-        for i in 0..valid_tlb_entries_count {
-            if valid_tlb_entries[i as usize] == page {
-                found = true;
-                break;
-            }
-        }
-        dbg_assert!(found);
-    }
     let is_in_mapped_range = in_mapped_range(high as u32);
-    let has_code = !is_in_mapped_range && jit::jit_page_has_code(Page::page_of(high as u32));
     let info_bits = TLB_VALID
         | if can_write { 0 } else { TLB_READONLY }
         | if allow_user { 0 } else { TLB_NO_USER }
+        | if no_execute { TLB_NO_EXECUTE } else { 0 }
         | if is_in_mapped_range { TLB_IN_MAPPED_RANGE } else { 0 }
-        | if global && 0 != *cr.offset(4) & CR4_PGE { TLB_GLOBAL } else { 0 }
-        | if has_code { TLB_HAS_CODE } else { 0 };
+        | if global && 0 != *cr.offset(4) & CR4_PGE { TLB_GLOBAL } else { 0 };
     dbg_assert!((high ^ page << 12) & 0xFFF == 0);
-    if side_effects {
-        tlb_data[page as usize] = high ^ page << 12 | info_bits
+    return Ok((high ^ page << 12 | info_bits, accessed));
+}
+
+/// With PAE, the processor loads the four page directory pointers when cr3 is written (and when
+/// paging is reconfigured) instead of reading them on each page walk. Only the low halves are kept,
+/// as there's no physical memory above 4 GiB
+static mut pae_pdpte: [i32; 4] = [0; 4];
+
+unsafe fn load_pae_pdpte() {
+    if *cr.offset(4) & CR4_PAE == 0 {
+        return;
     }
-    return Ok(high);
+    let base = (*cr.offset(3) as u32 & !0x1F) >> 2;
+    for i in 0..4 {
+        dbg_assert!(
+            read_aligned32(base + 2 * i + 1) & 0xFFFFF == 0,
+            "physical address above 4 GiB"
+        );
+        pae_pdpte[i as usize] = read_aligned32(base + 2 * i);
+    }
+}
+
+/// Translations of address spaces that were recently switched away from, so that switching back
+/// to them doesn't need to walk the page tables again. While an address space is here, writes to
+/// its page directory and page tables are reported to page_table_written (via TLB_HAS_CODE) and
+/// drop it
+struct CachedAddressSpace {
+    cr3: i32,
+    entries: Vec<(u32, i32)>,
+    tables: Vec<u32>,
+}
+
+struct AddressSpaceCache {
+    spaces: Vec<CachedAddressSpace>,
+    /// Bitmap of the physical pages in CachedAddressSpace::tables
+    tracked_page_tables: Vec<u64>,
+}
+
+const CACHED_ADDRESS_SPACES_MAX: usize = 8;
+
+static mut address_space_cache: AddressSpaceCache = AddressSpaceCache {
+    spaces: Vec::new(),
+    tracked_page_tables: Vec::new(),
+};
+
+fn get_address_space_cache() -> &'static mut AddressSpaceCache {
+    unsafe { &mut *std::ptr::addr_of_mut!(address_space_cache) }
+}
+
+impl AddressSpaceCache {
+    fn is_tracked(&self, page: u32) -> bool {
+        let index = (page >> 6) as usize;
+        index < self.tracked_page_tables.len()
+            && self.tracked_page_tables[index] >> (page & 63) & 1 == 1
+    }
+
+    fn rebuild_tracked_page_tables(&mut self) {
+        for word in self.tracked_page_tables.iter_mut() {
+            *word = 0;
+        }
+        for space in self.spaces.iter() {
+            for &page in &space.tables {
+                let index = (page >> 6) as usize;
+                if index >= self.tracked_page_tables.len() {
+                    self.tracked_page_tables.resize(index + 1, 0);
+                }
+                self.tracked_page_tables[index] |= 1 << (page & 63);
+            }
+        }
+    }
+}
+
+pub fn is_tracked_page_table(page: u32) -> bool { get_address_space_cache().is_tracked(page) }
+
+/// The physical page has been written to: Drop the cached address spaces that use it as a page
+/// directory or page table
+pub fn page_table_written(page: u32) {
+    let cache = get_address_space_cache();
+    if !cache.is_tracked(page) {
+        return;
+    }
+    profiler::stat_increment(ADDRESS_SPACE_CACHE_DROPPED);
+    cache.spaces.retain(|space| !space.tables.contains(&page));
+    cache.rebuild_tracked_page_tables();
+}
+
+pub fn drop_cached_address_spaces() {
+    let cache = get_address_space_cache();
+    cache.spaces.clear();
+    cache.rebuild_tracked_page_tables();
+}
+
+/// Keep the non-global tlb entries of the current address space that still match its page tables
+unsafe fn save_address_space() {
+    let cr3 = *cr.offset(3);
+    let pae = *cr.offset(4) & CR4_PAE != 0;
+    if pae && (0..4).any(|i| read_aligned32((cr3 as u32 >> 2) + 2 * i) != pae_pdpte[i as usize]) {
+        // Switching back reloads the page directory pointers, which have been changed in memory
+        return;
+    }
+    let mut candidates = Vec::new();
+    tlb_update_entries(|page, entry| {
+        if entry & TLB_GLOBAL == 0 {
+            candidates.push((page, entry));
+        }
+        entry
+    });
+
+    let mut entries = Vec::with_capacity(candidates.len());
+    let mut tables = vec![cr3 as u32 >> 12];
+    for (page, entry) in candidates {
+        match page_walk((page << 12) as i32, false, false, false) {
+            // entries of pages that aren't dirty yet are read-only (see do_page_walk)
+            Ok((walked_entry, true))
+                if walked_entry == entry & !TLB_HAS_CODE
+                    || walked_entry | TLB_READONLY == entry & !TLB_HAS_CODE => {},
+            _ => continue,
+        }
+        let page_dir_entry = if pae {
+            let pdpte = pae_pdpte[(page >> 18) as usize];
+            tables.push(pdpte as u32 >> 12);
+            read_aligned32(((pdpte as u32 & 0xFFFFF000) >> 2) + ((page >> 9 & 0x1FF) << 1))
+        }
+        else {
+            read_aligned32((cr3 as u32 >> 2) + (page >> 10))
+        };
+        if page_dir_entry & PAGE_TABLE_PSE_MASK == 0 || !pae && *cr.offset(4) & CR4_PSE == 0 {
+            tables.push(page_dir_entry as u32 >> 12);
+        }
+        entries.push((page, entry));
+    }
+    tables.sort();
+    tables.dedup();
+    if entries.is_empty() || tables.iter().any(|&p| in_mapped_range(p << 12)) {
+        return;
+    }
+
+    let cache = get_address_space_cache();
+    cache.spaces.retain(|space| space.cr3 != cr3);
+    if cache.spaces.len() == CACHED_ADDRESS_SPACES_MAX {
+        cache.spaces.remove(0);
+    }
+    cache.spaces.push(CachedAddressSpace {
+        cr3,
+        entries,
+        tables,
+    });
+    cache.rebuild_tracked_page_tables();
+}
+
+/// Load the tlb entries of the current address space, if it's cached
+unsafe fn restore_address_space() {
+    let cr3 = *cr.offset(3);
+    let cache = get_address_space_cache();
+    let space = match cache.spaces.iter().position(|space| space.cr3 == cr3) {
+        Some(i) => cache.spaces.remove(i),
+        None => {
+            profiler::stat_increment(ADDRESS_SPACE_CACHE_MISS);
+            return;
+        },
+    };
+    profiler::stat_increment(ADDRESS_SPACE_CACHE_HIT);
+    cache.rebuild_tracked_page_tables();
+    for (page, entry) in space.entries {
+        if tlb_get(page) == 0 {
+            tlb_insert(page, entry);
+        }
+    }
+}
+
+/// Switch to another page directory (or reload the current one), flushing the non-global tlb
+/// entries. Entries that are still valid are kept in cached_address_spaces, so switching back to
+/// a recent address space doesn't have to refill the tlb.
+pub unsafe fn set_cr3(new_cr3: i32) {
+    let paging = *cr & CR0_PG != 0;
+    if paging {
+        save_address_space();
+    }
+    *cr.offset(3) = new_cr3;
+    load_pae_pdpte();
+    clear_tlb();
+    if paging {
+        restore_address_space();
+        // Global entries (and the restored ones) pointing to newly tracked page tables must report
+        // writes
+        tlb_update_entries(|page, entry| {
+            let physical_page = entry as u32 >> 12 ^ page;
+            if entry & TLB_HAS_CODE == 0 && is_tracked_page_table(physical_page) {
+                entry | TLB_HAS_CODE
+            }
+            else {
+                entry
+            }
+        });
+    }
+    check_tlb_invariants();
 }
 
 #[no_mangle]
@@ -1975,41 +2433,40 @@ pub unsafe fn full_clear_tlb() {
     profiler::stat_increment(FULL_CLEAR_TLB);
     // clear tlb including global pages
     *last_virt_eip = -1;
-    for i in 0..valid_tlb_entries_count {
-        let page = valid_tlb_entries[i as usize];
-        tlb_data[page as usize] = 0;
-    }
-    valid_tlb_entries_count = 0;
+    tlb_update_entries(|_, _| 0);
+    drop_cached_address_spaces();
+    load_pae_pdpte();
 
     if CHECK_TLB_INVARIANTS {
-        for &entry in tlb_data.iter() {
+        for entry in tlb_all_entries() {
             dbg_assert!(entry == 0);
         }
     };
 }
 
+/// Make the tlb entries read-only, including those of cached address spaces, so that the next
+/// write to each page walks the page tables again and marks it dirty
+pub unsafe fn tlb_clear_write_access() {
+    let clear = |entry: i32| {
+        if entry & TLB_IN_MAPPED_RANGE != 0 { entry } else { entry | TLB_READONLY }
+    };
+    tlb_update_entries(|_, entry| clear(entry));
+    for space in get_address_space_cache().spaces.iter_mut() {
+        for (_, entry) in space.entries.iter_mut() {
+            *entry = clear(*entry);
+        }
+    }
+}
+
 #[no_mangle]
 pub unsafe fn clear_tlb() {
     profiler::stat_increment(CLEAR_TLB);
     // clear tlb excluding global pages
     *last_virt_eip = -1;
-    let mut global_page_offset: i32 = 0;
-    for i in 0..valid_tlb_entries_count {
-        let page = valid_tlb_entries[i as usize];
-        let entry = tlb_data[page as usize];
-        if 0 != entry & TLB_GLOBAL {
-            // reinsert at the front
-            valid_tlb_entries[global_page_offset as usize] = page;
-            global_page_offset += 1;
-        }
-        else {
-            tlb_data[page as usize] = 0
-        }
-    }
-    valid_tlb_entries_count = global_page_offset;
+    tlb_update_entries(|_, entry| if 0 != entry & TLB_GLOBAL { entry } else { 0 });
 
     if CHECK_TLB_INVARIANTS {
-        for &entry in tlb_data.iter() {
+        for entry in tlb_all_entries() {
             dbg_assert!(entry == 0 || 0 != entry & TLB_GLOBAL);
         }
     };
@@ -2045,15 +2502,13 @@ pub unsafe fn trigger_pagefault_jit(fault: PageFault) {
     profiler::stat_increment(PAGE_FAULT);
     *cr.offset(2) = addr;
     // invalidate tlb entry
-    let page = ((addr as u32) >> 12) as i32;
-    tlb_data[page as usize] = 0;
+    tlb_invalidate(addr as u32 >> 12);
     if DEBUG {
         if cpu_exception_hook(CPU_EXCEPTION_PF) {
             return;
         }
     }
-    let error_code = (user as i32) << 2 | (write as i32) << 1 | present as i32;
-    jit_fault = Some((CPU_EXCEPTION_PF, Some(error_code)));
+    jit_fault = Some((CPU_EXCEPTION_PF, Some(pagefault_error_code(&fault))));
 }
 
 #[no_mangle]
@@ -2116,18 +2571,22 @@ pub unsafe fn trigger_pagefault(fault: PageFault) {
     profiler::stat_increment(PAGE_FAULT);
     *cr.offset(2) = addr;
     // invalidate tlb entry
-    let page = ((addr as u32) >> 12) as i32;
-    tlb_data[page as usize] = 0;
+    tlb_invalidate(addr as u32 >> 12);
     *instruction_pointer = *previous_ip;
-    call_interrupt_vector(
-        CPU_EXCEPTION_PF,
-        false,
-        Some((user as i32) << 2 | (write as i32) << 1 | present as i32),
-    );
+    call_interrupt_vector(CPU_EXCEPTION_PF, false, Some(pagefault_error_code(&fault)));
+}
+
+unsafe fn pagefault_error_code(fault: &PageFault) -> i32 {
+    // The instruction fetch bit is only reported when no-execute pages are enabled
+    let instruction_fetch = fault.instruction_fetch && *efer & IA32_EFER_NXE != 0;
+    (instruction_fetch as i32) << 4
+        | (fault.user as i32) << 2
+        | (fault.for_writing as i32) << 1
+        | fault.present as i32
 }
 
 pub unsafe fn translate_address_write_and_can_skip_dirty(address: i32) -> OrPageFault<(u32, bool)> {
-    let entry = tlb_data[(address as u32 >> 12) as usize];
+    let entry = tlb_get(address as u32 >> 12);
     let user = *cpl == 3;
     if entry & (TLB_VALID | if user { TLB_NO_USER } else { 0 } | TLB_READONLY) == TLB_VALID {
         return Ok(((entry & !0xFFF ^ address) as u32, entry & TLB_HAS_CODE == 0));
@@ -2140,8 +2599,26 @@ pub unsafe fn translate_address_write_and_can_skip_dirty(address: i32) -> OrPage
     };
 }
 
+/// Like translate_address_write_and_can_skip_dirty, but returns None instead of triggering a page
+/// fault, so that bulk string instructions can stop in front of the faulting page
+pub unsafe fn translate_address_write_and_can_skip_dirty_no_fault(
+    address: i32,
+) -> Option<(u32, bool)> {
+    let entry = tlb_get(address as u32 >> 12);
+    let user = *cpl == 3;
+    if entry & (TLB_VALID | if user { TLB_NO_USER } else { 0 } | TLB_READONLY) == TLB_VALID {
+        Some(((entry & !0xFFF ^ address) as u32, entry & TLB_HAS_CODE == 0))
+    }
+    else {
+        match do_page_walk(address, true, user, true) {
+            Ok(phys_addr_high) => Some(((phys_addr_high | address & 0xFFF) as u32, false)),
+            Err(_pagefault) => None,
+        }
+    }
+}
+
 pub unsafe fn translate_address_write(address: i32) -> OrPageFault<u32> {
-    let entry = tlb_data[(address as u32 >> 12) as usize];
+    let entry = tlb_get(address as u32 >> 12);
     let user = *cpl == 3;
     if entry & (TLB_VALID | if user { TLB_NO_USER } else { 0 } | TLB_READONLY) == TLB_VALID {
         return Ok((entry & !0xFFF ^ address) as u32);
@@ -2152,7 +2629,7 @@ pub unsafe fn translate_address_write(address: i32) -> OrPageFault<u32> {
 }
 
 pub unsafe fn translate_address_write_jit(address: i32) -> OrPageFault<u32> {
-    let entry = tlb_data[(address as u32 >> 12) as usize];
+    let entry = tlb_get(address as u32 >> 12);
     let user = *cpl == 3;
     if entry & (TLB_VALID | if user { TLB_NO_USER } else { 0 } | TLB_READONLY) == TLB_VALID {
         Ok((entry & !0xFFF ^ address) as u32)
@@ -2170,16 +2647,21 @@ pub unsafe fn translate_address_write_jit(address: i32) -> OrPageFault<u32> {
 
 pub fn tlb_set_has_code(physical_page: Page, has_code: bool) {
     let physical_page = physical_page.to_u32();
-    for i in 0..unsafe { valid_tlb_entries_count } {
-        let page = unsafe { valid_tlb_entries[i as usize] };
-        let entry = unsafe { tlb_data[page as usize] };
-        if 0 != entry {
-            let tlb_physical_page = entry as u32 >> 12 ^ page as u32;
-            if physical_page == tlb_physical_page {
-                unsafe {
-                    tlb_data[page as usize] =
-                        if has_code { entry | TLB_HAS_CODE } else { entry & !TLB_HAS_CODE }
-                }
+    let has_code = has_code || is_tracked_page_table(physical_page);
+    let update = |page: u32, entry: i32| {
+        let tlb_physical_page = entry as u32 >> 12 ^ page;
+        if physical_page == tlb_physical_page {
+            if has_code { entry | TLB_HAS_CODE } else { entry & !TLB_HAS_CODE }
+        }
+        else {
+            entry
+        }
+    };
+    unsafe {
+        tlb_update_entries(update);
+        for space in get_address_space_cache().spaces.iter_mut() {
+            for (page, entry) in space.entries.iter_mut() {
+                *entry = update(*page, *entry);
             }
         }
     }
@@ -2192,23 +2674,25 @@ pub fn check_tlb_invariants() {
         return;
     }
 
-    for i in 0..unsafe { valid_tlb_entries_count } {
-        let page = unsafe { valid_tlb_entries[i as usize] };
-        let entry = unsafe { tlb_data[page as usize] };
-
-        if 0 == entry || 0 != entry & TLB_IN_MAPPED_RANGE {
-            // there's no code in mapped memory
-            continue;
-        }
+    unsafe {
+        tlb_update_entries(|page, entry| {
+            if 0 != entry & TLB_IN_MAPPED_RANGE {
+                // there's no code in mapped memory
+                return entry;
+            }
 
-        let target = (entry ^ page << 12) as u32;
-        dbg_assert!(!in_mapped_range(target));
+            let target = (entry ^ (page << 12) as i32) as u32;
+            dbg_assert!(!in_mapped_range(target));
 
-        let entry_has_code = entry & TLB_HAS_CODE != 0;
-        let has_code = jit::jit_page_has_code(Page::page_of(target));
+            let entry_has_code = entry & TLB_HAS_CODE != 0;
+            let has_code = jit::jit_page_has_code(Page::page_of(target));
 
-        // If some code has been created in a page, the corresponding tlb entries must be marked
-        dbg_assert!(!has_code || entry_has_code);
+            // If some code has been created in a page, the corresponding tlb entries must be marked
+            dbg_assert!(!has_code || entry_has_code);
+            // Same for page tables of cached address spaces
+            dbg_assert!(!is_tracked_page_table(target >> 12) || entry_has_code);
+            entry
+        })
     }
 }
 
@@ -2223,13 +2707,13 @@ pub unsafe fn readable_or_pagefault(addr: i32, size: i32) -> OrPageFault<()> {
     let mask = TLB_VALID | if user { TLB_NO_USER } else { 0 };
     let expect = TLB_VALID;
     let page = (addr as u32 >> 12) as i32;
-    if tlb_data[page as usize] & mask != expect {
+    if tlb_get(page as u32) & mask != expect {
         do_page_translation(addr, false, user)?;
     }
     let next_page = ((addr + size - 1) as u32 >> 12) as i32;
     if page != next_page {
         dbg_assert!(next_page == page + 1);
-        if tlb_data[next_page as usize] & mask != expect {
+        if tlb_get(next_page as u32) & mask != expect {
             do_page_translation(next_page << 12, false, user)?;
         }
     }
@@ -2247,13 +2731,13 @@ pub unsafe fn writable_or_pagefault(addr: i32, size: i32) -> OrPageFault<()> {
     let mask = TLB_READONLY | TLB_VALID | if user { TLB_NO_USER } else { 0 };
     let expect = TLB_VALID;
     let page = (addr as u32 >> 12) as i32;
-    if tlb_data[page as usize] & mask != expect {
+    if tlb_get(page as u32) & mask != expect {
         do_page_translation(addr, true, user)?;
     }
     let next_page = ((addr + size - 1) as u32 >> 12) as i32;
     if page != next_page {
         dbg_assert!(next_page == page + 1);
-        if tlb_data[next_page as usize] & mask != expect {
+        if tlb_get(next_page as u32) & mask != expect {
             do_page_translation(next_page << 12, true, user)?;
         }
     }
@@ -2265,11 +2749,11 @@ pub const DISABLE_EIP_TRANSLATION_OPTIMISATION: bool = false;
 pub unsafe fn read_imm8() -> OrPageFault<i32> {
     let eip = *instruction_pointer;
     if DISABLE_EIP_TRANSLATION_OPTIMISATION || 0 != eip & !0xFFF ^ *last_virt_eip {
-        *eip_phys = (translate_address_read(eip)? ^ eip as u32) as i32;
+        *eip_phys = (translate_address_execute(eip)? ^ eip as u32) as i32;
         *last_virt_eip = eip & !0xFFF
     }
     dbg_assert!(!in_mapped_range((*eip_phys ^ eip) as u32));
-    let data8 = *mem8.offset((*eip_phys ^ eip) as isize) as i32;
+    let data8 = *mem8.add((*eip_phys ^ eip) as u32 as usize) as i32;
     *instruction_pointer = eip + 1;
     return Ok(data8);
 }
@@ -2708,6 +3192,10 @@ pub unsafe fn run_instruction0f_32(opcode: i32) { ::gen::interpreter0f::run(opco
 pub unsafe fn cycle_internal() {
     profiler::stat_increment(CYCLE_INTERNAL);
     if !::config::FORCE_DISABLE_JIT {
+        // set by compiled code that exited through a linkable exit site
+        let exit_site = *jit_exit_site;
+        *jit_exit_site = 0;
+
         *previous_ip = *instruction_pointer;
         let phys_addr = return_on_pagefault!(get_phys_eip()) as u32;
         let state_flags = pack_current_state_flags();
@@ -2715,7 +3203,11 @@ pub unsafe fn cycle_internal() {
 
         if entry != jit::CachedCode::NONE {
             profiler::stat_increment(RUN_FROM_CACHE);
+            if exit_site != 0 {
+                jit::jit_link_exit_site(exit_site, phys_addr, state_flags, entry);
+            }
             let initial_instruction_counter = *instruction_counter;
+            *jit_chained_instructions = 0;
             let wasm_table_index = entry.wasm_table_index;
             let initial_state = entry.initial_state;
             #[cfg(debug_assertions)]
@@ -2735,6 +3227,21 @@ pub unsafe fn cycle_internal() {
                 RUN_FROM_CACHE_STEPS,
                 (*instruction_counter - initial_instruction_counter) as u64,
             );
+            profiler::stat_increment_by(
+                RUN_FROM_CACHE_CHAINED_STEPS,
+                *jit_chained_instructions as u64,
+            );
+            // Instructions run by modules linked from this one (see gen_chained_exit) belong to
+            // them, not to the module entered here. They're at the optimizing tier already, as
+            // only those are linked
+            jit::jit_increase_hotness_of_module(
+                entry,
+                initial_eip,
+                phys_addr,
+                get_seg_cs() as u32,
+                state_flags,
+                *instruction_counter - initial_instruction_counter - *jit_chained_instructions,
+            );
             dbg_assert!(
                 *instruction_counter != initial_instruction_counter,
                 "Instruction counter didn't change"
@@ -2815,7 +3322,7 @@ pub unsafe fn cycle_internal() {
 pub unsafe fn get_phys_eip() -> OrPageFault<u32> {
     let eip = *instruction_pointer;
     if 0 != eip & !0xFFF ^ *last_virt_eip {
-        *eip_phys = (translate_address_read(eip)? ^ eip as u32) as i32;
+        *eip_phys = (translate_address_execute(eip)? ^ eip as u32) as i32;
         *last_virt_eip = eip & !0xFFF
     }
     let phys_addr = (*eip_phys ^ eip) as u32;
@@ -2832,12 +3339,15 @@ unsafe fn jit_run_interpreted(phys_addr: u32) {
     }
 
     jit_block_boundary = false;
-    let opcode = *mem8.offset(phys_addr as isize) as i32;
-    *instruction_pointer += 1;
-    *instruction_counter += 1;
-    dbg_assert!(*prefixes == 0);
-    run_instruction(opcode | (*is_32 as i32) << 8);
-    dbg_assert!(*prefixes == 0);
+
+    if !::config::INTERPRETER_DECODED_BLOCKS || run_decoded_block(phys_addr) == 0 {
+        let opcode = *mem8.add(phys_addr as usize) as i32;
+        *instruction_pointer += 1;
+        *instruction_counter += 1;
+        dbg_assert!(*prefixes == 0);
+        run_instruction(opcode | (*is_32 as i32) << 8);
+        dbg_assert!(*prefixes == 0);
+    }
 
     // We need to limit the number of iterations here as jumps within the same page are not counted
     // as block boundaries for the interpreter (as they don't create an entry point and don't need
@@ -2849,6 +3359,16 @@ unsafe fn jit_run_interpreted(phys_addr: u32) {
         && i < INTERPRETER_ITERATION_LIMIT
     {
         *previous_ip = *instruction_pointer;
+
+        if ::config::INTERPRETER_DECODED_BLOCKS {
+            let phys_addr = return_on_pagefault!(get_phys_eip());
+            let steps = run_decoded_block(phys_addr);
+            if steps != 0 {
+                i += steps;
+                continue;
+            }
+        }
+
         let opcode = return_on_pagefault!(read_imm8());
 
         if CHECK_MISSED_ENTRY_POINTS {
@@ -2887,6 +3407,19 @@ unsafe fn jit_run_interpreted(phys_addr: u32) {
     }
 }
 
+/// Run the pre-decoded block at this address, if there is one (see interpreter_cache). Returns the
+/// number of instructions that were run
+unsafe fn run_decoded_block(phys_addr: u32) -> u32 {
+    match jit::jit_get_decoded_block(phys_addr, pack_current_state_flags()) {
+        Some(block) => {
+            let steps = interpreter_cache::run_block(&block);
+            profiler::stat_increment_by(RUN_INTERPRETED_DECODED_STEPS, steps as u64);
+            steps
+        },
+        None => 0,
+    }
+}
+
 pub fn pack_current_state_flags() -> CachedStateFlags {
     unsafe {
         CachedStateFlags::of_u32(
@@ -3088,6 +3621,10 @@ pub fn report_safe_read_jit_slow(address: u32, entry: i32) {
     else if entry & TLB_NO_USER != 0 {
         profiler::stat_increment(SAFE_READ_SLOW_NOT_USER);
     }
+    else if entry & TLB_NO_EXECUTE != 0 {
+        // instruction fetch from gen_get_phys_eip
+        profiler::stat_increment(SAFE_READ_SLOW_NO_EXECUTE);
+    }
     else if address & 0xFFF > 0x1000 - 16 {
         profiler::stat_increment(SAFE_READ_SLOW_PAGE_CROSSED);
     }
@@ -3243,7 +3780,7 @@ pub unsafe fn safe_read128s_slow_jit(addr: i32, eip: i32) -> i32 {
 
 #[no_mangle]
 pub unsafe fn get_phys_eip_slow_jit(addr: i32) -> i32 {
-    match translate_address_read_jit(addr) {
+    match translate_address_execute_jit(addr) {
         Err(()) => 1,
         Ok(addr_low) => {
             dbg_assert!(!in_mapped_range(addr_low as u32)); // same assumption as in read_imm8
@@ -3349,7 +3886,7 @@ pub unsafe fn safe_write_slow_jit(
         ((scratch as i32 - mem8 as i32) ^ addr) & !0xFFF
     }
     else {
-        jit::jit_dirty_page(jit::get_jit_state(), Page::page_of(addr_low));
+        jit::jit_dirty_cache_small(addr_low, addr_low + bitsize as u32 / 8);
         (addr_low as i32 ^ addr) & !0xFFF
     }
 }
@@ -3382,7 +3919,7 @@ pub unsafe fn safe_write8(addr: i32, value: i32) -> OrPageFault<()> {
     }
     else {
         if !can_skip_dirty_page {
-            jit::jit_dirty_page(jit::get_jit_state(), Page::page_of(phys_addr));
+            jit::jit_dirty_cache_small(phys_addr, phys_addr + 1);
         }
         else {
             dbg_assert!(!jit::jit_page_has_code(Page::page_of(phys_addr as u32)));
@@ -3402,7 +3939,7 @@ pub unsafe fn safe_write16(addr: i32, value: i32) -> OrPageFault<()> {
     }
     else {
         if !can_skip_dirty_page {
-            jit::jit_dirty_page(jit::get_jit_state(), Page::page_of(phys_addr));
+            jit::jit_dirty_cache_small(phys_addr, phys_addr + 2);
         }
         else {
             dbg_assert!(!jit::jit_page_has_code(Page::page_of(phys_addr as u32)));
@@ -3426,7 +3963,7 @@ pub unsafe fn safe_write32(addr: i32, value: i32) -> OrPageFault<()> {
     }
     else {
         if !can_skip_dirty_page {
-            jit::jit_dirty_page(jit::get_jit_state(), Page::page_of(phys_addr));
+            jit::jit_dirty_cache_small(phys_addr, phys_addr + 4);
         }
         else {
             dbg_assert!(!jit::jit_page_has_code(Page::page_of(phys_addr as u32)));
@@ -3449,7 +3986,7 @@ pub unsafe fn safe_write64(addr: i32, value: u64) -> OrPageFault<()> {
         }
         else {
             if !can_skip_dirty_page {
-                jit::jit_dirty_page(jit::get_jit_state(), Page::page_of(phys_addr));
+                jit::jit_dirty_cache_small(phys_addr, phys_addr + 8);
             }
             else {
                 dbg_assert!(!jit::jit_page_has_code(Page::page_of(phys_addr as u32)));
@@ -3479,7 +4016,7 @@ pub unsafe fn safe_write128(addr: i32, value: reg128) -> OrPageFault<()> {
         }
         else {
             if !can_skip_dirty_page {
-                jit::jit_dirty_page(jit::get_jit_state(), Page::page_of(phys_addr));
+                jit::jit_dirty_cache_small(phys_addr, phys_addr + 16);
             }
             else {
                 dbg_assert!(!jit::jit_page_has_code(Page::page_of(phys_addr as u32)));
@@ -3785,12 +4322,11 @@ pub unsafe fn get_opstats_buffer(
 }
 
 pub unsafe fn invlpg(addr: i32) {
-    let page = (addr as u32 >> 12) as i32;
     // Note: Doesn't remove this page from valid_tlb_entries: This isn't
     // necessary, because when valid_tlb_entries grows too large, it will be
     // empties by calling clear_tlb, which removes this entry as it isn't global.
     // This however means that valid_tlb_entries can contain some invalid entries
-    tlb_data[page as usize] = 0;
+    tlb_invalidate(addr as u32 >> 12);
     *last_virt_eip = -1;
 }
 
@@ -3835,13 +4371,10 @@ pub unsafe fn get_valid_tlb_entries_count() -> i32 {
         return 0;
     }
     let mut result: i32 = 0;
-    for i in 0..valid_tlb_entries_count {
-        let page = valid_tlb_entries[i as usize];
-        let entry = tlb_data[page as usize];
-        if 0 != entry {
-            result += 1
-        }
-    }
+    tlb_update_entries(|_, entry| {
+        result += 1;
+        entry
+    });
     return result;
 }
 
@@ -3851,18 +4384,17 @@ pub unsafe fn get_valid_global_tlb_entries_count() -> i32 {
         return 0;
     }
     let mut result: i32 = 0;
-    for i in 0..valid_tlb_entries_count {
-        let page = valid_tlb_entries[i as usize];
-        let entry = tlb_data[page as usize];
+    tlb_update_entries(|_, entry| {
         if 0 != entry & TLB_GLOBAL {
             result += 1
         }
-    }
+        entry
+    });
     return result;
 }
 
 pub unsafe fn translate_address_system_read(address: i32) -> OrPageFault<u32> {
-    let entry = tlb_data[(address as u32 >> 12) as usize];
+    let entry = tlb_get(address as u32 >> 12);
     if 0 != entry & TLB_VALID {
         return Ok((entry & !0xFFF ^ address) as u32);
     }
@@ -3872,7 +4404,7 @@ pub unsafe fn translate_address_system_read(address: i32) -> OrPageFault<u32> {
 }
 
 pub unsafe fn translate_address_system_write(address: i32) -> OrPageFault<u32> {
-    let entry = tlb_data[(address as u32 >> 12) as usize];
+    let entry = tlb_get(address as u32 >> 12);
     if entry & (TLB_VALID | TLB_READONLY) == TLB_VALID {
         return Ok((entry & !0xFFF ^ address) as u32);
     }
@@ -3982,6 +4514,7 @@ pub unsafe fn reset_cpu() {
     *cr.offset(2) = 0;
     *cr.offset(3) = 0;
     *cr.offset(4) = 0;
+    *efer = 0;
     *dreg.offset(6) = 0xFFFF0FF0u32 as i32;
     *dreg.offset(7) = 0x400;
     *cpl = 0;
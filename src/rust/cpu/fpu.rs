@@ -21,6 +21,11 @@ const FPU_EX_U: u16 = 1 << 4; // underflow
 const FPU_EX_P: u16 = 1 << 5; // precision
 const FPU_EX_SF: u16 = 1 << 6;
 
+// precision and rounding control
+const FPU_CW_PC_RC: u16 = 0xF00;
+const FPU_CW_SINGLE_NEAREST: u16 = 0 << 8;
+const FPU_CW_DOUBLE_NEAREST: u16 = 2 << 8;
+
 pub fn fpu_write_st(index: i32, value: F80) {
     dbg_assert!(index >= 0 && index < 8);
     unsafe {
@@ -153,12 +158,77 @@ pub unsafe fn fpu_load_status_word() -> u16 {
     dbg_assert!(*fpu_stack_ptr < 8);
     return *fpu_status_word & !(7 << 11) | (*fpu_stack_ptr as u16) << 11;
 }
+
+/// Compute an arithmetic operation using native f64 or f32 instructions instead of softfloat.
+/// Possible if the control word selects double or single precision with round-to-nearest (the
+/// only rounding mode wasm has), both operands are representable in that precision and the result
+/// is a normal number larger than the smallest one, or a zero from a zero operand: Then rounding
+/// the exact result to 53 or 24 bits gives the same value in the x87's wider exponent range, and
+/// no exceptions are raised. Returns None if softfloat has to be used.
+#[inline]
+fn fpu_native_arith(
+    control_word: u16,
+    x: F80,
+    y: F80,
+    op64: fn(f64, f64) -> f64,
+    op32: fn(f32, f32) -> f32,
+) -> Option<F80> {
+    match control_word & FPU_CW_PC_RC {
+        FPU_CW_DOUBLE_NEAREST => {
+            let (x, y) = (x.to_f64_exact()?, y.to_f64_exact()?);
+            let r = op64(x, y);
+            if r == 0.0 && (x == 0.0 || y == 0.0) || r.is_finite() && r.abs() > f64::MIN_POSITIVE {
+                F80::of_f64_exact(r.to_bits())
+            }
+            else {
+                None
+            }
+        },
+        FPU_CW_SINGLE_NEAREST => {
+            let (x, y) = (x.to_f32_exact()?, y.to_f32_exact()?);
+            let r = op32(x, y);
+            if r == 0.0 && (x == 0.0 || y == 0.0) || r.is_finite() && r.abs() > f32::MIN_POSITIVE {
+                F80::of_f32_exact(r.to_bits() as i32)
+            }
+            else {
+                None
+            }
+        },
+        _ => None,
+    }
+}
+
+// The arithmetic of fadd, fsub, fmul and fdiv on plain values, also called from code generated
+// by jit_fpu, which keeps the stack in locals. Only fadd and fdiv update the exception flags.
 #[no_mangle]
-pub unsafe fn fpu_fadd(target_index: i32, val: F80) {
+pub unsafe fn fpu_add(x: F80, y: F80) -> F80 {
     F80::clear_exception_flags();
-    let st0 = fpu_get_st0();
-    fpu_write_st(*fpu_stack_ptr as i32 + target_index & 7, st0 + val);
+    let result = fpu_native_arith(*fpu_control_word, x, y, |x, y| x + y, |x, y| x + y)
+        .unwrap_or_else(|| x + y);
     *fpu_status_word |= F80::get_exception_flags() as u16;
+    result
+}
+#[no_mangle]
+pub unsafe fn fpu_sub(x: F80, y: F80) -> F80 {
+    fpu_native_arith(*fpu_control_word, x, y, |x, y| x - y, |x, y| x - y).unwrap_or_else(|| x - y)
+}
+#[no_mangle]
+pub unsafe fn fpu_mul(x: F80, y: F80) -> F80 {
+    fpu_native_arith(*fpu_control_word, x, y, |x, y| x * y, |x, y| x * y).unwrap_or_else(|| x * y)
+}
+#[no_mangle]
+pub unsafe fn fpu_div(x: F80, y: F80) -> F80 {
+    F80::clear_exception_flags();
+    let result = fpu_native_arith(*fpu_control_word, x, y, |x, y| x / y, |x, y| x / y)
+        .unwrap_or_else(|| x / y);
+    *fpu_status_word |= F80::get_exception_flags() as u16;
+    result
+}
+
+#[no_mangle]
+pub unsafe fn fpu_fadd(target_index: i32, val: F80) {
+    let result = fpu_add(fpu_get_st0(), val);
+    fpu_write_st(*fpu_stack_ptr as i32 + target_index & 7, result);
 }
 #[no_mangle]
 pub unsafe fn fpu_fclex() { *fpu_status_word = 0; }
@@ -229,17 +299,13 @@ pub unsafe fn fpu_fcomp(val: F80) {
 
 #[no_mangle]
 pub unsafe fn fpu_fdiv(target_index: i32, val: F80) {
-    F80::clear_exception_flags();
-    let st0 = fpu_get_st0();
-    fpu_write_st(*fpu_stack_ptr as i32 + target_index & 7, st0 / val);
-    *fpu_status_word |= F80::get_exception_flags() as u16;
+    let result = fpu_div(fpu_get_st0(), val);
+    fpu_write_st(*fpu_stack_ptr as i32 + target_index & 7, result);
 }
 #[no_mangle]
 pub unsafe fn fpu_fdivr(target_index: i32, val: F80) {
-    F80::clear_exception_flags();
-    let st0 = fpu_get_st0();
-    fpu_write_st(*fpu_stack_ptr as i32 + target_index & 7, val / st0);
-    *fpu_status_word |= F80::get_exception_flags() as u16;
+    let result = fpu_div(val, fpu_get_st0());
+    fpu_write_st(*fpu_stack_ptr as i32 + target_index & 7, result);
 }
 #[no_mangle]
 pub unsafe fn fpu_ffree(r: i32) { *fpu_stack_empty |= 1 << (*fpu_stack_ptr as i32 + r & 7); }
@@ -434,8 +500,8 @@ pub unsafe fn fpu_fldm80(addr: i32) {
 
 #[no_mangle]
 pub unsafe fn fpu_fmul(target_index: i32, val: F80) {
-    let st0 = fpu_get_st0();
-    fpu_write_st(*fpu_stack_ptr as i32 + target_index & 7, st0 * val);
+    let result = fpu_mul(fpu_get_st0(), val);
+    fpu_write_st(*fpu_stack_ptr as i32 + target_index & 7, result);
 }
 #[no_mangle]
 pub unsafe fn fpu_fnstsw_mem(addr: i32) {
@@ -627,13 +693,13 @@ pub unsafe fn fpu_fstp(r: i32) {
 
 #[no_mangle]
 pub unsafe fn fpu_fsub(target_index: i32, val: F80) {
-    let st0 = fpu_get_st0();
-    fpu_write_st(*fpu_stack_ptr as i32 + target_index & 7, st0 - val)
+    let result = fpu_sub(fpu_get_st0(), val);
+    fpu_write_st(*fpu_stack_ptr as i32 + target_index & 7, result)
 }
 #[no_mangle]
 pub unsafe fn fpu_fsubr(target_index: i32, val: F80) {
-    let st0 = fpu_get_st0();
-    fpu_write_st(*fpu_stack_ptr as i32 + target_index & 7, val - st0)
+    let result = fpu_sub(val, fpu_get_st0());
+    fpu_write_st(*fpu_stack_ptr as i32 + target_index & 7, result)
 }
 
 #[no_mangle]
@@ -820,7 +886,15 @@ pub unsafe fn fpu_fsqrt() {
     //if st0 < 0.0 {
     //    fpu_invalid_arithmetic();
     //}
-    fpu_write_st(*fpu_stack_ptr as i32, st0.sqrt())
+    let result = fpu_native_arith(
+        *fpu_control_word,
+        st0,
+        st0,
+        |x, _| x.sqrt(),
+        |x, _| x.sqrt(),
+    )
+    .unwrap_or_else(|| st0.sqrt());
+    fpu_write_st(*fpu_stack_ptr as i32, result)
 }
 
 pub unsafe fn fpu_fsincos() {
@@ -877,3 +951,228 @@ pub unsafe fn fpu_fincstp() {
     *fpu_stack_ptr = *fpu_stack_ptr + 1 & 7;
     *fpu_status_word &= !FPU_C1
 }
+
+#[cfg(test)]
+mod tests {
+    use cpu::fpu::{fpu_native_arith, FPU_CW_DOUBLE_NEAREST, FPU_CW_SINGLE_NEAREST};
+    use softfloat::{Precision, RoundingMode, F80};
+
+    fn check(control_word: u16, x: F80, y: F80, op: usize) -> bool {
+        let native = match op {
+            0 => fpu_native_arith(control_word, x, y, |x, y| x + y, |x, y| x + y),
+            1 => fpu_native_arith(control_word, x, y, |x, y| x - y, |x, y| x - y),
+            2 => fpu_native_arith(control_word, x, y, |x, y| x * y, |x, y| x * y),
+            3 => fpu_native_arith(control_word, x, y, |x, y| x / y, |x, y| x / y),
+            _ => fpu_native_arith(control_word, x, x, |x, _| x.sqrt(), |x, _| x.sqrt()),
+        };
+        let native = match native {
+            Some(native) => native,
+            None => return false,
+        };
+        F80::set_rounding_mode(RoundingMode::NearEven);
+        F80::set_precision(if control_word == FPU_CW_DOUBLE_NEAREST {
+            Precision::P64
+        }
+        else {
+            Precision::P32
+        });
+        F80::clear_exception_flags();
+        let soft = match op {
+            0 => x + y,
+            1 => x - y,
+            2 => x * y,
+            3 => x / y,
+            _ => x.sqrt(),
+        };
+        let flags = F80::get_exception_flags();
+        F80::set_precision(Precision::P80);
+        assert!(
+            native.mantissa == soft.mantissa && native.sign_exponent == soft.sign_exponent,
+            "op={} cw={:#x} x={:#x}/{:#x} y={:#x}/{:#x} native={:#x}/{:#x} softfloat={:#x}/{:#x}",
+            op,
+            control_word,
+            x.sign_exponent,
+            x.mantissa,
+            y.sign_exponent,
+            y.mantissa,
+            native.sign_exponent,
+            native.mantissa,
+            soft.sign_exponent,
+            soft.mantissa
+        );
+        assert_eq!(
+            flags, 0,
+            "op={} x={:#x} y={:#x}",
+            op, x.mantissa, y.mantissa
+        );
+        true
+    }
+
+    fn of_f64(x: f64) -> F80 { F80::of_f64_exact(x.to_bits()).unwrap() }
+    fn of_f32(x: f32) -> F80 { F80::of_f32_exact(x.to_bits() as i32).unwrap() }
+
+    #[test]
+    fn native_arith_double() {
+        let min = f64::MIN_POSITIVE;
+        let edges = [
+            // around the smallest normal number
+            (min, min),
+            (min * 1.5, min),
+            (min * 2.0, min),
+            (min * 3.0, min * 2.0),
+            (min * (1.0 + f64::EPSILON), 1.0 - f64::EPSILON / 2.0),
+            // the product is between the largest subnormal number and the smallest normal one:
+            // f64 rounds it up to the smallest normal number, the x87 rounds it down to 53 bits
+            (
+                min * (1.0 + 40265318.0 * f64::EPSILON),
+                1.0 - 40265318.0 * f64::EPSILON,
+            ),
+            (min * 4.0, 0.25),
+            (min * 4.0, 0.2),
+            (min, 0.5),
+            (min, 2.0),
+            // exact cancellation
+            (1.0, 1.0),
+            (1.0, -1.0),
+            (1.0 + f64::EPSILON, 1.0),
+            (-3.5, -3.5),
+            (0.0, 0.0),
+            (-0.0, 0.0),
+            (-0.0, -0.0),
+            (0.0, 5.0),
+            (-0.0, 5.0),
+            // overflow
+            (f64::MAX, f64::MAX),
+            (f64::MAX, 2.0),
+            (f64::MAX, 0.5),
+            (f64::MAX, -f64::MAX),
+            (f64::MAX / 2.0, f64::MAX / 2.0 * (1.0 + f64::EPSILON)),
+            (1e300, 1e-300),
+            // rounding of the 53rd bit
+            (1.0, f64::EPSILON / 2.0),
+            (1.0 + f64::EPSILON, f64::EPSILON / 2.0),
+            (1.0, f64::EPSILON / 2.0 * (1.0 + f64::EPSILON)),
+            (1.0 / 3.0, 3.0),
+            (2.0, 3.0),
+            (f64::INFINITY, 1.0),
+            (f64::NAN, 1.0),
+        ];
+        let mut native = 0;
+        for &(x, y) in edges.iter() {
+            for &(x, y) in [(x, y), (y, x), (-x, y), (x, -y)].iter() {
+                for op in 0..5 {
+                    if x.is_finite() && y.is_finite() {
+                        native += check(FPU_CW_DOUBLE_NEAREST, of_f64(x), of_f64(y), op) as u32;
+                    }
+                    else {
+                        // infinities and NaNs are left to softfloat (fsqrt only uses x)
+                        let uses_native = check(
+                            FPU_CW_DOUBLE_NEAREST,
+                            F80::of_f64(x.to_bits()),
+                            F80::of_f64(y.to_bits()),
+                            op,
+                        );
+                        assert!(!uses_native || op == 4 && x.is_finite());
+                    }
+                }
+            }
+        }
+        assert!(native > 100);
+
+        // operands that need more than 53 bits
+        let x = F80 {
+            mantissa: 0x8000_0000_0000_0401,
+            sign_exponent: 0x3FFF,
+        };
+        assert!(!check(FPU_CW_DOUBLE_NEAREST, x, F80::ONE, 0));
+        // beyond the exponent range of f64
+        let x = F80 {
+            mantissa: 1 << 63,
+            sign_exponent: 0x3FFF + 1024,
+        };
+        assert!(!check(FPU_CW_DOUBLE_NEAREST, x, F80::ONE, 2));
+        // not with other rounding or precision
+        assert!(!check(FPU_CW_DOUBLE_NEAREST | 0x400, F80::ONE, F80::ONE, 0));
+        assert!(!check(0x300, F80::ONE, F80::ONE, 0));
+    }
+
+    #[test]
+    fn native_arith_single() {
+        let min = f32::MIN_POSITIVE;
+        let edges = [
+            (min, min),
+            (min * 1.5, min),
+            (min * 3.0, min * 2.0),
+            (min * (1.0 + f32::EPSILON), 1.0 - f32::EPSILON / 2.0),
+            (
+                min * (1.0 + 1700.0 * f32::EPSILON),
+                1.0 - 1700.0 * f32::EPSILON,
+            ),
+            (min, 0.5),
+            (1.0, 1.0),
+            (1.0 + f32::EPSILON, 1.0),
+            (0.0, 0.0),
+            (-0.0, 0.0),
+            (f32::MAX, f32::MAX),
+            (f32::MAX, 2.0),
+            (1e30, 1e-30),
+            (1.0, f32::EPSILON / 2.0),
+            (1.0 + f32::EPSILON, f32::EPSILON / 2.0),
+            (1.0 / 3.0, 3.0),
+            (16777215.0, 3.0),
+        ];
+        let mut native = 0;
+        for &(x, y) in edges.iter() {
+            for &(x, y) in [(x, y), (y, x), (-x, y), (x, -y)].iter() {
+                for op in 0..5 {
+                    native += check(FPU_CW_SINGLE_NEAREST, of_f32(x), of_f32(y), op) as u32;
+                }
+            }
+        }
+        assert!(native > 50);
+
+        // representable in double, but not in single precision
+        let x = of_f64(1.0 + f64::EPSILON);
+        assert!(!check(FPU_CW_SINGLE_NEAREST, x, F80::ONE, 0));
+    }
+
+    #[test]
+    fn native_arith_random() {
+        let mut state = 0x2545_F491u32;
+        let mut next = move || {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            state
+        };
+        for _ in 0..100000 {
+            let op = next() as usize % 5;
+            // biased exponents near the ends of the range and close to each other
+            let low = next() & 1 == 0;
+            let e = next() % 16;
+            let e2 = if next() & 1 == 0 { e } else { e ^ next() & 7 };
+            let (x_exponent, y_exponent) =
+                if low { (e + 1, e2 + 1) } else { (2046 - e, 2046 - e2) };
+            let x = ((next() as u64) << 32 | next() as u64) & !(0x7FF << 52)
+                | (x_exponent as u64) << 52;
+            let y = ((next() as u64) << 32 | next() as u64) & !(0x7FF << 52)
+                | (y_exponent as u64) << 52;
+            check(
+                FPU_CW_DOUBLE_NEAREST,
+                of_f64(f64::from_bits(x)),
+                of_f64(f64::from_bits(y)),
+                op,
+            );
+
+            let (x_exponent, y_exponent) = if low { (e + 1, e2 + 1) } else { (254 - e, 254 - e2) };
+            let x = next() & !(0xFF << 23) | x_exponent << 23;
+            let y = next() & !(0xFF << 23) | y_exponent << 23;
+            check(
+                FPU_CW_SINGLE_NEAREST,
+                of_f32(f32::from_bits(x)),
+                of_f32(f32::from_bits(y)),
+                op,
+            );
+        }
+    }
+}
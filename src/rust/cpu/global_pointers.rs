@@ -31,11 +31,14 @@ pub const cpl: *mut u8 = 612 as *mut u8;
 pub const in_hlt: *mut bool = 616 as *mut bool;
 pub const last_virt_eip: *mut i32 = 620 as *mut i32;
 pub const eip_phys: *mut i32 = 624 as *mut i32;
+pub const jit_exit_site: *mut u32 = 628 as *mut u32;
+pub const jit_chain_depth: *mut u32 = 632 as *mut u32;
 
 pub const sysenter_cs: *mut i32 = 636 as *mut i32;
 pub const sysenter_esp: *mut i32 = 640 as *mut i32;
 pub const sysenter_eip: *mut i32 = 644 as *mut i32;
 pub const prefixes: *mut u8 = 648 as *mut u8;
+pub const jit_chained_instructions: *mut u32 = 652 as *mut u32;
 pub const instruction_counter: *mut u32 = 664 as *mut u32;
 pub const sreg: *mut u16 = 668 as *mut u16;
 pub const dreg: *mut i32 = 684 as *mut i32;
@@ -61,6 +64,7 @@ pub const fpu_ip: *mut i32 = 1048 as *mut i32;
 pub const fpu_ip_selector: *mut i32 = 1052 as *mut i32;
 pub const fpu_dp: *mut i32 = 1056 as *mut i32;
 pub const fpu_dp_selector: *mut i32 = 1060 as *mut i32;
+pub const efer: *mut i32 = 1064 as *mut i32;
 pub const tss_size_32: *mut bool = 1128 as *mut bool;
 
 pub const sse_scratch_register: *mut reg128 = 1136 as *mut reg128;
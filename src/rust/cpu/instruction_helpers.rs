@@ -12,7 +12,7 @@ macro_rules! SAFE_READ_WRITE8 {
         }
         else {
             if !can_skip_dirty_page {
-                ::jit::jit_dirty_page(::jit::get_jit_state(), Page::page_of(phys_addr));
+                ::jit::jit_dirty_cache_small(phys_addr, phys_addr + 1);
             }
             else {
                 dbg_assert!(!::jit::jit_page_has_code(Page::page_of(phys_addr as u32)));
@@ -43,7 +43,7 @@ macro_rules! SAFE_READ_WRITE16 {
             }
             else {
                 if !can_skip_dirty_page {
-                    ::jit::jit_dirty_page(::jit::get_jit_state(), Page::page_of(phys_addr));
+                    ::jit::jit_dirty_cache_small(phys_addr, phys_addr + 2);
                 }
                 else {
                     dbg_assert!(!::jit::jit_page_has_code(Page::page_of(phys_addr as u32)));
@@ -77,7 +77,7 @@ macro_rules! SAFE_READ_WRITE32 {
             }
             else {
                 if !can_skip_dirty_page {
-                    ::jit::jit_dirty_page(::jit::get_jit_state(), Page::page_of(phys_addr));
+                    ::jit::jit_dirty_cache_small(phys_addr, phys_addr + 4);
                 }
                 else {
                     dbg_assert!(!::jit::jit_page_has_code(Page::page_of(phys_addr as u32)));
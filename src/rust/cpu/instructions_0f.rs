@@ -783,10 +783,15 @@ pub unsafe fn instr_0F22(r: i32, creg: i32) {
             if false {
                 dbg_log!("cr3 <- {:x}", data);
             }
-            data &= !0b111111100111;
-            dbg_assert!(data & 0xFFF == 0, "TODO");
-            *cr.offset(3) = data;
-            clear_tlb();
+            if 0 != *cr.offset(4) & CR4_PAE {
+                // 32-byte aligned page directory pointer table
+                data &= !0b11111;
+            }
+            else {
+                data &= !0b111111100111;
+                dbg_assert!(data & 0xFFF == 0, "TODO");
+            }
+            set_cr3(data);
         },
         4 => {
             dbg_log!("cr4 <- {:x}", *cr.offset(4));
@@ -798,12 +803,11 @@ pub unsafe fn instr_0F22(r: i32, creg: i32) {
                 return;
             }
             else {
-                if 0 != (*cr.offset(4) ^ data) & (CR4_PGE | CR4_PSE) {
-                    full_clear_tlb();
-                }
+                let old_cr4 = *cr.offset(4);
                 *cr.offset(4) = data;
-                if 0 != *cr.offset(4) & CR4_PAE {
-                    dbg_assert!(false, "PAE is not supported");
+                if 0 != (old_cr4 ^ data) & (CR4_PGE | CR4_PSE | CR4_PAE) {
+                    // also reloads the page directory pointers when PAE is enabled
+                    full_clear_tlb();
                 }
             }
         },
@@ -1227,6 +1231,19 @@ pub unsafe fn instr_0F30() {
     else if index == IA32_PAT {
         //
     }
+    else if index == IA32_EFER {
+        if low & !IA32_EFER_NXE != 0 || high != 0 {
+            dbg_log!("trigger_gp: Unsupported efer bit");
+            trigger_gp(0);
+            return;
+        }
+        let old_efer = *efer;
+        *efer = low;
+        if (old_efer ^ low) & IA32_EFER_NXE != 0 {
+            // the no-execute bits of the page tables are cached in the tlb
+            full_clear_tlb();
+        }
+    }
     else {
         dbg_log!("Unknown msr: {:x}", index);
         dbg_assert!(false);
@@ -1316,6 +1333,9 @@ pub unsafe fn instr_0F32() {
     }
     else if index == MSR_PKG_C2_RESIDENCY {
     }
+    else if index == IA32_EFER {
+        low = *efer
+    }
     else {
         dbg_log!("Unknown msr: {:x}", index);
         dbg_assert!(false);
@@ -3177,7 +3197,7 @@ pub unsafe fn instr_0FA2() {
                 ecx |= 1 << 31
             }; // hypervisor
             edx = (if true /* have fpu */ { 1 } else {  0 }) |      // fpu
-                    vme | 1 << 3 | 1 << 4 | 1 << 5 |   // vme, pse, tsc, msr
+                    vme | 1 << 3 | 1 << 4 | 1 << 5 | 1 << 6 | // vme, pse, tsc, msr, pae
                     1 << 8 | 1 << 11 | 1 << 13 | 1 << 15 | // cx8, sep, pge, cmov
                     1 << 23 | 1 << 24 | 1 << 25 | 1 << 26; // mmx, fxsr, sse1, sse2
 
@@ -3238,10 +3258,14 @@ pub unsafe fn instr_0FA2() {
 
         0x80000000 => {
             // maximum supported extended level
-            eax = 5;
+            eax = 0x80000001u32 as i32;
             // other registers are reserved
         },
 
+        0x80000001 => {
+            edx = 1 << 20; // nx
+        },
+
         0x40000000 => {
             // hypervisor
             if ::config::VMWARE_HYPERVISOR_PORT {
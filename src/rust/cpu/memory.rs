@@ -8,34 +8,440 @@ extern "C" {
     pub fn mmap_write32(addr: u32, value: i32);
     pub fn mmap_write64(addr: u32, v0: i32, v1: i32);
     pub fn mmap_write128(addr: u32, v0: i32, v1: i32, v2: i32, v3: i32);
+
+    fn materialize_page(page: u32);
 }
 
 use cpu::cpu::reg128;
 use cpu::global_pointers::memory_size;
-use page::Page;
 use std::alloc;
+use std::collections::hash_map::Entry;
+use std::collections::HashMap;
 use std::ptr;
+use std::slice;
 
 #[allow(non_upper_case_globals)]
 pub static mut mem8: *mut u8 = ptr::null_mut();
 
+/// Returns 0 if the memory can't be allocated
 #[no_mangle]
 pub fn allocate_memory(size: u32) -> u32 {
     unsafe {
         dbg_assert!(mem8.is_null())
     };
     dbg_log!("Allocate memory size={}m", size >> 20);
-    let layout = alloc::Layout::from_size_align(size as usize, 0x1000).unwrap();
-    let ptr = unsafe { alloc::alloc(layout) as u32 };
+    let ptr = allocate_guest_pages(size);
     unsafe {
         mem8 = ptr as *mut u8;
     };
     ptr
 }
 
+/// Guest memory doesn't come from the heap, but is appended to the wasm memory, so that the
+/// allocator neither has to find (and keep) a contiguous block of up to 3 GiB nor adds its
+/// alignment overhead. The heap keeps growing behind it.
+#[cfg(target_arch = "wasm32")]
+fn allocate_guest_pages(size: u32) -> u32 {
+    const WASM_PAGE_SIZE: usize = 0x10000;
+    let pages = (size as usize + WASM_PAGE_SIZE - 1) / WASM_PAGE_SIZE;
+    let previous_pages = std::arch::wasm32::memory_grow(0, pages);
+    if previous_pages == usize::MAX {
+        return 0;
+    }
+    (previous_pages * WASM_PAGE_SIZE) as u32
+}
+
+#[cfg(not(target_arch = "wasm32"))]
+fn allocate_guest_pages(size: u32) -> u32 {
+    let layout = alloc::Layout::from_size_align(size as usize, 0x1000).unwrap();
+    unsafe { alloc::alloc(layout) as u32 }
+}
+
 #[no_mangle]
 pub unsafe fn zero_memory(size: u32) { ptr::write_bytes(mem8, 0, size as usize); }
 
+// Lazily restored memory: Pages whose bit is set still have to be copied in from the memory image
+// of a saved state (see set_lazy_memory in cpu.js). Every access to physical memory either goes
+// through a tlb entry, which is only created by do_page_walk, or through one of the functions
+// below that check for mapped memory, so these are the only places that need to materialize
+// pages.
+const PAGE_BITMAP_WORDS: usize = 0x100000 / 32;
+#[allow(non_upper_case_globals)]
+static mut lazy_pages: [u32; PAGE_BITMAP_WORDS] = [0; PAGE_BITMAP_WORDS];
+#[allow(non_upper_case_globals)]
+static mut lazy_page_count: u32 = 0;
+// All pages below this one have been materialized, see materialize_next_pages
+#[allow(non_upper_case_globals)]
+static mut lazy_fill_next: u32 = 0;
+
+#[no_mangle]
+pub unsafe fn set_all_pages_lazy() {
+    let page_count = *memory_size >> 12;
+    for i in 0..PAGE_BITMAP_WORDS {
+        let first_page = (i * 32) as u32;
+        lazy_pages[i] = if first_page + 32 <= page_count {
+            !0
+        }
+        else if first_page < page_count {
+            (1 << (page_count - first_page)) - 1
+        }
+        else {
+            0
+        };
+    }
+    lazy_page_count = page_count;
+    lazy_fill_next = 0;
+}
+
+#[no_mangle]
+pub unsafe fn clear_lazy_pages() {
+    for i in 0..PAGE_BITMAP_WORDS {
+        lazy_pages[i] = 0;
+    }
+    lazy_page_count = 0;
+    lazy_fill_next = 0;
+}
+
+/// Copy in all remaining pages, for example before the memory is saved
+#[no_mangle]
+pub unsafe fn materialize_all_pages() {
+    materialize_next_pages(!0);
+    dbg_assert!(lazy_page_count == 0);
+}
+
+/// Copy in up to `count` of the remaining pages, in order of their address, so that the memory
+/// image of the state can eventually be dropped (see fill_lazy_memory in cpu.js). Returns the
+/// number of pages that are still lazy
+#[no_mangle]
+pub unsafe fn materialize_next_pages(count: u32) -> u32 {
+    let page_count = *memory_size >> 12;
+    let mut done = 0;
+    while done < count && lazy_page_count != 0 && lazy_fill_next < page_count {
+        let page = lazy_fill_next;
+        let word = lazy_pages[(page >> 5) as usize];
+        if word == 0 {
+            lazy_fill_next = (page | 31) + 1;
+            continue;
+        }
+        if word & 1 << (page & 31) != 0 {
+            materialize_slow(page);
+            done += 1;
+        }
+        lazy_fill_next = page + 1;
+    }
+    lazy_page_count
+}
+
+#[no_mangle]
+pub fn materialize_range(start: u32, length: u32) {
+    if length == 0 {
+        return;
+    }
+    for page in start >> 12..=(start + length - 1) >> 12 {
+        materialize(page);
+    }
+}
+
+#[inline(always)]
+pub fn materialize(page: u32) {
+    unsafe {
+        if lazy_page_count != 0 {
+            materialize_slow(page)
+        }
+    }
+}
+
+#[cold]
+unsafe fn materialize_slow(page: u32) {
+    let word = (page >> 5) as usize;
+    let bit = 1 << (page & 31);
+    if lazy_pages[word] & bit != 0 {
+        lazy_pages[word] &= !bit;
+        lazy_page_count -= 1;
+        materialize_page(page);
+    }
+}
+
+// Pages written since the last call to clear_dirty_pages, for incremental states (see pack_memory
+// in cpu.js). Like lazy pages, these are marked by do_page_walk when it creates a writable tlb
+// entry, and by the functions below for writes that don't go through the tlb. While tracking is
+// enabled, a page that isn't dirty only gets read-only tlb entries, so that the first write to it
+// takes the slow path. Tracking is off until the first incremental state is saved, so that other
+// guests don't pay for the extra page walks.
+#[allow(non_upper_case_globals)]
+static mut dirty_pages: [u32; PAGE_BITMAP_WORDS] = [0; PAGE_BITMAP_WORDS];
+#[allow(non_upper_case_globals)]
+pub static mut dirty_page_tracking: bool = false;
+
+#[no_mangle]
+pub unsafe fn get_dirty_pages_bitmap() -> u32 { ptr::addr_of!(dirty_pages) as u32 }
+
+#[no_mangle]
+pub unsafe fn set_dirty_page_tracking(enabled: bool) {
+    dirty_page_tracking = enabled;
+    clear_dirty_pages();
+}
+
+#[no_mangle]
+pub unsafe fn clear_dirty_pages() {
+    if !dirty_page_tracking {
+        return;
+    }
+    for i in 0..PAGE_BITMAP_WORDS {
+        dirty_pages[i] = 0;
+    }
+    ::cpu::cpu::tlb_clear_write_access();
+}
+
+#[inline(always)]
+pub fn is_dirty(page: u32) -> bool {
+    unsafe { dirty_pages[(page >> 5) as usize] & 1 << (page & 31) != 0 }
+}
+
+#[inline(always)]
+pub fn mark_dirty(page: u32) {
+    unsafe {
+        dirty_pages[(page >> 5) as usize] |= 1 << (page & 31);
+    }
+}
+
+#[no_mangle]
+pub fn mark_dirty_range(start: u32, length: u32) {
+    if length == 0 {
+        return;
+    }
+    for page in start >> 12..=(start + length - 1) >> 12 {
+        mark_dirty(page);
+    }
+}
+
+// Result of pack_memory_scan, one entry per page: -1 for pages that are zero, the page itself for
+// pages whose contents have to be saved, or an earlier page with the same contents
+#[allow(non_upper_case_globals)]
+static mut pack_table: Vec<i32> = Vec::new();
+
+/// Classify the pages of guest memory for pack_memory in cpu.js, returns a pointer to pack_table,
+/// which stays valid until pack_memory_scan_free
+#[no_mangle]
+pub unsafe fn pack_memory_scan() -> u32 {
+    let memory = slice::from_raw_parts(mem8, *memory_size as usize);
+    let table = &mut *ptr::addr_of_mut!(pack_table);
+    *table = pack_pages(memory);
+    table.as_ptr() as u32
+}
+
+#[no_mangle]
+pub unsafe fn pack_memory_scan_free() { *ptr::addr_of_mut!(pack_table) = Vec::new(); }
+
+/// The pack_table entries of the pages of memory, which must be 8-byte aligned
+fn pack_pages(memory: &[u8]) -> Vec<i32> {
+    dbg_assert!(memory.as_ptr() as usize & 7 == 0);
+    let page_count = (memory.len() >> 12) as u32;
+    let mut table = Vec::with_capacity(page_count as usize);
+
+    // hash of the contents -> first page with these contents, other pages with the same hash
+    // aren't deduplicated
+    let mut first_page_by_hash: HashMap<u64, u32> = HashMap::new();
+
+    let page_contents = |page: u32| &memory[(page << 12) as usize..((page + 1) << 12) as usize];
+
+    for page in 0..page_count {
+        let contents = page_contents(page);
+        let entry = if unsafe { is_zero_page(contents.as_ptr()) } {
+            -1
+        }
+        else {
+            let hash = unsafe { hash_page(contents.as_ptr()) };
+            let first_page = match first_page_by_hash.entry(hash) {
+                Entry::Vacant(e) => *e.insert(page),
+                Entry::Occupied(e) => {
+                    if page_contents(*e.get()) == contents { *e.get() } else { page }
+                },
+            };
+            first_page as i32
+        };
+        table.push(entry);
+    }
+
+    table
+}
+
+#[cfg(all(target_arch = "wasm32", target_feature = "simd128"))]
+unsafe fn is_zero_page(page: *const u8) -> bool {
+    use std::arch::wasm32::*;
+    let page = page as *const v128;
+    // check 256 bytes at a time, most non-zero pages are rejected in the first block
+    for block in 0..16 {
+        let mut acc = v128_load(page.add(block * 16));
+        for i in 1..16 {
+            acc = v128_or(acc, v128_load(page.add(block * 16 + i)));
+        }
+        if v128_any_true(acc) {
+            return false;
+        }
+    }
+    true
+}
+
+#[cfg(not(all(target_arch = "wasm32", target_feature = "simd128")))]
+unsafe fn is_zero_page(page: *const u8) -> bool {
+    let page = page as *const u64;
+    for block in 0..16 {
+        let mut acc = 0;
+        for i in 0..32 {
+            acc |= *page.add(block * 32 + i);
+        }
+        if acc != 0 {
+            return false;
+        }
+    }
+    true
+}
+
+// Two interleaved streams of 64-bit words, so that both versions compute the same hash
+const PAGE_HASH_MUL: u64 = 0x9E37_79B9_7F4A_7C15;
+const PAGE_HASH_SEED: u64 = 0x2545_F491_4F6C_DD1D;
+
+#[cfg(all(target_arch = "wasm32", target_feature = "simd128"))]
+unsafe fn hash_page(page: *const u8) -> u64 {
+    use std::arch::wasm32::*;
+    let page = page as *const v128;
+    let mul = u64x2_splat(PAGE_HASH_MUL);
+    let mut acc = u64x2_splat(PAGE_HASH_SEED);
+    for i in 0..256 {
+        acc = i64x2_mul(v128_xor(acc, v128_load(page.add(i))), mul);
+        acc = v128_or(i64x2_shl(acc, 31), u64x2_shr(acc, 33));
+    }
+    u64x2_extract_lane::<0>(acc) ^ u64x2_extract_lane::<1>(acc).rotate_left(32)
+}
+
+#[cfg(not(all(target_arch = "wasm32", target_feature = "simd128")))]
+unsafe fn hash_page(page: *const u8) -> u64 {
+    let page = page as *const u64;
+    let mut acc = [PAGE_HASH_SEED; 2];
+    for i in 0..512 {
+        let lane = &mut acc[i & 1];
+        *lane = (*lane ^ *page.add(i))
+            .wrapping_mul(PAGE_HASH_MUL)
+            .rotate_left(31);
+    }
+    acc[0] ^ acc[1].rotate_left(32)
+}
+
+// Search kernels for rep scasb and rep cmpsb: Index of the first of the `count` bytes at `a` that
+// is equal (if `stop_on_equal`) or not equal to the byte at the same index of `b`, or to `value`
+// if `b` is null. Returns `count` if there is none
+#[cfg(not(all(target_arch = "wasm32", target_feature = "simd128")))]
+use self::find_byte_u64 as find_byte;
+#[cfg(all(target_arch = "wasm32", target_feature = "simd128"))]
+use self::find_byte_v128 as find_byte;
+
+#[cfg(all(target_arch = "wasm32", target_feature = "simd128"))]
+unsafe fn find_byte_v128(
+    a: *const u8,
+    b: *const u8,
+    value: u8,
+    count: u32,
+    stop_on_equal: bool,
+) -> u32 {
+    use std::arch::wasm32::*;
+    let splat = u8x16_splat(value);
+    let mut i = 0;
+    while i + 16 <= count {
+        let x = v128_load(a.add(i as usize) as *const v128);
+        let y = if b.is_null() { splat } else { v128_load(b.add(i as usize) as *const v128) };
+        let mut mask = i8x16_bitmask(i8x16_eq(x, y)) as u32;
+        if !stop_on_equal {
+            mask ^= 0xFFFF;
+        }
+        if mask != 0 {
+            return i + mask.trailing_zeros();
+        }
+        i += 16;
+    }
+    find_byte_tail(a, b, value, i, count, stop_on_equal)
+}
+
+// also compiled for the tests of builds with simd128, which compare both kernels
+#[cfg(any(test, not(all(target_arch = "wasm32", target_feature = "simd128"))))]
+unsafe fn find_byte_u64(
+    a: *const u8,
+    b: *const u8,
+    value: u8,
+    count: u32,
+    stop_on_equal: bool,
+) -> u32 {
+    const LOW_BITS: u64 = 0x0101_0101_0101_0101;
+    const HIGH_BITS: u64 = 0x8080_8080_8080_8080;
+    let splat = value as u64 * LOW_BITS;
+    let mut i = 0;
+    while i + 8 <= count {
+        let y =
+            if b.is_null() { splat } else { ptr::read_unaligned(b.add(i as usize) as *const u64) };
+        // zero where the bytes are equal
+        let x = ptr::read_unaligned(a.add(i as usize) as *const u64) ^ y;
+        // the lowest byte marked by the zero byte test is always correct, others may not be
+        let mask = if stop_on_equal { x.wrapping_sub(LOW_BITS) & !x & HIGH_BITS } else { x };
+        if mask != 0 {
+            return i + mask.trailing_zeros() / 8;
+        }
+        i += 8;
+    }
+    find_byte_tail(a, b, value, i, count, stop_on_equal)
+}
+
+#[inline(always)]
+unsafe fn find_byte_tail(
+    a: *const u8,
+    b: *const u8,
+    value: u8,
+    mut i: u32,
+    count: u32,
+    stop_on_equal: bool,
+) -> u32 {
+    while i < count {
+        let y = if b.is_null() { value } else { *b.add(i as usize) };
+        if (*a.add(i as usize) == y) == stop_on_equal {
+            return i;
+        }
+        i += 1;
+    }
+    count
+}
+
+/// Index of the first of the `count` bytes at `addr` that is equal (if `stop_on_equal`) or not
+/// equal to `value`, or `count` if there is none
+pub unsafe fn find_byte_no_mmap_check(
+    addr: u32,
+    value: u8,
+    count: u32,
+    stop_on_equal: bool,
+) -> u32 {
+    find_byte(
+        mem8.add(addr as usize),
+        ptr::null(),
+        value,
+        count,
+        stop_on_equal,
+    )
+}
+
+/// Like find_byte_no_mmap_check, but compares the bytes at `addr1` with those at `addr2`
+pub unsafe fn find_byte_pair_no_mmap_check(
+    addr1: u32,
+    addr2: u32,
+    count: u32,
+    stop_on_equal: bool,
+) -> u32 {
+    find_byte(
+        mem8.add(addr1 as usize),
+        mem8.add(addr2 as usize),
+        0,
+        count,
+        stop_on_equal,
+    )
+}
+
 #[no_mangle]
 pub fn in_mapped_range(addr: u32) -> bool {
     return addr >= 0xA0000 && addr < 0xC0000 || addr >= unsafe { *memory_size };
@@ -47,10 +453,11 @@ pub fn read8(addr: u32) -> i32 {
         return unsafe { mmap_read8(addr) };
     }
     else {
+        materialize(addr >> 12);
         return read8_no_mmap_check(addr);
     };
 }
-pub fn read8_no_mmap_check(addr: u32) -> i32 { unsafe { *mem8.offset(addr as isize) as i32 } }
+pub fn read8_no_mmap_check(addr: u32) -> i32 { unsafe { *mem8.add(addr as usize) as i32 } }
 
 #[no_mangle]
 pub fn read16(addr: u32) -> i32 {
@@ -58,11 +465,12 @@ pub fn read16(addr: u32) -> i32 {
         return unsafe { mmap_read16(addr) };
     }
     else {
+        materialize(addr >> 12);
         return read16_no_mmap_check(addr);
     };
 }
 pub fn read16_no_mmap_check(addr: u32) -> i32 {
-    unsafe { *(mem8.offset(addr as isize) as *mut u16) as i32 }
+    unsafe { *(mem8.add(addr as usize) as *mut u16) as i32 }
 }
 
 #[no_mangle]
@@ -71,19 +479,19 @@ pub fn read32s(addr: u32) -> i32 {
         return unsafe { mmap_read32(addr) };
     }
     else {
+        materialize(addr >> 12);
         return read32_no_mmap_check(addr);
     };
 }
-pub fn read32_no_mmap_check(addr: u32) -> i32 {
-    unsafe { *(mem8.offset(addr as isize) as *mut i32) }
-}
+pub fn read32_no_mmap_check(addr: u32) -> i32 { unsafe { *(mem8.add(addr as usize) as *mut i32) } }
 
 pub unsafe fn read64s(addr: u32) -> i64 {
     if in_mapped_range(addr) {
         return mmap_read32(addr) as i64 | (mmap_read32(addr.wrapping_add(4 as u32)) as i64) << 32;
     }
     else {
-        return *(mem8.offset(addr as isize) as *mut i64);
+        materialize(addr >> 12);
+        return *(mem8.add(addr as usize) as *mut i64);
     };
 }
 
@@ -93,7 +501,8 @@ pub unsafe fn read_aligned32(addr: u32) -> i32 {
         return mmap_read32(addr << 2);
     }
     else {
-        return *(mem8 as *mut i32).offset(addr as isize);
+        materialize(addr >> 10);
+        return *(mem8 as *mut i32).add(addr as usize);
     };
 }
 
@@ -108,8 +517,9 @@ pub unsafe fn read128(addr: u32) -> reg128 {
         value.i32_0[3] = mmap_read32(addr.wrapping_add(12 as u32))
     }
     else {
-        value.i64_0[0] = *(mem8.offset(addr as isize) as *mut i64);
-        value.i64_0[1] = *(mem8.offset(addr as isize).offset(8) as *mut i64)
+        materialize(addr >> 12);
+        value.i64_0[0] = *(mem8.add(addr as usize) as *mut i64);
+        value.i64_0[1] = *(mem8.add(addr as usize + 8) as *mut i64)
     }
     return value;
 }
@@ -119,13 +529,15 @@ pub unsafe fn write8(addr: u32, value: i32) {
         mmap_write8(addr, value);
     }
     else {
-        ::jit::jit_dirty_page(::jit::get_jit_state(), Page::page_of(addr));
+        materialize(addr >> 12);
+        mark_dirty(addr >> 12);
+        ::jit::jit_dirty_cache_small(addr, addr + 1);
         write8_no_mmap_or_dirty_check(addr, value);
     };
 }
 
 pub unsafe fn write8_no_mmap_or_dirty_check(addr: u32, value: i32) {
-    *mem8.offset(addr as isize) = value as u8
+    *mem8.add(addr as usize) = value as u8
 }
 
 #[no_mangle]
@@ -134,12 +546,14 @@ pub unsafe fn write16(addr: u32, value: i32) {
         mmap_write16(addr, value);
     }
     else {
+        materialize(addr >> 12);
+        mark_dirty(addr >> 12);
         ::jit::jit_dirty_cache_small(addr, addr.wrapping_add(2 as u32));
         write16_no_mmap_or_dirty_check(addr, value);
     };
 }
 pub unsafe fn write16_no_mmap_or_dirty_check(addr: u32, value: i32) {
-    *(mem8.offset(addr as isize) as *mut u16) = value as u16
+    *(mem8.add(addr as usize) as *mut u16) = value as u16
 }
 
 #[no_mangle]
@@ -148,17 +562,19 @@ pub unsafe fn write32(addr: u32, value: i32) {
         mmap_write32(addr, value);
     }
     else {
+        materialize(addr >> 12);
+        mark_dirty(addr >> 12);
         ::jit::jit_dirty_cache_small(addr, addr.wrapping_add(4 as u32));
         write32_no_mmap_or_dirty_check(addr, value);
     };
 }
 
 pub unsafe fn write32_no_mmap_or_dirty_check(addr: u32, value: i32) {
-    *(mem8.offset(addr as isize) as *mut i32) = value
+    *(mem8.add(addr as usize) as *mut i32) = value
 }
 
 pub unsafe fn write_aligned32_no_mmap_or_dirty_check(addr: u32, value: i32) {
-    *(mem8 as *mut i32).offset(addr as isize) = value
+    *(mem8 as *mut i32).add(addr as usize) = value
 }
 
 pub unsafe fn write_aligned32(addr: u32, value: i32) {
@@ -168,28 +584,298 @@ pub unsafe fn write_aligned32(addr: u32, value: i32) {
         mmap_write32(phys_addr, value);
     }
     else {
+        materialize(phys_addr >> 12);
+        mark_dirty(phys_addr >> 12);
         ::jit::jit_dirty_cache_small(phys_addr, phys_addr.wrapping_add(4 as u32));
         write_aligned32_no_mmap_or_dirty_check(addr, value);
     };
 }
 
 pub unsafe fn write64_no_mmap_or_dirty_check(addr: u32, value: u64) {
-    *(mem8.offset(addr as isize) as *mut u64) = value
+    *(mem8.add(addr as usize) as *mut u64) = value
 }
 
 pub unsafe fn write128_no_mmap_or_dirty_check(addr: u32, value: reg128) {
-    *(mem8.offset(addr as isize) as *mut reg128) = value
+    *(mem8.add(addr as usize) as *mut reg128) = value
 }
 
 pub unsafe fn memset_no_mmap_or_dirty_check(addr: u32, value: u8, count: u32) {
-    ptr::write_bytes(mem8.offset(addr as isize), value, count as usize);
+    ptr::write_bytes(mem8.add(addr as usize), value, count as usize);
 }
 
 pub unsafe fn memcpy_no_mmap_or_dirty_check(src_addr: u32, dst_addr: u32, count: u32) {
     dbg_assert!(u32::max(src_addr, dst_addr) - u32::min(src_addr, dst_addr) >= count);
     ptr::copy_nonoverlapping(
-        mem8.offset(src_addr as isize),
-        mem8.offset(dst_addr as isize),
+        mem8.add(src_addr as usize),
+        mem8.add(dst_addr as usize),
         count as usize,
     )
 }
+
+#[cfg(test)]
+mod tests {
+    use cpu::memory::{
+        find_byte, find_byte_tail, find_byte_u64, hash_page, is_zero_page, pack_pages,
+        PAGE_HASH_MUL, PAGE_HASH_SEED,
+    };
+    use std::ptr;
+
+    /// 8-byte aligned, like guest memory
+    fn memory(pages: usize) -> Vec<u64> { vec![0; pages << 9] }
+
+    fn bytes(memory: &mut Vec<u64>) -> &mut [u8] {
+        unsafe { std::slice::from_raw_parts_mut(memory.as_mut_ptr() as *mut u8, memory.len() * 8) }
+    }
+
+    fn fill_random(page: &mut [u8], seed: u32) {
+        let mut x = seed;
+        for byte in page.iter_mut() {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            *byte = x as u8;
+        }
+    }
+
+    #[test]
+    fn zero_pages() {
+        let mut memory = memory(1);
+        let page = bytes(&mut memory);
+        assert!(unsafe { is_zero_page(page.as_ptr()) });
+        // the first and last byte of each block that is checked at once
+        for &offset in &[0, 1, 255, 256, 2047, 2048, 3840, 4095] {
+            page[offset] = 0x80;
+            assert!(!unsafe { is_zero_page(page.as_ptr()) }, "offset {}", offset);
+            page[offset] = 0;
+        }
+    }
+
+    #[test]
+    fn hash_page_definition() {
+        // Both versions of hash_page must compute this, as the simd version can only be tested
+        // in wasm
+        fn reference(page: &[u8]) -> u64 {
+            let mut even = PAGE_HASH_SEED;
+            let mut odd = PAGE_HASH_SEED;
+            for (i, word) in page.chunks(8).enumerate() {
+                let word = u64::from_le_bytes([
+                    word[0], word[1], word[2], word[3], word[4], word[5], word[6], word[7],
+                ]);
+                let lane = if i % 2 == 0 { &mut even } else { &mut odd };
+                *lane = (*lane ^ word).wrapping_mul(PAGE_HASH_MUL).rotate_left(31);
+            }
+            even ^ odd.rotate_left(32)
+        }
+
+        let mut memory = memory(1);
+        let page = bytes(&mut memory);
+        let zero_hash = unsafe { hash_page(page.as_ptr()) };
+        assert_eq!(zero_hash, reference(page));
+        for seed in 1..10 {
+            fill_random(page, seed);
+            let hash = unsafe { hash_page(page.as_ptr()) };
+            assert_eq!(hash, reference(page));
+            assert_ne!(hash, zero_hash);
+            // swapping two words of different lanes changes the hash
+            page.swap(0, 8);
+            assert_ne!(unsafe { hash_page(page.as_ptr()) }, hash);
+        }
+    }
+
+    #[test]
+    fn pack_zero_and_duplicate_pages() {
+        let mut memory = memory(9);
+        let memory = bytes(&mut memory);
+        for &(page, seed) in &[(1, 1), (3, 1), (4, 2), (5, 1), (6, 2), (7, 1)] {
+            fill_random(&mut memory[page << 12..(page + 1) << 12], seed);
+        }
+        // differs from page 1 in its last byte
+        memory[5 << 12 | 4095] ^= 1;
+        // zero except for its last byte
+        memory[8 << 12 | 4095] = 1;
+        assert_eq!(pack_pages(memory), [-1, 1, -1, 1, 4, 5, 4, 1, 8]);
+        assert_eq!(pack_pages(&memory[..0]), []);
+    }
+
+    fn find_byte_naive(a: &[u8], b: Option<&[u8]>, value: u8, stop_on_equal: bool) -> u32 {
+        for i in 0..a.len() {
+            let y = match b {
+                Some(b) => b[i],
+                None => value,
+            };
+            if (a[i] == y) == stop_on_equal {
+                return i as u32;
+            }
+        }
+        a.len() as u32
+    }
+
+    fn check(a: &[u8], b: Option<&[u8]>, value: u8, stop_on_equal: bool) {
+        let expected = find_byte_naive(a, b, value, stop_on_equal);
+        let b_ptr = match b {
+            Some(b) => b.as_ptr(),
+            None => ptr::null(),
+        };
+        let count = a.len() as u32;
+        let result = unsafe { find_byte(a.as_ptr(), b_ptr, value, count, stop_on_equal) };
+        assert_eq!(
+            result, expected,
+            "{:?} {:?} {:#x} {}",
+            a, b, value, stop_on_equal
+        );
+        // the same as find_byte, except in builds with simd128, where find_byte is the v128 kernel
+        let result = unsafe { find_byte_u64(a.as_ptr(), b_ptr, value, count, stop_on_equal) };
+        assert_eq!(
+            result, expected,
+            "{:?} {:?} {:#x} {}",
+            a, b, value, stop_on_equal
+        );
+        let result = unsafe { find_byte_tail(a.as_ptr(), b_ptr, value, 0, count, stop_on_equal) };
+        assert_eq!(
+            result, expected,
+            "{:?} {:?} {:#x} {}",
+            a, b, value, stop_on_equal
+        );
+    }
+
+    // Differences to the searched byte that may cause borrows and carries in the chunked search
+    const DELTAS: [u8; 6] = [0x01, 0x7F, 0x80, 0x81, 0xFE, 0xFF];
+
+    #[test]
+    fn find_byte_each_offset() {
+        let mut buffer = [0u8; 64 + 16];
+        let mut other = [0u8; 64 + 16];
+        for &value in [0x00u8, 0x01, 0x80, 0xFF, 0x5A].iter() {
+            for &delta in DELTAS.iter() {
+                for &stop_on_equal in [true, false].iter() {
+                    // the bytes that don't stop the search, and the one that does
+                    let (filler, stop) =
+                        if stop_on_equal { (value ^ delta, value) } else { (value, value ^ delta) };
+                    for len in 0..=48 {
+                        // unaligned starts, so that matches cross the 8- and 16-byte chunks
+                        for start in [0, 1, 7, 15].iter().cloned() {
+                            let a = &mut buffer[start..start + len];
+                            for x in a.iter_mut() {
+                                *x = filler;
+                            }
+                            check(a, None, value, stop_on_equal);
+                            for position in 0..len {
+                                a[position] = stop;
+                                check(a, None, value, stop_on_equal);
+                                // later matches don't change the result
+                                for later in position + 1..len {
+                                    a[later] = stop;
+                                    check(a, None, value, stop_on_equal);
+                                    a[later] = filler;
+                                }
+                                a[position] = filler;
+                            }
+
+                            let b = &mut other[start..start + len];
+                            for (i, (x, y)) in a.iter_mut().zip(b.iter_mut()).enumerate() {
+                                *y = value.wrapping_add(i as u8);
+                                *x = if stop_on_equal { *y ^ delta } else { *y };
+                            }
+                            check(a, Some(b), 0, stop_on_equal);
+                            for position in 0..len {
+                                let saved = a[position];
+                                a[position] =
+                                    if stop_on_equal { b[position] } else { b[position] ^ delta };
+                                check(a, Some(b), 0, stop_on_equal);
+                                a[position] = saved;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn find_byte_borrow() {
+        // A matching byte followed by bytes one above it: The zero byte test marks the byte
+        // after it too, only the lowest mark may be used
+        check(&[0x01, 0x00], None, 0, true);
+        check(&[0x00, 0x01], None, 0, true);
+        for &value in [0x00u8, 0x01, 0x80, 0xFF].iter() {
+            for position in 0..24 {
+                let mut a = [value.wrapping_add(1); 24];
+                a[position] = value;
+                for i in 0..position {
+                    a[i] = value ^ 0x80;
+                }
+                check(&a, None, value, true);
+                check(&a, None, value, false);
+                let b = [value; 24];
+                check(&a, Some(&b), 0, true);
+                check(&a, Some(&b), 0, false);
+            }
+        }
+    }
+
+    #[test]
+    fn find_byte_lanes_and_page_tail() {
+        let mut memory = memory(1);
+        let page = bytes(&mut memory);
+        let mut other = [0u8; 4096];
+        for (i, y) in other.iter_mut().enumerate() {
+            *y = (i * 7) as u8;
+        }
+        for &value in [0x00u8, 0x80, 0xFF].iter() {
+            for &delta in [0x01u8, 0x80, 0xFF].iter() {
+                for &stop_on_equal in [true, false].iter() {
+                    let (filler, stop) =
+                        if stop_on_equal { (value ^ delta, value) } else { (value, value ^ delta) };
+                    let mut check_at = |start: usize, position: usize| {
+                        for x in page.iter_mut() {
+                            *x = filler;
+                        }
+                        page[position] = stop;
+                        check(&page[start..], None, value, stop_on_equal);
+
+                        // differs from b except at the position if stop_on_equal, and vice versa
+                        for (x, y) in page.iter_mut().zip(other.iter()) {
+                            *x = if stop_on_equal { *y ^ delta } else { *y };
+                        }
+                        page[position] ^= delta;
+                        check(&page[start..], Some(&other[start..]), 0, stop_on_equal);
+                    };
+                    // each offset of a 16-byte lane, from each alignment of the start
+                    for start in 0..16 {
+                        for position in start..start + 32 {
+                            check_at(start, position);
+                        }
+                    }
+                    // the last lane of the page and the bytes after the last complete lane
+                    for &start in [0, 1, 8, 15].iter() {
+                        for position in 4096 - 33..4096 {
+                            check_at(start, position);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    #[test]
+    fn find_byte_random() {
+        let mut state = 0x1234_5678u32;
+        let mut next = move || {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            state
+        };
+        for _ in 0..20000 {
+            let len = (next() % 80) as usize;
+            let value = next() as u8;
+            let stop_on_equal = next() & 1 == 0;
+            let a: Vec<u8> = (0..len)
+                .map(|_| value ^ DELTAS[next() as usize % 6] & next() as u8)
+                .collect();
+            let b: Vec<u8> = (0..len).map(|i| a[i] ^ (next() % 4 == 0) as u8).collect();
+            check(&a, None, value, stop_on_equal);
+            check(&a, Some(&b), 0, stop_on_equal);
+        }
+    }
+}
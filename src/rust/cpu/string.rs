@@ -14,16 +14,21 @@ use cpu::cpu::{
     get_seg, io_port_read8, io_port_read16, io_port_read32, io_port_write8, io_port_write16,
     io_port_write32, read_reg16, read_reg32, safe_read8, safe_read16, safe_read32s, safe_write8,
     safe_write16, safe_write32, set_reg_asize, test_privileges_for_io, translate_address_read,
-    translate_address_write_and_can_skip_dirty, writable_or_pagefault, write_reg8, write_reg16,
-    write_reg32, AL, AX, DX, EAX, ECX, EDI, ES, ESI, FLAG_DIRECTION,
+    translate_address_read_no_fault, translate_address_write_and_can_skip_dirty,
+    translate_address_write_and_can_skip_dirty_no_fault, writable_or_pagefault, write_reg8,
+    write_reg16, write_reg32, AL, AX, DX, EAX, ECX, EDI, ES, ESI, FLAG_DIRECTION,
 };
 use cpu::global_pointers::{flags, instruction_pointer, previous_ip};
 use cpu::memory::{
-    in_mapped_range, memcpy_no_mmap_or_dirty_check, memset_no_mmap_or_dirty_check,
-    read8_no_mmap_check, read16_no_mmap_check, read32_no_mmap_check, write8_no_mmap_or_dirty_check,
+    find_byte_no_mmap_check, find_byte_pair_no_mmap_check, in_mapped_range,
+    memcpy_no_mmap_or_dirty_check, memset_no_mmap_or_dirty_check, read8_no_mmap_check,
+    read16_no_mmap_check, read32_no_mmap_check, write8_no_mmap_or_dirty_check,
     write16_no_mmap_or_dirty_check, write32_no_mmap_or_dirty_check,
 };
-use page::Page;
+
+// Upper bound for the number of bytes copied by one invocation of rep movs or rep stos, after
+// which the instruction is restarted, so that interrupts are still handled in time
+const REP_BULK_MAX_BYTES: u32 = 0x100000;
 
 fn count_until_end_of_page(direction: i32, size: i32, addr: u32) -> u32 {
     (if direction == 1 {
@@ -184,7 +189,37 @@ unsafe fn string_instruction(
         }
     }
 
-    if rep_fast {
+    let is_bulk = match instruction {
+        Instruction::Movs | Instruction::Stos => true,
+        _ => false,
+    };
+
+    if rep_fast && is_bulk {
+        let done = rep_movs_stos_bulk(
+            instruction,
+            size_bytes,
+            direction,
+            data & size_mask,
+            ds + src,
+            es + dst,
+            phys_src,
+            phys_dst,
+            skip_dirty_page,
+            count,
+        );
+        dbg_assert!(done > 0 && done <= count);
+        count -= done;
+
+        if count != 0 {
+            // go back to the current instruction, the remaining pages couldn't be translated
+            // without faulting (or the limit per invocation has been reached)
+            *instruction_pointer = *previous_ip;
+        }
+
+        src += done as i32 * increment;
+        dst += done as i32 * increment;
+    }
+    else if rep_fast {
         let count_until_end_of_page = u32::min(
             count,
             match instruction {
@@ -203,12 +238,53 @@ unsafe fn string_instruction(
         dbg_assert!(count_until_end_of_page > 0);
 
         if !skip_dirty_page {
-            ::jit::jit_dirty_page(::jit::get_jit_state(), Page::page_of(phys_dst));
+            let length = count_until_end_of_page * size_bytes as u32;
+            if direction == 1 {
+                ::jit::jit_dirty_cache_small(phys_dst, phys_dst + length);
+            }
+            else {
+                ::jit::jit_dirty_cache_small(
+                    phys_dst + size_bytes as u32 - length,
+                    phys_dst + size_bytes as u32,
+                );
+            }
         }
 
         let mut rep_cmp_finished = false;
 
         let mut i = 0;
+
+        if size == Size::B && direction == 1 {
+            // Skip the bytes that don't end the loop in bulk, the byte that does (or the last one
+            // on this page) is handled below, which also sets the flags
+            let stop_on_equal = match rep {
+                Rep::NZ => true,
+                Rep::Z | Rep::None => false,
+            };
+            match instruction {
+                Instruction::Scas => {
+                    i = find_byte_no_mmap_check(
+                        phys_dst,
+                        data as u8,
+                        count_until_end_of_page - 1,
+                        stop_on_equal,
+                    );
+                    phys_dst += i;
+                },
+                Instruction::Cmps => {
+                    i = find_byte_pair_no_mmap_check(
+                        phys_src,
+                        phys_dst,
+                        count_until_end_of_page - 1,
+                        stop_on_equal,
+                    );
+                    phys_src += i;
+                    phys_dst += i;
+                },
+                _ => {},
+            }
+        }
+
         while i < count_until_end_of_page {
             i += 1;
 
@@ -251,34 +327,9 @@ unsafe fn string_instruction(
                     Size::W => write16_no_mmap_or_dirty_check(phys_dst, src_val),
                     Size::D => write32_no_mmap_or_dirty_check(phys_dst, src_val),
                 },
-                Instruction::Movs => {
-                    if direction == -1 {
-                        phys_src -= (count_until_end_of_page - 1) * size_bytes as u32;
-                        phys_dst -= (count_until_end_of_page - 1) * size_bytes as u32;
-                    }
-                    memcpy_no_mmap_or_dirty_check(
-                        phys_src,
-                        phys_dst,
-                        count_until_end_of_page * size_bytes as u32,
-                    );
-                    i = count_until_end_of_page;
-                    break;
-                },
-                Instruction::Stos => match size {
-                    Size::B => {
-                        if direction == -1 {
-                            phys_dst -= count_until_end_of_page - 1
-                        }
-                        memset_no_mmap_or_dirty_check(
-                            phys_dst,
-                            src_val as u8,
-                            count_until_end_of_page,
-                        );
-                        i = count_until_end_of_page;
-                        break;
-                    },
-                    Size::W => write16_no_mmap_or_dirty_check(phys_dst, src_val),
-                    Size::D => write32_no_mmap_or_dirty_check(phys_dst, src_val),
+                Instruction::Movs | Instruction::Stos => {
+                    // handled by rep_movs_stos_bulk
+                    dbg_assert!(false);
                 },
             };
 
@@ -458,6 +509,208 @@ unsafe fn string_instruction(
     }
 }
 
+/// rep movs and rep stos: Process as many elements as possible across page boundaries, with one
+/// memcpy or memset per run of physically contiguous pages. The first page has been translated by
+/// the caller (and may have faulted there), the following ones are translated without faulting.
+/// Stops in front of the first page that would fault, is in the mapped range or overlaps the
+/// source, so that the restarted instruction handles it. Returns the number of elements processed
+#[inline(always)]
+unsafe fn rep_movs_stos_bulk(
+    instruction: Instruction,
+    size_bytes: i32,
+    direction: i32,
+    data: i32,
+    mut src_addr: i32,
+    mut dst_addr: i32,
+    mut phys_src: u32,
+    mut phys_dst: u32,
+    skip_dirty_page: bool,
+    count: u32,
+) -> u32 {
+    let is_movs = match instruction {
+        Instruction::Movs => true,
+        _ => false,
+    };
+    let increment = direction * size_bytes;
+    let count = u32::min(count, REP_BULK_MAX_BYTES / size_bytes as u32);
+
+    let mut done = 0;
+
+    // The current span starts at element `done`, phys_src and phys_dst point to the element
+    // following it
+    let mut span_src = phys_src;
+    let mut span_dst = phys_dst;
+    let mut span_count = 0;
+    let mut span_skip_dirty = skip_dirty_page;
+
+    loop {
+        let mut chunk = u32::min(
+            count - done - span_count,
+            count_until_end_of_page(direction, size_bytes, phys_dst),
+        );
+        if is_movs {
+            chunk = u32::min(
+                chunk,
+                count_until_end_of_page(direction, size_bytes, phys_src),
+            );
+        }
+        let chunk_bytes = (chunk as i32).wrapping_mul(increment);
+
+        span_count += chunk;
+        phys_dst = phys_dst.wrapping_add(chunk_bytes as u32);
+        dst_addr = dst_addr.wrapping_add(chunk_bytes);
+        if is_movs {
+            phys_src = phys_src.wrapping_add(chunk_bytes as u32);
+            src_addr = src_addr.wrapping_add(chunk_bytes);
+        }
+
+        if done + span_count == count {
+            break;
+        }
+
+        if !span_skip_dirty {
+            // Pages with code or page tables are written before translating the next page, so
+            // that the translation sees their new contents
+            rep_movs_stos_span(
+                instruction,
+                size_bytes,
+                direction,
+                data,
+                span_src,
+                span_dst,
+                span_count,
+                false,
+            );
+            done += span_count;
+            span_count = 0;
+        }
+
+        let (next_dst, next_skip_dirty) =
+            match translate_address_write_and_can_skip_dirty_no_fault(dst_addr) {
+                Some((addr, skip)) if !in_mapped_range(addr) => (addr, skip),
+                _ => break,
+            };
+        let next_src = if is_movs {
+            match translate_address_read_no_fault(src_addr) {
+                Some(addr) if !in_mapped_range(addr) => addr,
+                _ => break,
+            }
+        }
+        else {
+            0
+        };
+
+        if span_count != 0 && next_dst == phys_dst && next_src == phys_src && next_skip_dirty {
+            continue;
+        }
+
+        if span_count != 0 {
+            rep_movs_stos_span(
+                instruction,
+                size_bytes,
+                direction,
+                data,
+                span_src,
+                span_dst,
+                span_count,
+                true,
+            );
+            done += span_count;
+            span_count = 0;
+        }
+
+        if is_movs {
+            // like in string_instruction, for the remaining elements
+            let overlap = u32::max(next_src, next_dst) - u32::min(next_src, next_dst)
+                < (count - done) * size_bytes as u32;
+            if overlap {
+                break;
+            }
+        }
+
+        phys_src = next_src;
+        phys_dst = next_dst;
+        span_src = next_src;
+        span_dst = next_dst;
+        span_skip_dirty = next_skip_dirty;
+    }
+
+    if span_count != 0 {
+        rep_movs_stos_span(
+            instruction,
+            size_bytes,
+            direction,
+            data,
+            span_src,
+            span_dst,
+            span_count,
+            span_skip_dirty,
+        );
+        done += span_count;
+    }
+
+    done
+}
+
+/// Copy or fill `count` elements starting at the physical addresses `phys_src` and `phys_dst`,
+/// which don't cross any mapped memory
+#[inline(always)]
+unsafe fn rep_movs_stos_span(
+    instruction: Instruction,
+    size_bytes: i32,
+    direction: i32,
+    data: i32,
+    phys_src: u32,
+    phys_dst: u32,
+    count: u32,
+    skip_dirty_page: bool,
+) {
+    let length = count * size_bytes as u32;
+    let (low_src, low_dst) = if direction == 1 {
+        (phys_src, phys_dst)
+    }
+    else {
+        (
+            (phys_src + size_bytes as u32).wrapping_sub(length),
+            phys_dst + size_bytes as u32 - length,
+        )
+    };
+
+    if !skip_dirty_page {
+        ::jit::jit_dirty_cache(low_dst, low_dst + length);
+    }
+
+    match instruction {
+        Instruction::Movs => memcpy_no_mmap_or_dirty_check(low_src, low_dst, length),
+        Instruction::Stos => {
+            let byte = data & 0xFF;
+            let is_byte_pattern = match size_bytes {
+                1 => true,
+                2 => data == byte * 0x0101,
+                _ => data == (byte as u32).wrapping_mul(0x01010101) as i32,
+            };
+            if is_byte_pattern {
+                memset_no_mmap_or_dirty_check(low_dst, byte as u8, length);
+            }
+            else {
+                let mut addr = low_dst;
+                while addr < low_dst + length {
+                    if size_bytes == 2 {
+                        write16_no_mmap_or_dirty_check(addr, data);
+                    }
+                    else {
+                        write32_no_mmap_or_dirty_check(addr, data);
+                    }
+                    addr += size_bytes as u32;
+                }
+            }
+        },
+        _ => {
+            dbg_assert!(false);
+        },
+    }
+}
+
 #[no_mangle]
 pub unsafe fn movsb_rep(is_asize_32: bool, ds: i32) {
     string_instruction(is_asize_32, ds, Instruction::Movs, Size::B, Rep::Z)
@@ -1,5 +1,6 @@
 pub mod interpreter;
 pub mod interpreter0f;
+pub mod interpreter_decoded;
 
 pub mod jit;
 pub mod jit0f;
@@ -0,0 +1,294 @@
+// Pre-decoded blocks of instructions for the interpreter
+//
+// Code of pages that the interpreter runs often (see JIT_THRESHOLD_DECODE), but that isn't hot
+// enough to be compiled yet, is decoded once into blocks of DecodedInstruction: The length and the
+// operands of each instruction and the index of a handler that runs it without reading the
+// instruction stream (see gen/generate_interpreter.js). Running a block skips the reads of the
+// immediates and the nested dispatch on opcode, prefixes and modrm byte of the interpreter.
+//
+// Blocks are cached by physical address and removed by jit_dirty_chunks together with the
+// compiled code of the chunks they were decoded from. Only instructions without prefixes are
+// decoded, everything else is left to the interpreter.
+
+use cpu::cpu::{jit_block_boundary, tlb_set_has_code};
+use cpu::global_pointers::{instruction_counter, instruction_pointer, prefixes, previous_ip};
+use cpu_context::CpuContext;
+use gen::interpreter_decoded;
+use jit::{chunks_of_range, is_near_end_of_page};
+use modrm::ModrmByte;
+use page::Page;
+use profiler;
+use profiler::stat;
+use state_flags::CachedStateFlags;
+
+use std::collections::HashMap;
+use std::rc::Rc;
+
+// Blocks end after this many instructions even without a block boundary
+const MAX_BLOCK_INSTRUCTIONS: usize = 64;
+
+// All blocks are dropped when this many blocks or decoded instructions are cached (see
+// jit_get_decoded_block). Blocks have between 0 and MAX_BLOCK_INSTRUCTIONS instructions, so the
+// number of blocks alone doesn't bound the memory used
+const MAX_BLOCKS: usize = 0x4000;
+const MAX_INSTRUCTIONS: usize = 0x20000;
+
+pub enum DecodeResult {
+    Unsupported,
+    Next,
+    // The interpreter stops after this instruction (see after_block_boundary) or the next
+    // instruction isn't reached
+    BlockEnd,
+}
+
+#[derive(Clone, Copy, Default)]
+pub struct DecodedInstruction {
+    pub handler: u16,
+    pub length: u8,
+    pub modrm_byte: u8,
+    pub imm: i32,
+    pub imm2: i32,
+    pub modrm: ModrmByte,
+}
+
+pub struct DecodedBlock {
+    is_32: bool,
+    // Empty if the first instruction can't be decoded, so that it's not decoded again
+    instructions: Vec<DecodedInstruction>,
+}
+impl DecodedBlock {
+    pub fn is_empty(&self) -> bool { self.instructions.is_empty() }
+}
+
+pub struct DecodedBlocks {
+    blocks: HashMap<u32, Rc<DecodedBlock>>,
+    // The addresses of the blocks of each page, with the 64-byte chunks they were decoded from
+    pages: HashMap<Page, Vec<(u32, u64)>>,
+    // Total number of instructions of all blocks
+    instruction_count: usize,
+}
+
+impl DecodedBlocks {
+    pub fn new() -> DecodedBlocks {
+        DecodedBlocks {
+            blocks: HashMap::new(),
+            pages: HashMap::new(),
+            instruction_count: 0,
+        }
+    }
+
+    /// The block at this address, decoding it if it isn't cached for the current code size
+    pub fn get(&mut self, phys_addr: u32, state_flags: CachedStateFlags) -> Rc<DecodedBlock> {
+        if let Some(block) = self.lookup(phys_addr, state_flags.is_32()) {
+            return block;
+        }
+
+        let (block, chunks) = decode_block(phys_addr, state_flags);
+        let page = Page::page_of(phys_addr);
+        if !self.pages.contains_key(&page) {
+            tlb_set_has_code(page, true);
+        }
+        self.insert(phys_addr, block, chunks)
+    }
+
+    fn lookup(&self, phys_addr: u32, is_32: bool) -> Option<Rc<DecodedBlock>> {
+        match self.blocks.get(&phys_addr) {
+            Some(block) if block.is_32 == is_32 => Some(block.clone()),
+            _ => None,
+        }
+    }
+
+    /// Add a block, replacing the one at the same address (decoded for the other code size)
+    fn insert(&mut self, phys_addr: u32, block: DecodedBlock, chunks: u64) -> Rc<DecodedBlock> {
+        let block = Rc::new(block);
+        let page_blocks = self
+            .pages
+            .entry(Page::page_of(phys_addr))
+            .or_insert_with(Vec::new);
+        page_blocks.retain(|&(addr, _)| addr != phys_addr);
+        page_blocks.push((phys_addr, chunks));
+        self.instruction_count += block.instructions.len();
+        if let Some(old_block) = self.blocks.insert(phys_addr, block.clone()) {
+            self.instruction_count -= old_block.instructions.len();
+        }
+        block
+    }
+
+    /// Remove the blocks decoded from the given chunks of this page. Returns whether there were any
+    pub fn dirty_chunks(&mut self, page: Page, chunks: u64) -> bool {
+        let page_blocks = match self.pages.get_mut(&page) {
+            Some(page_blocks) => page_blocks,
+            None => return false,
+        };
+        let blocks = &mut self.blocks;
+        let instruction_count = &mut self.instruction_count;
+        let count = page_blocks.len();
+        page_blocks.retain(|&(addr, block_chunks)| {
+            if block_chunks & chunks == 0 {
+                return true;
+            }
+            if let Some(block) = blocks.remove(&addr) {
+                *instruction_count -= block.instructions.len();
+            }
+            false
+        });
+        let removed = page_blocks.len() != count;
+        if page_blocks.is_empty() {
+            self.pages.remove(&page);
+        }
+        removed
+    }
+
+    pub fn is_full(&self) -> bool {
+        self.blocks.len() >= MAX_BLOCKS || self.instruction_count >= MAX_INSTRUCTIONS
+    }
+
+    /// Remove all blocks. Returns the pages that had blocks
+    pub fn clear(&mut self) -> Vec<Page> {
+        self.blocks.clear();
+        self.instruction_count = 0;
+        self.pages.drain().map(|(page, _)| page).collect()
+    }
+
+    pub fn has_page(&self, page: Page) -> bool { self.pages.contains_key(&page) }
+
+    pub fn pages(&self) -> impl Iterator<Item = &Page> { self.pages.keys() }
+}
+
+fn decode_block(phys_addr: u32, state_flags: CachedStateFlags) -> (DecodedBlock, u64) {
+    profiler::stat_increment(stat::DECODE_BLOCK);
+    let is_32 = state_flags.is_32();
+    let mut cpu = CpuContext {
+        eip: phys_addr,
+        prefixes: 0,
+        cs_offset: 0,
+        state_flags,
+    };
+    let mut instructions = Vec::new();
+
+    while instructions.len() < MAX_BLOCK_INSTRUCTIONS && !is_near_end_of_page(cpu.eip) {
+        let start = cpu.eip;
+        let opcode = cpu.read_imm8() as u32 | (is_32 as u32) << 8;
+        let mut instruction = DecodedInstruction::default();
+        let result = interpreter_decoded::decode(opcode, &mut cpu, &mut instruction);
+        if let DecodeResult::Unsupported = result {
+            break;
+        }
+        instruction.length = (cpu.eip - start) as u8;
+        instructions.push(instruction);
+        if let DecodeResult::BlockEnd = result {
+            break;
+        }
+    }
+
+    // the bytes of an unsupported instruction were read too
+    let end = u32::max(cpu.eip, phys_addr + 1);
+    let chunks = chunks_of_range(phys_addr & 0xFFF, end - (phys_addr & !0xFFF));
+    (
+        DecodedBlock {
+            is_32,
+            instructions,
+        },
+        chunks,
+    )
+}
+
+/// Whether the block has been removed from the cache, which holds a reference to each block it
+/// contains, while the caller holds the only other one
+fn is_removed(block: &Rc<DecodedBlock>) -> bool { Rc::strong_count(block) == 1 }
+
+/// Run the instructions of a block from the current instruction pointer, as the interpreter would.
+/// Returns the number of instructions that were run
+pub unsafe fn run_block(block: &Rc<DecodedBlock>) -> u32 {
+    let mut count = 0;
+    for instruction in block.instructions.iter() {
+        let eip = *instruction_pointer;
+        let next_eip = eip + instruction.length as i32;
+        *previous_ip = eip;
+        *instruction_pointer = next_eip;
+        *instruction_counter += 1;
+        count += 1;
+
+        dbg_assert!(*prefixes == 0);
+        interpreter_decoded::run(instruction);
+        dbg_assert!(*prefixes == 0);
+
+        // Stop at jumps, exceptions and block boundaries, and when the instruction wrote to the
+        // block and it was removed from the cache
+        if jit_block_boundary || *instruction_pointer != next_eip || is_removed(block) {
+            break;
+        }
+    }
+    count
+}
+
+#[cfg(test)]
+mod tests {
+    use interpreter_cache::{
+        is_removed, DecodedBlock, DecodedBlocks, DecodedInstruction, MAX_BLOCK_INSTRUCTIONS,
+        MAX_INSTRUCTIONS,
+    };
+    use page::Page;
+
+    fn block(is_32: bool, length: usize) -> DecodedBlock {
+        DecodedBlock {
+            is_32,
+            instructions: vec![DecodedInstruction::default(); length],
+        }
+    }
+
+    #[test]
+    fn code_size() {
+        let mut blocks = DecodedBlocks::new();
+        blocks.insert(0x1000, block(true, 3), 1);
+        assert!(blocks.lookup(0x1000, true).is_some());
+        // decoded again for 16-bit code, which replaces the 32-bit block
+        assert!(blocks.lookup(0x1000, false).is_none());
+        blocks.insert(0x1000, block(false, 5), 1);
+        assert_eq!(blocks.lookup(0x1000, false).unwrap().instructions.len(), 5);
+        assert!(blocks.lookup(0x1000, true).is_none());
+        assert_eq!(blocks.pages[&Page::page_of(0x1000)], [(0x1000, 1)]);
+        assert_eq!(blocks.instruction_count, 5);
+    }
+
+    #[test]
+    fn write_into_running_block() {
+        let mut blocks = DecodedBlocks::new();
+        blocks.insert(0x1000, block(true, 3), 0b11);
+        blocks.insert(0x1080, block(true, 4), 0b100);
+        // held by run_block
+        let running = blocks.lookup(0x1000, true).unwrap();
+        assert!(!is_removed(&running));
+
+        // other chunks and pages don't affect it
+        assert!(!blocks.dirty_chunks(Page::page_of(0x1000), 0b1000));
+        assert!(!blocks.dirty_chunks(Page::page_of(0x2000), 0b11));
+        assert!(!is_removed(&running));
+
+        // a write into its second chunk removes it, so that run_block stops after the instruction
+        assert!(blocks.dirty_chunks(Page::page_of(0x1000), 0b10));
+        assert!(is_removed(&running));
+        assert!(blocks.lookup(0x1000, true).is_none());
+        assert!(blocks.lookup(0x1080, true).is_some());
+        assert!(blocks.has_page(Page::page_of(0x1000)));
+        assert_eq!(blocks.instruction_count, 4);
+
+        assert!(blocks.dirty_chunks(Page::page_of(0x1000), 0b100));
+        assert!(!blocks.has_page(Page::page_of(0x1000)));
+        assert_eq!(blocks.instruction_count, 0);
+    }
+
+    #[test]
+    fn limit_instructions() {
+        let mut blocks = DecodedBlocks::new();
+        let count = MAX_INSTRUCTIONS / MAX_BLOCK_INSTRUCTIONS;
+        for i in 0..count as u32 {
+            assert!(!blocks.is_full());
+            blocks.insert(i << 12, block(true, MAX_BLOCK_INSTRUCTIONS), 1);
+        }
+        assert!(blocks.is_full());
+        assert_eq!(blocks.clear().len(), count);
+        assert!(!blocks.is_full());
+        assert_eq!(blocks.instruction_count, 0);
+    }
+}
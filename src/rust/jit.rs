@@ -2,16 +2,24 @@ use std::collections::{BTreeMap, HashMap, HashSet, VecDeque};
 use std::iter::FromIterator;
 use std::mem;
 use std::ptr::NonNull;
+use std::rc::Rc;
 
 use analysis::AnalysisType;
 use codegen;
 use control_flow;
-use control_flow::WasmStructure;
+use control_flow::{ModuleFunction, WasmStructure};
 use cpu::cpu;
 use cpu::global_pointers;
 use cpu::memory;
 use cpu_context::CpuContext;
+use interpreter_cache::{DecodedBlock, DecodedBlocks};
+use jit_cache::{DispatchTable, EntryCache, EntryPoints, ExitLinks};
+use jit_flags;
+use jit_flags::{FlagLiveness, FlagLocals, LazyFlags};
+use jit_fpu;
 use jit_instructions;
+use jit_profile;
+use jit_profile::ProfiledPage;
 use opstats;
 use page::Page;
 use profiler;
@@ -67,10 +75,26 @@ pub const CHECK_JIT_STATE_INVARIANTS: bool = false;
 
 pub const JIT_USE_LOOP_SAFETY: bool = true;
 
+// Number of instructions after which a page is compiled at the baseline tier, and after which a
+// module of the baseline tier is recompiled at the optimizing tier (see Tier)
+pub const JIT_THRESHOLD_BASELINE: u32 = 20 * 1000;
 pub const JIT_THRESHOLD: u32 = 200 * 1000;
 
+// Number of instructions after which code of a page is run from pre-decoded blocks when it's
+// interpreted (see interpreter_cache)
+pub const JIT_THRESHOLD_DECODE: u32 = 2 * 1000;
+
 pub const MAX_EXTRA_BASIC_BLOCKS: usize = 250;
 
+// Number of modules that may be compiled (instantiated by the browser) at the same time, and number
+// of pages that may wait for compilation while that many modules are being compiled
+pub const MAX_COMPILING_MODULES: usize = 4;
+pub const MAX_QUEUED_COMPILES: usize = 32;
+
+// How many modules may call each other directly through linked exits before returning to the main
+// loop (see ExitLinks)
+pub const MAX_CHAIN_DEPTH: u32 = 8;
+
 const MAX_INSTRUCTION_LENGTH: u32 = 16;
 
 #[allow(non_upper_case_globals)]
@@ -93,6 +117,18 @@ pub fn rust_init() {
     }));
 }
 
+/// Modules are first compiled at the baseline tier, which is cheap to generate: A single page,
+/// no duplication of loops with several entries (see control_flow::loopify) and no linked exits,
+/// so that every run of the module goes through the main loop and is counted towards its
+/// hotness. Modules that stay hot are recompiled at the optimizing tier, which also keeps the lazy
+/// flags in locals across basic blocks (see jit_flags)
+#[derive(Copy, Clone, PartialEq, PartialOrd)]
+pub enum Tier {
+    Baseline,
+    Optimizing,
+}
+
+#[derive(Copy, Clone)]
 pub struct Entry {
     #[cfg(any(debug_assertions, feature = "profiler"))]
     pub len: u32,
@@ -110,34 +146,75 @@ enum PageState {
     CompilingWritten,
 }
 
+/// A page that became hot while MAX_COMPILING_MODULES modules were being compiled, see
+/// jit_compile_from_queue
+struct QueuedCompile {
+    virt_address: i32,
+    phys_address: u32,
+    cs_offset: u32,
+    state_flags: CachedStateFlags,
+    tier: Tier,
+    hotness: u32,
+}
+
 pub struct JitState {
     wasm_builder: WasmBuilder,
 
-    // as an alternative to HashSet, we could use a bitmap of 4096 bits here
-    // (faster, but uses much more memory)
-    // or a compressed bitmap (likely faster)
-    // or HashSet<u32> rather than nested
-    entry_points: HashMap<Page, HashSet<u16>>,
+    entry_points: HashMap<Page, EntryPoints>,
     hot_pages: [u32; HASH_PRIME as usize],
 
     wasm_table_index_free_list: Vec<WasmTableIndex>,
-    used_wasm_table_indices: HashMap<WasmTableIndex, HashSet<Page>>,
-    // All pages from used_wasm_table_indices
+    used_wasm_table_indices: HashMap<WasmTableIndex, Vec<Page>>,
+    // Reverse of used_wasm_table_indices: The modules containing each page, with the 64-byte chunks
+    // of the page that their code was generated from (see jit_dirty_chunks). A page is removed when
+    // its last module is freed
     // Used to improve the performance of jit_dirty_page and jit_page_has_code
-    all_pages: HashSet<Page>,
-    cache: HashMap<u32, Entry>,
-    compiling: Option<(WasmTableIndex, PageState)>,
+    page_modules: HashMap<Page, Vec<(WasmTableIndex, u64)>>,
+    cache: EntryCache<Entry>,
+    // Indexed by wasm table index: The addresses of the cache entries of each module. May contain
+    // addresses whose entry has since been overwritten by another module
+    module_entries: Vec<Vec<u32>>,
+    // Indexed by wasm table index, see DispatchTable
+    dispatch_tables: Vec<DispatchTable>,
+    // Indexed by wasm table index, see ExitLinks
+    exit_links: Vec<ExitLinks>,
+    // For each module, the exit sites (module and site) that are linked to it
+    linked_from: HashMap<WasmTableIndex, Vec<(WasmTableIndex, u16)>>,
+    // Indexed by wasm table index: The tier of each module and the number of instructions run by
+    // modules of the baseline tier
+    module_tiers: Vec<Tier>,
+    module_hotness: Vec<u32>,
+    // The modules that are being compiled, at most MAX_COMPILING_MODULES
+    compiling: HashMap<WasmTableIndex, PageState>,
+    // At most one request per page, at most MAX_QUEUED_COMPILES
+    compile_queue: Vec<QueuedCompile>,
+    // Pages of a loaded profile that haven't been run yet, see jit_profile
+    profile: HashMap<Page, Vec<ProfiledPage>>,
+    // Serialized profile, exchanged with js
+    profile_buffer: Vec<u8>,
+    // Pre-decoded blocks of the interpreter, invalidated together with the code of a page
+    decoded_blocks: DecodedBlocks,
 }
 
 pub fn check_jit_state_invariants(ctx: &mut JitState) {
     if !CHECK_JIT_STATE_INVARIANTS {
         return;
     }
-    let mut all_pages = HashSet::new();
-    for pages in ctx.used_wasm_table_indices.values() {
-        all_pages.extend(pages);
+    let mut page_modules: HashMap<Page, HashSet<WasmTableIndex>> = HashMap::new();
+    for (&wasm_table_index, pages) in &ctx.used_wasm_table_indices {
+        for &page in pages {
+            page_modules
+                .entry(page)
+                .or_insert_with(HashSet::new)
+                .insert(wasm_table_index);
+        }
+    }
+    dbg_assert!(page_modules.len() == ctx.page_modules.len());
+    for (page, modules) in &ctx.page_modules {
+        dbg_assert!(modules.len() == page_modules[page].len());
+        dbg_assert!(modules.iter().all(|(i, _)| page_modules[page].contains(i)));
+        dbg_assert!(modules.iter().all(|&(_, chunks)| chunks != 0));
     }
-    dbg_assert!(ctx.all_pages == all_pages);
 }
 
 impl JitState {
@@ -153,9 +230,19 @@ impl JitState {
 
             wasm_table_index_free_list: Vec::from_iter(wasm_table_indices),
             used_wasm_table_indices: HashMap::new(),
-            all_pages: HashSet::new(),
-            cache: HashMap::new(),
-            compiling: None,
+            page_modules: HashMap::new(),
+            cache: EntryCache::new(),
+            module_entries: (0..WASM_TABLE_SIZE).map(|_| Vec::new()).collect(),
+            dispatch_tables: (0..WASM_TABLE_SIZE).map(|_| DispatchTable::new()).collect(),
+            exit_links: (0..WASM_TABLE_SIZE).map(|_| ExitLinks::new()).collect(),
+            linked_from: HashMap::new(),
+            module_tiers: vec![Tier::Optimizing; WASM_TABLE_SIZE as usize],
+            module_hotness: vec![0; WASM_TABLE_SIZE as usize],
+            compiling: HashMap::new(),
+            compile_queue: Vec::new(),
+            profile: HashMap::new(),
+            profile_buffer: Vec::new(),
+            decoded_blocks: DecodedBlocks::new(),
         }
     }
 }
@@ -234,6 +321,10 @@ pub struct JitContext<'a> {
     pub exit_label: Label,
     pub last_instruction: Instruction,
     pub instruction_counter: WasmLocal,
+    /// Where the current instruction puts the lazy flags it computes
+    pub lazy_flags: LazyFlags,
+    /// None if no instruction of the function keeps its flags in locals
+    pub flag_locals: Option<FlagLocals>,
 }
 impl<'a> JitContext<'a> {
     pub fn reg(&self, i: u32) -> WasmLocal { self.register_locals[i as usize].unsafe_clone() }
@@ -254,7 +345,7 @@ pub fn jit_find_cache_entry(phys_address: u32, state_flags: CachedStateFlags) ->
 
     let ctx = get_jit_state();
 
-    match ctx.cache.get(&phys_address) {
+    match ctx.cache.get(phys_address) {
         Some(entry) => {
             if entry.state_flags == state_flags {
                 return CachedCode {
@@ -272,33 +363,19 @@ pub fn jit_find_cache_entry(phys_address: u32, state_flags: CachedStateFlags) ->
     return CachedCode::NONE;
 }
 
-#[no_mangle]
-pub fn jit_find_cache_entry_in_page(
-    phys_address: u32,
-    wasm_table_index: WasmTableIndex,
-    state_flags: u32,
-) -> i32 {
-    profiler::stat_increment(stat::INDIRECT_JUMP);
-
-    let state_flags = CachedStateFlags::of_u32(state_flags);
-    let ctx = get_jit_state();
-
-    match ctx.cache.get(&phys_address) {
-        Some(entry) => {
-            if entry.state_flags == state_flags && entry.wasm_table_index == wasm_table_index {
-                return entry.initial_state as i32;
-            }
-        },
-        None => {},
+/// Whether the entry at this address is compiled at the given tier or a higher one
+fn is_compiled(ctx: &JitState, phys_address: u32, tier: Tier) -> bool {
+    match ctx.cache.get(phys_address) {
+        Some(entry) => ctx.module_tiers[entry.wasm_table_index.to_u16() as usize] >= tier,
+        None => false,
     }
-
-    profiler::stat_increment(stat::INDIRECT_JUMP_NO_ENTRY);
-
-    return -1;
 }
 
 pub fn record_entry_point(phys_address: u32) {
-    let ctx = get_jit_state();
+    record_entry_point_ctx(get_jit_state(), phys_address)
+}
+
+fn record_entry_point_ctx(ctx: &mut JitState, phys_address: u32) {
     if is_near_end_of_page(phys_address) {
         return;
     }
@@ -309,7 +386,7 @@ pub fn record_entry_point(phys_address: u32) {
         .entry(page)
         .or_insert_with(|| {
             is_new = true;
-            HashSet::new()
+            EntryPoints::new()
         })
         .insert(offset_in_page);
 
@@ -318,18 +395,24 @@ pub fn record_entry_point(phys_address: u32) {
     }
 }
 
-// Maximum number of pages per wasm module. Necessary for the following reasons:
+// Maximum number of pages per wasm module
+const MAX_PAGES: usize = 8;
+
+// Maximum number of pages per wasm function (modules are split into several functions, see
+// control_flow::split_functions). Necessary for the following reasons:
 // - There is an upper limit on the size of a single function in wasm (currently ~7MB in all browsers)
 //   See https://github.com/WebAssembly/design/issues/1138
 // - v8 poorly handles large br_table elements and OOMs on modules much smaller than the above limit
 //   See https://bugs.chromium.org/p/v8/issues/detail?id=9697 and https://bugs.chromium.org/p/v8/issues/detail?id=9141
 //   Will hopefully be fixed in the near future by generating direct control flow
-const MAX_PAGES: usize = 3;
+const MAX_PAGES_PER_FUNCTION: usize = 3;
 
 fn jit_find_basic_blocks(
     ctx: &mut JitState,
     entry_points: HashSet<i32>,
     cpu: CpuContext,
+    tier: Tier,
+    max_pages: usize,
 ) -> Vec<BasicBlock> {
     fn follow_jump(
         virt_target: i32,
@@ -337,6 +420,7 @@ fn jit_find_basic_blocks(
         pages: &mut HashSet<Page>,
         page_blacklist: &mut HashSet<Page>,
         max_pages: usize,
+        tier: Tier,
         marked_as_entry: &mut HashSet<i32>,
         to_visit_stack: &mut Vec<i32>,
     ) -> Option<u32> {
@@ -362,9 +446,8 @@ fn jit_find_basic_blocks(
         if !pages.contains(&phys_page) {
             // page seen for the first time, handle entry points
             if let Some(entry_points) = ctx.entry_points.get(&phys_page) {
-                if entry_points.iter().all(|&entry_point| {
-                    ctx.cache
-                        .contains_key(&(phys_page.to_address() | u32::from(entry_point)))
+                if entry_points.iter().all(|entry_point| {
+                    is_compiled(ctx, phys_page.to_address() | u32::from(entry_point), tier)
                 }) {
                     profiler::stat_increment(stat::COMPILE_PAGE_SKIPPED_NO_NEW_ENTRY_POINTS);
                     page_blacklist.insert(phys_page);
@@ -374,7 +457,7 @@ fn jit_find_basic_blocks(
                 let address_hash = jit_hot_hash_page(phys_page) as usize;
                 ctx.hot_pages[address_hash] = 0;
 
-                for &addr_low in entry_points {
+                for addr_low in entry_points.iter() {
                     let addr = virt_target & !0xFFF | addr_low as i32;
                     to_visit_stack.push(addr);
                     marked_as_entry.insert(addr);
@@ -398,9 +481,6 @@ fn jit_find_basic_blocks(
     let mut pages: HashSet<Page> = HashSet::new();
     let mut page_blacklist = HashSet::new();
 
-    // 16-bit doesn't not work correctly, most likely due to instruction pointer wrap-around
-    let max_pages = if cpu.state_flags.is_32() { MAX_PAGES } else { 1 };
-
     for virt_addr in entry_points {
         let ok = follow_jump(
             virt_addr,
@@ -408,6 +488,7 @@ fn jit_find_basic_blocks(
             &mut pages,
             &mut page_blacklist,
             max_pages,
+            tier,
             &mut marked_as_entry,
             &mut to_visit_stack,
         );
@@ -534,6 +615,7 @@ fn jit_find_basic_blocks(
                             &mut pages,
                             &mut page_blacklist,
                             max_pages,
+                            tier,
                             &mut marked_as_entry,
                             &mut to_visit_stack,
                         ),
@@ -576,6 +658,7 @@ fn jit_find_basic_blocks(
                             &mut pages,
                             &mut page_blacklist,
                             max_pages,
+                            tier,
                             &mut marked_as_entry,
                             &mut to_visit_stack,
                         ),
@@ -684,7 +767,14 @@ pub fn jit_force_generate_unsafe(virt_addr: i32) {
     record_entry_point(phys_addr);
     let cs_offset = cpu::get_seg_cs() as u32;
     let state_flags = cpu::pack_current_state_flags();
-    jit_analyze_and_generate(ctx, virt_addr, phys_addr, cs_offset, state_flags);
+    jit_analyze_and_generate(
+        ctx,
+        virt_addr,
+        phys_addr,
+        cs_offset,
+        state_flags,
+        Tier::Optimizing,
+    );
 }
 
 #[inline(never)]
@@ -694,10 +784,11 @@ fn jit_analyze_and_generate(
     phys_entry_point: u32,
     cs_offset: u32,
     state_flags: CachedStateFlags,
+    tier: Tier,
 ) {
     let page = Page::page_of(phys_entry_point);
 
-    if ctx.compiling.is_some() {
+    if ctx.compiling.len() >= MAX_COMPILING_MODULES {
         return;
     }
 
@@ -708,15 +799,18 @@ fn jit_analyze_and_generate(
         Some(entry_points) => entry_points,
     };
 
-    if entry_points.iter().all(|&entry_point| {
-        ctx.cache
-            .contains_key(&(page.to_address() | u32::from(entry_point)))
-    }) {
+    if entry_points
+        .iter()
+        .all(|entry_point| is_compiled(ctx, page.to_address() | u32::from(entry_point), tier))
+    {
         profiler::stat_increment(stat::COMPILE_SKIPPED_NO_NEW_ENTRY_POINTS);
         return;
     }
 
     profiler::stat_increment(stat::COMPILE);
+    if tier == Tier::Baseline {
+        profiler::stat_increment(stat::COMPILE_BASELINE);
+    }
 
     let cpu = CpuContext {
         eip: 0,
@@ -731,16 +825,43 @@ fn jit_analyze_and_generate(
     let virt_page = Page::page_of(virt_entry_point as u32);
     let entry_points: HashSet<i32> = entry_points
         .iter()
-        .map(|e| virt_page.to_address() as i32 | *e as i32)
+        .map(|e| virt_page.to_address() as i32 | e as i32)
         .collect();
-    let basic_blocks = jit_find_basic_blocks(ctx, entry_points, cpu.clone());
 
-    let mut pages = HashSet::new();
+    // 16-bit doesn't not work correctly, most likely due to instruction pointer wrap-around
+    let mut max_pages =
+        if cpu.state_flags.is_32() && tier == Tier::Optimizing { MAX_PAGES } else { 1 };
+
+    let (basic_blocks, graph, structure) = loop {
+        let basic_blocks =
+            jit_find_basic_blocks(ctx, entry_points.clone(), cpu.clone(), tier, max_pages);
+        let graph = control_flow::make_graph(&basic_blocks);
+        let structure = control_flow::loopify(
+            &graph,
+            if tier == Tier::Optimizing { MAX_EXTRA_BASIC_BLOCKS } else { 0 },
+        );
+
+        // A loop can't be split into several functions. If one spans more pages than fit into a
+        // function, fall back to modules that fit into a single function
+        if max_pages > MAX_PAGES_PER_FUNCTION
+            && control_flow::max_pages_of_element(&structure) > MAX_PAGES_PER_FUNCTION
+        {
+            profiler::stat_increment(stat::COMPILE_LOOP_TOO_LARGE_FOR_FUNCTION);
+            max_pages = MAX_PAGES_PER_FUNCTION;
+            continue;
+        }
+
+        break (basic_blocks, graph, structure);
+    };
+
+    // The chunks of each page that the code was generated from
+    let mut pages: HashMap<Page, u64> = HashMap::new();
 
     for b in basic_blocks.iter() {
         // Remove this assertion once page-crossing jit is enabled
         dbg_assert!(Page::page_of(b.addr) == Page::page_of(b.end_addr));
-        pages.insert(Page::page_of(b.addr));
+        *pages.entry(Page::page_of(b.addr)).or_insert(0) |=
+            chunks_of_range(b.addr & 0xFFF, (b.end_addr - 1 & 0xFFF) + 1);
     }
 
     let print = false;
@@ -795,28 +916,31 @@ fn jit_analyze_and_generate(
         );
     }
 
-    let graph = control_flow::make_graph(&basic_blocks);
-    let mut structure = control_flow::loopify(&graph);
+    let mut functions = control_flow::split_functions(structure, &graph, MAX_PAGES_PER_FUNCTION);
+
+    for function in functions.iter_mut() {
+        let structure = &mut function.structure;
 
-    if print {
-        dbg_log!("before blockify:");
-        for group in &structure {
-            dbg_log!("=> Group");
-            group.print(0);
+        if print {
+            dbg_log!("before blockify:");
+            for group in structure.iter() {
+                dbg_log!("=> Group");
+                group.print(0);
+            }
         }
-    }
 
-    control_flow::blockify(&mut structure, &graph);
+        control_flow::blockify(structure, &graph);
 
-    if cfg!(debug_assertions) {
-        control_flow::assert_invariants(&structure);
-    }
+        if cfg!(debug_assertions) {
+            control_flow::assert_invariants(structure);
+        }
 
-    if print {
-        dbg_log!("after blockify:");
-        for group in &structure {
-            dbg_log!("=> Group");
-            group.print(0);
+        if print {
+            dbg_log!("after blockify:");
+            for group in structure.iter() {
+                dbg_log!("=> Group");
+                group.print(0);
+            }
         }
     }
 
@@ -851,19 +975,30 @@ fn jit_analyze_and_generate(
     dbg_assert!(!pages.is_empty());
     dbg_assert!(pages.len() <= MAX_PAGES);
     ctx.used_wasm_table_indices
-        .insert(wasm_table_index, pages.clone());
-    ctx.all_pages.extend(pages.clone());
+        .insert(wasm_table_index, pages.keys().cloned().collect());
+    for (&p, &chunks) in &pages {
+        ctx.page_modules
+            .entry(p)
+            .or_insert_with(Vec::new)
+            .push((wasm_table_index, chunks));
+    }
+    ctx.module_tiers[wasm_table_index.to_u16() as usize] = tier;
+    ctx.module_hotness[wasm_table_index.to_u16() as usize] = 0;
+    dbg_assert!(ctx.module_entries[wasm_table_index.to_u16() as usize].is_empty());
 
     let basic_block_by_addr: HashMap<u32, BasicBlock> =
         basic_blocks.into_iter().map(|b| (b.addr, b)).collect();
 
     let entries = jit_generate_module(
-        structure,
+        functions,
         &basic_block_by_addr,
         cpu.clone(),
         &mut ctx.wasm_builder,
+        &mut ctx.dispatch_tables[wasm_table_index.to_u16() as usize],
+        &mut ctx.exit_links[wasm_table_index.to_u16() as usize],
         wasm_table_index,
         state_flags,
+        tier,
     );
     dbg_assert!(!entries.is_empty());
 
@@ -873,12 +1008,13 @@ fn jit_analyze_and_generate(
     );
     profiler::stat_increment_by(stat::COMPILE_PAGE, pages.len() as u64);
 
-    for &p in &pages {
+    for &p in pages.keys() {
         cpu::tlb_set_has_code(p, true);
     }
 
-    dbg_assert!(ctx.compiling.is_none());
-    ctx.compiling = Some((wasm_table_index, PageState::Compiling { entries }));
+    ctx.compiling
+        .insert(wasm_table_index, PageState::Compiling { entries });
+    dbg_assert!(ctx.compiling.len() <= MAX_COMPILING_MODULES);
 
     let phys_addr = page.to_address();
 
@@ -903,7 +1039,16 @@ pub fn codegen_finalize_finished(
     state_flags: CachedStateFlags,
 ) {
     let ctx = get_jit_state();
+    codegen_install_module(ctx, wasm_table_index, phys_addr, state_flags);
+    jit_compile_from_queue(ctx);
+}
 
+fn codegen_install_module(
+    ctx: &mut JitState,
+    wasm_table_index: WasmTableIndex,
+    phys_addr: u32,
+    state_flags: CachedStateFlags,
+) {
     dbg_assert!(wasm_table_index != WasmTableIndex(0));
 
     dbg_log!(
@@ -911,28 +1056,24 @@ pub fn codegen_finalize_finished(
         Page::page_of(phys_addr).to_address()
     );
 
-    let entries = match mem::replace(&mut ctx.compiling, None) {
+    let entries = match ctx.compiling.remove(&wasm_table_index) {
         None => {
             dbg_assert!(false);
             return;
         },
-        Some((in_progress_wasm_table_index, PageState::CompilingWritten)) => {
-            dbg_assert!(wasm_table_index == in_progress_wasm_table_index);
-
+        Some(PageState::CompilingWritten) => {
             profiler::stat_increment(stat::INVALIDATE_MODULE_WRITTEN_WHILE_COMPILED);
             free_wasm_table_index(ctx, wasm_table_index);
             return;
         },
-        Some((in_progress_wasm_table_index, PageState::Compiling { entries })) => {
-            dbg_assert!(wasm_table_index == in_progress_wasm_table_index);
-            entries
-        },
+        Some(PageState::Compiling { entries }) => entries,
     };
 
     let mut check_for_unused_wasm_table_index = HashSet::new();
 
     dbg_assert!(!entries.is_empty());
     for (addr, entry) in entries {
+        ctx.module_entries[wasm_table_index.to_u16() as usize].push(addr);
         let maybe_old_entry = ctx.cache.insert(addr, entry);
 
         if let Some(old_entry) = maybe_old_entry {
@@ -946,19 +1087,14 @@ pub fn codegen_finalize_finished(
     }
 
     for index in check_for_unused_wasm_table_index {
-        let pages = ctx.used_wasm_table_indices.get(&index).unwrap();
-
-        let mut is_used = false;
-        'outer: for p in pages {
-            for addr in p.address_range() {
-                if let Some(entry) = ctx.cache.get(&addr) {
-                    if entry.wasm_table_index == index {
-                        is_used = true;
-                        break 'outer;
-                    }
-                }
-            }
-        }
+        let cache = &ctx.cache;
+        let module_entries = &mut ctx.module_entries[index.to_u16() as usize];
+        module_entries.retain(|&addr| {
+            cache
+                .get(addr)
+                .map_or(false, |entry| entry.wasm_table_index == index)
+        });
+        let is_used = !module_entries.is_empty();
 
         if !is_used {
             profiler::stat_increment(stat::INVALIDATE_MODULE_UNUSED_AFTER_OVERWRITE);
@@ -966,13 +1102,13 @@ pub fn codegen_finalize_finished(
         }
 
         if !is_used {
-            for (_, entry) in &ctx.cache {
+            for (_, entry) in ctx.cache.iter() {
                 dbg_assert!(entry.wasm_table_index != index);
             }
         }
         else {
             let mut ok = false;
-            for (_, entry) in &ctx.cache {
+            for (_, entry) in ctx.cache.iter() {
                 if entry.wasm_table_index == index {
                     ok = true;
                     break;
@@ -986,15 +1122,178 @@ pub fn codegen_finalize_finished(
 }
 
 fn jit_generate_module(
-    structure: Vec<WasmStructure>,
+    functions: Vec<ModuleFunction>,
     basic_blocks: &HashMap<u32, BasicBlock>,
     mut cpu: CpuContext,
     builder: &mut WasmBuilder,
+    dispatch_table: &mut DispatchTable,
+    exit_links: &mut ExitLinks,
     wasm_table_index: WasmTableIndex,
     state_flags: CachedStateFlags,
+    tier: Tier,
 ) -> Vec<(u32, Entry)> {
     builder.reset();
 
+    // at most two exit sites per generated basic block (conditional jumps), none for the baseline
+    // tier
+    let generated_basic_blocks = functions
+        .iter()
+        .flat_map(|f| f.structure.iter())
+        .map(|s| s.basic_block_count())
+        .sum::<usize>();
+    exit_links.reset(
+        if tier == Tier::Optimizing { 2 * generated_basic_blocks } else { 0 },
+        state_flags,
+    );
+
+    // The initial states of the module number the module entries of all functions in order,
+    // function i handles those in function_entries[i] (see jit_generate_trampoline)
+    let mut module_entries: Vec<(u32, u16)> = Vec::new();
+    let mut function_entries = Vec::new();
+    let mut cross_function_targets = HashMap::new();
+    for (i, function) in functions.iter().enumerate() {
+        let entries = dispatcher_entries(&function.structure);
+        function_entries.push((
+            module_entries.len().safe_to_u16(),
+            function.module_entry_count.safe_to_u16(),
+        ));
+        for (j, &addr) in entries.iter().enumerate() {
+            if j < function.module_entry_count {
+                module_entries.push((addr, module_entries.len().safe_to_u16()));
+            }
+            cross_function_targets.insert(addr, (i.safe_to_u16(), j as i32));
+        }
+    }
+
+    dispatch_table.fill(&module_entries);
+
+    let function_count = functions.len();
+    for (i, function) in functions.into_iter().enumerate() {
+        profiler::stat_increment(stat::COMPILE_FUNCTION);
+
+        jit_generate_function(
+            function.structure,
+            i.safe_to_u16(),
+            basic_blocks,
+            &mut cpu,
+            builder,
+            dispatch_table,
+            if function_count > 1 { Some(function_entries[i]) } else { None },
+            &cross_function_targets,
+            exit_links,
+            wasm_table_index,
+            tier,
+        );
+
+        if function_count > 1 {
+            builder.finish_function();
+        }
+    }
+
+    if function_count > 1 {
+        jit_generate_trampoline(builder, &function_entries);
+    }
+
+    builder.finish();
+
+    let mut entries = Vec::new();
+
+    for &(addr, initial_state) in module_entries.iter() {
+        let block = basic_blocks.get(&addr).unwrap();
+
+        profiler::stat_increment(stat::COMPILE_ENTRY_POINT);
+
+        dbg_assert!(block.addr < block.end_addr);
+        // Note: We also insert blocks that weren't originally marked as entries here
+        //       This doesn't have any downside, besides making the hash table slightly larger
+
+        let entry = Entry {
+            wasm_table_index,
+            initial_state,
+            state_flags,
+
+            #[cfg(any(debug_assertions, feature = "profiler"))]
+            len: block.end_addr - block.addr,
+
+            #[cfg(debug_assertions)]
+            opcode: memory::read32s(block.addr) as u32,
+        };
+        entries.push((block.addr, entry));
+    }
+
+    for b in basic_blocks.values() {
+        if b.is_entry_block {
+            dbg_assert!(entries.iter().find(|(addr, _)| *addr == b.addr).is_some());
+        }
+    }
+
+    return entries;
+}
+
+/// The entries of the dispatcher at the start of a function
+fn dispatcher_entries(structure: &Vec<WasmStructure>) -> Vec<u32> {
+    let mut nodes = structure;
+    loop {
+        match &nodes[0] {
+            WasmStructure::Dispatcher(e) => return e.clone(),
+            WasmStructure::Loop { .. } => dbg_assert!(false),
+            WasmStructure::BasicBlock(_) => dbg_assert!(false),
+            // Note: We could use these blocks as entry points, which will yield
+            // more entries for free, but it requires adding those to the dispatcher
+            // It's to be investigated if this yields a performance improvement
+            // See also the comment at the bottom of jit_generate_module when creating entry
+            // points
+            WasmStructure::Block(children) => {
+                nodes = children;
+            },
+        }
+    }
+}
+
+/// Generate the exported function of a module with several functions, which calls the function
+/// handling the given initial state
+fn jit_generate_trampoline(builder: &mut WasmBuilder, function_entries: &Vec<(u16, u16)>) {
+    let last = function_entries
+        .iter()
+        .rposition(|&(_, count)| count > 0)
+        .unwrap();
+    for (i, &(first, count)) in function_entries.iter().enumerate() {
+        if count == 0 {
+            continue;
+        }
+        if i != last {
+            builder.get_local(&builder.arg_local_initial_state.unsafe_clone());
+            builder.const_i32((first + count) as i32);
+            builder.ltu_i32();
+            builder.if_void();
+        }
+        builder.get_local(&builder.arg_local_initial_state.unsafe_clone());
+        builder.const_i32(first as i32);
+        builder.sub_i32();
+        builder.call_function(i.safe_to_u16());
+        if i != last {
+            builder.return_();
+            builder.block_end();
+        }
+        else {
+            break;
+        }
+    }
+}
+
+fn jit_generate_function(
+    structure: Vec<WasmStructure>,
+    function: u16,
+    basic_blocks: &HashMap<u32, BasicBlock>,
+    cpu: &mut CpuContext,
+    builder: &mut WasmBuilder,
+    dispatch_table: &DispatchTable,
+    function_entries: Option<(u16, u16)>,
+    cross_function_targets: &HashMap<u32, (u16, i32)>,
+    exit_links: &mut ExitLinks,
+    wasm_table_index: WasmTableIndex,
+    tier: Tier,
+) {
     let mut register_locals = (0..8)
         .map(|i| {
             builder.load_fixed_i32(global_pointers::get_reg32_offset(i));
@@ -1005,6 +1304,14 @@ fn jit_generate_module(
     builder.const_i32(0);
     let instruction_counter = builder.set_new_local();
 
+    let mut function_blocks = Vec::new();
+    for s in structure.iter() {
+        s.basic_blocks(&mut function_blocks);
+    }
+    let flag_liveness = jit_flags::analyze(cpu, basic_blocks, &function_blocks, tier);
+    let flag_locals =
+        if flag_liveness.uses_locals() { Some(FlagLocals::new(builder)) } else { None };
+
     let exit_label = builder.block_void();
     let exit_with_fault_label = builder.block_void();
     let main_loop_label = builder.loop_void();
@@ -1025,7 +1332,7 @@ fn jit_generate_module(
     let brtable_default = builder.block_void();
 
     let ctx = &mut JitContext {
-        cpu: &mut cpu,
+        cpu,
         builder,
         register_locals: &mut register_locals,
         start_of_current_instruction: 0,
@@ -1033,40 +1340,20 @@ fn jit_generate_module(
         exit_label,
         last_instruction: Instruction::Other,
         instruction_counter,
+        lazy_flags: LazyFlags::Memory,
+        flag_locals,
     };
 
-    let entry_blocks = {
-        let mut nodes = &structure;
-        let result;
-        loop {
-            match &nodes[0] {
-                WasmStructure::Dispatcher(e) => {
-                    result = e.clone();
-                    break;
-                },
-                WasmStructure::Loop { .. } => dbg_assert!(false),
-                WasmStructure::BasicBlock(_) => dbg_assert!(false),
-                // Note: We could use these blocks as entry points, which will yield
-                // more entries for free, but it requires adding those to the dispatcher
-                // It's to be investigated if this yields a performance improvement
-                // See also the comment at the bottom of this function when creating entry
-                // points
-                WasmStructure::Block(children) => {
-                    nodes = children;
-                },
-            }
-        }
-        result
-    };
+    let entry_blocks = dispatcher_entries(&structure);
 
     let mut index_for_addr = HashMap::new();
     for (i, &addr) in entry_blocks.iter().enumerate() {
         index_for_addr.insert(addr, i as i32);
     }
-    for b in basic_blocks.values() {
-        if !index_for_addr.contains_key(&b.addr) {
+    for addr in function_blocks {
+        if !index_for_addr.contains_key(&addr) {
             let i = index_for_addr.len();
-            index_for_addr.insert(b.addr, i as i32);
+            index_for_addr.insert(addr, i as i32);
         }
     }
 
@@ -1100,7 +1387,7 @@ fn jit_generate_module(
         match block {
             Work::WasmStructure(WasmStructure::BasicBlock(addr)) => {
                 let block = basic_blocks.get(&addr).unwrap();
-                jit_generate_basic_block(ctx, block);
+                jit_generate_basic_block(ctx, block, &flag_liveness);
 
                 if block.has_sti {
                     match block.ty {
@@ -1164,21 +1451,24 @@ fn jit_generate_module(
                     },
                     BasicBlockType::AbsoluteEip => {
                         // Check if we can stay in this module, if not exit
-                        codegen::gen_get_eip(ctx.builder);
-                        let new_eip = ctx.builder.set_new_local();
-                        codegen::gen_get_phys_eip(ctx, &new_eip);
-                        ctx.builder.free_local(new_eip);
-
-                        ctx.builder.const_i32(wasm_table_index.to_u16() as i32);
-                        ctx.builder.const_i32(state_flags.to_u32() as i32);
-                        ctx.builder.call_fn3_ret("jit_find_cache_entry_in_page");
-                        ctx.builder.tee_local(target_block);
-                        ctx.builder.const_i32(0);
-                        ctx.builder.ge_i32();
-                        // TODO: Could make this unconditional by including exit_label in the main br_table
-                        ctx.builder.br_if(main_loop_label);
+                        let phys_eip = codegen::gen_indirect_jump_dispatch(
+                            ctx,
+                            dispatch_table,
+                            function_entries,
+                            main_loop_label,
+                            target_block,
+                        );
 
                         codegen::gen_debug_track_jit_exit(ctx.builder, block.last_instruction_addr);
+                        if tier == Tier::Optimizing {
+                            codegen::gen_chained_exit(
+                                ctx,
+                                exit_links,
+                                wasm_table_index,
+                                Some(&phys_eip),
+                            );
+                        }
+                        ctx.builder.free_local(phys_eip);
                         ctx.builder.br(ctx.exit_label);
                     },
                     &BasicBlockType::Normal {
@@ -1202,6 +1492,9 @@ fn jit_generate_module(
                         }
 
                         codegen::gen_debug_track_jit_exit(ctx.builder, block.last_instruction_addr);
+                        if tier == Tier::Optimizing {
+                            codegen::gen_chained_exit(ctx, exit_links, wasm_table_index, None);
+                        }
                         codegen::gen_profiler_stat_increment(ctx.builder, stat::DIRECT_EXIT);
                         ctx.builder.br(ctx.exit_label);
                     },
@@ -1275,8 +1568,9 @@ fn jit_generate_module(
                                 );
                             }
                         }
-                        else {
-                            let &(br, target_index) = label_for_addr.get(&next_block_addr).unwrap();
+                        else if let Some(&(br, target_index)) =
+                            label_for_addr.get(&next_block_addr)
+                        {
                             if let Some(target_index) = target_index {
                                 if cfg!(feature = "profiler") {
                                     ctx.builder.const_i32(target_index);
@@ -1297,6 +1591,13 @@ fn jit_generate_module(
                             }
                             ctx.builder.br(br);
                         }
+                        else {
+                            // target is in a later function of this module
+                            let &(target_function, target_index) =
+                                cross_function_targets.get(&next_block_addr).unwrap();
+                            dbg_assert!(target_function > function);
+                            codegen::gen_call_function(ctx, target_function, target_index);
+                        }
                     },
                     &BasicBlockType::ConditionalJump {
                         next_block_addr,
@@ -1342,6 +1643,10 @@ fn jit_generate_module(
                             else {
                                 next_block_addr
                             };
+                            // The flags may still be in locals (see jit_flags) and need to be in
+                            // memory on this edge
+                            let store_flags = jit_flags::in_locals(ctx)
+                                && flag_liveness.needed_at(next_block_addr);
 
                             if let Some(next_block_addr) = next_block_addr {
                                 if Page::page_of(next_block_addr) != Page::page_of(block.addr) {
@@ -1399,6 +1704,10 @@ fn jit_generate_module(
                                     // fallthrough, has to be second
                                     dbg_assert!(!is_first);
 
+                                    if store_flags {
+                                        jit_flags::gen_store_flags(ctx);
+                                    }
+
                                     if next_addr.as_ref().unwrap().len() > 1 {
                                         let target_index =
                                             *index_for_addr.get(&next_block_addr).unwrap();
@@ -1420,9 +1729,9 @@ fn jit_generate_module(
                                         );
                                     }
                                 }
-                                else {
-                                    let &(br, target_index) =
-                                        label_for_addr.get(&next_block_addr).unwrap();
+                                else if let Some(&(br, target_index)) =
+                                    label_for_addr.get(&next_block_addr)
+                                {
                                     if let Some(target_index) = target_index {
                                         if cfg!(feature = "profiler") {
                                             // Note: Currently called unconditionally, even if the
@@ -1435,8 +1744,11 @@ fn jit_generate_module(
                                     }
 
                                     if is_first {
-                                        if cfg!(feature = "profiler") {
+                                        if cfg!(feature = "profiler") || store_flags {
                                             ctx.builder.if_void();
+                                            if store_flags {
+                                                jit_flags::gen_store_flags(ctx);
+                                            }
                                             codegen::gen_profiler_stat_increment(
                                                 ctx.builder,
                                                 if target_index.is_some() {
@@ -1454,6 +1766,9 @@ fn jit_generate_module(
                                         }
                                     }
                                     else {
+                                        if store_flags {
+                                            jit_flags::gen_store_flags(ctx);
+                                        }
                                         codegen::gen_profiler_stat_increment(
                                             ctx.builder,
                                             if target_index.is_some() {
@@ -1466,6 +1781,22 @@ fn jit_generate_module(
                                         ctx.builder.br(br);
                                     }
                                 }
+                                else {
+                                    // target is in a later function of this module
+                                    let &(target_function, target_index) =
+                                        cross_function_targets.get(&next_block_addr).unwrap();
+                                    dbg_assert!(target_function > function);
+                                    if is_first {
+                                        ctx.builder.if_void();
+                                    }
+                                    if store_flags {
+                                        jit_flags::gen_store_flags(ctx);
+                                    }
+                                    codegen::gen_call_function(ctx, target_function, target_index);
+                                    if is_first {
+                                        ctx.builder.block_end();
+                                    }
+                                }
                             }
                             else {
                                 // target is outside of this module, update eip and exit
@@ -1500,6 +1831,17 @@ fn jit_generate_module(
                                     ctx.builder,
                                     block.last_instruction_addr,
                                 );
+                                if store_flags {
+                                    jit_flags::gen_store_flags(ctx);
+                                }
+                                if tier == Tier::Optimizing {
+                                    codegen::gen_chained_exit(
+                                        ctx,
+                                        exit_links,
+                                        wasm_table_index,
+                                        None,
+                                    );
+                                }
                                 codegen::gen_profiler_stat_increment(
                                     ctx.builder,
                                     stat::CONDITIONAL_JUMP_EXIT,
@@ -1522,6 +1864,12 @@ fn jit_generate_module(
                             });
 
                         if branch_not_taken_is_fallthrough && branch_taken_is_fallthrough {
+                            if jit_flags::in_locals(ctx)
+                                && (flag_liveness.needed_at(next_block_addr)
+                                    || flag_liveness.needed_at(next_block_branch_taken_addr))
+                            {
+                                jit_flags::gen_store_flags(ctx);
+                            }
                             dbg_assert!(
                                 Page::page_of(next_block_branch_taken_addr.unwrap())
                                     == Page::page_of(block.addr)
@@ -1735,6 +2083,7 @@ fn jit_generate_module(
     {
         // exit-with-fault case
         ctx.builder.block_end();
+        jit_flags::gen_store_flags_if_in_locals(ctx);
         codegen::gen_move_registers_from_locals_to_memory(ctx);
         codegen::gen_fn0_const(ctx.builder, "trigger_fault_end_jit");
         codegen::gen_update_instruction_counter(ctx);
@@ -1743,6 +2092,7 @@ fn jit_generate_module(
     {
         // exit
         ctx.builder.block_end();
+        jit_flags::gen_store_flags_if_in_locals(ctx);
         codegen::gen_move_registers_from_locals_to_memory(ctx);
         codegen::gen_update_instruction_counter(ctx);
     }
@@ -1752,47 +2102,16 @@ fn jit_generate_module(
     }
     ctx.builder
         .free_local(ctx.instruction_counter.unsafe_clone());
-
-    ctx.builder.finish();
-
-    let mut entries = Vec::new();
-
-    for &addr in entry_blocks.iter() {
-        let block = basic_blocks.get(&addr).unwrap();
-        let index = *index_for_addr.get(&addr).unwrap();
-
-        profiler::stat_increment(stat::COMPILE_ENTRY_POINT);
-
-        dbg_assert!(block.addr < block.end_addr);
-        // Note: We also insert blocks that weren't originally marked as entries here
-        //       This doesn't have any downside, besides making the hash table slightly larger
-
-        let initial_state = index.safe_to_u16();
-
-        let entry = Entry {
-            wasm_table_index,
-            initial_state,
-            state_flags,
-
-            #[cfg(any(debug_assertions, feature = "profiler"))]
-            len: block.end_addr - block.addr,
-
-            #[cfg(debug_assertions)]
-            opcode: memory::read32s(block.addr) as u32,
-        };
-        entries.push((block.addr, entry));
+    if let Some(flag_locals) = &ctx.flag_locals {
+        flag_locals.free(ctx.builder);
     }
-
-    for b in basic_blocks.values() {
-        if b.is_entry_block {
-            dbg_assert!(entries.iter().find(|(addr, _)| *addr == b.addr).is_some());
-        }
-    }
-
-    return entries;
 }
 
-fn jit_generate_basic_block(ctx: &mut JitContext, block: &BasicBlock) {
+fn jit_generate_basic_block(
+    ctx: &mut JitContext,
+    block: &BasicBlock,
+    flag_liveness: &FlagLiveness,
+) {
     let needs_eip_updated = match block.ty {
         BasicBlockType::Exit => true,
         _ => false,
@@ -1817,10 +2136,28 @@ fn jit_generate_basic_block(ctx: &mut JitContext, block: &BasicBlock) {
     ctx.builder.add_i32();
     ctx.builder.set_local(&ctx.instruction_counter);
 
+    let fpu_runs = if ::config::JIT_FPU_STACK_IN_LOCALS {
+        jit_fpu::find_runs(ctx.cpu, block)
+    }
+    else {
+        HashMap::new()
+    };
+
     ctx.cpu.eip = start_addr;
     ctx.last_instruction = Instruction::Other;
+    if let Some(flag_locals) = &mut ctx.flag_locals {
+        flag_locals.current = false;
+    }
 
     loop {
+        if let Some(run) = fpu_runs.get(&ctx.cpu.eip) {
+            // never contains the last instruction of the block
+            ctx.last_instruction = Instruction::Other;
+            jit_fpu::gen_run(ctx, run);
+            dbg_assert!(ctx.cpu.eip == run.end_addr && run.end_addr < stop_addr);
+            continue;
+        }
+
         let mut instruction = 0;
         if cfg!(feature = "profiler") {
             instruction = memory::read32s(ctx.cpu.eip) as u32;
@@ -1849,7 +2186,12 @@ fn jit_generate_basic_block(ctx: &mut JitContext, block: &BasicBlock) {
         ctx.start_of_current_instruction = ctx.cpu.eip;
         let start_eip = ctx.cpu.eip;
         let mut instruction_flags = 0;
+        if flag_liveness.clears_locals(start_eip) {
+            jit_flags::gen_clear_flags_in_locals(ctx);
+        }
+        ctx.lazy_flags = flag_liveness.lazy_flags(start_eip);
         jit_instructions::jit_instruction(ctx, &mut instruction_flags);
+        ctx.lazy_flags = LazyFlags::Memory;
         let end_eip = ctx.cpu.eip;
 
         let instruction_length = end_eip - start_eip;
@@ -1894,15 +2236,47 @@ pub fn jit_increase_hotness_and_maybe_compile(
     let ctx = get_jit_state();
     let page = Page::page_of(phys_address);
     let address_hash = jit_hot_hash_page(page) as usize;
+    if !ctx.profile.is_empty() {
+        jit_apply_profile(ctx, page, state_flags);
+    }
     ctx.hot_pages[address_hash] += hotness;
-    if ctx.hot_pages[address_hash] >= JIT_THRESHOLD {
-        if ctx.compiling.is_some() {
+    if ctx.hot_pages[address_hash] >= JIT_THRESHOLD_BASELINE {
+        if is_compiling(ctx, page) {
             return;
         }
+        let tier = if ctx.hot_pages[address_hash] >= JIT_THRESHOLD {
+            Tier::Optimizing
+        }
+        else if ctx.entry_points.get(&page).map_or(false, |entry_points| {
+            entry_points.iter().any(|entry_point| {
+                is_compiled(
+                    ctx,
+                    page.to_address() | u32::from(entry_point),
+                    Tier::Optimizing,
+                )
+            })
+        }) {
+            // Don't replace optimized code of this page by baseline code, wait until it's hot
+            // enough for the optimizing tier
+            return;
+        }
+        else {
+            Tier::Baseline
+        };
         // only try generating if we're in the correct address space
         if cpu::translate_address_read_no_side_effects(virt_address) == Some(phys_address) {
-            ctx.hot_pages[address_hash] = 0;
-            jit_analyze_and_generate(ctx, virt_address, phys_address, cs_offset, state_flags)
+            let hotness = mem::replace(&mut ctx.hot_pages[address_hash], 0);
+            jit_compile_or_queue(
+                ctx,
+                QueuedCompile {
+                    virt_address,
+                    phys_address,
+                    cs_offset,
+                    state_flags,
+                    tier,
+                    hotness,
+                },
+            )
         }
         else {
             profiler::stat_increment(stat::COMPILE_WRONG_ADDRESS_SPACE);
@@ -1910,28 +2284,286 @@ pub fn jit_increase_hotness_and_maybe_compile(
     };
 }
 
+fn page_contents(page: Page) -> &'static [u8] {
+    dbg_assert!(!memory::in_mapped_range(page.to_address()));
+    memory::materialize(page.to_u32());
+    unsafe { std::slice::from_raw_parts(memory::mem8.add(page.to_address() as usize), 0x1000) }
+}
+
+/// Code runs in this page for the first time since the profile was loaded: If the profile has the
+/// same code, record its entry points and make the page hot enough to be compiled right away
+fn jit_apply_profile(ctx: &mut JitState, page: Page, state_flags: CachedStateFlags) {
+    let profiled_page = match ctx.profile.get_mut(&page) {
+        None => return,
+        Some(profiled_pages) => {
+            let i = match profiled_pages
+                .iter()
+                .position(|p| p.state_flags == state_flags)
+            {
+                None => return,
+                Some(i) => i,
+            };
+            let profiled_page = profiled_pages.swap_remove(i);
+            if profiled_pages.is_empty() {
+                ctx.profile.remove(&page);
+            }
+            profiled_page
+        },
+    };
+
+    if memory::in_mapped_range(page.to_address())
+        || jit_profile::hash_page(page_contents(page)) != profiled_page.hash
+    {
+        profiler::stat_increment(stat::JIT_PROFILE_PAGE_CHANGED);
+        return;
+    }
+
+    profiler::stat_increment(stat::JIT_PROFILE_PAGE_USED);
+    for &offset in &profiled_page.entry_points {
+        record_entry_point_ctx(ctx, page.to_address() | offset as u32);
+    }
+    let address_hash = jit_hot_hash_page(page) as usize;
+    let threshold = match profiled_page.tier {
+        Tier::Baseline => JIT_THRESHOLD_BASELINE,
+        Tier::Optimizing => JIT_THRESHOLD,
+    };
+    ctx.hot_pages[address_hash] = u32::max(ctx.hot_pages[address_hash], threshold);
+}
+
+/// Serialize the pages that have compiled code into the profile buffer, returning its length
+#[no_mangle]
+pub fn jit_profile_save() -> u32 {
+    let ctx = get_jit_state();
+    let mut pages: HashMap<(Page, u8), ProfiledPage> = HashMap::new();
+    for (addr, entry) in ctx.cache.iter() {
+        let page = Page::page_of(addr);
+        if memory::in_mapped_range(page.to_address()) {
+            continue;
+        }
+        let tier = ctx.module_tiers[entry.wasm_table_index.to_u16() as usize];
+        let profiled_page = pages
+            .entry((page, entry.state_flags.to_u32() as u8))
+            .or_insert_with(|| ProfiledPage {
+                page,
+                hash: jit_profile::hash_page(page_contents(page)),
+                state_flags: entry.state_flags,
+                tier,
+                entry_points: Vec::new(),
+            });
+        if tier > profiled_page.tier {
+            profiled_page.tier = tier;
+        }
+        profiled_page.entry_points.push(addr as u16 & 0xFFF);
+    }
+    let pages: Vec<ProfiledPage> = pages.into_iter().map(|(_, p)| p).collect();
+    jit_profile::serialize(&pages, &mut ctx.profile_buffer);
+    ctx.profile_buffer.len() as u32
+}
+
+#[no_mangle]
+pub fn jit_profile_buffer() -> u32 { get_jit_state().profile_buffer.as_ptr() as u32 }
+
+/// Make room for a profile of the given length, returning the address to write it to
+#[no_mangle]
+pub fn jit_profile_allocate(len: u32) -> u32 {
+    let ctx = get_jit_state();
+    ctx.profile_buffer.clear();
+    ctx.profile_buffer.resize(len as usize, 0);
+    ctx.profile_buffer.as_ptr() as u32
+}
+
+/// Load the profile from the profile buffer, replacing any previously loaded one. Returns false if
+/// it isn't a valid profile
+#[no_mangle]
+pub fn jit_profile_load() -> bool {
+    let ctx = get_jit_state();
+    let pages = match jit_profile::parse(&ctx.profile_buffer) {
+        None => return false,
+        Some(pages) => pages,
+    };
+    ctx.profile.clear();
+    for p in pages {
+        ctx.profile.entry(p.page).or_insert_with(Vec::new).push(p);
+    }
+    ctx.profile_buffer = Vec::new();
+    true
+}
+
+/// Count the instructions run by a module of the baseline tier, which was entered at the given
+/// address from the main loop, and recompile it at the optimizing tier once it's hot enough
+pub fn jit_increase_hotness_of_module(
+    code: CachedCode,
+    virt_address: i32,
+    phys_address: u32,
+    cs_offset: u32,
+    state_flags: CachedStateFlags,
+    hotness: u32,
+) {
+    let ctx = get_jit_state();
+    let index = code.wasm_table_index.to_u16() as usize;
+    if ctx.module_tiers[index] != Tier::Baseline
+        || !ctx
+            .used_wasm_table_indices
+            .contains_key(&code.wasm_table_index)
+    {
+        return;
+    }
+    ctx.module_hotness[index] = ctx.module_hotness[index].saturating_add(hotness);
+    if ctx.module_hotness[index] >= JIT_THRESHOLD {
+        if is_compiling(ctx, Page::page_of(phys_address)) {
+            return;
+        }
+        if cpu::translate_address_read_no_side_effects(virt_address) == Some(phys_address) {
+            let hotness = mem::replace(&mut ctx.module_hotness[index], 0);
+            profiler::stat_increment(stat::COMPILE_TIER_UP);
+            jit_compile_or_queue(
+                ctx,
+                QueuedCompile {
+                    virt_address,
+                    phys_address,
+                    cs_offset,
+                    state_flags,
+                    tier: Tier::Optimizing,
+                    hotness,
+                },
+            )
+        }
+        else {
+            profiler::stat_increment(stat::COMPILE_WRONG_ADDRESS_SPACE);
+        }
+    }
+}
+
+/// Whether a module containing this page is being compiled
+fn is_compiling(ctx: &JitState, page: Page) -> bool {
+    ctx.compiling
+        .keys()
+        .any(|index| ctx.used_wasm_table_indices[index].contains(&page))
+}
+
+/// Compile the page of the request now, or queue it if too many modules are being compiled
+fn jit_compile_or_queue(ctx: &mut JitState, request: QueuedCompile) {
+    if ctx.compiling.len() < MAX_COMPILING_MODULES {
+        jit_analyze_and_generate(
+            ctx,
+            request.virt_address,
+            request.phys_address,
+            request.cs_offset,
+            request.state_flags,
+            request.tier,
+        );
+        return;
+    }
+
+    profiler::stat_increment(stat::COMPILE_QUEUED);
+
+    let page = Page::page_of(request.phys_address);
+    if let Some(queued) = ctx
+        .compile_queue
+        .iter_mut()
+        .find(|q| Page::page_of(q.phys_address) == page)
+    {
+        let hotness = queued.hotness.saturating_add(request.hotness);
+        let tier = if queued.tier > request.tier { queued.tier } else { request.tier };
+        *queued = QueuedCompile {
+            hotness,
+            tier,
+            ..request
+        };
+        return;
+    }
+
+    if ctx.compile_queue.len() < MAX_QUEUED_COMPILES {
+        ctx.compile_queue.push(request);
+        return;
+    }
+
+    // full: replace the coldest request
+    let (coldest, _) = ctx
+        .compile_queue
+        .iter()
+        .enumerate()
+        .min_by_key(|(_, q)| q.hotness)
+        .unwrap();
+    profiler::stat_increment(stat::COMPILE_QUEUE_DROPPED);
+    if ctx.compile_queue[coldest].hotness < request.hotness {
+        ctx.compile_queue[coldest] = request;
+    }
+}
+
+/// Called when a module has been compiled: Start compiling the hottest queued pages
+fn jit_compile_from_queue(ctx: &mut JitState) {
+    while ctx.compiling.len() < MAX_COMPILING_MODULES && !ctx.compile_queue.is_empty() {
+        let (hottest, _) = ctx
+            .compile_queue
+            .iter()
+            .enumerate()
+            .max_by_key(|(_, q)| q.hotness)
+            .unwrap();
+        let request = ctx.compile_queue.swap_remove(hottest);
+
+        if is_compiling(ctx, Page::page_of(request.phys_address)) {
+            continue;
+        }
+        // the address space may have changed while the request was queued
+        if cpu::translate_address_read_no_side_effects(request.virt_address)
+            != Some(request.phys_address)
+        {
+            profiler::stat_increment(stat::COMPILE_WRONG_ADDRESS_SPACE);
+            continue;
+        }
+
+        jit_analyze_and_generate(
+            ctx,
+            request.virt_address,
+            request.phys_address,
+            request.cs_offset,
+            request.state_flags,
+            request.tier,
+        );
+    }
+}
+
 fn free_wasm_table_index(ctx: &mut JitState, wasm_table_index: WasmTableIndex) {
     if CHECK_JIT_STATE_INVARIANTS {
         dbg_assert!(!ctx.wasm_table_index_free_list.contains(&wasm_table_index));
-
-        match &ctx.compiling {
-            Some((wasm_table_index_compiling, _)) => {
-                dbg_assert!(
-                    *wasm_table_index_compiling != wasm_table_index,
-                    "Attempt to free wasm table index that is currently being compiled"
-                );
-            },
-            _ => {},
-        }
+        dbg_assert!(
+            !ctx.compiling.contains_key(&wasm_table_index),
+            "Attempt to free wasm table index that is currently being compiled"
+        );
     }
 
     match ctx.used_wasm_table_indices.remove(&wasm_table_index) {
         None => dbg_assert!(false),
-        Some(_pages) => {
+        Some(pages) => {
             //dbg_assert!(!pages.is_empty()); // only if CompilingWritten
+            remove_page_modules(&mut ctx.page_modules, &pages, wasm_table_index);
         },
     }
     ctx.wasm_table_index_free_list.push(wasm_table_index);
+    ctx.module_entries[wasm_table_index.to_u16() as usize].clear();
+
+    // Make code of this module that is still running exit at the next indirect jump
+    ctx.dispatch_tables[wasm_table_index.to_u16() as usize].clear();
+
+    // Unlink the exits of other modules that call this module directly, and those of this module
+    if let Some(sources) = ctx.linked_from.remove(&wasm_table_index) {
+        for (source, site) in sources {
+            let exit_links = &mut ctx.exit_links[source.to_u16() as usize];
+            dbg_assert!(exit_links.target(site) == Some(wasm_table_index.to_u16()));
+            exit_links.unlink(site);
+        }
+    }
+    let exit_links = &mut ctx.exit_links[wasm_table_index.to_u16() as usize];
+    for (site, target) in exit_links.linked() {
+        unlink_from(
+            &mut ctx.linked_from,
+            WasmTableIndex(target),
+            wasm_table_index,
+            site,
+        );
+    }
+    exit_links.clear();
 
     dbg_assert!(
         ctx.wasm_table_index_free_list.len() + ctx.used_wasm_table_indices.len()
@@ -1942,70 +2574,150 @@ fn free_wasm_table_index(ctx: &mut JitState, wasm_table_index: WasmTableIndex) {
     // accidentally use the function and may garbage collect unused modules earlier
     jit_clear_func(wasm_table_index);
 
-    rebuild_all_pages(ctx);
-
     check_jit_state_invariants(ctx);
 }
 
-pub fn rebuild_all_pages(ctx: &mut JitState) {
-    // rebuild ctx.all_pages
-    let mut all_pages = HashSet::new();
-    for pages in ctx.used_wasm_table_indices.values() {
-        all_pages.extend(pages);
+fn remove_page_modules(
+    page_modules: &mut HashMap<Page, Vec<(WasmTableIndex, u64)>>,
+    pages: &[Page],
+    wasm_table_index: WasmTableIndex,
+) {
+    for page in pages {
+        let modules = page_modules.get_mut(page).unwrap();
+        let i = modules
+            .iter()
+            .position(|&(i, _)| i == wasm_table_index)
+            .unwrap();
+        modules.swap_remove(i);
+        if modules.is_empty() {
+            page_modules.remove(page);
+        }
     }
-    ctx.all_pages = all_pages;
 }
 
-/// Register a write in this page: Delete all present code
-pub fn jit_dirty_page(ctx: &mut JitState, page: Page) {
-    let mut did_have_code = false;
+fn unlink_from(
+    linked_from: &mut HashMap<WasmTableIndex, Vec<(WasmTableIndex, u16)>>,
+    target: WasmTableIndex,
+    source: WasmTableIndex,
+    site: u16,
+) {
+    if let Some(sources) = linked_from.get_mut(&target) {
+        if let Some(i) = sources.iter().position(|&s| s == (source, site)) {
+            sources.swap_remove(i);
+        }
+        if sources.is_empty() {
+            linked_from.remove(&target);
+        }
+    }
+}
 
-    if ctx.all_pages.contains(&page) {
-        profiler::stat_increment(stat::INVALIDATE_PAGE_HAD_CODE);
-        did_have_code = true;
-        let mut index_to_free = HashSet::new();
+/// Called from the main loop when code that left a module through an exit site (see ExitLinks)
+/// has been found in the cache: Link the site, so that the next exit through it calls the code
+/// directly
+pub fn jit_link_exit_site(
+    exit_site: u32,
+    phys_address: u32,
+    state_flags: CachedStateFlags,
+    target: CachedCode,
+) {
+    let ctx = get_jit_state();
+    let source = WasmTableIndex((exit_site >> 16) as u16);
+    let site = exit_site as u16;
 
-        let compiling = match &ctx.compiling {
-            Some((wasm_table_index, _)) => Some(*wasm_table_index),
-            None => None,
-        };
+    if !ctx.used_wasm_table_indices.contains_key(&source) {
+        // freed while it was running
+        return;
+    }
+    if ctx.module_tiers[target.wasm_table_index.to_u16() as usize] == Tier::Baseline {
+        // entered through the main loop, which counts its hotness
+        return;
+    }
+    let exit_links = &mut ctx.exit_links[source.to_u16() as usize];
+    if !exit_links.has_site(site) || exit_links.state_flags() != state_flags {
+        return;
+    }
+
+    profiler::stat_increment(stat::LINK_EXIT_SITE);
 
-        for (&wasm_table_index, pages) in &ctx.used_wasm_table_indices {
-            if Some(wasm_table_index) != compiling && pages.contains(&page) {
-                index_to_free.insert(wasm_table_index);
+    let previous = exit_links.link(
+        site,
+        phys_address,
+        target.wasm_table_index.to_u16(),
+        target.initial_state,
+    );
+    if let Some(previous) = previous {
+        unlink_from(&mut ctx.linked_from, WasmTableIndex(previous), source, site);
+    }
+    ctx.linked_from
+        .entry(target.wasm_table_index)
+        .or_insert_with(Vec::new)
+        .push((source, site));
+}
+
+/// Code is invalidated in chunks of 64 bytes, bit i of a chunk mask stands for the bytes 64*i to
+/// 64*i+63 of a page
+const ALL_CHUNKS: u64 = !0;
+
+/// The chunks containing the bytes from start to end (exclusive) of a page
+pub fn chunks_of_range(start: u32, end: u32) -> u64 {
+    dbg_assert!(start < end && end <= 0x1000);
+    let first = start >> 6;
+    let last = (end - 1) >> 6;
+    ALL_CHUNKS >> (63 - last) & ALL_CHUNKS << first
+}
+
+/// Register a write in this page: Delete all present code
+pub fn jit_dirty_page(ctx: &mut JitState, page: Page) { jit_dirty_chunks(ctx, page, ALL_CHUNKS) }
+
+/// Register a write to the given chunks of this page: Delete the modules that were generated from
+/// code in these chunks and the entry points within them. Writes to data that merely shares a
+/// page with code keep the code
+pub fn jit_dirty_chunks(ctx: &mut JitState, page: Page, chunks: u64) {
+    let mut did_have_code = false;
+
+    if let Some(modules) = ctx.page_modules.get(&page) {
+        let mut compiling_written = Vec::new();
+        let mut index_to_free = Vec::new();
+        for &(wasm_table_index, module_chunks) in modules {
+            if module_chunks & chunks == 0 {
+                continue;
+            }
+            if ctx.compiling.contains_key(&wasm_table_index) {
+                compiling_written.push(wasm_table_index);
+            }
+            else {
+                index_to_free.push(wasm_table_index);
             }
         }
 
-        match &ctx.compiling {
-            None => {},
-            Some((_, PageState::CompilingWritten)) => {},
-            Some((wasm_table_index, PageState::Compiling { .. })) => {
-                let pages = ctx
-                    .used_wasm_table_indices
-                    .get_mut(wasm_table_index)
-                    .unwrap();
-                if pages.contains(&page) {
-                    pages.clear();
-                    ctx.compiling = Some((*wasm_table_index, PageState::CompilingWritten));
-                    rebuild_all_pages(ctx);
-                }
-            },
+        if !compiling_written.is_empty() || !index_to_free.is_empty() {
+            profiler::stat_increment(stat::INVALIDATE_PAGE_HAD_CODE);
+            did_have_code = true;
         }
 
-        for index in &index_to_free {
-            match ctx.used_wasm_table_indices.get(&index) {
-                None => dbg_assert!(false),
-                Some(pages) => {
-                    for &p in pages {
-                        for addr in p.address_range() {
-                            if let Some(e) = ctx.cache.get(&addr) {
-                                if index_to_free.contains(&e.wasm_table_index) {
-                                    ctx.cache.remove(&addr);
-                                }
-                            }
-                        }
+        for wasm_table_index in compiling_written {
+            // CompilingWritten modules have no pages and can't be in page_modules
+            dbg_assert!(match ctx.compiling[&wasm_table_index] {
+                PageState::Compiling { .. } => true,
+                PageState::CompilingWritten => false,
+            });
+            let pages = ctx
+                .used_wasm_table_indices
+                .get_mut(&wasm_table_index)
+                .unwrap();
+            remove_page_modules(&mut ctx.page_modules, pages, wasm_table_index);
+            pages.clear();
+            ctx.compiling
+                .insert(wasm_table_index, PageState::CompilingWritten);
+        }
+
+        for &index in &index_to_free {
+            for &addr in &ctx.module_entries[index.to_u16() as usize] {
+                if let Some(e) = ctx.cache.get(addr) {
+                    if e.wasm_table_index == index {
+                        ctx.cache.remove(addr);
                     }
-                },
+                }
             }
         }
 
@@ -2015,63 +2727,83 @@ pub fn jit_dirty_page(ctx: &mut JitState, page: Page) {
         }
     }
 
-    match ctx.entry_points.remove(&page) {
-        None => {},
-        Some(_entry_points) => {
+    if ctx.decoded_blocks.dirty_chunks(page, chunks) {
+        profiler::stat_increment(stat::INVALIDATE_PAGE_HAD_DECODED_BLOCKS);
+        did_have_code = true;
+    }
+
+    if let Some(entry_points) = ctx.entry_points.get_mut(&page) {
+        if entry_points.remove_chunks(chunks) {
             profiler::stat_increment(stat::INVALIDATE_PAGE_HAD_ENTRY_POINTS);
             did_have_code = true;
 
+            if entry_points.len() == 0 {
+                ctx.entry_points.remove(&page);
+            }
+
             // don't try to compile code in this page anymore until it's hot again
             ctx.hot_pages[jit_hot_hash_page(page) as usize] = 0;
-        },
-    }
-
-    for pages in ctx.used_wasm_table_indices.values() {
-        dbg_assert!(!pages.contains(&page));
+            ctx.compile_queue
+                .retain(|q| Page::page_of(q.phys_address) != page);
+        }
     }
 
     check_jit_state_invariants(ctx);
 
-    dbg_assert!(!ctx.all_pages.contains(&page));
-    dbg_assert!(!jit_page_has_code_ctx(ctx, page));
+    if chunks == ALL_CHUNKS {
+        for pages in ctx.used_wasm_table_indices.values() {
+            dbg_assert!(!pages.contains(&page));
+        }
+        dbg_assert!(!ctx.page_modules.contains_key(&page));
+        dbg_assert!(!jit_page_has_code_ctx(ctx, page));
+    }
+
+    let has_code = jit_page_has_code_ctx(ctx, page);
 
-    if did_have_code {
+    if did_have_code && !has_code {
         cpu::tlb_set_has_code(page, false);
     }
 
     if !did_have_code {
-        profiler::stat_increment(stat::DIRTY_PAGE_DID_NOT_HAVE_CODE);
+        if has_code {
+            profiler::stat_increment(stat::DIRTY_PAGE_OUTSIDE_OF_CODE);
+        }
+        else {
+            profiler::stat_increment(stat::DIRTY_PAGE_DID_NOT_HAVE_CODE);
+        }
     }
 }
 
-#[no_mangle]
-pub fn jit_dirty_cache(start_addr: u32, end_addr: u32) {
-    dbg_assert!(start_addr < end_addr);
-
+/// Register a write to the bytes from start_addr to end_addr (exclusive)
+fn jit_dirty_range(ctx: &mut JitState, start_addr: u32, end_addr: u32) {
     let start_page = Page::page_of(start_addr);
     let end_page = Page::page_of(end_addr - 1);
 
     for page in start_page.to_u32()..end_page.to_u32() + 1 {
-        jit_dirty_page(get_jit_state(), Page::page_of(page << 12));
+        let page = Page::page_of(page << 12);
+        let page_start = page.to_address();
+        let start = if start_addr > page_start { start_addr - page_start } else { 0 };
+        let end = u32::min(end_addr - page_start, 0x1000);
+        jit_dirty_chunks(ctx, page, chunks_of_range(start, end));
+        cpu::page_table_written(page.to_u32());
     }
 }
 
+#[no_mangle]
+pub fn jit_dirty_cache(start_addr: u32, end_addr: u32) {
+    dbg_assert!(start_addr < end_addr);
+    jit_dirty_range(get_jit_state(), start_addr, end_addr);
+}
+
 /// dirty pages in the range of start_addr and end_addr, which must span at most two pages
 pub fn jit_dirty_cache_small(start_addr: u32, end_addr: u32) {
     dbg_assert!(start_addr < end_addr);
 
-    let start_page = Page::page_of(start_addr);
-    let end_page = Page::page_of(end_addr - 1);
-
-    let ctx = get_jit_state();
-    jit_dirty_page(ctx, start_page);
-
-    // Note: This can't happen when paging is enabled, as writes across
+    // Note: Spanning two pages can't happen when paging is enabled, as writes across
     //       boundaries are split up on two pages
-    if start_page != end_page {
-        dbg_assert!(start_page.to_u32() + 1 == end_page.to_u32());
-        jit_dirty_page(ctx, end_page);
-    }
+    dbg_assert!(Page::page_of(end_addr - 1).to_u32() - Page::page_of(start_addr).to_u32() <= 1);
+
+    jit_dirty_range(get_jit_state(), start_addr, end_addr);
 }
 
 #[no_mangle]
@@ -2083,14 +2815,17 @@ pub fn jit_clear_cache(ctx: &mut JitState) {
     for page in ctx.entry_points.keys() {
         pages_with_code.insert(*page);
     }
-    for &p in &ctx.all_pages {
+    for &p in ctx.page_modules.keys() {
+        pages_with_code.insert(p);
+    }
+    for &p in ctx.decoded_blocks.pages() {
         pages_with_code.insert(p);
     }
     for addr in ctx.cache.keys() {
-        dbg_assert!(pages_with_code.contains(&Page::page_of(*addr)));
+        dbg_assert!(pages_with_code.contains(&Page::page_of(addr)));
     }
     for pages in ctx.used_wasm_table_indices.values() {
-        dbg_assert!(pages_with_code.is_superset(pages));
+        dbg_assert!(pages.iter().all(|p| pages_with_code.contains(p)));
     }
 
     for page in pages_with_code {
@@ -2101,7 +2836,32 @@ pub fn jit_clear_cache(ctx: &mut JitState) {
 pub fn jit_page_has_code(page: Page) -> bool { jit_page_has_code_ctx(get_jit_state(), page) }
 
 pub fn jit_page_has_code_ctx(ctx: &mut JitState, page: Page) -> bool {
-    ctx.all_pages.contains(&page) || ctx.entry_points.contains_key(&page)
+    ctx.page_modules.contains_key(&page)
+        || ctx.entry_points.contains_key(&page)
+        || ctx.decoded_blocks.has_page(page)
+}
+
+/// The pre-decoded block of the interpreter at this address, if its page has been run often enough
+/// to be worth decoding. None if the block is empty
+pub fn jit_get_decoded_block(
+    phys_address: u32,
+    state_flags: CachedStateFlags,
+) -> Option<Rc<DecodedBlock>> {
+    let ctx = get_jit_state();
+    let page = Page::page_of(phys_address);
+    if ctx.hot_pages[jit_hot_hash_page(page) as usize] < JIT_THRESHOLD_DECODE {
+        return None;
+    }
+    if ctx.decoded_blocks.is_full() {
+        profiler::stat_increment(stat::DECODED_BLOCKS_FULL);
+        for page in ctx.decoded_blocks.clear() {
+            if !jit_page_has_code_ctx(ctx, page) {
+                cpu::tlb_set_has_code(page, false);
+            }
+        }
+    }
+    let block = ctx.decoded_blocks.get(phys_address, state_flags);
+    if block.is_empty() { None } else { Some(block) }
 }
 
 #[no_mangle]
@@ -2127,7 +2887,7 @@ pub fn check_missed_entry_points(phys_address: u32, state_flags: CachedStateFlag
         let addr = phys_address - offset;
         dbg_assert!(phys_address >= addr);
 
-        if let Some(entry) = ctx.cache.get(&addr) {
+        if let Some(entry) = ctx.cache.get(addr) {
             if entry.state_flags != state_flags || phys_address >= addr + entry.len {
                 // give up search on first entry that is not a match
                 break;
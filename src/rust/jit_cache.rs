@@ -0,0 +1,477 @@
+// Open-addressed hash table mapping physical addresses to compiled entries
+//
+// This is looked up on every block transition that leaves a wasm module, so it's kept flat:
+// power-of-two capacity, a multiplicative hash of the address and linear probing, with the
+// key and value stored inline in the slot. Deletion uses backward shifting, so there are no
+// tombstones and lookups of missing keys stop at the first empty slot.
+
+use profiler;
+use profiler::stat;
+use state_flags::CachedStateFlags;
+
+const INITIAL_CAPACITY: usize = 1 << 12;
+
+// Addresses this close to the end of a page never get an entry (see is_near_end_of_page)
+pub const EMPTY: u32 = 0xFFFF_FFFF;
+
+pub const HASH_MULTIPLIER: u32 = 0x9E37_79B9;
+
+// Fibonacci hashing: consecutive addresses are spread over the whole table
+pub fn hash(key: u32, shift: u32) -> usize { (key.wrapping_mul(HASH_MULTIPLIER) >> shift) as usize }
+
+pub struct EntryCache<V: Copy> {
+    slots: Vec<(u32, Option<V>)>,
+    len: usize,
+    shift: u32,
+}
+
+impl<V: Copy> EntryCache<V> {
+    pub fn new() -> EntryCache<V> {
+        EntryCache {
+            slots: vec![(EMPTY, None); INITIAL_CAPACITY],
+            len: 0,
+            shift: 32 - INITIAL_CAPACITY.trailing_zeros(),
+        }
+    }
+
+    fn mask(&self) -> usize { self.slots.len() - 1 }
+
+    fn ideal_slot(&self, key: u32) -> usize { hash(key, self.shift) }
+
+    fn find(&self, key: u32) -> Option<usize> {
+        let mask = self.mask();
+        let mut i = self.ideal_slot(key);
+        loop {
+            profiler::stat_increment(stat::ENTRY_CACHE_PROBE);
+            let slot_key = self.slots[i].0;
+            if slot_key == EMPTY {
+                return None;
+            }
+            if slot_key == key {
+                return Some(i);
+            }
+            i = (i + 1) & mask;
+        }
+    }
+
+    pub fn len(&self) -> usize { self.len }
+
+    pub fn get(&self, key: u32) -> Option<&V> {
+        profiler::stat_increment(stat::ENTRY_CACHE_LOOKUP);
+        match self.find(key) {
+            Some(i) => self.slots[i].1.as_ref(),
+            None => None,
+        }
+    }
+
+    #[cfg(test)]
+    pub fn contains_key(&self, key: u32) -> bool { self.find(key).is_some() }
+
+    /// Insert an entry, returning the entry previously stored at this address
+    pub fn insert(&mut self, key: u32, value: V) -> Option<V> {
+        dbg_assert!(key != EMPTY);
+        if 2 * (self.len + 1) > self.slots.len() {
+            self.grow();
+        }
+
+        let mask = self.mask();
+        let mut i = self.ideal_slot(key);
+        loop {
+            let slot_key = self.slots[i].0;
+            if slot_key == key {
+                return self.slots[i].1.replace(value);
+            }
+            if slot_key == EMPTY {
+                self.slots[i] = (key, Some(value));
+                self.len += 1;
+                return None;
+            }
+            i = (i + 1) & mask;
+        }
+    }
+
+    pub fn remove(&mut self, key: u32) -> Option<V> {
+        let mut hole = match self.find(key) {
+            Some(i) => i,
+            None => return None,
+        };
+        let removed = self.slots[hole].1;
+        self.len -= 1;
+
+        // Shift following entries of the same cluster back, unless that would move them in front
+        // of their ideal slot
+        let mask = self.mask();
+        let mut i = (hole + 1) & mask;
+        loop {
+            let slot_key = self.slots[i].0;
+            if slot_key == EMPTY {
+                break;
+            }
+            let ideal = self.ideal_slot(slot_key);
+            if (i.wrapping_sub(ideal) & mask) >= (i.wrapping_sub(hole) & mask) {
+                self.slots[hole] = self.slots[i];
+                hole = i;
+            }
+            i = (i + 1) & mask;
+        }
+        self.slots[hole] = (EMPTY, None);
+
+        removed
+    }
+
+    pub fn iter<'a>(&'a self) -> impl Iterator<Item = (u32, &'a V)> + 'a {
+        self.slots
+            .iter()
+            .filter_map(|(key, value)| value.as_ref().map(|v| (*key, v)))
+    }
+
+    pub fn keys<'a>(&'a self) -> impl Iterator<Item = u32> + 'a { self.iter().map(|(k, _)| k) }
+
+    fn grow(&mut self) {
+        let new_capacity = 2 * self.slots.len();
+        let old_slots = std::mem::replace(&mut self.slots, vec![(EMPTY, None); new_capacity]);
+        self.shift -= 1;
+        self.len = 0;
+        for (key, value) in old_slots {
+            if let Some(value) = value {
+                self.insert(key, value);
+            }
+        }
+    }
+}
+
+/// Per-module table of (physical address, initial state) pairs, probed by the generated code of
+/// indirect jumps (ret, jmp r/m, call r/m) to find the target within the same module
+///
+/// Lives in linear memory at a fixed address for as long as the module exists. Freeing the
+/// module empties the table, so that code of a module that was invalidated while running exits
+/// at its next indirect jump.
+pub struct DispatchTable {
+    // Pairs of (key, initial_state), EMPTY keys for unused slots
+    slots: Vec<u32>,
+    shift: u32,
+}
+
+impl DispatchTable {
+    pub fn new() -> DispatchTable {
+        DispatchTable {
+            slots: Vec::new(),
+            shift: 0,
+        }
+    }
+
+    pub fn fill(&mut self, entries: &[(u32, u16)]) {
+        let capacity = (2 * entries.len()).next_power_of_two().max(2);
+        let mask = capacity - 1;
+        self.slots.clear();
+        self.slots.resize(2 * capacity, EMPTY);
+        self.shift = 32 - capacity.trailing_zeros();
+        for &(key, initial_state) in entries {
+            dbg_assert!(key != EMPTY);
+            let mut i = hash(key, self.shift);
+            while self.slots[2 * i] != EMPTY {
+                dbg_assert!(self.slots[2 * i] != key);
+                i = (i + 1) & mask;
+            }
+            self.slots[2 * i] = key;
+            self.slots[2 * i + 1] = initial_state as u32;
+        }
+    }
+
+    pub fn clear(&mut self) {
+        for key in self.slots.iter_mut().step_by(2) {
+            *key = EMPTY;
+        }
+    }
+
+    #[cfg(test)]
+    pub fn get(&self, key: u32) -> Option<u16> {
+        if self.slots.is_empty() {
+            return None;
+        }
+        let mask = self.mask() as usize;
+        let mut i = hash(key, self.shift);
+        loop {
+            match self.slots[2 * i] {
+                EMPTY => return None,
+                k if k == key => return Some(self.slots[2 * i + 1] as u16),
+                _ => i = (i + 1) & mask,
+            }
+        }
+    }
+
+    pub fn address(&self) -> u32 { self.slots.as_ptr() as u32 }
+    pub fn mask(&self) -> u32 { (self.slots.len() / 2 - 1) as u32 }
+    pub fn shift(&self) -> u32 { self.shift }
+}
+
+#[derive(Copy, Clone)]
+#[repr(C)]
+struct ExitLink {
+    // EMPTY if the exit site isn't linked
+    phys_address: u32,
+    // wasm table index | initial_state << 16
+    target: u32,
+}
+
+/// Per-module slots for the exit sites of a module (jumps out of the module), each remembering the
+/// compiled code that the last exit through it continued in
+///
+/// The generated code of an exit site compares the physical eip with the slot and, if it
+/// matches, calls the target module directly rather than returning to the main loop. Like the
+/// dispatch table, the slots live in linear memory at a fixed address for as long as the module
+/// exists: Their capacity is reserved before code generation, so they're never moved.
+pub struct ExitLinks {
+    slots: Vec<ExitLink>,
+    state_flags: CachedStateFlags,
+}
+
+impl ExitLinks {
+    pub fn new() -> ExitLinks {
+        ExitLinks {
+            slots: Vec::new(),
+            state_flags: CachedStateFlags::EMPTY,
+        }
+    }
+
+    /// Prepare for a new module with at most `capacity` exit sites
+    pub fn reset(&mut self, capacity: usize, state_flags: CachedStateFlags) {
+        self.slots.clear();
+        self.slots.reserve_exact(capacity);
+        self.state_flags = state_flags;
+    }
+
+    /// Allocate an exit site, returning its index and the address of its slot. None if the
+    /// reserved capacity is exhausted
+    pub fn allocate(&mut self) -> Option<(u16, u32)> {
+        let site = self.slots.len();
+        if site == self.slots.capacity() || site > 0xFFFF {
+            return None;
+        }
+        self.slots.push(ExitLink {
+            phys_address: EMPTY,
+            target: 0,
+        });
+        Some((site as u16, &self.slots[site] as *const ExitLink as u32))
+    }
+
+    pub fn state_flags(&self) -> CachedStateFlags { self.state_flags }
+
+    pub fn has_site(&self, site: u16) -> bool { (site as usize) < self.slots.len() }
+
+    /// Link an exit site, returning the table index it was previously linked to
+    pub fn link(
+        &mut self,
+        site: u16,
+        phys_address: u32,
+        wasm_table_index: u16,
+        initial_state: u16,
+    ) -> Option<u16> {
+        dbg_assert!(phys_address != EMPTY && wasm_table_index != 0);
+        let previous = self.target(site);
+        self.slots[site as usize] = ExitLink {
+            phys_address,
+            target: wasm_table_index as u32 | (initial_state as u32) << 16,
+        };
+        previous
+    }
+
+    pub fn unlink(&mut self, site: u16) {
+        self.slots[site as usize] = ExitLink {
+            phys_address: EMPTY,
+            target: 0,
+        };
+    }
+
+    /// The table index an exit site is linked to
+    pub fn target(&self, site: u16) -> Option<u16> {
+        let slot = self.slots[site as usize];
+        if slot.phys_address == EMPTY {
+            None
+        }
+        else {
+            Some(slot.target as u16)
+        }
+    }
+
+    /// Pairs of (exit site, table index) of all linked exit sites
+    pub fn linked<'a>(&'a self) -> impl Iterator<Item = (u16, u16)> + 'a {
+        (0..self.slots.len() as u16).filter_map(move |site| self.target(site).map(|t| (site, t)))
+    }
+
+    /// Unlink all exit sites, keeping the slots in place for code of this module that may still
+    /// be running
+    pub fn clear(&mut self) {
+        for site in 0..self.slots.len() as u16 {
+            self.unlink(site);
+        }
+    }
+}
+
+/// The entry points of a page, one bit per byte offset
+#[derive(Clone)]
+pub struct EntryPoints {
+    bits: [u64; 64],
+    len: u16,
+}
+
+impl EntryPoints {
+    pub fn new() -> EntryPoints {
+        EntryPoints {
+            bits: [0; 64],
+            len: 0,
+        }
+    }
+
+    /// Insert an offset, returning whether it was new
+    pub fn insert(&mut self, offset: u16) -> bool {
+        dbg_assert!(offset < 0x1000);
+        let word = &mut self.bits[offset as usize >> 6];
+        let bit = 1 << (offset & 63);
+        if *word & bit != 0 {
+            return false;
+        }
+        *word |= bit;
+        self.len += 1;
+        true
+    }
+
+    #[cfg(test)]
+    pub fn contains(&self, offset: u16) -> bool {
+        self.bits[offset as usize >> 6] & 1 << (offset & 63) != 0
+    }
+
+    pub fn len(&self) -> usize { self.len as usize }
+
+    /// Remove the offsets in the given 64-byte chunks (bit i for the offsets 64*i to 64*i+63),
+    /// returning whether any were present
+    pub fn remove_chunks(&mut self, chunks: u64) -> bool {
+        let mut removed = false;
+        for (i, word) in self.bits.iter_mut().enumerate() {
+            if chunks >> i & 1 != 0 && *word != 0 {
+                self.len -= word.count_ones() as u16;
+                *word = 0;
+                removed = true;
+            }
+        }
+        removed
+    }
+
+    /// The offsets in ascending order
+    pub fn iter<'a>(&'a self) -> impl Iterator<Item = u16> + 'a {
+        self.bits.iter().enumerate().flat_map(|(i, &word)| {
+            let mut word = word;
+            std::iter::from_fn(move || {
+                if word == 0 {
+                    return None;
+                }
+                let bit = word.trailing_zeros() as u16;
+                word &= word - 1;
+                Some((i as u16) << 6 | bit)
+            })
+        })
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use jit_cache::{DispatchTable, EntryCache, EntryPoints, ExitLinks};
+    use state_flags::CachedStateFlags;
+    use std::collections::HashMap;
+
+    #[test]
+    fn matches_hashmap() {
+        let mut cache = EntryCache::new();
+        let mut reference = HashMap::new();
+
+        let mut x: u32 = 12345;
+        for i in 0..100_000u32 {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            // few distinct pages to create long clusters
+            let key = (x % 16) << 12 | (x >> 8) % 0xFF0;
+            if x % 3 == 0 {
+                assert_eq!(cache.remove(key), reference.remove(&key));
+            }
+            else {
+                assert_eq!(cache.insert(key, i), reference.insert(key, i));
+            }
+            assert_eq!(cache.contains_key(key), reference.contains_key(&key));
+            assert_eq!(cache.len(), reference.len());
+        }
+
+        for (key, value) in cache.iter() {
+            assert_eq!(reference.get(&key), Some(value));
+        }
+        for (key, value) in &reference {
+            assert_eq!(cache.get(*key), Some(value));
+        }
+    }
+
+    #[test]
+    fn dispatch_table() {
+        let mut table = DispatchTable::new();
+        assert_eq!(table.get(0x1000), None);
+
+        let entries: Vec<(u32, u16)> = (0..37).map(|i| (0x5000 | i * 97, i as u16)).collect();
+        table.fill(&entries);
+        for &(addr, initial_state) in &entries {
+            assert_eq!(table.get(addr), Some(initial_state));
+        }
+        assert_eq!(table.get(0x5001), None);
+
+        table.clear();
+        for &(addr, _) in &entries {
+            assert_eq!(table.get(addr), None);
+        }
+    }
+    #[test]
+    fn exit_links() {
+        let mut links = ExitLinks::new();
+        links.reset(3, CachedStateFlags::EMPTY);
+
+        let (site0, address0) = links.allocate().unwrap();
+        let (site1, address1) = links.allocate().unwrap();
+        let (_, address2) = links.allocate().unwrap();
+        assert!(links.allocate().is_none());
+        assert_eq!((site0, site1), (0, 1));
+        assert_eq!(address1 - address0, 8);
+        assert_eq!(address2 - address1, 8);
+
+        assert_eq!(links.link(site0, 0x7000, 5, 3), None);
+        assert_eq!(links.link(site1, 0x8000, 6, 0), None);
+        assert_eq!(links.link(site0, 0x9000, 7, 1), Some(5));
+        assert_eq!(links.linked().collect::<Vec<_>>(), vec![(0, 7), (1, 6)]);
+
+        links.unlink(site1);
+        assert_eq!(links.target(site1), None);
+
+        links.clear();
+        assert_eq!(links.linked().count(), 0);
+        assert!(links.has_site(2) && !links.has_site(3));
+    }
+
+    #[test]
+    fn entry_points() {
+        let mut entry_points = EntryPoints::new();
+        for &offset in &[0x123, 0, 63, 64, 0xFFF, 0x123] {
+            entry_points.insert(offset);
+        }
+        assert!(!entry_points.insert(64));
+        assert_eq!(entry_points.len(), 5);
+        assert!(entry_points.contains(0xFFF) && !entry_points.contains(0x124));
+        assert_eq!(
+            entry_points.iter().collect::<Vec<_>>(),
+            vec![0, 63, 64, 0x123, 0xFFF]
+        );
+
+        assert!(entry_points.remove_chunks(1 << 1 | 1 << 2));
+        assert!(!entry_points.remove_chunks(1 << 2));
+        assert_eq!(
+            entry_points.iter().collect::<Vec<_>>(),
+            vec![0, 63, 0x123, 0xFFF]
+        );
+        assert_eq!(entry_points.len(), 4);
+    }
+}
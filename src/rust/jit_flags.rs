@@ -0,0 +1,398 @@
+//! Liveness of the lazy flags (last_op1, last_result, last_op_size and flags_changed) across the
+//! basic blocks of a function, and keeping them in wasm locals where they may be dead.
+//!
+//! Only instructions that overwrite all lazy flags are considered (see analysis::flags_effect).
+//! Depending on what follows such an instruction, its flags are:
+//! - Not stored at all, if a later instruction of the same block overwrites them before
+//!   anything else happens
+//! - Stored to memory as usual, if anything may read them (any instruction that isn't known to
+//!   leave the flags alone, as it may call a helper, fault or read them)
+//! - Kept in locals, if the instruction is the last one of its block to write the flags and some
+//!   successor of the block overwrites them before reading them. A conditional jump right after
+//!   it computes its condition from the locals. On the edges to the other successors, including
+//!   those leaving the function, the locals are stored to memory
+//!
+//! Only the optimizing tier looks across basic blocks. The baseline tier treats every block as
+//! reading the flags, which leaves only the dead stores inside a block.
+//!
+//! Between the block that keeps its flags in locals and the instruction overwriting them, only
+//! instructions that neither fault nor call helpers are run. The function may still exit there,
+//! for the loop iteration limit or a page switch that doesn't hold. While the locals hold newer
+//! flags than memory, their flags_changed is non-zero, and the exit paths of the function store
+//! them in that case.
+
+use std::collections::{HashMap, HashSet};
+
+use analysis;
+use analysis::{FlagsEffect, FlagsProducer};
+use codegen;
+use cpu::cpu::OPSIZE_32;
+use cpu::global_pointers;
+use cpu_context::CpuContext;
+use jit::{BasicBlock, BasicBlockType, Instruction, JitContext, Tier};
+use profiler;
+use profiler::stat;
+use wasmgen::wasm_builder::{WasmBuilder, WasmLocal};
+
+/// Where an instruction that overwrites all lazy flags puts them
+#[derive(Copy, Clone, PartialEq, Eq)]
+pub enum LazyFlags {
+    Memory,
+    /// Overwritten before anything could read them
+    Dead,
+    /// In the FlagLocals of the function
+    Locals,
+}
+
+/// The lazy flags of an instruction with LazyFlags::Locals. The operand size is always 32 bits,
+/// and last_op1 isn't set by the logical instructions, which don't use it
+pub struct FlagLocals {
+    pub last_op1: WasmLocal,
+    pub last_result: WasmLocal,
+    /// Zero while memory is up to date
+    pub flags_changed: WasmLocal,
+    /// Whether the locals hold the flags of the current instruction, from the instruction that
+    /// set them to the end of the basic block
+    pub current: bool,
+}
+
+impl FlagLocals {
+    pub fn new(builder: &mut WasmBuilder) -> FlagLocals {
+        let mut new_local = || {
+            builder.const_i32(0);
+            builder.set_new_local()
+        };
+        FlagLocals {
+            last_op1: new_local(),
+            last_result: new_local(),
+            flags_changed: new_local(),
+            current: false,
+        }
+    }
+
+    pub fn free(&self, builder: &mut WasmBuilder) {
+        builder.free_local(self.last_op1.unsafe_clone());
+        builder.free_local(self.last_result.unsafe_clone());
+        builder.free_local(self.flags_changed.unsafe_clone());
+    }
+}
+
+pub struct FlagLiveness {
+    lazy_flags: HashMap<u32, LazyFlags>,
+    /// The first instruction of blocks that overwrite the flags before reading them, unless it
+    /// keeps its flags in locals itself: Flags that an earlier block left in locals are dead
+    /// from here on
+    clear_locals: HashSet<u32>,
+    function_blocks: HashSet<u32>,
+    /// Blocks that may read the flags before overwriting them
+    live_in: HashSet<u32>,
+}
+
+impl FlagLiveness {
+    pub fn lazy_flags(&self, addr: u32) -> LazyFlags {
+        self.lazy_flags
+            .get(&addr)
+            .copied()
+            .unwrap_or(LazyFlags::Memory)
+    }
+
+    pub fn clears_locals(&self, addr: u32) -> bool { self.clear_locals.contains(&addr) }
+
+    /// Whether any instruction of the function keeps its flags in locals
+    pub fn uses_locals(&self) -> bool {
+        self.lazy_flags
+            .values()
+            .any(|&lazy_flags| lazy_flags == LazyFlags::Locals)
+    }
+
+    /// Whether the flags must be in memory when continuing at the given block of this function.
+    /// None and blocks of other functions stand for leaving the function
+    pub fn needed_at(&self, target: Option<u32>) -> bool {
+        target.map_or(true, |addr| {
+            !self.function_blocks.contains(&addr) || self.live_in.contains(&addr)
+        })
+    }
+}
+
+/// The conditions (low 4 bits of the jcc opcode) that codegen::gen_condition_fn computes from the
+/// operands or from the flag locals, rather than the lazy flags in memory, when the last
+/// instruction was of the given kind
+fn conditions_from_locals(producer: FlagsProducer) -> u16 {
+    const ZF_SF: u16 = 1 << 0x4 | 1 << 0x5 | 1 << 0x8 | 1 << 0x9;
+    match producer {
+        FlagsProducer::Arithmetic => ZF_SF,
+        FlagsProducer::Sub => ZF_SF | 1 << 0x6 | 1 << 0x7,
+        // not jo, jno, jp, jnp
+        FlagsProducer::Cmp => !(1 << 0x0 | 1 << 0x1 | 1 << 0xA | 1 << 0xB),
+    }
+}
+
+/// Whether the condition of a jump right after the instruction ctx.last_instruction can be
+/// computed without the lazy flags in memory
+pub fn condition_from_locals(instruction: &Instruction, condition: u8) -> bool {
+    let producer = match instruction {
+        &Instruction::Cmp { opsize, .. } if opsize == OPSIZE_32 => FlagsProducer::Cmp,
+        &Instruction::Sub { opsize } if opsize == OPSIZE_32 => FlagsProducer::Sub,
+        &Instruction::Arithmetic { opsize } if opsize == OPSIZE_32 => FlagsProducer::Arithmetic,
+        _ => return false,
+    };
+    jcc_condition(condition).map_or(false, |c| conditions_from_locals(producer) & 1 << c != 0)
+}
+
+/// The low 4 bits of the opcode of jcc, None for loop, loopz, loopnz and jcxz
+fn jcc_condition(condition: u8) -> Option<u8> {
+    if condition & 0xF0 == 0xE0 {
+        None
+    }
+    else {
+        Some(condition & 0xF)
+    }
+}
+
+fn successors(block: &BasicBlock) -> Vec<Option<u32>> {
+    if block.has_sti {
+        // exits to handle interrupts
+        return vec![None];
+    }
+    match block.ty {
+        BasicBlockType::Normal {
+            next_block_addr, ..
+        } => vec![next_block_addr],
+        BasicBlockType::ConditionalJump {
+            next_block_addr,
+            next_block_branch_taken_addr,
+            ..
+        } => vec![next_block_addr, next_block_branch_taken_addr],
+        BasicBlockType::AbsoluteEip | BasicBlockType::Exit => vec![None],
+    }
+}
+
+/// The condition read by a jcc at the end of this block
+fn read_at_end(block: &BasicBlock) -> Option<u8> {
+    match block.ty {
+        BasicBlockType::ConditionalJump { condition, .. } => jcc_condition(condition),
+        _ => None,
+    }
+}
+
+pub fn analyze(
+    cpu: &CpuContext,
+    basic_blocks: &HashMap<u32, BasicBlock>,
+    function_blocks: &Vec<u32>,
+    tier: Tier,
+) -> FlagLiveness {
+    let mut cpu = cpu.clone();
+    let mut effects = HashMap::new();
+    for &addr in function_blocks {
+        let block = basic_blocks.get(&addr).unwrap();
+        let mut block_effects = Vec::new();
+        cpu.eip = block.addr;
+        while cpu.eip < block.end_addr {
+            let addr = cpu.eip;
+            cpu.prefixes = 0;
+            block_effects.push((addr, analysis::flags_effect(&cpu)));
+            analysis::analyze_step(&mut cpu);
+        }
+        effects.insert(addr, block_effects);
+    }
+
+    let mut liveness = FlagLiveness {
+        lazy_flags: HashMap::new(),
+        clear_locals: HashSet::new(),
+        function_blocks: function_blocks.iter().copied().collect(),
+        live_in: HashSet::new(),
+    };
+
+    // Blocks that neither read nor overwrite the flags are live if any successor is
+    let mut transparent = Vec::new();
+    for (&addr, block_effects) in effects.iter() {
+        if tier == Tier::Baseline {
+            liveness.live_in.insert(addr);
+            continue;
+        }
+        let first = block_effects
+            .iter()
+            .map(|&(_, effect)| effect)
+            .find(|&effect| effect != FlagsEffect::Unused);
+        match first {
+            Some(FlagsEffect::Overwrite(_)) => {},
+            Some(_) => {
+                liveness.live_in.insert(addr);
+            },
+            None => {
+                if read_at_end(basic_blocks.get(&addr).unwrap()).is_some() {
+                    liveness.live_in.insert(addr);
+                }
+                else {
+                    transparent.push(addr);
+                }
+            },
+        }
+    }
+    loop {
+        let mut changed = false;
+        for &addr in transparent.iter() {
+            if !liveness.live_in.contains(&addr)
+                && successors(basic_blocks.get(&addr).unwrap())
+                    .into_iter()
+                    .any(|target| liveness.needed_at(target))
+            {
+                liveness.live_in.insert(addr);
+                changed = true;
+            }
+        }
+        if !changed {
+            break;
+        }
+    }
+
+    for (&addr, block_effects) in effects.iter() {
+        let block = basic_blocks.get(&addr).unwrap();
+        let all_needed = successors(block)
+            .into_iter()
+            .all(|target| liveness.needed_at(target));
+        let condition = read_at_end(block);
+
+        #[derive(PartialEq)]
+        enum Next {
+            End,
+            Overwrite,
+            Read,
+        }
+        let mut next = Next::End;
+        for (i, &(instruction_addr, effect)) in block_effects.iter().enumerate().rev() {
+            match effect {
+                FlagsEffect::Overwrite(producer) => {
+                    let lazy_flags = match next {
+                        Next::Overwrite => LazyFlags::Dead,
+                        Next::Read => LazyFlags::Memory,
+                        Next::End => {
+                            // A jump only uses the operands of the instruction right before it
+                            // (see ctx.last_instruction)
+                            let condition_from_locals = condition.map_or(true, |c| {
+                                i + 2 == block_effects.len()
+                                    && conditions_from_locals(producer) & 1 << c != 0
+                            });
+                            if condition_from_locals && !all_needed {
+                                LazyFlags::Locals
+                            }
+                            else {
+                                LazyFlags::Memory
+                            }
+                        },
+                    };
+                    liveness.lazy_flags.insert(instruction_addr, lazy_flags);
+                    next = Next::Overwrite;
+                },
+                FlagsEffect::Unused => {},
+                FlagsEffect::Other => next = Next::Read,
+            }
+        }
+
+        if !liveness.live_in.contains(&addr) {
+            if let Some(&(first, _)) = block_effects
+                .iter()
+                .find(|&&(_, effect)| effect != FlagsEffect::Unused)
+            {
+                if liveness.lazy_flags(first) != LazyFlags::Locals {
+                    liveness.clear_locals.insert(first);
+                }
+            }
+        }
+    }
+
+    if !liveness.uses_locals() {
+        liveness.clear_locals.clear();
+    }
+
+    let count = |value| {
+        liveness
+            .lazy_flags
+            .values()
+            .filter(|&&lazy_flags| lazy_flags == value)
+            .count() as u64
+    };
+    profiler::stat_increment_by(stat::COMPILE_DEAD_FLAG_STORES, count(LazyFlags::Dead));
+    profiler::stat_increment_by(stat::COMPILE_FLAGS_IN_LOCALS, count(LazyFlags::Locals));
+    liveness
+}
+
+/// Whether the locals hold the flags of the current instruction
+pub fn in_locals(ctx: &JitContext) -> bool {
+    ctx.flag_locals
+        .as_ref()
+        .map_or(false, |flag_locals| flag_locals.current)
+}
+
+pub fn gen_set_last_op1(ctx: &mut JitContext, source: &WasmLocal) {
+    if ctx.lazy_flags == LazyFlags::Locals {
+        ctx.builder.get_local(source);
+        ctx.builder
+            .set_local(&ctx.flag_locals.as_ref().unwrap().last_op1);
+    }
+    else {
+        codegen::gen_set_last_op1(ctx.builder, source);
+    }
+}
+
+pub fn gen_set_last_result(ctx: &mut JitContext, source: &WasmLocal) {
+    if ctx.lazy_flags == LazyFlags::Locals {
+        ctx.builder.get_local(source);
+        ctx.builder
+            .set_local(&ctx.flag_locals.as_ref().unwrap().last_result);
+    }
+    else {
+        codegen::gen_set_last_result(ctx.builder, source);
+    }
+}
+
+/// Set the (32-bit) operand size and flags_changed, after last_op1 and last_result
+pub fn gen_set_last_op_size_and_flags_changed(ctx: &mut JitContext, flags_changed: i32) {
+    if ctx.lazy_flags == LazyFlags::Locals {
+        let flag_locals = ctx.flag_locals.as_mut().unwrap();
+        ctx.builder.const_i32(flags_changed);
+        ctx.builder.set_local(&flag_locals.flags_changed);
+        flag_locals.current = true;
+    }
+    else {
+        codegen::gen_set_last_op_size(ctx.builder, OPSIZE_32);
+        codegen::gen_set_flags_changed(ctx.builder, flags_changed);
+    }
+}
+
+/// Mark the flags in locals as dead, see FlagLiveness::clear_locals
+pub fn gen_clear_flags_in_locals(ctx: &mut JitContext) {
+    ctx.builder.const_i32(0);
+    ctx.builder
+        .set_local(&ctx.flag_locals.as_ref().unwrap().flags_changed);
+}
+
+fn gen_store(builder: &mut WasmBuilder, flag_locals: &FlagLocals) {
+    codegen::gen_set_last_op1(builder, &flag_locals.last_op1);
+    codegen::gen_set_last_result(builder, &flag_locals.last_result);
+    codegen::gen_set_last_op_size(builder, OPSIZE_32);
+    builder.const_i32(global_pointers::flags_changed as i32);
+    builder.get_local(&flag_locals.flags_changed);
+    builder.store_aligned_i32(0);
+    builder.const_i32(0);
+    builder.set_local(&flag_locals.flags_changed);
+}
+
+/// On an edge that needs the flags in memory: Store them if the current instruction kept them in
+/// locals
+pub fn gen_store_flags(ctx: &mut JitContext) {
+    match &ctx.flag_locals {
+        Some(flag_locals) if flag_locals.current => gen_store(ctx.builder, flag_locals),
+        _ => {},
+    }
+}
+
+/// At the exits of the function: Store the flags if the locals hold newer ones than memory
+pub fn gen_store_flags_if_in_locals(ctx: &mut JitContext) {
+    if let Some(flag_locals) = &ctx.flag_locals {
+        ctx.builder.get_local(&flag_locals.flags_changed);
+        ctx.builder.if_void();
+        gen_store(ctx.builder, flag_locals);
+        ctx.builder.block_end();
+    }
+}
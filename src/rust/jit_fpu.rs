@@ -0,0 +1,560 @@
+//! Keeps the x87 register stack in wasm locals across runs of consecutive x87 instructions.
+//!
+//! Within a run, the stack pointer is tracked at compile time relative to its value at the start
+//! of the run, so st(i) refers to a fixed register and can live in a pair of locals (mantissa and
+//! sign_exponent). The registers that are read are loaded once at the start, the registers that
+//! are written are stored once at the end (or before exiting with a fault), and the stack pointer
+//! and tag word are updated once. The generated code is only used if a guard at the start of the
+//! run confirms that no instruction causes a stack fault or a #NM, otherwise the code generated
+//! by jit_instructions for each instruction runs.
+
+use std::collections::HashMap;
+
+use analysis::{FpuArith, FpuOp, FpuOperand};
+use codegen;
+use cpu::global_pointers;
+use cpu::memory;
+use cpu_context::CpuContext;
+use jit::{BasicBlock, JitContext};
+use jit_instructions;
+use modrm::ModrmByte;
+use opstats;
+use profiler;
+use profiler::stat;
+use regs;
+use softfloat::F80;
+use wasmgen::wasm_builder::{WasmBuilder, WasmLocal, WasmLocalI64};
+
+const FPU_C1: i32 = 0x200;
+
+/// Runs shorter than this are left to the code generated per instruction. A single instruction
+/// gains nothing, as the guard, loads and stores cost about as much as the helper call they
+/// replace, and its per-instruction code has to be generated anyway for the guard's slow path.
+/// COMPILE_FPU_RUN_INSTRUCTIONS/COMPILE_FPU_RUN and FPU_RUN_GUARD_FAILED/FPU_RUN in the profiler
+/// show the run lengths and how often the slow path is taken
+const MIN_RUN_LENGTH: usize = 2;
+
+pub struct FpuRun {
+    /// Address and classification of each instruction of the run
+    instructions: Vec<(u32, FpuOp)>,
+    pub end_addr: u32,
+    /// Stack state after executing the run, assuming the guard passed
+    stack: FpuStack,
+}
+
+/// Static state of the register stack during a run. Register numbers are relative to the stack
+/// pointer at the start of the run, i.e. bit i refers to st(i) at the start of the run.
+#[derive(Clone, Copy, Default)]
+struct FpuStack {
+    /// Stack pointer relative to the one at the start of the run
+    top: u32,
+    /// Registers that are known to be empty or non-empty at this point
+    known_empty: u8,
+    known_nonempty: u8,
+    /// Registers that have to be empty or non-empty at the start of the run (checked by the
+    /// guard)
+    requires_empty: u8,
+    requires_nonempty: u8,
+    /// Registers whose value is read before being written by the run
+    live_in: u8,
+    /// Registers whose value was written by the run
+    written: u8,
+    /// Registers that were marked as empty or non-empty by a pop or push
+    became_empty: u8,
+    became_nonempty: u8,
+    pushed: bool,
+}
+
+impl FpuStack {
+    fn st(&self, i: u32) -> u32 { self.top + i & 7 }
+
+    fn read(&mut self, r: u32) -> Result<(), ()> {
+        let bit = 1 << r;
+        if self.known_empty & bit != 0 {
+            return Err(());
+        }
+        if self.known_nonempty & bit == 0 {
+            self.requires_nonempty |= bit;
+            self.known_nonempty |= bit;
+        }
+        if self.written & bit == 0 {
+            self.live_in |= bit;
+        }
+        Ok(())
+    }
+    fn write(&mut self, r: u32) { self.written |= 1 << r; }
+
+    fn push(&mut self) -> Result<(), ()> {
+        self.top = self.top.wrapping_sub(1) & 7;
+        let bit = 1 << self.top;
+        if self.known_nonempty & bit != 0 {
+            return Err(());
+        }
+        if self.known_empty & bit == 0 {
+            self.requires_empty |= bit;
+        }
+        self.known_empty &= !bit;
+        self.known_nonempty |= bit;
+        self.became_empty &= !bit;
+        self.became_nonempty |= bit;
+        self.written |= bit;
+        self.pushed = true;
+        Ok(())
+    }
+    fn pop(&mut self) {
+        let bit = 1 << self.top;
+        self.known_nonempty &= !bit;
+        self.known_empty |= bit;
+        self.became_nonempty &= !bit;
+        self.became_empty |= bit;
+        self.top = self.top + 1 & 7;
+    }
+
+    /// Apply the effect of an instruction, or Err if it certainly causes a stack fault
+    fn step(&mut self, op: FpuOp) -> Result<(), ()> {
+        let st0 = self.st(0);
+        match op {
+            FpuOp::Load(operand) => {
+                if let FpuOperand::Reg(r) = operand {
+                    self.read(self.st(r))?;
+                }
+                self.push()?;
+            },
+            FpuOp::LoadOne | FpuOp::LoadZero => self.push()?,
+            FpuOp::Store(operand, pop) => {
+                self.read(st0)?;
+                if let FpuOperand::Reg(r) = operand {
+                    self.write(self.st(r));
+                }
+                if pop {
+                    self.pop();
+                }
+            },
+            FpuOp::Xchg(r) => {
+                self.read(self.st(r))?;
+                self.read(st0)?;
+                self.write(self.st(r));
+                self.write(st0);
+            },
+            FpuOp::Chs | FpuOp::Abs => {
+                self.read(st0)?;
+                self.write(st0);
+            },
+            FpuOp::Arith {
+                operand,
+                target,
+                pop,
+                ..
+            } => {
+                self.read(st0)?;
+                if let FpuOperand::Reg(r) = operand {
+                    self.read(self.st(r))?;
+                }
+                self.write(self.st(target));
+                if pop {
+                    self.pop();
+                }
+            },
+        }
+        Ok(())
+    }
+}
+
+/// Find the runs of x87 instructions in this basic block that are handled by gen_run, by the
+/// address of their first instruction. The last instruction of the block is never part of a run,
+/// as jit_generate_basic_block handles it specially.
+pub fn find_runs(cpu: &CpuContext, block: &BasicBlock) -> HashMap<u32, FpuRun> {
+    let mut cpu = cpu.clone();
+    cpu.eip = block.addr;
+    let mut runs = HashMap::new();
+    let mut current: Option<FpuRun> = None;
+    while cpu.eip < block.last_instruction_addr {
+        let addr = cpu.eip;
+        cpu.prefixes = 0;
+        let op = ::analysis::fpu_op(&cpu);
+        ::analysis::analyze_step(&mut cpu);
+
+        if let Some(op) = op {
+            if let Some(run) = &mut current {
+                let mut stack = run.stack;
+                if stack.step(op).is_ok() {
+                    run.instructions.push((addr, op));
+                    run.end_addr = cpu.eip;
+                    run.stack = stack;
+                    continue;
+                }
+            }
+            finish_run(&mut runs, current.take());
+            let mut stack = FpuStack::default();
+            // fails for fld st(7), which always faults
+            if stack.step(op).is_ok() {
+                current = Some(FpuRun {
+                    instructions: vec![(addr, op)],
+                    end_addr: cpu.eip,
+                    stack,
+                });
+            }
+        }
+        else {
+            finish_run(&mut runs, current.take());
+        }
+    }
+    finish_run(&mut runs, current);
+    runs
+}
+
+fn finish_run(runs: &mut HashMap<u32, FpuRun>, run: Option<FpuRun>) {
+    if let Some(run) = run {
+        if run.instructions.len() >= MIN_RUN_LENGTH {
+            profiler::stat_increment(stat::COMPILE_FPU_RUN);
+            profiler::stat_increment_by(
+                stat::COMPILE_FPU_RUN_INSTRUCTIONS,
+                run.instructions.len() as u64,
+            );
+            runs.insert(run.instructions[0].0, run);
+        }
+    }
+}
+
+/// Generate code for the given run, leaving ctx.cpu.eip at its end
+pub fn gen_run(ctx: &mut JitContext, run: &FpuRun) {
+    if cfg!(feature = "profiler") {
+        for &(addr, _) in &run.instructions {
+            let instruction = memory::read32s(addr) as u32;
+            opstats::gen_opstats(ctx.builder, instruction);
+            opstats::record_opstat_compiled(instruction);
+        }
+    }
+
+    ctx.builder
+        .load_fixed_u8(global_pointers::fpu_stack_ptr as u32);
+    let top = ctx.builder.set_new_local();
+
+    // if((cr0 & (EM | TS)) == 0 && ((stack_empty ^ requires_empty) & requires) == 0)
+    dbg_assert!(regs::CR0_EM | regs::CR0_TS <= 0xFF);
+    ctx.builder
+        .load_fixed_u8(global_pointers::get_creg_offset(0));
+    ctx.builder.const_i32((regs::CR0_EM | regs::CR0_TS) as i32);
+    ctx.builder.and_i32();
+    ctx.builder.eqz_i32();
+    let requires = run.stack.requires_empty | run.stack.requires_nonempty;
+    if requires != 0 {
+        ctx.builder
+            .load_fixed_u8(global_pointers::fpu_stack_empty as u32);
+        gen_rotate(ctx.builder, &top, run.stack.requires_empty);
+        ctx.builder.xor_i32();
+        gen_rotate(ctx.builder, &top, requires);
+        ctx.builder.and_i32();
+        ctx.builder.eqz_i32();
+        ctx.builder.and_i32();
+    }
+    ctx.builder.if_void();
+    {
+        codegen::gen_profiler_stat_increment(ctx.builder, stat::FPU_RUN);
+        gen_run_fast(ctx, run, &top);
+    }
+    ctx.builder.else_();
+    {
+        codegen::gen_profiler_stat_increment(ctx.builder, stat::FPU_RUN_GUARD_FAILED);
+        for &(addr, _) in &run.instructions {
+            ctx.cpu.eip = addr;
+            let mut instruction_flags = 0;
+            jit_instructions::jit_instruction(ctx, &mut instruction_flags);
+        }
+    }
+    ctx.builder.block_end();
+
+    ctx.builder.free_local(top);
+    dbg_assert!(ctx.cpu.eip == run.end_addr);
+}
+
+fn gen_run_fast(ctx: &mut JitContext, run: &FpuRun, top: &WasmLocal) {
+    let mut regs: [Option<(WasmLocalI64, WasmLocal)>; 8] = Default::default();
+    for r in 0..8 {
+        if run.stack.live_in & 1 << r != 0 {
+            gen_st_address(ctx.builder, top, r);
+            ctx.builder.load_aligned_i64(global_pointers::fpu_st as u32);
+            let mantissa = ctx.builder.set_new_local_i64();
+            gen_st_address(ctx.builder, top, r);
+            ctx.builder
+                .load_aligned_u16(global_pointers::fpu_st as u32 + 8);
+            let sign_exponent = ctx.builder.set_new_local();
+            regs[r as usize] = Some((mantissa, sign_exponent));
+        }
+    }
+
+    let mut stack = FpuStack::default();
+    for &(addr, op) in &run.instructions {
+        ctx.cpu.eip = addr;
+        ctx.start_of_current_instruction = addr;
+        ctx.cpu.prefixes = 0;
+        let _opcode = ctx.cpu.read_imm8();
+        let modrm_byte = ctx.cpu.read_imm8();
+
+        if modrm_byte < 0xC0 {
+            let modrm_byte = ::modrm::decode(ctx.cpu, modrm_byte);
+
+            // Faults exit through a handler that first stores the stack as it was before this
+            // instruction. Instructions only write to registers after the last point where they
+            // can fault, so the locals still hold that state.
+            let done = ctx.builder.block_void();
+            let fault = ctx.builder.block_void();
+            let exit_with_fault_label = ctx.exit_with_fault_label;
+            ctx.exit_with_fault_label = fault;
+            let stack_before = stack;
+            gen_instruction(ctx, op, Some(modrm_byte), &mut stack, &mut regs);
+            ctx.exit_with_fault_label = exit_with_fault_label;
+            ctx.builder.br(done);
+            ctx.builder.block_end();
+            gen_writeback(ctx.builder, &stack_before, &regs, top);
+            ctx.builder.br(exit_with_fault_label);
+            ctx.builder.block_end();
+        }
+        else {
+            gen_instruction(ctx, op, None, &mut stack, &mut regs);
+        }
+    }
+
+    gen_writeback(ctx.builder, &stack, &regs, top);
+
+    for reg in regs.iter_mut() {
+        if let Some((mantissa, sign_exponent)) = reg.take() {
+            ctx.builder.free_local_i64(mantissa);
+            ctx.builder.free_local(sign_exponent);
+        }
+    }
+}
+
+fn gen_instruction(
+    ctx: &mut JitContext,
+    op: FpuOp,
+    modrm_byte: Option<ModrmByte>,
+    stack: &mut FpuStack,
+    regs: &mut [Option<(WasmLocalI64, WasmLocal)>; 8],
+) {
+    let st0 = stack.st(0);
+    let pushed = stack.st(7);
+    match op {
+        FpuOp::Load(FpuOperand::Reg(r)) => {
+            gen_get(ctx.builder, regs, stack.st(r));
+            gen_set(ctx.builder, regs, pushed);
+        },
+        FpuOp::Load(operand) => {
+            gen_operand(ctx, operand, modrm_byte, stack, regs);
+            gen_set(ctx.builder, regs, pushed);
+        },
+        FpuOp::LoadOne => {
+            ctx.builder.const_i64(F80::ONE.mantissa as i64);
+            ctx.builder.const_i32(F80::ONE.sign_exponent as i32);
+            gen_set(ctx.builder, regs, pushed);
+        },
+        FpuOp::LoadZero => {
+            ctx.builder.const_i64(F80::ZERO.mantissa as i64);
+            ctx.builder.const_i32(F80::ZERO.sign_exponent as i32);
+            gen_set(ctx.builder, regs, pushed);
+        },
+        FpuOp::Store(FpuOperand::Reg(r), _) => {
+            if r != 0 {
+                gen_get(ctx.builder, regs, st0);
+                gen_set(ctx.builder, regs, stack.st(r));
+            }
+        },
+        FpuOp::Store(operand, _) => {
+            codegen::gen_modrm_resolve(ctx, modrm_byte.unwrap());
+            let address_local = ctx.builder.set_new_local();
+            gen_get(ctx.builder, regs, st0);
+            match operand {
+                FpuOperand::M32 => ctx.builder.call_fn2_i64_i32_ret("f80_to_f32"),
+                FpuOperand::I16 => ctx.builder.call_fn2_i64_i32_ret("fpu_convert_to_i16"),
+                FpuOperand::I32 => ctx.builder.call_fn2_i64_i32_ret("fpu_convert_to_i32"),
+                FpuOperand::M64 => ctx.builder.call_fn2_i64_i32_ret_i64("f80_to_f64"),
+                FpuOperand::I64 => ctx.builder.call_fn2_i64_i32_ret_i64("fpu_convert_to_i64"),
+                FpuOperand::Reg(_) => {
+                    dbg_assert!(false);
+                },
+            }
+            match operand {
+                FpuOperand::M64 | FpuOperand::I64 => {
+                    let value_local = ctx.builder.set_new_local_i64();
+                    codegen::gen_safe_write64(ctx, &address_local, &value_local);
+                    ctx.builder.free_local_i64(value_local);
+                },
+                _ => {
+                    let value_local = ctx.builder.set_new_local();
+                    if operand == FpuOperand::I16 {
+                        codegen::gen_safe_write16(ctx, &address_local, &value_local);
+                    }
+                    else {
+                        codegen::gen_safe_write32(ctx, &address_local, &value_local);
+                    }
+                    ctx.builder.free_local(value_local);
+                },
+            }
+            ctx.builder.free_local(address_local);
+        },
+        FpuOp::Xchg(r) => {
+            // no code, the locals just swap roles
+            regs.swap(st0 as usize, stack.st(r) as usize);
+        },
+        FpuOp::Chs | FpuOp::Abs => {
+            let (_, sign_exponent) = regs[st0 as usize].as_ref().unwrap();
+            ctx.builder.get_local(sign_exponent);
+            if op == FpuOp::Chs {
+                ctx.builder.const_i32(0x8000);
+                ctx.builder.xor_i32();
+            }
+            else {
+                ctx.builder.const_i32(0x7FFF);
+                ctx.builder.and_i32();
+            }
+            ctx.builder.set_local(sign_exponent);
+        },
+        FpuOp::Arith {
+            op: arith,
+            operand,
+            target,
+            ..
+        } => {
+            ctx.builder
+                .const_i32(global_pointers::sse_scratch_register as i32);
+            let reversed = arith == FpuArith::SubR || arith == FpuArith::DivR;
+            if reversed {
+                gen_operand(ctx, operand, modrm_byte, stack, regs);
+                gen_get(ctx.builder, regs, st0);
+            }
+            else {
+                gen_get(ctx.builder, regs, st0);
+                gen_operand(ctx, operand, modrm_byte, stack, regs);
+            }
+            ctx.builder.call_fn5_i32_i64_i32_i64_i32(match arith {
+                FpuArith::Add => "fpu_add",
+                FpuArith::Mul => "fpu_mul",
+                FpuArith::Sub | FpuArith::SubR => "fpu_sub",
+                FpuArith::Div | FpuArith::DivR => "fpu_div",
+            });
+            ctx.builder
+                .load_fixed_i64(global_pointers::sse_scratch_register as u32);
+            ctx.builder
+                .load_fixed_u16(global_pointers::sse_scratch_register as u32 + 8);
+            gen_set(ctx.builder, regs, stack.st(target));
+        },
+    }
+    let ok = stack.step(op).is_ok();
+    dbg_assert!(ok);
+}
+
+/// Push the value of the operand as mantissa and sign_exponent
+fn gen_operand(
+    ctx: &mut JitContext,
+    operand: FpuOperand,
+    modrm_byte: Option<ModrmByte>,
+    stack: &FpuStack,
+    regs: &[Option<(WasmLocalI64, WasmLocal)>; 8],
+) {
+    match operand {
+        FpuOperand::Reg(r) => gen_get(ctx.builder, regs, stack.st(r)),
+        FpuOperand::M32 => codegen::gen_fpu_load_m32(ctx, modrm_byte.unwrap()),
+        FpuOperand::M64 => codegen::gen_fpu_load_m64(ctx, modrm_byte.unwrap()),
+        FpuOperand::I16 => codegen::gen_fpu_load_i16(ctx, modrm_byte.unwrap()),
+        FpuOperand::I32 => codegen::gen_fpu_load_i32(ctx, modrm_byte.unwrap()),
+        FpuOperand::I64 => codegen::gen_fpu_load_i64(ctx, modrm_byte.unwrap()),
+    }
+}
+
+fn gen_get(builder: &mut WasmBuilder, regs: &[Option<(WasmLocalI64, WasmLocal)>; 8], r: u32) {
+    let (mantissa, sign_exponent) = regs[r as usize].as_ref().unwrap();
+    builder.get_local_i64(mantissa);
+    builder.get_local(sign_exponent);
+}
+
+/// Pop mantissa and sign_exponent into the locals of the given register
+fn gen_set(builder: &mut WasmBuilder, regs: &mut [Option<(WasmLocalI64, WasmLocal)>; 8], r: u32) {
+    match &regs[r as usize] {
+        Some((mantissa, sign_exponent)) => {
+            builder.set_local(sign_exponent);
+            builder.set_local_i64(mantissa);
+        },
+        None => {
+            let sign_exponent = builder.set_new_local();
+            let mantissa = builder.set_new_local_i64();
+            regs[r as usize] = Some((mantissa, sign_exponent));
+        },
+    }
+}
+
+/// Store the written registers, the stack pointer, the tag word and C1 to memory
+fn gen_writeback(
+    builder: &mut WasmBuilder,
+    stack: &FpuStack,
+    regs: &[Option<(WasmLocalI64, WasmLocal)>; 8],
+    top: &WasmLocal,
+) {
+    for r in 0..8 {
+        if stack.written & 1 << r != 0 {
+            let (mantissa, sign_exponent) = regs[r as usize].as_ref().unwrap();
+            gen_st_address(builder, top, r);
+            builder.get_local_i64(mantissa);
+            builder.store_aligned_i64(global_pointers::fpu_st as u32);
+            gen_st_address(builder, top, r);
+            builder.get_local(sign_exponent);
+            builder.store_unaligned_u16(global_pointers::fpu_st as u32 + 8);
+        }
+    }
+
+    if stack.top != 0 {
+        builder.const_i32(global_pointers::fpu_stack_ptr as i32);
+        builder.get_local(top);
+        builder.const_i32(stack.top as i32);
+        builder.add_i32();
+        builder.const_i32(7);
+        builder.and_i32();
+        builder.store_u8(0);
+    }
+
+    if stack.became_empty | stack.became_nonempty != 0 {
+        builder.const_i32(global_pointers::fpu_stack_empty as i32);
+        builder.load_fixed_u8(global_pointers::fpu_stack_empty as u32);
+        if stack.became_empty != 0 {
+            gen_rotate(builder, top, stack.became_empty);
+            builder.or_i32();
+        }
+        if stack.became_nonempty != 0 {
+            gen_rotate(builder, top, stack.became_nonempty);
+            builder.const_i32(-1);
+            builder.xor_i32();
+            builder.and_i32();
+        }
+        builder.store_u8(0);
+    }
+
+    if stack.pushed {
+        builder.const_i32(global_pointers::fpu_status_word as i32);
+        builder.load_fixed_u16(global_pointers::fpu_status_word as u32);
+        builder.const_i32(!FPU_C1);
+        builder.and_i32();
+        builder.store_unaligned_u16(0);
+    }
+}
+
+/// Push the offset of the register that is st(r) at the start of the run, relative to fpu_st
+fn gen_st_address(builder: &mut WasmBuilder, top: &WasmLocal, r: u32) {
+    builder.get_local(top);
+    builder.const_i32(r as i32);
+    builder.add_i32();
+    builder.const_i32(7);
+    builder.and_i32();
+    builder.const_i32(4);
+    builder.shl_i32();
+}
+
+/// Push the mask of registers relative to the start of the run, rotated to absolute register
+/// numbers: ((mask * 0x101) << top >> 8) & 0xFF
+fn gen_rotate(builder: &mut WasmBuilder, top: &WasmLocal, mask: u8) {
+    builder.const_i32(mask as i32 * 0x101);
+    builder.get_local(top);
+    builder.shl_i32();
+    builder.const_i32(8);
+    builder.shr_u_i32();
+    builder.const_i32(0xFF);
+    builder.and_i32();
+}
@@ -8,6 +8,8 @@ use cpu::cpu::{
 };
 use cpu::global_pointers;
 use jit::{Instruction, InstructionOperand, JitContext};
+use jit_flags;
+use jit_flags::LazyFlags;
 use modrm::{jit_add_seg_offset, jit_add_seg_offset_no_override, ModrmByte};
 use prefix::SEG_PREFIX_ZERO;
 use prefix::{PREFIX_66, PREFIX_67, PREFIX_F2, PREFIX_F3};
@@ -16,6 +18,7 @@ use regs::{AX, BP, BX, CX, DI, DX, SI, SP};
 use regs::{CS, DS, ES, FS, GS, SS};
 use regs::{EAX, EBP, EBX, ECX, EDI, EDX, ESI, ESP};
 use wasmgen::wasm_builder::{WasmBuilder, WasmLocal};
+use wasmgen::wasm_opcodes as op;
 
 enum LocalOrImmediate<'a> {
     WasmLocal(&'a WasmLocal),
@@ -168,6 +171,16 @@ fn sse_read128_xmm_xmm(ctx: &mut JitContext, name: &str, r1: u32, r2: u32) {
     ctx.builder.call_fn2(name);
 }
 fn sse_mov_xmm_xmm(ctx: &mut JitContext, r1: u32, r2: u32) {
+    if ::config::JIT_USE_SIMD {
+        ctx.builder
+            .const_i32(global_pointers::get_reg_xmm_offset(r2) as i32);
+        ctx.builder
+            .const_i32(global_pointers::get_reg_xmm_offset(r1) as i32);
+        ctx.builder.load_aligned_v128(0);
+        ctx.builder.store_aligned_v128(0);
+        return;
+    }
+
     ctx.builder
         .const_i32(global_pointers::get_reg_xmm_offset(r2) as i32);
     ctx.builder
@@ -183,6 +196,186 @@ fn sse_mov_xmm_xmm(ctx: &mut JitContext, r1: u32, r2: u32) {
     ctx.builder.store_aligned_i64(0);
 }
 
+/// An sse instruction that maps to wasm simd instructions, see sse_simd_xmm_xmm
+#[derive(Copy, Clone)]
+enum Simd {
+    /// dest = op(dest, source)
+    Binary(u32),
+    /// dest = op(source, dest)
+    BinaryReversed(u32),
+    /// dest = op(source)
+    Unary(u32),
+    /// dest = shuffle(dest, source)
+    Shuffle([u8; 16]),
+}
+
+fn gen_sse_simd(ctx: &mut JitContext, simd: Simd, source: u32, r: u32) {
+    let dest = global_pointers::get_reg_xmm_offset(r);
+    ctx.builder.const_i32(dest as i32);
+    match simd {
+        Simd::Binary(op) => {
+            ctx.builder.const_i32(dest as i32);
+            ctx.builder.load_aligned_v128(0);
+            ctx.builder.const_i32(source as i32);
+            ctx.builder.load_aligned_v128(0);
+            ctx.builder.simd(op);
+        },
+        Simd::BinaryReversed(op) => {
+            ctx.builder.const_i32(source as i32);
+            ctx.builder.load_aligned_v128(0);
+            ctx.builder.const_i32(dest as i32);
+            ctx.builder.load_aligned_v128(0);
+            ctx.builder.simd(op);
+        },
+        Simd::Unary(op) => {
+            ctx.builder.const_i32(source as i32);
+            ctx.builder.load_aligned_v128(0);
+            ctx.builder.simd(op);
+        },
+        Simd::Shuffle(lanes) => {
+            ctx.builder.const_i32(dest as i32);
+            ctx.builder.load_aligned_v128(0);
+            ctx.builder.const_i32(source as i32);
+            ctx.builder.load_aligned_v128(0);
+            ctx.builder.shuffle_i8x16(lanes);
+        },
+    }
+    ctx.builder.store_aligned_v128(0);
+}
+
+/// Like sse_read128_xmm_xmm, but inline using wasm simd instructions if they're available
+fn sse_simd_xmm_xmm(ctx: &mut JitContext, name: &str, simd: Simd, r1: u32, r2: u32) {
+    if ::config::JIT_USE_SIMD {
+        gen_sse_simd(ctx, simd, global_pointers::get_reg_xmm_offset(r1), r2);
+    }
+    else {
+        sse_read128_xmm_xmm(ctx, name, r1, r2);
+    }
+}
+fn sse_simd_xmm_mem(ctx: &mut JitContext, name: &str, simd: Simd, modrm_byte: ModrmByte, r: u32) {
+    if ::config::JIT_USE_SIMD {
+        let source = global_pointers::sse_scratch_register as u32;
+        codegen::gen_modrm_resolve_safe_read128(ctx, modrm_byte, source);
+        gen_sse_simd(ctx, simd, source, r);
+    }
+    else {
+        sse_read128_xmm_mem(ctx, name, modrm_byte, r);
+    }
+}
+
+/// Shuffle lanes for punpckl* and punpckh*: Interleave the elements of size `size` from the low
+/// (or high) halves of both operands
+fn simd_unpack_lanes(size: u8, high: bool) -> [u8; 16] {
+    let mut lanes = [0; 16];
+    let base = if high { 8 } else { 0 };
+    for i in 0..16 {
+        let element = i / size;
+        let byte = i % size;
+        let from_source = if element & 1 == 1 { 16 } else { 0 };
+        lanes[i as usize] = from_source + base + element / 2 * size + byte;
+    }
+    lanes
+}
+
+/// Shuffle lanes that move the elements of size `size` from `selection` to their index
+fn simd_select_lanes(size: u8, selection: &[u8]) -> [u8; 16] {
+    dbg_assert!(selection.len() as u8 * size == 16);
+    let mut lanes = [0; 16];
+    for i in 0..16 {
+        lanes[i as usize] = selection[(i / size) as usize] * size + i % size;
+    }
+    lanes
+}
+
+/// The i-th two-bit element index of imm8, for pshufd and shufps
+fn imm8_select(imm8: u32, i: u32) -> u8 { (imm8 >> (2 * i) & 3) as u8 }
+
+// Elements of the source (the second operand) start at 4 for dwords and 8 for words
+fn simd_pshufd_lanes(imm8: u32) -> [u8; 16] {
+    let select = |i| 4 + imm8_select(imm8, i);
+    simd_select_lanes(4, &[select(0), select(1), select(2), select(3)])
+}
+fn simd_pshuflw_lanes(imm8: u32) -> [u8; 16] {
+    let select = |i| 8 + imm8_select(imm8, i);
+    simd_select_lanes(
+        2,
+        &[select(0), select(1), select(2), select(3), 12, 13, 14, 15],
+    )
+}
+fn simd_pshufhw_lanes(imm8: u32) -> [u8; 16] {
+    let select = |i| 12 + imm8_select(imm8, i);
+    simd_select_lanes(
+        2,
+        &[8, 9, 10, 11, select(0), select(1), select(2), select(3)],
+    )
+}
+fn simd_shufps_lanes(imm8: u32) -> [u8; 16] {
+    let select = |i| imm8_select(imm8, i);
+    simd_select_lanes(4, &[select(0), select(1), 4 + select(2), 4 + select(3)])
+}
+fn simd_shufpd_lanes(imm8: u32) -> [u8; 16] {
+    simd_select_lanes(8, &[(imm8 & 1) as u8, 2 + (imm8 >> 1 & 1) as u8])
+}
+
+/// psrlw, psraw, psllw and friends with an immediate count. Larger counts than the element size
+/// clear the register (or fill it with the sign bit for arithmetic shifts), while wasm takes them
+/// modulo the element size
+fn sse_simd_shift_imm(
+    ctx: &mut JitContext,
+    name: &str,
+    op: u32,
+    bits: u32,
+    arithmetic: bool,
+    r: u32,
+    imm8: u32,
+) {
+    if !::config::JIT_USE_SIMD {
+        ctx.builder.const_i32(r as i32);
+        ctx.builder.const_i32(imm8 as i32);
+        ctx.builder.call_fn2(name);
+        return;
+    }
+    let dest = global_pointers::get_reg_xmm_offset(r);
+    ctx.builder.const_i32(dest as i32);
+    if imm8 >= bits && !arithmetic {
+        ctx.builder.const_v128([0; 16]);
+    }
+    else {
+        ctx.builder.const_i32(dest as i32);
+        ctx.builder.load_aligned_v128(0);
+        ctx.builder.const_i32(u32::min(imm8, bits - 1) as i32);
+        ctx.builder.simd(op);
+    }
+    ctx.builder.store_aligned_v128(0);
+}
+
+/// psrldq and pslldq: Shuffle with a zero vector, which provides the bytes shifted in
+fn sse_simd_shift_bytes(ctx: &mut JitContext, name: &str, right: bool, r: u32, imm8: u32) {
+    if !::config::JIT_USE_SIMD {
+        ctx.builder.const_i32(r as i32);
+        ctx.builder.const_i32(imm8 as i32);
+        ctx.builder.call_fn2(name);
+        return;
+    }
+    let count = u32::min(imm8, 16) as u8;
+    let mut lanes = [16; 16];
+    for i in 0..16 {
+        if right && i + count < 16 {
+            lanes[i as usize] = i + count;
+        }
+        else if !right && i >= count {
+            lanes[i as usize] = i - count;
+        }
+    }
+    let dest = global_pointers::get_reg_xmm_offset(r);
+    ctx.builder.const_i32(dest as i32);
+    ctx.builder.const_i32(dest as i32);
+    ctx.builder.load_aligned_v128(0);
+    ctx.builder.const_v128([0; 16]);
+    ctx.builder.shuffle_i8x16(lanes);
+    ctx.builder.store_aligned_v128(0);
+}
+
 fn mmx_read64_mm_mem32(ctx: &mut JitContext, name: &str, modrm_byte: ModrmByte, r: u32) {
     codegen::gen_modrm_resolve_safe_read32(ctx, modrm_byte);
     ctx.builder.const_i32(r as i32);
@@ -952,16 +1145,23 @@ fn gen_add8(ctx: &mut JitContext, dest_operand: &WasmLocal, source_operand: &Loc
 fn gen_add32(ctx: &mut JitContext, dest_operand: &WasmLocal, source_operand: &LocalOrImmediate) {
     ctx.last_instruction = Instruction::Arithmetic { opsize: OPSIZE_32 };
 
-    codegen::gen_set_last_op1(ctx.builder, &dest_operand);
+    if ctx.lazy_flags == LazyFlags::Dead {
+        ctx.builder.get_local(&dest_operand);
+        source_operand.gen_get(ctx.builder);
+        ctx.builder.add_i32();
+        ctx.builder.set_local(dest_operand);
+        return;
+    }
+
+    jit_flags::gen_set_last_op1(ctx, &dest_operand);
 
     ctx.builder.get_local(&dest_operand);
     source_operand.gen_get(ctx.builder);
     ctx.builder.add_i32();
     ctx.builder.set_local(dest_operand);
 
-    codegen::gen_set_last_result(ctx.builder, &dest_operand);
-    codegen::gen_set_last_op_size(ctx.builder, OPSIZE_32);
-    codegen::gen_set_flags_changed(ctx.builder, FLAGS_ALL);
+    jit_flags::gen_set_last_result(ctx, &dest_operand);
+    jit_flags::gen_set_last_op_size_and_flags_changed(ctx, FLAGS_ALL);
 }
 
 fn gen_sub8(ctx: &mut JitContext, dest_operand: &WasmLocal, source_operand: &LocalOrImmediate) {
@@ -990,16 +1190,23 @@ fn gen_sub8(ctx: &mut JitContext, dest_operand: &WasmLocal, source_operand: &Loc
 fn gen_sub32(ctx: &mut JitContext, dest_operand: &WasmLocal, source_operand: &LocalOrImmediate) {
     ctx.last_instruction = Instruction::Sub { opsize: OPSIZE_32 };
 
-    codegen::gen_set_last_op1(ctx.builder, &dest_operand);
+    if ctx.lazy_flags == LazyFlags::Dead {
+        ctx.builder.get_local(&dest_operand);
+        source_operand.gen_get(ctx.builder);
+        ctx.builder.sub_i32();
+        ctx.builder.set_local(dest_operand);
+        return;
+    }
+
+    jit_flags::gen_set_last_op1(ctx, &dest_operand);
 
     ctx.builder.get_local(&dest_operand);
     source_operand.gen_get(ctx.builder);
     ctx.builder.sub_i32();
     ctx.builder.set_local(dest_operand);
 
-    codegen::gen_set_last_result(ctx.builder, &dest_operand);
-    codegen::gen_set_last_op_size(ctx.builder, OPSIZE_32);
-    codegen::gen_set_flags_changed(ctx.builder, FLAGS_ALL | FLAG_SUB);
+    jit_flags::gen_set_last_result(ctx, &dest_operand);
+    jit_flags::gen_set_last_op_size_and_flags_changed(ctx, FLAGS_ALL | FLAG_SUB);
 }
 
 fn gen_cmp(
@@ -1029,6 +1236,22 @@ fn gen_cmp(
         opsize: size,
     };
 
+    match ctx.lazy_flags {
+        LazyFlags::Dead => return,
+        LazyFlags::Locals => {
+            dbg_assert!(size == OPSIZE_32);
+            ctx.builder.get_local(&dest_operand);
+            source_operand.gen_get(ctx.builder);
+            ctx.builder.sub_i32();
+            ctx.builder
+                .set_local(&ctx.flag_locals.as_ref().unwrap().last_result);
+            jit_flags::gen_set_last_op1(ctx, dest_operand);
+            jit_flags::gen_set_last_op_size_and_flags_changed(ctx, FLAGS_ALL | FLAG_SUB);
+            return;
+        },
+        LazyFlags::Memory => {},
+    }
+
     ctx.builder.const_i32(global_pointers::last_result as i32);
     if source_operand.is_zero() {
         ctx.builder.get_local(&dest_operand);
@@ -1247,10 +1470,14 @@ fn gen_and32(ctx: &mut JitContext, dest_operand: &WasmLocal, source_operand: &Lo
     ctx.builder.and_i32();
     ctx.builder.set_local(dest_operand);
 
-    codegen::gen_set_last_result(ctx.builder, &dest_operand);
-    codegen::gen_set_last_op_size(ctx.builder, OPSIZE_32);
-    codegen::gen_set_flags_changed(
-        ctx.builder,
+    if ctx.lazy_flags == LazyFlags::Dead {
+        codegen::gen_clear_flags_bits(ctx.builder, FLAG_CARRY | FLAG_OVERFLOW | FLAG_ADJUST);
+        return;
+    }
+
+    jit_flags::gen_set_last_result(ctx, &dest_operand);
+    jit_flags::gen_set_last_op_size_and_flags_changed(
+        ctx,
         FLAGS_ALL & !FLAG_CARRY & !FLAG_OVERFLOW & !FLAG_ADJUST,
     );
     codegen::gen_clear_flags_bits(ctx.builder, FLAG_CARRY | FLAG_OVERFLOW | FLAG_ADJUST);
@@ -1264,6 +1491,30 @@ fn gen_test(
 ) {
     ctx.last_instruction = Instruction::Arithmetic { opsize: size };
 
+    match ctx.lazy_flags {
+        LazyFlags::Dead => {
+            codegen::gen_clear_flags_bits(ctx.builder, FLAG_CARRY | FLAG_OVERFLOW | FLAG_ADJUST);
+            return;
+        },
+        LazyFlags::Locals => {
+            dbg_assert!(size == OPSIZE_32);
+            ctx.builder.get_local(&dest_operand);
+            if !source_operand.eq_local(dest_operand) {
+                source_operand.gen_get(ctx.builder);
+                ctx.builder.and_i32();
+            }
+            ctx.builder
+                .set_local(&ctx.flag_locals.as_ref().unwrap().last_result);
+            jit_flags::gen_set_last_op_size_and_flags_changed(
+                ctx,
+                FLAGS_ALL & !FLAG_CARRY & !FLAG_OVERFLOW & !FLAG_ADJUST,
+            );
+            codegen::gen_clear_flags_bits(ctx.builder, FLAG_CARRY | FLAG_OVERFLOW | FLAG_ADJUST);
+            return;
+        },
+        LazyFlags::Memory => {},
+    }
+
     ctx.builder.const_i32(global_pointers::last_result as i32);
     if source_operand.eq_local(dest_operand) {
         ctx.builder.get_local(&dest_operand);
@@ -1319,10 +1570,14 @@ fn gen_or32(ctx: &mut JitContext, dest_operand: &WasmLocal, source_operand: &Loc
     ctx.builder.or_i32();
     ctx.builder.set_local(dest_operand);
 
-    codegen::gen_set_last_result(ctx.builder, &dest_operand);
-    codegen::gen_set_last_op_size(ctx.builder, OPSIZE_32);
-    codegen::gen_set_flags_changed(
-        ctx.builder,
+    if ctx.lazy_flags == LazyFlags::Dead {
+        codegen::gen_clear_flags_bits(ctx.builder, FLAG_CARRY | FLAG_OVERFLOW | FLAG_ADJUST);
+        return;
+    }
+
+    jit_flags::gen_set_last_result(ctx, &dest_operand);
+    jit_flags::gen_set_last_op_size_and_flags_changed(
+        ctx,
         FLAGS_ALL & !FLAG_CARRY & !FLAG_OVERFLOW & !FLAG_ADJUST,
     );
     codegen::gen_clear_flags_bits(ctx.builder, FLAG_CARRY | FLAG_OVERFLOW | FLAG_ADJUST);
@@ -1364,10 +1619,14 @@ fn gen_xor32(ctx: &mut JitContext, dest_operand: &WasmLocal, source_operand: &Lo
         ctx.builder.set_local(dest_operand);
     }
 
-    codegen::gen_set_last_result(ctx.builder, &dest_operand);
-    codegen::gen_set_last_op_size(ctx.builder, OPSIZE_32);
-    codegen::gen_set_flags_changed(
-        ctx.builder,
+    if ctx.lazy_flags == LazyFlags::Dead {
+        codegen::gen_clear_flags_bits(ctx.builder, FLAG_CARRY | FLAG_OVERFLOW | FLAG_ADJUST);
+        return;
+    }
+
+    jit_flags::gen_set_last_result(ctx, &dest_operand);
+    jit_flags::gen_set_last_op_size_and_flags_changed(
+        ctx,
         FLAGS_ALL & !FLAG_CARRY & !FLAG_OVERFLOW & !FLAG_ADJUST,
     );
     codegen::gen_clear_flags_bits(ctx.builder, FLAG_CARRY | FLAG_OVERFLOW | FLAG_ADJUST);
@@ -4454,18 +4713,18 @@ fn gen_string_ins(ctx: &mut JitContext, ins: String, size: u8, prefix: u8) {
     dbg_assert!(prefix == 0 || prefix == 0xF2 || prefix == 0xF3);
     dbg_assert!(size == 8 || size == 16 || size == 32);
 
-    if prefix == 0 {
-        fn get_direction(ctx: &mut JitContext, size: u8) {
-            let bytes: i32 = (size / 8).into();
-            dbg_assert!(bytes == 1 || bytes == 2 || bytes == 4);
-            ctx.builder.const_i32(-bytes);
-            ctx.builder.const_i32(bytes);
-            codegen::gen_get_flags(ctx.builder);
-            ctx.builder.const_i32(FLAG_DIRECTION);
-            ctx.builder.and_i32();
-            ctx.builder.select();
-        }
+    fn get_direction(ctx: &mut JitContext, size: u8) {
+        let bytes: i32 = (size / 8).into();
+        dbg_assert!(bytes == 1 || bytes == 2 || bytes == 4);
+        ctx.builder.const_i32(-bytes);
+        ctx.builder.const_i32(bytes);
+        codegen::gen_get_flags(ctx.builder);
+        ctx.builder.const_i32(FLAG_DIRECTION);
+        ctx.builder.and_i32();
+        ctx.builder.select();
+    }
 
+    if prefix == 0 {
         match &ins {
             String::LODS => {
                 if ctx.cpu.asize_32() {
@@ -4658,6 +4917,64 @@ fn gen_string_ins(ctx: &mut JitContext, ins: String, size: u8, prefix: u8) {
         }
     }
 
+    let inline_rep_movsd = ins == String::MOVS && size == 32 && ctx.cpu.asize_32();
+    if inline_rep_movsd {
+        // Small counts are copied here, one element at a time, with the registers updated after
+        // each element, so that a page fault restarts the instruction with the remaining count
+        codegen::gen_get_reg32(ctx, regs::ECX);
+        ctx.builder.const_i32(::config::JIT_REP_MOVSD_INLINE_MAX);
+        ctx.builder.leu_i32();
+        ctx.builder.if_void();
+        {
+            get_direction(ctx, size);
+            let direction = ctx.builder.set_new_local();
+
+            let done = ctx.builder.block_void();
+            let next = ctx.builder.loop_void();
+
+            codegen::gen_get_reg32(ctx, regs::ECX);
+            ctx.builder.eqz_i32();
+            ctx.builder.br_if(done);
+
+            codegen::gen_get_reg32(ctx, regs::EDI);
+            jit_add_seg_offset_no_override(ctx, regs::ES);
+            let dest_address = ctx.builder.set_new_local();
+
+            codegen::gen_get_reg32(ctx, regs::ESI);
+            jit_add_seg_offset(ctx, regs::DS);
+            let source_address = ctx.builder.set_new_local();
+
+            codegen::gen_safe_read32(ctx, &source_address);
+            ctx.builder.free_local(source_address);
+            let value = ctx.builder.set_new_local();
+            codegen::gen_safe_write32(ctx, &dest_address, &value);
+            ctx.builder.free_local(value);
+            ctx.builder.free_local(dest_address);
+
+            codegen::gen_get_reg32(ctx, regs::EDI);
+            ctx.builder.get_local(&direction);
+            ctx.builder.add_i32();
+            codegen::gen_set_reg32(ctx, regs::EDI);
+
+            codegen::gen_get_reg32(ctx, regs::ESI);
+            ctx.builder.get_local(&direction);
+            ctx.builder.add_i32();
+            codegen::gen_set_reg32(ctx, regs::ESI);
+
+            codegen::gen_get_reg32(ctx, regs::ECX);
+            ctx.builder.const_i32(1);
+            ctx.builder.sub_i32();
+            codegen::gen_set_reg32(ctx, regs::ECX);
+
+            ctx.builder.br(next);
+            ctx.builder.block_end();
+            ctx.builder.block_end();
+
+            ctx.builder.free_local(direction);
+        }
+        ctx.builder.else_();
+    }
+
     let mut args = 0;
     args += 1;
     ctx.builder.const_i32(ctx.cpu.asize_32() as i32);
@@ -4717,6 +5034,10 @@ fn gen_string_ins(ctx: &mut JitContext, ins: String, size: u8, prefix: u8) {
         dbg_assert!(false);
     }
     codegen::gen_move_registers_from_memory_to_locals(ctx);
+
+    if inline_rep_movsd {
+        ctx.builder.block_end();
+    }
 }
 
 pub fn instr_6C_jit(ctx: &mut JitContext) { gen_string_ins(ctx, String::INS, 8, 0) }
@@ -5184,6 +5505,11 @@ pub fn instr_F30FC2_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32,
 }
 
 pub fn instr_0FC6_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32, imm8: u32) {
+    if ::config::JIT_USE_SIMD {
+        let source = global_pointers::get_reg_xmm_offset(r1);
+        gen_sse_simd(ctx, Simd::Shuffle(simd_shufps_lanes(imm8)), source, r2);
+        return;
+    }
     let dest = global_pointers::get_reg_xmm_offset(r1);
     ctx.builder.const_i32(dest as i32);
     ctx.builder.const_i32(r2 as i32);
@@ -5193,12 +5519,21 @@ pub fn instr_0FC6_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32, imm8: u32) {
 pub fn instr_0FC6_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32, imm8: u32) {
     let dest = global_pointers::sse_scratch_register as u32;
     codegen::gen_modrm_resolve_safe_read128(ctx, modrm_byte, dest);
+    if ::config::JIT_USE_SIMD {
+        gen_sse_simd(ctx, Simd::Shuffle(simd_shufps_lanes(imm8)), dest, r);
+        return;
+    }
     ctx.builder.const_i32(dest as i32);
     ctx.builder.const_i32(r as i32);
     ctx.builder.const_i32(imm8 as i32);
     ctx.builder.call_fn3("instr_0FC6");
 }
 pub fn instr_660FC6_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32, imm8: u32) {
+    if ::config::JIT_USE_SIMD {
+        let source = global_pointers::get_reg_xmm_offset(r1);
+        gen_sse_simd(ctx, Simd::Shuffle(simd_shufpd_lanes(imm8)), source, r2);
+        return;
+    }
     let dest = global_pointers::get_reg_xmm_offset(r1);
     ctx.builder.const_i32(dest as i32);
     ctx.builder.const_i32(r2 as i32);
@@ -5208,6 +5543,10 @@ pub fn instr_660FC6_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32, imm8: u32) {
 pub fn instr_660FC6_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32, imm8: u32) {
     let dest = global_pointers::sse_scratch_register as u32;
     codegen::gen_modrm_resolve_safe_read128(ctx, modrm_byte, dest);
+    if ::config::JIT_USE_SIMD {
+        gen_sse_simd(ctx, Simd::Shuffle(simd_shufpd_lanes(imm8)), dest, r);
+        return;
+    }
     ctx.builder.const_i32(dest as i32);
     ctx.builder.const_i32(r as i32);
     ctx.builder.const_i32(imm8 as i32);
@@ -5504,16 +5843,40 @@ pub fn instr_660F14_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
 }
 
 pub fn instr_0F15_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_0F15", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_0F15",
+        Simd::Shuffle(simd_unpack_lanes(4, true)),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_0F15_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_0F15", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_0F15",
+        Simd::Shuffle(simd_unpack_lanes(4, true)),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660F15_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F15", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F15",
+        Simd::Shuffle(simd_unpack_lanes(8, true)),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F15_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F15", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660F15",
+        Simd::Shuffle(simd_unpack_lanes(8, true)),
+        r1,
+        r2,
+    );
 }
 
 pub fn instr_0F28_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
@@ -5682,16 +6045,28 @@ pub fn instr_660F2F_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
 }
 
 pub fn instr_0F51_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_0F51", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_0F51",
+        Simd::Unary(op::SIMD_F32X4SQRT),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_0F51_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_0F51", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_0F51", Simd::Unary(op::SIMD_F32X4SQRT), r1, r2);
 }
 pub fn instr_660F51_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F51", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F51",
+        Simd::Unary(op::SIMD_F64X2SQRT),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F51_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F51", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660F51", Simd::Unary(op::SIMD_F64X2SQRT), r1, r2);
 }
 pub fn instr_F20F51_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
     sse_read64_xmm_mem(ctx, "instr_F20F51", modrm_byte, r);
@@ -5733,68 +6108,140 @@ pub fn instr_F30F53_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
 }
 
 pub fn instr_0F54_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_0F54", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_0F54",
+        Simd::Binary(op::SIMD_V128AND),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_0F54_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_0F54", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_0F54", Simd::Binary(op::SIMD_V128AND), r1, r2);
 }
 pub fn instr_660F54_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F54", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F54",
+        Simd::Binary(op::SIMD_V128AND),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F54_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F54", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660F54", Simd::Binary(op::SIMD_V128AND), r1, r2);
 }
 
 pub fn instr_0F55_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_0F55", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_0F55",
+        Simd::BinaryReversed(op::SIMD_V128ANDNOT),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_0F55_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_0F55", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_0F55",
+        Simd::BinaryReversed(op::SIMD_V128ANDNOT),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660F55_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F55", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F55",
+        Simd::BinaryReversed(op::SIMD_V128ANDNOT),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F55_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F55", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660F55",
+        Simd::BinaryReversed(op::SIMD_V128ANDNOT),
+        r1,
+        r2,
+    );
 }
 
 pub fn instr_0F56_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_0F56", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_0F56",
+        Simd::Binary(op::SIMD_V128OR),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_0F56_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_0F56", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_0F56", Simd::Binary(op::SIMD_V128OR), r1, r2);
 }
 pub fn instr_660F56_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F56", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F56",
+        Simd::Binary(op::SIMD_V128OR),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F56_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F56", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660F56", Simd::Binary(op::SIMD_V128OR), r1, r2);
 }
 
 pub fn instr_0F57_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_0F57", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_0F57",
+        Simd::Binary(op::SIMD_V128XOR),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_0F57_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_0F57", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_0F57", Simd::Binary(op::SIMD_V128XOR), r1, r2);
 }
 pub fn instr_660F57_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F57", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F57",
+        Simd::Binary(op::SIMD_V128XOR),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F57_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F57", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660F57", Simd::Binary(op::SIMD_V128XOR), r1, r2);
 }
 
 pub fn instr_0F58_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_0F58", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_0F58",
+        Simd::Binary(op::SIMD_F32X4ADD),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_0F58_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_0F58", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_0F58", Simd::Binary(op::SIMD_F32X4ADD), r1, r2);
 }
 pub fn instr_660F58_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F58", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F58",
+        Simd::Binary(op::SIMD_F64X2ADD),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F58_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F58", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660F58", Simd::Binary(op::SIMD_F64X2ADD), r1, r2);
 }
 pub fn instr_F20F58_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
     sse_read64_xmm_mem(ctx, "instr_F20F58", modrm_byte, r);
@@ -5810,16 +6257,28 @@ pub fn instr_F30F58_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
 }
 
 pub fn instr_0F59_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_0F59", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_0F59",
+        Simd::Binary(op::SIMD_F32X4MUL),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_0F59_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_0F59", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_0F59", Simd::Binary(op::SIMD_F32X4MUL), r1, r2);
 }
 pub fn instr_660F59_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F59", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F59",
+        Simd::Binary(op::SIMD_F64X2MUL),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F59_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F59", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660F59", Simd::Binary(op::SIMD_F64X2MUL), r1, r2);
 }
 pub fn instr_F20F59_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
     sse_read64_xmm_mem(ctx, "instr_F20F59", modrm_byte, r);
@@ -5879,16 +6338,28 @@ pub fn instr_F30F5B_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
 }
 
 pub fn instr_0F5C_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_0F5C", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_0F5C",
+        Simd::Binary(op::SIMD_F32X4SUB),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_0F5C_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_0F5C", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_0F5C", Simd::Binary(op::SIMD_F32X4SUB), r1, r2);
 }
 pub fn instr_660F5C_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F5C", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F5C",
+        Simd::Binary(op::SIMD_F64X2SUB),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F5C_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F5C", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660F5C", Simd::Binary(op::SIMD_F64X2SUB), r1, r2);
 }
 pub fn instr_F20F5C_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
     sse_read64_xmm_mem(ctx, "instr_F20F5C", modrm_byte, r);
@@ -5904,16 +6375,40 @@ pub fn instr_F30F5C_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
 }
 
 pub fn instr_0F5D_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_0F5D", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_0F5D",
+        Simd::BinaryReversed(op::SIMD_F32X4PMIN),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_0F5D_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_0F5D", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_0F5D",
+        Simd::BinaryReversed(op::SIMD_F32X4PMIN),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660F5D_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F5D", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F5D",
+        Simd::BinaryReversed(op::SIMD_F64X2PMIN),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F5D_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F5D", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660F5D",
+        Simd::BinaryReversed(op::SIMD_F64X2PMIN),
+        r1,
+        r2,
+    );
 }
 pub fn instr_F20F5D_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
     sse_read64_xmm_mem(ctx, "instr_F20F5D", modrm_byte, r);
@@ -5929,16 +6424,28 @@ pub fn instr_F30F5D_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
 }
 
 pub fn instr_0F5E_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_0F5E", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_0F5E",
+        Simd::Binary(op::SIMD_F32X4DIV),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_0F5E_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_0F5E", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_0F5E", Simd::Binary(op::SIMD_F32X4DIV), r1, r2);
 }
 pub fn instr_660F5E_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F5E", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F5E",
+        Simd::Binary(op::SIMD_F64X2DIV),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F5E_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F5E", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660F5E", Simd::Binary(op::SIMD_F64X2DIV), r1, r2);
 }
 pub fn instr_F20F5E_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
     sse_read64_xmm_mem(ctx, "instr_F20F5E", modrm_byte, r);
@@ -5954,16 +6461,40 @@ pub fn instr_F30F5E_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
 }
 
 pub fn instr_0F5F_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_0F5F", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_0F5F",
+        Simd::BinaryReversed(op::SIMD_F32X4PMAX),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_0F5F_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_0F5F", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_0F5F",
+        Simd::BinaryReversed(op::SIMD_F32X4PMAX),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660F5F_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F5F", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F5F",
+        Simd::BinaryReversed(op::SIMD_F64X2PMAX),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F5F_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F5F", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660F5F",
+        Simd::BinaryReversed(op::SIMD_F64X2PMAX),
+        r1,
+        r2,
+    );
 }
 pub fn instr_F20F5F_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
     sse_read64_xmm_mem(ctx, "instr_F20F5F", modrm_byte, r);
@@ -6054,89 +6585,239 @@ pub fn instr_0F6B_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
 
 pub fn instr_660F60_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
     // Note: Only requires 64-bit read, but is allowed to do 128-bit read
-    sse_read128_xmm_mem(ctx, "instr_660F60", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F60",
+        Simd::Shuffle(simd_unpack_lanes(1, false)),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F60_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F60", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660F60",
+        Simd::Shuffle(simd_unpack_lanes(1, false)),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660F61_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
     // Note: Only requires 64-bit read, but is allowed to do 128-bit read
-    sse_read128_xmm_mem(ctx, "instr_660F61", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F61",
+        Simd::Shuffle(simd_unpack_lanes(2, false)),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F61_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F61", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660F61",
+        Simd::Shuffle(simd_unpack_lanes(2, false)),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660F62_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F62", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F62",
+        Simd::Shuffle(simd_unpack_lanes(4, false)),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F62_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F62", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660F62",
+        Simd::Shuffle(simd_unpack_lanes(4, false)),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660F63_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F63", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F63",
+        Simd::Binary(op::SIMD_I8X16NARROWI16X8S),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F63_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F63", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660F63",
+        Simd::Binary(op::SIMD_I8X16NARROWI16X8S),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660F64_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F64", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F64",
+        Simd::Binary(op::SIMD_I8X16GTS),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F64_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F64", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660F64", Simd::Binary(op::SIMD_I8X16GTS), r1, r2);
 }
 pub fn instr_660F65_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F65", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F65",
+        Simd::Binary(op::SIMD_I16X8GTS),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F65_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F65", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660F65", Simd::Binary(op::SIMD_I16X8GTS), r1, r2);
 }
 pub fn instr_660F66_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F66", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F66",
+        Simd::Binary(op::SIMD_I32X4GTS),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F66_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F66", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660F66", Simd::Binary(op::SIMD_I32X4GTS), r1, r2);
 }
 pub fn instr_660F67_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F67", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F67",
+        Simd::Binary(op::SIMD_I8X16NARROWI16X8U),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F67_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F67", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660F67",
+        Simd::Binary(op::SIMD_I8X16NARROWI16X8U),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660F68_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F68", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F68",
+        Simd::Shuffle(simd_unpack_lanes(1, true)),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F68_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F68", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660F68",
+        Simd::Shuffle(simd_unpack_lanes(1, true)),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660F69_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F69", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F69",
+        Simd::Shuffle(simd_unpack_lanes(2, true)),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F69_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F69", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660F69",
+        Simd::Shuffle(simd_unpack_lanes(2, true)),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660F6A_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F6A", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F6A",
+        Simd::Shuffle(simd_unpack_lanes(4, true)),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F6A_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F6A", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660F6A",
+        Simd::Shuffle(simd_unpack_lanes(4, true)),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660F6B_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F6B", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F6B",
+        Simd::Binary(op::SIMD_I16X8NARROWI32X4S),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F6B_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F6B", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660F6B",
+        Simd::Binary(op::SIMD_I16X8NARROWI32X4S),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660F6C_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F6C", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F6C",
+        Simd::Shuffle(simd_unpack_lanes(8, false)),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F6C_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F6C", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660F6C",
+        Simd::Shuffle(simd_unpack_lanes(8, false)),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660F6D_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F6D", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F6D",
+        Simd::Shuffle(simd_unpack_lanes(8, true)),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F6D_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F6D", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660F6D",
+        Simd::Shuffle(simd_unpack_lanes(8, true)),
+        r1,
+        r2,
+    );
 }
 
 pub fn instr_0F6E_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
@@ -6202,12 +6883,21 @@ pub fn instr_0F70_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32, imm8: u32) {
 pub fn instr_660F70_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32, imm8: u32) {
     let dest = global_pointers::sse_scratch_register as u32;
     codegen::gen_modrm_resolve_safe_read128(ctx, modrm_byte, dest);
+    if ::config::JIT_USE_SIMD {
+        gen_sse_simd(ctx, Simd::Shuffle(simd_pshufd_lanes(imm8)), dest, r);
+        return;
+    }
     ctx.builder.const_i32(dest as i32);
     ctx.builder.const_i32(r as i32);
     ctx.builder.const_i32(imm8 as i32);
     ctx.builder.call_fn3("instr_660F70");
 }
 pub fn instr_660F70_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32, imm8: u32) {
+    if ::config::JIT_USE_SIMD {
+        let source = global_pointers::get_reg_xmm_offset(r1);
+        gen_sse_simd(ctx, Simd::Shuffle(simd_pshufd_lanes(imm8)), source, r2);
+        return;
+    }
     codegen::gen_read_reg_xmm128_into_scratch(ctx, r1);
     let dest = global_pointers::sse_scratch_register;
     ctx.builder.const_i32(dest as i32);
@@ -6218,12 +6908,21 @@ pub fn instr_660F70_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32, imm8: u32) {
 pub fn instr_F20F70_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32, imm8: u32) {
     let dest = global_pointers::sse_scratch_register as u32;
     codegen::gen_modrm_resolve_safe_read128(ctx, modrm_byte, dest);
+    if ::config::JIT_USE_SIMD {
+        gen_sse_simd(ctx, Simd::Shuffle(simd_pshuflw_lanes(imm8)), dest, r);
+        return;
+    }
     ctx.builder.const_i32(dest as i32);
     ctx.builder.const_i32(r as i32);
     ctx.builder.const_i32(imm8 as i32);
     ctx.builder.call_fn3("instr_F20F70");
 }
 pub fn instr_F20F70_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32, imm8: u32) {
+    if ::config::JIT_USE_SIMD {
+        let source = global_pointers::get_reg_xmm_offset(r1);
+        gen_sse_simd(ctx, Simd::Shuffle(simd_pshuflw_lanes(imm8)), source, r2);
+        return;
+    }
     codegen::gen_read_reg_xmm128_into_scratch(ctx, r1);
     let dest = global_pointers::sse_scratch_register;
     ctx.builder.const_i32(dest as i32);
@@ -6234,12 +6933,21 @@ pub fn instr_F20F70_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32, imm8: u32) {
 pub fn instr_F30F70_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32, imm8: u32) {
     let dest = global_pointers::sse_scratch_register as u32;
     codegen::gen_modrm_resolve_safe_read128(ctx, modrm_byte, dest);
+    if ::config::JIT_USE_SIMD {
+        gen_sse_simd(ctx, Simd::Shuffle(simd_pshufhw_lanes(imm8)), dest, r);
+        return;
+    }
     ctx.builder.const_i32(dest as i32);
     ctx.builder.const_i32(r as i32);
     ctx.builder.const_i32(imm8 as i32);
     ctx.builder.call_fn3("instr_F30F70");
 }
 pub fn instr_F30F70_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32, imm8: u32) {
+    if ::config::JIT_USE_SIMD {
+        let source = global_pointers::get_reg_xmm_offset(r1);
+        gen_sse_simd(ctx, Simd::Shuffle(simd_pshufhw_lanes(imm8)), source, r2);
+        return;
+    }
     codegen::gen_read_reg_xmm128_into_scratch(ctx, r1);
     let dest = global_pointers::sse_scratch_register;
     ctx.builder.const_i32(dest as i32);
@@ -6319,83 +7027,127 @@ pub fn instr_660F71_2_mem_jit(ctx: &mut JitContext, _modrm_byte: ModrmByte, _imm
     codegen::gen_trigger_ud(ctx);
 }
 pub fn instr_660F71_2_reg_jit(ctx: &mut JitContext, r: u32, imm8: u32) {
-    ctx.builder.const_i32(r as i32);
-    ctx.builder.const_i32(imm8 as i32);
-    ctx.builder.call_fn2("instr_660F71_2_reg");
+    sse_simd_shift_imm(
+        ctx,
+        "instr_660F71_2_reg",
+        op::SIMD_I16X8SHRU,
+        16,
+        false,
+        r,
+        imm8,
+    );
 }
 pub fn instr_660F71_4_mem_jit(ctx: &mut JitContext, _modrm_byte: ModrmByte, _imm: u32) {
     codegen::gen_trigger_ud(ctx);
 }
 pub fn instr_660F71_4_reg_jit(ctx: &mut JitContext, r: u32, imm8: u32) {
-    ctx.builder.const_i32(r as i32);
-    ctx.builder.const_i32(imm8 as i32);
-    ctx.builder.call_fn2("instr_660F71_4_reg");
+    sse_simd_shift_imm(
+        ctx,
+        "instr_660F71_4_reg",
+        op::SIMD_I16X8SHRS,
+        16,
+        true,
+        r,
+        imm8,
+    );
 }
 pub fn instr_660F71_6_mem_jit(ctx: &mut JitContext, _modrm_byte: ModrmByte, _imm: u32) {
     codegen::gen_trigger_ud(ctx);
 }
 pub fn instr_660F71_6_reg_jit(ctx: &mut JitContext, r: u32, imm8: u32) {
-    ctx.builder.const_i32(r as i32);
-    ctx.builder.const_i32(imm8 as i32);
-    ctx.builder.call_fn2("instr_660F71_6_reg");
+    sse_simd_shift_imm(
+        ctx,
+        "instr_660F71_6_reg",
+        op::SIMD_I16X8SHL,
+        16,
+        false,
+        r,
+        imm8,
+    );
 }
 
 pub fn instr_660F72_2_mem_jit(ctx: &mut JitContext, _modrm_byte: ModrmByte, _imm: u32) {
     codegen::gen_trigger_ud(ctx);
 }
 pub fn instr_660F72_2_reg_jit(ctx: &mut JitContext, r: u32, imm8: u32) {
-    ctx.builder.const_i32(r as i32);
-    ctx.builder.const_i32(imm8 as i32);
-    ctx.builder.call_fn2("instr_660F72_2_reg");
+    sse_simd_shift_imm(
+        ctx,
+        "instr_660F72_2_reg",
+        op::SIMD_I32X4SHRU,
+        32,
+        false,
+        r,
+        imm8,
+    );
 }
 pub fn instr_660F72_4_mem_jit(ctx: &mut JitContext, _modrm_byte: ModrmByte, _imm: u32) {
     codegen::gen_trigger_ud(ctx);
 }
 pub fn instr_660F72_4_reg_jit(ctx: &mut JitContext, r: u32, imm8: u32) {
-    ctx.builder.const_i32(r as i32);
-    ctx.builder.const_i32(imm8 as i32);
-    ctx.builder.call_fn2("instr_660F72_4_reg");
+    sse_simd_shift_imm(
+        ctx,
+        "instr_660F72_4_reg",
+        op::SIMD_I32X4SHRS,
+        32,
+        true,
+        r,
+        imm8,
+    );
 }
 pub fn instr_660F72_6_mem_jit(ctx: &mut JitContext, _modrm_byte: ModrmByte, _imm: u32) {
     codegen::gen_trigger_ud(ctx);
 }
 pub fn instr_660F72_6_reg_jit(ctx: &mut JitContext, r: u32, imm8: u32) {
-    ctx.builder.const_i32(r as i32);
-    ctx.builder.const_i32(imm8 as i32);
-    ctx.builder.call_fn2("instr_660F72_6_reg");
+    sse_simd_shift_imm(
+        ctx,
+        "instr_660F72_6_reg",
+        op::SIMD_I32X4SHL,
+        32,
+        false,
+        r,
+        imm8,
+    );
 }
 
 pub fn instr_660F73_2_mem_jit(ctx: &mut JitContext, _modrm_byte: ModrmByte, _imm: u32) {
     codegen::gen_trigger_ud(ctx);
 }
 pub fn instr_660F73_2_reg_jit(ctx: &mut JitContext, r: u32, imm8: u32) {
-    ctx.builder.const_i32(r as i32);
-    ctx.builder.const_i32(imm8 as i32);
-    ctx.builder.call_fn2("instr_660F73_2_reg");
+    sse_simd_shift_imm(
+        ctx,
+        "instr_660F73_2_reg",
+        op::SIMD_I64X2SHRU,
+        64,
+        false,
+        r,
+        imm8,
+    );
 }
 pub fn instr_660F73_3_mem_jit(ctx: &mut JitContext, _modrm_byte: ModrmByte, _imm: u32) {
     codegen::gen_trigger_ud(ctx);
 }
 pub fn instr_660F73_3_reg_jit(ctx: &mut JitContext, r: u32, imm8: u32) {
-    ctx.builder.const_i32(r as i32);
-    ctx.builder.const_i32(imm8 as i32);
-    ctx.builder.call_fn2("instr_660F73_3_reg");
+    sse_simd_shift_bytes(ctx, "instr_660F73_3_reg", true, r, imm8);
 }
 pub fn instr_660F73_6_mem_jit(ctx: &mut JitContext, _modrm_byte: ModrmByte, _imm: u32) {
     codegen::gen_trigger_ud(ctx);
 }
 pub fn instr_660F73_6_reg_jit(ctx: &mut JitContext, r: u32, imm8: u32) {
-    ctx.builder.const_i32(r as i32);
-    ctx.builder.const_i32(imm8 as i32);
-    ctx.builder.call_fn2("instr_660F73_6_reg");
+    sse_simd_shift_imm(
+        ctx,
+        "instr_660F73_6_reg",
+        op::SIMD_I64X2SHL,
+        64,
+        false,
+        r,
+        imm8,
+    );
 }
 pub fn instr_660F73_7_mem_jit(ctx: &mut JitContext, _modrm_byte: ModrmByte, _imm: u32) {
     codegen::gen_trigger_ud(ctx);
 }
 pub fn instr_660F73_7_reg_jit(ctx: &mut JitContext, r: u32, imm8: u32) {
-    ctx.builder.const_i32(r as i32);
-    ctx.builder.const_i32(imm8 as i32);
-    ctx.builder.call_fn2("instr_660F73_7_reg");
+    sse_simd_shift_bytes(ctx, "instr_660F73_7_reg", false, r, imm8);
 }
 
 pub fn instr_0F74_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
@@ -6418,22 +7170,40 @@ pub fn instr_0F76_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
 }
 
 pub fn instr_660F74_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F74", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F74",
+        Simd::Binary(op::SIMD_I8X16EQ),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F74_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F74", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660F74", Simd::Binary(op::SIMD_I8X16EQ), r1, r2);
 }
 pub fn instr_660F75_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F75", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F75",
+        Simd::Binary(op::SIMD_I16X8EQ),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F75_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F75", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660F75", Simd::Binary(op::SIMD_I16X8EQ), r1, r2);
 }
 pub fn instr_660F76_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660F76", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660F76",
+        Simd::Binary(op::SIMD_I32X4EQ),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660F76_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660F76", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660F76", Simd::Binary(op::SIMD_I32X4EQ), r1, r2);
 }
 
 pub fn instr_0F7E_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
@@ -6964,16 +7734,28 @@ pub fn instr_660FD3_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
     sse_read128_xmm_xmm(ctx, "instr_660FD3", r1, r2);
 }
 pub fn instr_660FD4_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FD4", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FD4",
+        Simd::Binary(op::SIMD_I64X2ADD),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FD4_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FD4", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660FD4", Simd::Binary(op::SIMD_I64X2ADD), r1, r2);
 }
 pub fn instr_660FD5_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FD5", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FD5",
+        Simd::Binary(op::SIMD_I16X8MUL),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FD5_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FD5", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660FD5", Simd::Binary(op::SIMD_I16X8MUL), r1, r2);
 }
 
 pub fn instr_660FD6_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
@@ -6999,58 +7781,156 @@ pub fn instr_660FD7_mem_jit(ctx: &mut JitContext, _modrm_byte: ModrmByte, _r: u3
     codegen::gen_trigger_ud(ctx)
 }
 pub fn instr_660FD7_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
+    if ::config::JIT_USE_SIMD {
+        ctx.builder
+            .const_i32(global_pointers::get_reg_xmm_offset(r1) as i32);
+        ctx.builder.load_aligned_v128(0);
+        ctx.builder.simd(op::SIMD_I8X16BITMASK);
+        codegen::gen_set_reg32(ctx, r2);
+        return;
+    }
     ctx.builder.const_i32(r1 as i32);
     ctx.builder.call_fn1_ret("instr_660FD7");
     codegen::gen_set_reg32(ctx, r2);
 }
 
 pub fn instr_660FD8_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FD8", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FD8",
+        Simd::Binary(op::SIMD_I8X16SUBSATU),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FD8_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FD8", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660FD8",
+        Simd::Binary(op::SIMD_I8X16SUBSATU),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660FD9_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FD9", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FD9",
+        Simd::Binary(op::SIMD_I16X8SUBSATU),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FD9_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FD9", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660FD9",
+        Simd::Binary(op::SIMD_I16X8SUBSATU),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660FDA_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FDA", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FDA",
+        Simd::Binary(op::SIMD_I8X16MINU),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FDA_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FDA", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660FDA",
+        Simd::Binary(op::SIMD_I8X16MINU),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660FDB_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FDB", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FDB",
+        Simd::Binary(op::SIMD_V128AND),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FDB_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FDB", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660FDB", Simd::Binary(op::SIMD_V128AND), r1, r2);
 }
 pub fn instr_660FDC_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FDC", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FDC",
+        Simd::Binary(op::SIMD_I8X16ADDSATU),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FDC_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FDC", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660FDC",
+        Simd::Binary(op::SIMD_I8X16ADDSATU),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660FDD_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FDD", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FDD",
+        Simd::Binary(op::SIMD_I16X8ADDSATU),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FDD_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FDD", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660FDD",
+        Simd::Binary(op::SIMD_I16X8ADDSATU),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660FDE_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FDE", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FDE",
+        Simd::Binary(op::SIMD_I8X16MAXU),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FDE_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FDE", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660FDE",
+        Simd::Binary(op::SIMD_I8X16MAXU),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660FDF_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FDF", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FDF",
+        Simd::BinaryReversed(op::SIMD_V128ANDNOT),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FDF_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FDF", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660FDF",
+        Simd::BinaryReversed(op::SIMD_V128ANDNOT),
+        r1,
+        r2,
+    );
 }
 
 pub fn instr_0FE0_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
@@ -7140,10 +8020,22 @@ pub fn instr_0FEF_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
 }
 
 pub fn instr_660FE0_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FE0", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FE0",
+        Simd::Binary(op::SIMD_I8X16AVGRU),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FE0_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FE0", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660FE0",
+        Simd::Binary(op::SIMD_I8X16AVGRU),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660FE1_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
     sse_read128_xmm_mem(ctx, "instr_660FE1", modrm_byte, r);
@@ -7158,10 +8050,22 @@ pub fn instr_660FE2_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
     sse_read128_xmm_xmm(ctx, "instr_660FE2", r1, r2);
 }
 pub fn instr_660FE3_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FE3", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FE3",
+        Simd::Binary(op::SIMD_I16X8AVGRU),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FE3_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FE3", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660FE3",
+        Simd::Binary(op::SIMD_I16X8AVGRU),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660FE4_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
     sse_read128_xmm_mem(ctx, "instr_660FE4", modrm_byte, r);
@@ -7203,52 +8107,136 @@ pub fn instr_660FE7_reg_jit(ctx: &mut JitContext, _r1: u32, _r2: u32) {
 }
 
 pub fn instr_660FE8_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FE8", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FE8",
+        Simd::Binary(op::SIMD_I8X16SUBSATS),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FE8_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FE8", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660FE8",
+        Simd::Binary(op::SIMD_I8X16SUBSATS),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660FE9_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FE9", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FE9",
+        Simd::Binary(op::SIMD_I16X8SUBSATS),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FE9_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FE9", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660FE9",
+        Simd::Binary(op::SIMD_I16X8SUBSATS),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660FEA_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FEA", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FEA",
+        Simd::Binary(op::SIMD_I16X8MINS),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FEA_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FEA", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660FEA",
+        Simd::Binary(op::SIMD_I16X8MINS),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660FEB_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FEB", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FEB",
+        Simd::Binary(op::SIMD_V128OR),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FEB_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FEB", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660FEB", Simd::Binary(op::SIMD_V128OR), r1, r2);
 }
 pub fn instr_660FEC_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FEC", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FEC",
+        Simd::Binary(op::SIMD_I8X16ADDSATS),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FEC_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FEC", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660FEC",
+        Simd::Binary(op::SIMD_I8X16ADDSATS),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660FED_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FED", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FED",
+        Simd::Binary(op::SIMD_I16X8ADDSATS),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FED_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FED", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660FED",
+        Simd::Binary(op::SIMD_I16X8ADDSATS),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660FEE_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FEE", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FEE",
+        Simd::Binary(op::SIMD_I16X8MAXS),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FEE_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FEE", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660FEE",
+        Simd::Binary(op::SIMD_I16X8MAXS),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660FEF_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FEF", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FEF",
+        Simd::Binary(op::SIMD_V128XOR),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FEF_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FEF", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660FEF", Simd::Binary(op::SIMD_V128XOR), r1, r2);
 }
 
 pub fn instr_0FF1_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
@@ -7385,10 +8373,22 @@ pub fn instr_660FF4_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
     sse_read128_xmm_xmm(ctx, "instr_660FF4", r1, r2);
 }
 pub fn instr_660FF5_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FF5", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FF5",
+        Simd::Binary(op::SIMD_I32X4DOTI16X8S),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FF5_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FF5", r1, r2);
+    sse_simd_xmm_xmm(
+        ctx,
+        "instr_660FF5",
+        Simd::Binary(op::SIMD_I32X4DOTI16X8S),
+        r1,
+        r2,
+    );
 }
 pub fn instr_660FF6_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
     sse_read128_xmm_mem(ctx, "instr_660FF6", modrm_byte, r);
@@ -7427,44 +8427,86 @@ pub fn instr_660FF7_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
 }
 
 pub fn instr_660FF8_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FF8", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FF8",
+        Simd::Binary(op::SIMD_I8X16SUB),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FF8_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FF8", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660FF8", Simd::Binary(op::SIMD_I8X16SUB), r1, r2);
 }
 pub fn instr_660FF9_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FF9", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FF9",
+        Simd::Binary(op::SIMD_I16X8SUB),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FF9_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FF9", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660FF9", Simd::Binary(op::SIMD_I16X8SUB), r1, r2);
 }
 pub fn instr_660FFA_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FFA", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FFA",
+        Simd::Binary(op::SIMD_I32X4SUB),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FFA_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FFA", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660FFA", Simd::Binary(op::SIMD_I32X4SUB), r1, r2);
 }
 pub fn instr_660FFB_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FFB", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FFB",
+        Simd::Binary(op::SIMD_I64X2SUB),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FFB_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FFB", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660FFB", Simd::Binary(op::SIMD_I64X2SUB), r1, r2);
 }
 pub fn instr_660FFC_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FFC", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FFC",
+        Simd::Binary(op::SIMD_I8X16ADD),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FFC_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FFC", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660FFC", Simd::Binary(op::SIMD_I8X16ADD), r1, r2);
 }
 pub fn instr_660FFD_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FFD", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FFD",
+        Simd::Binary(op::SIMD_I16X8ADD),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FFD_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FFD", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660FFD", Simd::Binary(op::SIMD_I16X8ADD), r1, r2);
 }
 pub fn instr_660FFE_mem_jit(ctx: &mut JitContext, modrm_byte: ModrmByte, r: u32) {
-    sse_read128_xmm_mem(ctx, "instr_660FFE", modrm_byte, r);
+    sse_simd_xmm_mem(
+        ctx,
+        "instr_660FFE",
+        Simd::Binary(op::SIMD_I32X4ADD),
+        modrm_byte,
+        r,
+    );
 }
 pub fn instr_660FFE_reg_jit(ctx: &mut JitContext, r1: u32, r2: u32) {
-    sse_read128_xmm_xmm(ctx, "instr_660FFE", r1, r2);
+    sse_simd_xmm_xmm(ctx, "instr_660FFE", Simd::Binary(op::SIMD_I32X4ADD), r1, r2);
 }
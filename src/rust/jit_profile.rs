@@ -0,0 +1,158 @@
+// Persistent profile of the jit: The pages that had compiled code with their entry points, so that
+// a later run of the same guest can compile them without waiting for them to become hot again
+//
+// The compiled modules themselves can't be stored, as they contain addresses that are specific to
+// this instance (dispatch tables, exit links, table indices). Each page is stored together with a
+// hash of its contents, and is only used if the hash still matches when the guest runs code in it.
+
+use jit::Tier;
+use page::Page;
+use state_flags::CachedStateFlags;
+
+const MAGIC: u32 = 0x4A49_5450; // "JITP"
+const VERSION: u32 = 1;
+
+pub struct ProfiledPage {
+    pub page: Page,
+    pub hash: u64,
+    pub state_flags: CachedStateFlags,
+    pub tier: Tier,
+    pub entry_points: Vec<u16>,
+}
+
+/// FNV-1a over the contents of a page
+pub fn hash_page(contents: &[u8]) -> u64 {
+    dbg_assert!(contents.len() == 0x1000);
+    let mut hash: u64 = 0xCBF2_9CE4_8422_2325;
+    for &b in contents {
+        hash ^= b as u64;
+        hash = hash.wrapping_mul(0x0000_0100_0000_01B3);
+    }
+    hash
+}
+
+pub fn serialize(pages: &[ProfiledPage], out: &mut Vec<u8>) {
+    out.clear();
+    out.extend(&MAGIC.to_le_bytes());
+    out.extend(&VERSION.to_le_bytes());
+    for p in pages {
+        out.extend(&p.page.to_u32().to_le_bytes());
+        out.extend(&p.hash.to_le_bytes());
+        out.push(p.state_flags.to_u32() as u8);
+        out.push(match p.tier {
+            Tier::Baseline => 0,
+            Tier::Optimizing => 1,
+        });
+        out.extend(&(p.entry_points.len() as u16).to_le_bytes());
+        for &offset in &p.entry_points {
+            out.extend(&offset.to_le_bytes());
+        }
+    }
+}
+
+struct Reader<'a> {
+    data: &'a [u8],
+    pos: usize,
+}
+
+impl<'a> Reader<'a> {
+    fn bytes(&mut self, n: usize) -> Option<&'a [u8]> {
+        if self.data.len() - self.pos < n {
+            return None;
+        }
+        let result = &self.data[self.pos..self.pos + n];
+        self.pos += n;
+        Some(result)
+    }
+    fn u8(&mut self) -> Option<u8> { self.bytes(1).map(|b| b[0]) }
+    fn u16(&mut self) -> Option<u16> { self.bytes(2).map(|b| u16::from_le_bytes([b[0], b[1]])) }
+    fn u32(&mut self) -> Option<u32> {
+        self.bytes(4)
+            .map(|b| u32::from_le_bytes([b[0], b[1], b[2], b[3]]))
+    }
+    fn u64(&mut self) -> Option<u64> { Some(self.u32()? as u64 | (self.u32()? as u64) << 32) }
+}
+
+/// None if the data isn't a profile of this version or is truncated
+pub fn parse(data: &[u8]) -> Option<Vec<ProfiledPage>> {
+    let mut reader = Reader { data, pos: 0 };
+    if reader.u32()? != MAGIC || reader.u32()? != VERSION {
+        return None;
+    }
+    let mut pages = Vec::new();
+    while reader.pos < data.len() {
+        let page = reader.u32()?;
+        let hash = reader.u64()?;
+        let state_flags = reader.u8()?;
+        let tier = match reader.u8()? {
+            0 => Tier::Baseline,
+            1 => Tier::Optimizing,
+            _ => return None,
+        };
+        let count = reader.u16()?;
+        let mut entry_points = Vec::with_capacity(count as usize);
+        for _ in 0..count {
+            let offset = reader.u16()?;
+            if offset >= 0x1000 {
+                return None;
+            }
+            entry_points.push(offset);
+        }
+        if page >= 1 << 20 || state_flags & !0xF != 0 {
+            return None;
+        }
+        pages.push(ProfiledPage {
+            page: Page::page_of(page << 12),
+            hash,
+            state_flags: CachedStateFlags::of_u32(state_flags as u32),
+            tier,
+            entry_points,
+        });
+    }
+    Some(pages)
+}
+
+#[cfg(test)]
+mod tests {
+    use jit::Tier;
+    use jit_profile::{hash_page, parse, serialize, ProfiledPage};
+    use page::Page;
+    use state_flags::CachedStateFlags;
+
+    #[test]
+    fn roundtrip() {
+        let mut contents = vec![0u8; 0x1000];
+        let empty_hash = hash_page(&contents);
+        contents[0x800] = 1;
+        assert!(hash_page(&contents) != empty_hash);
+
+        let pages = vec![
+            ProfiledPage {
+                page: Page::page_of(0xF0000),
+                hash: empty_hash,
+                state_flags: CachedStateFlags::EMPTY,
+                tier: Tier::Baseline,
+                entry_points: vec![0x10, 0xE05],
+            },
+            ProfiledPage {
+                page: Page::page_of(0xC010_0000),
+                hash: hash_page(&contents),
+                state_flags: CachedStateFlags::of_u32(0xF),
+                tier: Tier::Optimizing,
+                entry_points: vec![],
+            },
+        ];
+        let mut data = Vec::new();
+        serialize(&pages, &mut data);
+
+        let parsed = parse(&data).unwrap();
+        assert_eq!(parsed.len(), 2);
+        for (a, b) in pages.iter().zip(parsed.iter()) {
+            assert!(a.page == b.page && a.hash == b.hash && a.state_flags == b.state_flags);
+            assert!(a.tier == b.tier && a.entry_points == b.entry_points);
+        }
+
+        assert!(parse(&data[..data.len() - 1]).is_none());
+        assert!(parse(&[0; 8]).is_none());
+    }
+}
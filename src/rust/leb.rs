@@ -6,7 +6,7 @@ pub fn write_leb_i64(buf: &mut Vec<u8>, mut v: i64) {
 
     let mut more = true;
     let negative = v < 0;
-    let size = 32;
+    let size = 64;
     while more {
         let mut byte = (v & 0b1111111) as u8; // get last 7 bits
         v >>= 7; // shift them away from the value
@@ -51,3 +51,42 @@ pub fn write_fixed_leb32_at_idx(vec: &mut Vec<u8>, idx: usize, x: u32) {
     vec[idx + 2] = (x >> 14 & 0b1111111) as u8 | 0b10000000;
     vec[idx + 3] = (x >> 21 & 0b1111111) as u8;
 }
+
+#[cfg(test)]
+mod tests {
+    use leb::{write_leb_i32, write_leb_i64};
+
+    fn leb_i64(v: i64) -> Vec<u8> {
+        let mut buf = Vec::new();
+        write_leb_i64(&mut buf, v);
+        buf
+    }
+
+    #[test]
+    fn signed() {
+        assert_eq!(leb_i64(0), [0x00]);
+        assert_eq!(leb_i64(-1), [0x7f]);
+        assert_eq!(leb_i64(63), [0x3f]);
+        assert_eq!(leb_i64(64), [0xc0, 0x00]);
+        assert_eq!(leb_i64(-65), [0xbf, 0x7f]);
+        assert_eq!(leb_i64(0x80000000), [0x80, 0x80, 0x80, 0x80, 0x08]);
+
+        let mut buf = Vec::new();
+        write_leb_i32(&mut buf, -0x80000000);
+        assert_eq!(buf, [0x80, 0x80, 0x80, 0x80, 0x78]);
+    }
+
+    #[test]
+    fn signed_64_bit() {
+        // negative constants that need more than 32 bits, such as the mantissa of an F80
+        assert_eq!(leb_i64(-0x100000001), [0xff, 0xff, 0xff, 0xff, 0x6f]);
+        assert_eq!(
+            leb_i64(::std::i64::MIN),
+            [0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x7f]
+        );
+        assert_eq!(
+            leb_i64(::std::i64::MAX),
+            [0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00]
+        );
+    }
+}
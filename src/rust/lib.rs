@@ -17,8 +17,13 @@ mod config;
 mod control_flow;
 mod cpu_context;
 mod gen;
+mod interpreter_cache;
 mod jit;
+mod jit_cache;
+mod jit_flags;
+mod jit_fpu;
 mod jit_instructions;
+mod jit_profile;
 mod leb;
 mod modrm;
 mod opstats;
@@ -30,3 +35,4 @@ mod state_flags;
 mod util;
 mod wasmgen;
 mod zstd;
+mod zstd_encoder;
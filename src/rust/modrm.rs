@@ -1,13 +1,16 @@
 use codegen;
+use cpu::cpu::{get_seg_prefix, read_reg32};
 use cpu::global_pointers;
 use cpu_context::CpuContext;
 use jit::JitContext;
+use paging::OrPageFault;
 use prefix::{PREFIX_MASK_SEGMENT, SEG_PREFIX_ZERO};
 use profiler;
 use regs::{BP, BX, DI, SI};
 use regs::{CS, DS, SS};
 use regs::{EAX, EBP, EBX, ECX, EDI, EDX, ESI, ESP};
 
+#[derive(Clone, Copy, Default)]
 pub struct ModrmByte {
     segment: u32,
     first_reg: Option<u32>,
@@ -239,6 +242,22 @@ pub fn gen(ctx: &mut JitContext, modrm_byte: ModrmByte) {
     jit_add_seg_offset(ctx, modrm_byte.segment);
 }
 
+/// Compute the address of a decoded memory operand in the interpreter, the same way as the code
+/// generated by gen
+pub unsafe fn resolve(modrm_byte: &ModrmByte) -> OrPageFault<i32> {
+    let mut address = modrm_byte.immediate;
+    if let Some(reg) = modrm_byte.first_reg {
+        address = address.wrapping_add(read_reg32(reg as i32));
+    }
+    if let Some(reg) = modrm_byte.second_reg {
+        address = address.wrapping_add(read_reg32(reg as i32) << modrm_byte.shift);
+    }
+    if modrm_byte.is_16 {
+        address &= 0xFFFF;
+    }
+    Ok(get_seg_prefix(modrm_byte.segment as i32)?.wrapping_add(address))
+}
+
 pub fn skip(ctx: &mut CpuContext, modrm_byte: u8) { let _ = decode(ctx, modrm_byte); }
 
 #[derive(PartialEq)]
@@ -1,18 +1,30 @@
 #[allow(non_camel_case_types)]
 pub enum stat {
     COMPILE,
+    COMPILE_BASELINE,
+    COMPILE_TIER_UP,
+    COMPILE_QUEUED,
+    COMPILE_QUEUE_DROPPED,
+    JIT_PROFILE_PAGE_USED,
+    JIT_PROFILE_PAGE_CHANGED,
     COMPILE_SKIPPED_NO_NEW_ENTRY_POINTS,
     COMPILE_SUCCESS,
     COMPILE_WRONG_ADDRESS_SPACE,
     COMPILE_CUT_OFF_AT_END_OF_PAGE,
+    COMPILE_LOOP_TOO_LARGE_FOR_FUNCTION,
     COMPILE_WITH_LOOP_SAFETY,
     COMPILE_PAGE,
     COMPILE_PAGE_SKIPPED_NO_NEW_ENTRY_POINTS,
     COMPILE_BASIC_BLOCK,
     COMPILE_DUPLICATED_BASIC_BLOCK,
+    COMPILE_DEAD_FLAG_STORES,
+    COMPILE_FLAGS_IN_LOCALS,
+    COMPILE_FPU_RUN,
+    COMPILE_FPU_RUN_INSTRUCTIONS,
     COMPILE_WASM_BLOCK,
     COMPILE_WASM_LOOP,
     COMPILE_DISPATCHER,
+    COMPILE_FUNCTION,
     COMPILE_ENTRY_POINT,
     COMPILE_WASM_TOTAL_BYTES,
 
@@ -26,13 +38,22 @@ pub enum stat {
     RUN_INTERPRETED_MISSED_COMPILED_ENTRY_RUN_INTERPRETED,
     RUN_INTERPRETED_MISSED_COMPILED_ENTRY_LOOKUP,
     RUN_INTERPRETED_STEPS,
+    RUN_INTERPRETED_DECODED_STEPS,
+    DECODE_BLOCK,
+    DECODED_BLOCKS_FULL,
 
     RUN_FROM_CACHE,
     RUN_FROM_CACHE_STEPS,
+    RUN_FROM_CACHE_CHAINED_STEPS,
+    ENTRY_CACHE_LOOKUP,
+    ENTRY_CACHE_PROBE,
 
     DIRECT_EXIT,
     INDIRECT_JUMP,
     INDIRECT_JUMP_NO_ENTRY,
+    CHAINED_EXIT,
+    LINK_EXIT_SITE,
+    CALL_OTHER_FUNCTION,
     NORMAL_PAGE_CHANGE,
     NORMAL_FALLTHRU,
     NORMAL_FALLTHRU_WITH_TARGET_BLOCK,
@@ -56,11 +77,15 @@ pub enum stat {
 
     FAILED_PAGE_CHANGE,
 
+    FPU_RUN,
+    FPU_RUN_GUARD_FAILED,
+
     SAFE_READ_FAST,
     SAFE_READ_SLOW_PAGE_CROSSED,
     SAFE_READ_SLOW_NOT_VALID,
     SAFE_READ_SLOW_NOT_USER,
     SAFE_READ_SLOW_IN_MAPPED_RANGE,
+    SAFE_READ_SLOW_NO_EXECUTE,
 
     SAFE_WRITE_FAST,
     SAFE_WRITE_SLOW_PAGE_CROSSED,
@@ -92,7 +117,9 @@ pub enum stat {
 
     INVALIDATE_PAGE_HAD_CODE,
     INVALIDATE_PAGE_HAD_ENTRY_POINTS,
+    INVALIDATE_PAGE_HAD_DECODED_BLOCKS,
     DIRTY_PAGE_DID_NOT_HAVE_CODE,
+    DIRTY_PAGE_OUTSIDE_OF_CODE,
 
     RUN_FROM_CACHE_EXIT_SAME_PAGE,
     RUN_FROM_CACHE_EXIT_NEAR_END_OF_PAGE,
@@ -102,6 +129,9 @@ pub enum stat {
     FULL_CLEAR_TLB,
     TLB_FULL,
     TLB_GLOBAL_FULL,
+    ADDRESS_SPACE_CACHE_HIT,
+    ADDRESS_SPACE_CACHE_MISS,
+    ADDRESS_SPACE_CACHE_DROPPED,
 
     MODRM_SIMPLE_REG,
     MODRM_SIMPLE_REG_WITH_OFFSET,
@@ -106,6 +106,9 @@ impl F80 {
     }
 
     pub fn of_f32(src: i32) -> F80 {
+        if let Some(x) = F80::of_f32_exact(src) {
+            return x;
+        }
         let mut x = F80::ZERO;
         unsafe {
             f32_to_extF80M(src, &mut x)
@@ -114,6 +117,9 @@ impl F80 {
     }
 
     pub fn of_f64(src: u64) -> F80 {
+        if let Some(x) = F80::of_f64_exact(src) {
+            return x;
+        }
         let mut x = F80::ZERO;
         unsafe {
             f64_to_extF80M(src, &mut x)
@@ -122,8 +128,78 @@ impl F80 {
     }
     fn of_f64x(src: f64) -> F80 { F80::of_f64(unsafe { std::mem::transmute(src) }) }
 
-    pub fn to_f32(&self) -> i32 { unsafe { extF80M_to_f32(self) } }
-    pub fn to_f64(&self) -> u64 { unsafe { extF80M_to_f64(self) } }
+    pub fn to_f32(&self) -> i32 {
+        match self.to_f32_exact() {
+            Some(x) => x.to_bits() as i32,
+            None => unsafe { extF80M_to_f32(self) },
+        }
+    }
+    pub fn to_f64(&self) -> u64 {
+        match self.to_f64_exact() {
+            Some(x) => x.to_bits(),
+            None => unsafe { extF80M_to_f64(self) },
+        }
+    }
+
+    // Conversions of normal numbers, zeros and infinities, which are exact and don't raise any
+    // exceptions, done on the bits without calling into softfloat. None for nans and denormals
+    pub fn of_f32_exact(src: i32) -> Option<F80> { F80::of_ieee_exact(src as u32 as u64, 8, 23) }
+    pub fn of_f64_exact(src: u64) -> Option<F80> { F80::of_ieee_exact(src, 11, 52) }
+
+    // The value as a normal f32 or f64 (or zero) if it is representable without rounding
+    pub fn to_f32_exact(&self) -> Option<f32> {
+        self.to_ieee_exact(8, 23).map(|x| f32::from_bits(x as u32))
+    }
+    pub fn to_f64_exact(&self) -> Option<f64> { self.to_ieee_exact(11, 52).map(f64::from_bits) }
+
+    fn of_ieee_exact(src: u64, exponent_bits: u32, fraction_bits: u32) -> Option<F80> {
+        let max_exponent = (1 << exponent_bits) - 1;
+        let bias = max_exponent >> 1;
+        let sign = (src >> (exponent_bits + fraction_bits)) as u16 & 1;
+        let exponent = (src >> fraction_bits) as u16 & max_exponent;
+        let fraction = src & ((1 << fraction_bits) - 1);
+        let (exponent, mantissa) = if exponent == 0 {
+            if fraction != 0 {
+                return None;
+            }
+            (0, 0)
+        }
+        else if exponent == max_exponent {
+            if fraction != 0 {
+                return None;
+            }
+            (0x7FFF, 1 << 63)
+        }
+        else {
+            (
+                exponent + (0x3FFF - bias),
+                1 << 63 | fraction << (63 - fraction_bits),
+            )
+        };
+        Some(F80 {
+            mantissa,
+            sign_exponent: sign << 15 | exponent,
+        })
+    }
+    fn to_ieee_exact(&self, exponent_bits: u32, fraction_bits: u32) -> Option<u64> {
+        let sign = (self.sign_exponent >> 15) as u64;
+        let sign = sign << (exponent_bits + fraction_bits);
+        if self.sign_exponent & 0x7FFF == 0 && self.mantissa == 0 {
+            return Some(sign);
+        }
+        let max_exponent = (1 << exponent_bits) - 1;
+        let exponent = self.exponent() as i32 + (max_exponent >> 1);
+        let dropped_bits = 63 - fraction_bits;
+        if self.mantissa >> 63 == 0
+            || exponent <= 0
+            || exponent >= max_exponent
+            || self.mantissa & ((1 << dropped_bits) - 1) != 0
+        {
+            return None;
+        }
+        let fraction = self.mantissa >> dropped_bits & ((1 << fraction_bits) - 1);
+        Some(sign | (exponent as u64) << fraction_bits | fraction)
+    }
     fn to_f64x(&self) -> f64 { unsafe { std::mem::transmute(extF80M_to_f64(self)) } }
 
     pub fn to_i32(&self) -> i32 { unsafe { extF80M_to_i32(self, softfloat_roundingMode, false) } }
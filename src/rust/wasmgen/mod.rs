@@ -1,2 +1,2 @@
 pub mod wasm_builder;
-mod wasm_opcodes;
+pub mod wasm_opcodes;
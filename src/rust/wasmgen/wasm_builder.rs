@@ -36,6 +36,7 @@ enum FunctionType {
     FN3_I32_I64_I32,
     FN3_I32_I64_I32_RET,
     FN4_I32_I64_I64_I32_RET,
+    FN5_I32_I64_I32_I64_I32,
     // When adding at the end, update LAST below
 }
 
@@ -45,7 +46,7 @@ impl FunctionType {
         unsafe { transmute(x) }
     }
     pub fn to_u8(self: FunctionType) -> u8 { self as u8 }
-    pub const LAST: FunctionType = FunctionType::FN4_I32_I64_I64_I32_RET;
+    pub const LAST: FunctionType = FunctionType::FN5_I32_I64_I32_I64_I32;
 }
 
 pub const WASM_MODULE_ARGUMENT_COUNT: u8 = 1;
@@ -72,6 +73,17 @@ pub struct WasmBuilder {
     free_locals_i64: Vec<WasmLocalI64>,
     local_count: u8,
     pub arg_local_initial_state: WasmLocal,
+
+    // whether the table of compiled modules needs to be imported (see call_indirect_fn1)
+    uses_table: bool,
+
+    // bodies of the functions completed by finish_function, as in the code section
+    function_bodies: Vec<u8>,
+    function_count: u16,
+    // offsets into instruction_body (or function_bodies once the function is completed) of calls
+    // to functions of this module, which need the number of imports added (see call_function)
+    function_calls: Vec<(usize, u16)>,
+    finished_function_calls: Vec<(usize, u16)>,
 }
 
 #[derive(Eq, PartialEq)]
@@ -118,6 +130,13 @@ impl WasmBuilder {
             free_locals_i64: Vec::with_capacity(8),
             local_count: 0,
             arg_local_initial_state: WasmLocal(0),
+
+            uses_table: false,
+
+            function_bodies: Vec::new(),
+            function_count: 0,
+            function_calls: Vec::new(),
+            finished_function_calls: Vec::new(),
         };
         b.init();
         b
@@ -147,37 +166,29 @@ impl WasmBuilder {
         self.free_locals_i32.clear();
         self.free_locals_i64.clear();
         self.local_count = 0;
+        self.uses_table = false;
+        self.function_bodies.clear();
+        self.function_count = 0;
+        self.function_calls.clear();
+        self.finished_function_calls.clear();
 
         dbg_assert!(self.label_to_depth.is_empty());
         dbg_assert!(self.label_stack.is_empty());
         self.next_label = Label::ZERO;
     }
 
-    pub fn finish(&mut self) -> usize {
+    /// Complete the current function. Code generated afterwards goes into a new function, the
+    /// last function is completed and exported by finish
+    pub fn finish_function(&mut self) {
         dbg_assert!(self.label_to_depth.is_empty());
         dbg_assert!(self.label_stack.is_empty());
 
-        self.write_memory_import();
-        self.write_function_section();
-        self.write_export_section();
-
-        // write code section preamble
-        self.output.push(op::SC_CODE);
-
-        let idx_code_section_size = self.output.len(); // we will write to this location later
-        self.output.push(0);
-        self.output.push(0); // write temp val for now using 4 bytes
-        self.output.push(0);
-        self.output.push(0);
-
-        self.output.push(1); // number of function bodies: just 1
-
-        // same as above but for body size of the function
-        let idx_fn_body_size = self.output.len();
-        self.output.push(0);
-        self.output.push(0);
-        self.output.push(0);
-        self.output.push(0);
+        // body size, written below using 4 bytes
+        let idx_fn_body_size = self.function_bodies.len();
+        self.function_bodies.push(0);
+        self.function_bodies.push(0);
+        self.function_bodies.push(0);
+        self.function_bodies.push(0);
 
         dbg_assert!(
             self.local_count as usize == self.free_locals_i32.len() + self.free_locals_i64.len(),
@@ -209,22 +220,72 @@ impl WasmBuilder {
             groups.push((local_type, 1));
         }
         dbg_assert!(groups.len() < 128);
-        self.output.push(groups.len().safe_to_u8());
+        self.function_bodies.push(groups.len().safe_to_u8());
         for (local_type, count) in groups {
             dbg_assert!(count < 128);
-            self.output.push(count);
-            self.output.push(local_type);
+            self.function_bodies.push(count);
+            self.function_bodies.push(local_type);
         }
 
-        self.output.append(&mut self.instruction_body);
+        let idx_instruction_body = self.function_bodies.len();
+        for (offset, function) in self.function_calls.drain(..) {
+            self.finished_function_calls
+                .push((idx_instruction_body + offset, function));
+        }
+
+        self.function_bodies.append(&mut self.instruction_body);
+
+        self.function_bodies.push(op::OP_END);
 
-        self.output.push(op::OP_END);
+        // We subtract 4 from the actual value because the ptr itself points to four bytes
+        let fn_body_size = (self.function_bodies.len() - idx_fn_body_size - 4) as u32;
+        write_fixed_leb32_at_idx(&mut self.function_bodies, idx_fn_body_size, fn_body_size);
 
-        // write the actual sizes to the pointer locations stored above. We subtract 4 from the actual
-        // value because the ptr itself points to four bytes
-        let fn_body_size = (self.output.len() - idx_fn_body_size - 4) as u32;
-        write_fixed_leb32_at_idx(&mut self.output, idx_fn_body_size, fn_body_size);
+        self.function_count += 1;
 
+        self.free_locals_i32.clear();
+        self.free_locals_i64.clear();
+        self.local_count = 0;
+    }
+
+    pub fn finish(&mut self) -> usize {
+        self.finish_function();
+
+        // function space starts with the imported functions, followed by the functions of this
+        // module
+        let function_import_count = self.import_count;
+
+        self.write_memory_import();
+        if self.uses_table {
+            self.write_table_import();
+        }
+        self.write_function_section();
+        self.write_export_section(function_import_count + self.function_count - 1);
+
+        // write code section preamble
+        self.output.push(op::SC_CODE);
+
+        let idx_code_section_size = self.output.len(); // we will write to this location later
+        self.output.push(0);
+        self.output.push(0); // write temp val for now using 4 bytes
+        self.output.push(0);
+        self.output.push(0);
+
+        write_leb_u32(&mut self.output, self.function_count as u32); // number of function bodies
+
+        let idx_function_bodies = self.output.len();
+        self.output.append(&mut self.function_bodies);
+
+        for &(offset, function) in &self.finished_function_calls {
+            write_fixed_leb16_at_idx(
+                &mut self.output,
+                idx_function_bodies + offset,
+                function_import_count + function,
+            );
+        }
+
+        // write the actual size to the pointer location stored above. We subtract 4 from the
+        // actual value because the ptr itself points to four bytes
         let code_section_size = (self.output.len() - idx_code_section_size - 4) as u32;
         write_fixed_leb32_at_idx(&mut self.output, idx_code_section_size, code_section_size);
 
@@ -399,6 +460,16 @@ impl WasmBuilder {
                     self.output.push(1);
                     self.output.push(op::TYPE_I32);
                 },
+                FunctionType::FN5_I32_I64_I32_I64_I32 => {
+                    self.output.push(op::TYPE_FUNC);
+                    self.output.push(5);
+                    self.output.push(op::TYPE_I32);
+                    self.output.push(op::TYPE_I64);
+                    self.output.push(op::TYPE_I32);
+                    self.output.push(op::TYPE_I64);
+                    self.output.push(op::TYPE_I32);
+                    self.output.push(0);
+                },
             }
         }
 
@@ -476,6 +547,25 @@ impl WasmBuilder {
         self.set_import_table_size(new_table_size);
     }
 
+    pub fn write_table_import(&mut self) {
+        self.output.push(1);
+        self.output.push('e' as u8);
+        self.output.push(1);
+        self.output.push('t' as u8);
+
+        self.output.push(op::EXT_TABLE);
+
+        self.output.push(op::TYPE_ANYFUNC);
+        self.output.push(0); // table flag, 0 for no maximum size present
+        self.output.push(0); // initial size, the imported table is at least as large
+
+        let new_import_count = self.import_count + 1;
+        self.set_import_count(new_import_count);
+
+        let new_table_size = self.import_table_size + 8;
+        self.set_import_table_size(new_table_size);
+    }
+
     fn write_import_entry(&mut self, fn_name: &str, type_index: FunctionType) -> u16 {
         self.output.push(1); // length of module name
         self.output.push('e' as u8); // module name
@@ -495,12 +585,15 @@ impl WasmBuilder {
 
     pub fn write_function_section(&mut self) {
         self.output.push(op::SC_FUNCTION);
-        self.output.push(2); // length of this section
-        self.output.push(1); // count of signature indices
-        self.output.push(FunctionType::FN1.to_u8());
+        dbg_assert!(self.function_count < 127);
+        self.output.push(1 + self.function_count as u8); // length of this section
+        self.output.push(self.function_count as u8); // count of signature indices
+        for _ in 0..self.function_count {
+            self.output.push(FunctionType::FN1.to_u8());
+        }
     }
 
-    pub fn write_export_section(&mut self) {
+    pub fn write_export_section(&mut self, function_index: u16) {
         self.output.push(op::SC_EXPORT);
         self.output.push(1 + 1 + 1 + 1 + 2); // size of this section
         self.output.push(1); // count of table: just one function exported
@@ -510,12 +603,10 @@ impl WasmBuilder {
         self.output.push(op::EXT_FUNCTION);
 
         // index of the exported function
-        // function space starts with imports. index of last import is import count - 1
-        // the last import however is a memory, so we subtract one from that
         let next_op_idx = self.output.len();
         self.output.push(0);
         self.output.push(0); // add 2 bytes for writing 16 byte val
-        write_fixed_leb16_at_idx(&mut self.output, next_op_idx, self.import_count - 1);
+        write_fixed_leb16_at_idx(&mut self.output, next_op_idx, function_index);
     }
 
     fn get_fn_idx(&mut self, fn_name: &str, type_index: FunctionType) -> u16 {
@@ -623,6 +714,10 @@ impl WasmBuilder {
         self.instruction_body.push(local.idx());
         local
     }
+    pub fn set_local_i64(&mut self, local: &WasmLocalI64) {
+        self.instruction_body.push(op::OP_SETLOCAL);
+        self.instruction_body.push(local.idx());
+    }
     pub fn get_local_i64(&mut self, local: &WasmLocalI64) {
         self.instruction_body.push(op::OP_GETLOCAL);
         self.instruction_body.push(local.idx());
@@ -761,6 +856,36 @@ impl WasmBuilder {
         write_leb_u32(&mut self.instruction_body, byte_offset);
     }
 
+    /// Any simd instruction that has no immediates, see wasm_opcodes.rs
+    pub fn simd(&mut self, simd_op: u32) {
+        self.instruction_body.push(op::OP_SIMD_PREFIX);
+        write_leb_u32(&mut self.instruction_body, simd_op);
+    }
+
+    pub fn load_aligned_v128(&mut self, byte_offset: u32) {
+        self.simd(op::SIMD_V128LOAD);
+        self.instruction_body.push(op::MEM_ALIGN128);
+        write_leb_u32(&mut self.instruction_body, byte_offset);
+    }
+
+    pub fn store_aligned_v128(&mut self, byte_offset: u32) {
+        self.simd(op::SIMD_V128STORE);
+        self.instruction_body.push(op::MEM_ALIGN128);
+        write_leb_u32(&mut self.instruction_body, byte_offset);
+    }
+
+    pub fn const_v128(&mut self, v: [u8; 16]) {
+        self.simd(op::SIMD_V128CONST);
+        self.instruction_body.extend_from_slice(&v);
+    }
+
+    /// Lanes 0 to 15 select bytes of the first operand, 16 to 31 bytes of the second
+    pub fn shuffle_i8x16(&mut self, lanes: [u8; 16]) {
+        dbg_assert!(lanes.iter().all(|&l| l < 32));
+        self.simd(op::SIMD_I8X16SHUFFLE);
+        self.instruction_body.extend_from_slice(&lanes);
+    }
+
     pub fn increment_fixed_i32(&mut self, byte_offset: u32, n: i32) {
         self.const_i32(byte_offset as i32);
         self.load_fixed_i32(byte_offset);
@@ -952,6 +1077,29 @@ impl WasmBuilder {
     pub fn call_fn4_i32_i64_i64_i32_ret(&mut self, name: &str) {
         self.call_fn(name, FunctionType::FN4_I32_I64_I64_I32_RET)
     }
+    pub fn call_fn5_i32_i64_i32_i64_i32(&mut self, name: &str) {
+        self.call_fn(name, FunctionType::FN5_I32_I64_I32_I64_I32)
+    }
+
+    /// Call a function of this module (in the order of finish_function), which has the same type
+    /// as the exported function
+    pub fn call_function(&mut self, function: u16) {
+        self.instruction_body.push(op::OP_CALL);
+        // the index is only known in finish, after all imports have been added
+        self.function_calls
+            .push((self.instruction_body.len(), function));
+        self.instruction_body.push(0);
+        self.instruction_body.push(0);
+    }
+
+    /// Call a compiled module through the imported table. Expects the argument and the table
+    /// index on the stack
+    pub fn call_indirect_fn1(&mut self) {
+        self.uses_table = true;
+        self.instruction_body.push(op::OP_CALLINDIRECT);
+        write_leb_u32(&mut self.instruction_body, FunctionType::FN1.to_u8() as u32);
+        self.instruction_body.push(0); // table index, reserved
+    }
 
     pub fn unreachable(&mut self) { self.instruction_body.push(op::OP_UNREACHABLE) }
 
@@ -1016,6 +1164,18 @@ mod tests {
         m.unreachable();
         m.block_end();
 
+        m.const_i32(0);
+        m.const_i32(1);
+        m.call_indirect_fn1();
+
+        m.finish_function();
+
+        // the exported function calls the first one, the index includes imports added later
+        let arg = m.arg_local_initial_state.unsafe_clone();
+        m.get_local(&arg);
+        m.call_function(0);
+        m.call_fn("bar", FunctionType::FN0);
+
         m.finish();
 
         let op_ptr = m.get_output_ptr();
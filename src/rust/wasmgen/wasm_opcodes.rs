@@ -219,3 +219,79 @@ c!(MEM_NO_ALIGN, 0);
 c!(MEM_ALIGN16, 1);
 c!(MEM_ALIGN32, 2);
 c!(MEM_ALIGN64, 3);
+c!(MEM_ALIGN128, 4);
+
+// https://github.com/WebAssembly/simd/blob/main/proposals/simd/BinarySIMD.md
+// Prefixed by OP_SIMD_PREFIX, followed by the opcode as a leb128-encoded u32
+c!(OP_SIMD_PREFIX, 0xfd);
+macro_rules! simd {
+    ($x:ident, $y:expr) => {
+        #[allow(dead_code)]
+        pub const $x: u32 = $y;
+    };
+}
+
+simd!(SIMD_V128LOAD, 0x00);
+simd!(SIMD_V128STORE, 0x0b);
+simd!(SIMD_V128CONST, 0x0c);
+simd!(SIMD_I8X16SHUFFLE, 0x0d);
+simd!(SIMD_I8X16EQ, 0x23);
+simd!(SIMD_I8X16GTS, 0x27);
+simd!(SIMD_I16X8EQ, 0x2d);
+simd!(SIMD_I16X8GTS, 0x31);
+simd!(SIMD_I32X4EQ, 0x37);
+simd!(SIMD_I32X4GTS, 0x3b);
+simd!(SIMD_V128AND, 0x4e);
+simd!(SIMD_V128ANDNOT, 0x4f);
+simd!(SIMD_V128OR, 0x50);
+simd!(SIMD_V128XOR, 0x51);
+simd!(SIMD_I8X16BITMASK, 0x64);
+simd!(SIMD_I8X16NARROWI16X8S, 0x65);
+simd!(SIMD_I8X16NARROWI16X8U, 0x66);
+simd!(SIMD_I8X16ADD, 0x6e);
+simd!(SIMD_I8X16ADDSATS, 0x6f);
+simd!(SIMD_I8X16ADDSATU, 0x70);
+simd!(SIMD_I8X16SUB, 0x71);
+simd!(SIMD_I8X16SUBSATS, 0x72);
+simd!(SIMD_I8X16SUBSATU, 0x73);
+simd!(SIMD_I8X16MINU, 0x77);
+simd!(SIMD_I8X16MAXU, 0x79);
+simd!(SIMD_I8X16AVGRU, 0x7b);
+simd!(SIMD_I16X8NARROWI32X4S, 0x85);
+simd!(SIMD_I16X8SHL, 0x8b);
+simd!(SIMD_I16X8SHRS, 0x8c);
+simd!(SIMD_I16X8SHRU, 0x8d);
+simd!(SIMD_I16X8ADD, 0x8e);
+simd!(SIMD_I16X8ADDSATS, 0x8f);
+simd!(SIMD_I16X8ADDSATU, 0x90);
+simd!(SIMD_I16X8SUB, 0x91);
+simd!(SIMD_I16X8SUBSATS, 0x92);
+simd!(SIMD_I16X8SUBSATU, 0x93);
+simd!(SIMD_I16X8MUL, 0x95);
+simd!(SIMD_I16X8MINS, 0x96);
+simd!(SIMD_I16X8MAXS, 0x98);
+simd!(SIMD_I16X8AVGRU, 0x9b);
+simd!(SIMD_I32X4SHL, 0xab);
+simd!(SIMD_I32X4SHRS, 0xac);
+simd!(SIMD_I32X4SHRU, 0xad);
+simd!(SIMD_I32X4ADD, 0xae);
+simd!(SIMD_I32X4SUB, 0xb1);
+simd!(SIMD_I32X4DOTI16X8S, 0xba);
+simd!(SIMD_I64X2SHL, 0xcb);
+simd!(SIMD_I64X2SHRU, 0xcd);
+simd!(SIMD_I64X2ADD, 0xce);
+simd!(SIMD_I64X2SUB, 0xd1);
+simd!(SIMD_F32X4SQRT, 0xe3);
+simd!(SIMD_F32X4ADD, 0xe4);
+simd!(SIMD_F32X4SUB, 0xe5);
+simd!(SIMD_F32X4MUL, 0xe6);
+simd!(SIMD_F32X4DIV, 0xe7);
+simd!(SIMD_F32X4PMIN, 0xea);
+simd!(SIMD_F32X4PMAX, 0xeb);
+simd!(SIMD_F64X2SQRT, 0xef);
+simd!(SIMD_F64X2ADD, 0xf0);
+simd!(SIMD_F64X2SUB, 0xf1);
+simd!(SIMD_F64X2MUL, 0xf2);
+simd!(SIMD_F64X2DIV, 0xf3);
+simd!(SIMD_F64X2PMIN, 0xf6);
+simd!(SIMD_F64X2PMAX, 0xf7);
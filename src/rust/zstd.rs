@@ -1,19 +1,22 @@
 use std::alloc;
+use zstd_encoder;
+use zstd_encoder::Encoder;
 
+// size_t is usize, so that the tests can link a native build of the library
 extern "C" {
-    fn ZSTD_createDStream() -> u32;
-    fn ZSTD_freeDStream(ctx: u32) -> i32;
+    fn ZSTD_createDStream() -> *mut u8;
+    fn ZSTD_freeDStream(ctx: *mut u8) -> usize;
     fn ZSTD_decompressStream_simpleArgs(
-        ctx: u32,
+        ctx: *mut u8,
         dst: *mut u8,
-        dstCapacity: u32,
-        dstPos: *mut u32,
+        dstCapacity: usize,
+        dstPos: *mut usize,
         src: *const u8,
-        srcSize: u32,
-        srcPos: *mut u32,
-    ) -> i32;
+        srcSize: usize,
+        srcPos: *mut usize,
+    ) -> usize;
 
-    fn ZSTD_isError(err: i32) -> bool;
+    fn ZSTD_isError(err: usize) -> bool;
 }
 
 const MALLOC_ALIGN: usize = 16;
@@ -34,10 +37,10 @@ pub unsafe fn v86_free(addr: u32) {
 }
 
 pub struct ZstdContext {
-    ctx: u32,
+    ctx: *mut u8,
     src: *mut u8,
     src_size: u32,
-    src_pos: u32,
+    src_pos: usize,
 }
 
 #[no_mangle]
@@ -74,10 +77,10 @@ pub unsafe fn zstd_read(ctx: *mut ZstdContext, length: u32) -> *mut u8 {
     let result = ZSTD_decompressStream_simpleArgs(
         (*ctx).ctx,
         dst,
-        length,
+        length as usize,
         &mut dst_pos,
         (*ctx).src,
-        (*ctx).src_size,
+        (*ctx).src_size as usize,
         &mut (*ctx).src_pos,
     );
     if ZSTD_isError(result) {
@@ -89,7 +92,7 @@ pub unsafe fn zstd_read(ctx: *mut ZstdContext, length: u32) -> *mut u8 {
         zstd_read_free(dst, length);
         return std::ptr::null_mut::<u8>();
     }
-    if dst_pos != length {
+    if dst_pos != length as usize {
         dbg_assert!(false, "ZSTD: Partial read");
         zstd_read_free(dst, length);
         return std::ptr::null_mut::<u8>();
@@ -103,3 +106,49 @@ pub unsafe fn zstd_read_free(ptr: *mut u8, length: u32) {
         alloc::Layout::from_size_align(length as usize, 1).unwrap(),
     );
 }
+
+pub struct ZstdCompressContext {
+    encoder: Encoder,
+    src: Vec<u8>,
+    dst: Vec<u8>,
+    started: bool,
+}
+
+#[no_mangle]
+pub fn zstd_create_cctx() -> *mut ZstdCompressContext {
+    Box::into_raw(Box::new(ZstdCompressContext {
+        encoder: Encoder::new(),
+        src: vec![0; zstd_encoder::BLOCK_SIZE],
+        dst: Vec::new(),
+        started: false,
+    }))
+}
+
+#[no_mangle]
+pub unsafe fn zstd_get_cctx_src_ptr(ctx: *mut ZstdCompressContext) -> *mut u8 {
+    (*ctx).src.as_mut_ptr()
+}
+
+/// Compress the first `length` bytes of the source buffer (at most one block) and append them to
+/// the frame. Returns the length of the output at zstd_get_cctx_dst_ptr, which is valid until the
+/// next call
+#[no_mangle]
+pub unsafe fn zstd_compress(ctx: *mut ZstdCompressContext, length: u32, last: bool) -> u32 {
+    let ctx = &mut *ctx;
+    ctx.dst.clear();
+    if !ctx.started {
+        Encoder::write_frame_header(&mut ctx.dst);
+        ctx.started = true;
+    }
+    ctx.encoder
+        .compress_block(&ctx.src[..length as usize], last, &mut ctx.dst);
+    ctx.dst.len() as u32
+}
+
+#[no_mangle]
+pub unsafe fn zstd_get_cctx_dst_ptr(ctx: *mut ZstdCompressContext) -> *const u8 {
+    (*ctx).dst.as_ptr()
+}
+
+#[no_mangle]
+pub unsafe fn zstd_free_cctx(ctx: *mut ZstdCompressContext) { drop(Box::from_raw(ctx)) }
@@ -0,0 +1,501 @@
+// A small zstd encoder for saving states. It finds matches greedily within each block and stores
+// literals uncompressed. Sequences are encoded with the predefined fse tables, so no entropy
+// tables need to be built or transmitted. The output is a regular zstd frame, which the bundled
+// decoder (and the zstd tool) can read.
+//
+// Guest memory is mostly runs of zeros and repeated structures, for which this gets most of what
+// a full zstd would, at a fraction of its code size.
+
+pub const BLOCK_SIZE: usize = 128 * 1024;
+
+// 128K window: Blocks don't refer to data of earlier blocks
+const WINDOW_DESCRIPTOR: u8 = (17 - 10) << 3;
+
+const MIN_MATCH: usize = 4;
+const HASH_LOG: u32 = 15;
+
+const BLOCK_TYPE_RAW: u32 = 0;
+const BLOCK_TYPE_RLE: u32 = 1;
+const BLOCK_TYPE_COMPRESSED: u32 = 2;
+
+const LITERAL_LENGTH_BASELINE: [u32; 36] = [
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 18, 20, 22, 24, 28, 32, 40, 48, 64,
+    128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768, 65536,
+];
+const LITERAL_LENGTH_BITS: [u32; 36] = [
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 3, 3, 4, 6, 7, 8, 9, 10, 11,
+    12, 13, 14, 15, 16,
+];
+const LITERAL_LENGTH_DISTRIBUTION: [i16; 36] = [
+    4, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 3, 2, 1, 1, 1, 1, 1,
+    -1, -1, -1, -1,
+];
+
+const MATCH_LENGTH_BASELINE: [u32; 53] = [
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27,
+    28, 29, 30, 31, 32, 33, 34, 35, 37, 39, 41, 43, 47, 51, 59, 67, 83, 99, 131, 259, 515, 1027,
+    2051, 4099, 8195, 16387, 32771, 65539,
+];
+const MATCH_LENGTH_BITS: [u32; 53] = [
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    1, 1, 1, 1, 2, 2, 3, 3, 4, 4, 5, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16,
+];
+const MATCH_LENGTH_DISTRIBUTION: [i16; 53] = [
+    1, 4, 3, 2, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1, -1, -1,
+];
+
+const OFFSET_DISTRIBUTION: [i16; 29] = [
+    1, 1, 1, 1, 1, 1, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, -1, -1, -1, -1, -1,
+];
+
+fn highbit(x: u32) -> u32 {
+    dbg_assert!(x != 0);
+    31 - x.leading_zeros()
+}
+
+struct BitWriter<'a> {
+    out: &'a mut Vec<u8>,
+    container: u64,
+    bits: u32,
+}
+
+impl<'a> BitWriter<'a> {
+    fn add(&mut self, value: u32, bits: u32) {
+        dbg_assert!(bits <= 32);
+        self.container |= (value as u64 & ((1u64 << bits) - 1)) << self.bits;
+        self.bits += bits;
+        while self.bits >= 8 {
+            self.out.push(self.container as u8);
+            self.container >>= 8;
+            self.bits -= 8;
+        }
+    }
+
+    /// The decoder reads the stream backwards, starting after the highest set bit
+    fn close(mut self) {
+        self.add(1, 1);
+        if self.bits > 0 {
+            self.out.push(self.container as u8);
+        }
+    }
+}
+
+/// Encoding table for a predefined fse distribution, built like FSE_buildCTable of the reference
+/// implementation
+struct FseTable {
+    table_log: u32,
+    states: Vec<u16>,
+    // per symbol: delta_nb_bits, delta_find_state
+    symbols: Vec<(u32, i32)>,
+}
+
+impl FseTable {
+    fn new(distribution: &[i16], table_log: u32) -> FseTable {
+        let size = 1usize << table_log;
+        let mask = size - 1;
+        let step = (size >> 1) + (size >> 3) + 3;
+
+        let mut table_symbol = vec![0u8; size];
+        let mut high_threshold = size - 1;
+        for (symbol, &count) in distribution.iter().enumerate() {
+            if count == -1 {
+                table_symbol[high_threshold] = symbol as u8;
+                high_threshold -= 1;
+            }
+        }
+        let mut position = 0;
+        for (symbol, &count) in distribution.iter().enumerate() {
+            for _ in 0..count.max(0) {
+                table_symbol[position] = symbol as u8;
+                position = (position + step) & mask;
+                while position > high_threshold {
+                    position = (position + step) & mask;
+                }
+            }
+        }
+        dbg_assert!(position == 0);
+
+        let mut cumul = vec![0usize; distribution.len() + 1];
+        for (symbol, &count) in distribution.iter().enumerate() {
+            cumul[symbol + 1] = cumul[symbol] + if count == -1 { 1 } else { count as usize };
+        }
+        dbg_assert!(cumul[distribution.len()] == size);
+        let mut states = vec![0u16; size];
+        for (u, &symbol) in table_symbol.iter().enumerate() {
+            states[cumul[symbol as usize]] = (size + u) as u16;
+            cumul[symbol as usize] += 1;
+        }
+
+        let mut total = 0i32;
+        let mut symbols = Vec::with_capacity(distribution.len());
+        for &count in distribution {
+            symbols.push(match count {
+                0 => (((table_log + 1) << 16) - size as u32, 0),
+                -1 | 1 => ((table_log << 16) - size as u32, total - 1),
+                _ => {
+                    let max_bits_out = table_log - highbit(count as u32 - 1);
+                    let min_state_plus = (count as u32) << max_bits_out;
+                    ((max_bits_out << 16) - min_state_plus, total - count as i32)
+                },
+            });
+            total += count.max(1) as i32;
+        }
+
+        FseTable {
+            table_log,
+            states,
+            symbols,
+        }
+    }
+
+    fn next_state(&self, value: u32, bits: u32, symbol: u32) -> u32 {
+        let delta_find_state = self.symbols[symbol as usize].1;
+        self.states[((value >> bits) as i32 + delta_find_state) as usize] as u32
+    }
+
+    fn initial_state(&self, symbol: u32) -> u32 {
+        let delta_nb_bits = self.symbols[symbol as usize].0;
+        let bits = (delta_nb_bits + (1 << 15)) >> 16;
+        self.next_state((bits << 16) - delta_nb_bits, bits, symbol)
+    }
+
+    fn encode(&self, writer: &mut BitWriter, state: &mut u32, symbol: u32) {
+        let bits = (*state + self.symbols[symbol as usize].0) >> 16;
+        writer.add(*state, bits);
+        *state = self.next_state(*state, bits, symbol);
+    }
+
+    fn flush(&self, writer: &mut BitWriter, state: u32) { writer.add(state, self.table_log) }
+}
+
+struct Sequence {
+    literal_length: u32,
+    offset: u32,
+    match_length: u32,
+}
+
+impl Sequence {
+    fn literal_length_code(&self) -> u32 {
+        LITERAL_LENGTH_BASELINE.partition_point(|&b| b <= self.literal_length) as u32 - 1
+    }
+    fn match_length_code(&self) -> u32 {
+        MATCH_LENGTH_BASELINE.partition_point(|&b| b <= self.match_length) as u32 - 1
+    }
+    /// Offsets 1 to 3 refer to repeated offsets, which aren't used
+    fn offset_value(&self) -> u32 { self.offset + 3 }
+}
+
+pub struct Encoder {
+    hash_table: Vec<u32>,
+    sequences: Vec<Sequence>,
+    literals: Vec<u8>,
+    block: Vec<u8>,
+    literal_lengths: FseTable,
+    match_lengths: FseTable,
+    offsets: FseTable,
+}
+
+fn read32(src: &[u8], i: usize) -> u32 {
+    u32::from_le_bytes([src[i], src[i + 1], src[i + 2], src[i + 3]])
+}
+
+impl Encoder {
+    pub fn new() -> Encoder {
+        Encoder {
+            hash_table: vec![0; 1 << HASH_LOG],
+            sequences: Vec::new(),
+            literals: Vec::new(),
+            block: Vec::new(),
+            literal_lengths: FseTable::new(&LITERAL_LENGTH_DISTRIBUTION, 6),
+            match_lengths: FseTable::new(&MATCH_LENGTH_DISTRIBUTION, 6),
+            offsets: FseTable::new(&OFFSET_DISTRIBUTION, 5),
+        }
+    }
+
+    pub fn write_frame_header(out: &mut Vec<u8>) {
+        out.extend(&0xFD2FB528u32.to_le_bytes());
+        // no content size, checksum or dictionary
+        out.push(0);
+        out.push(WINDOW_DESCRIPTOR);
+    }
+
+    /// Append one block of at most BLOCK_SIZE bytes to the frame
+    pub fn compress_block(&mut self, src: &[u8], last: bool, out: &mut Vec<u8>) {
+        dbg_assert!(src.len() <= BLOCK_SIZE);
+        let header = |block_type: u32, size: usize| {
+            (last as u32 | block_type << 1 | (size as u32) << 3).to_le_bytes()
+        };
+
+        if !src.is_empty() && src.iter().all(|&b| b == src[0]) {
+            out.extend(&header(BLOCK_TYPE_RLE, src.len())[..3]);
+            out.push(src[0]);
+            return;
+        }
+
+        self.find_sequences(src);
+        if !self.sequences.is_empty() {
+            let mut block = std::mem::replace(&mut self.block, Vec::new());
+            block.clear();
+            self.encode_block(&mut block);
+            let compressed = block.len() < src.len();
+            if compressed {
+                out.extend(&header(BLOCK_TYPE_COMPRESSED, block.len())[..3]);
+                out.extend(&block);
+            }
+            self.block = block;
+            if compressed {
+                return;
+            }
+        }
+
+        out.extend(&header(BLOCK_TYPE_RAW, src.len())[..3]);
+        out.extend(src);
+    }
+
+    fn find_sequences(&mut self, src: &[u8]) {
+        self.sequences.clear();
+        self.literals.clear();
+        for entry in self.hash_table.iter_mut() {
+            *entry = 0;
+        }
+
+        let mut literal_start = 0;
+        let mut pos = 0;
+        while pos + MIN_MATCH <= src.len() {
+            let value = read32(src, pos);
+            let hash = (value.wrapping_mul(2654435761) >> (32 - HASH_LOG)) as usize;
+            // positions are stored plus one, so that 0 is empty
+            let candidate = self.hash_table[hash] as usize;
+            self.hash_table[hash] = pos as u32 + 1;
+
+            if candidate != 0 && read32(src, candidate - 1) == value {
+                let candidate = candidate - 1;
+                let mut length = MIN_MATCH;
+                while pos + length < src.len() && src[candidate + length] == src[pos + length] {
+                    length += 1;
+                }
+                self.literals.extend(&src[literal_start..pos]);
+                self.sequences.push(Sequence {
+                    literal_length: (pos - literal_start) as u32,
+                    offset: (pos - candidate) as u32,
+                    match_length: length as u32,
+                });
+                pos += length;
+                literal_start = pos;
+            }
+            else {
+                // skip faster through data that doesn't compress
+                pos += 1 + ((pos - literal_start) >> 8);
+            }
+        }
+        self.literals.extend(&src[literal_start..]);
+    }
+
+    fn encode_block(&self, out: &mut Vec<u8>) {
+        // literals section, uncompressed
+        let size = self.literals.len() as u32;
+        if size < 32 {
+            out.push((size << 3) as u8);
+        }
+        else if size < 4096 {
+            out.extend(&[(1 << 2 | size << 4) as u8, (size >> 4) as u8]);
+        }
+        else {
+            out.extend(&[
+                (3 << 2 | size << 4) as u8,
+                (size >> 4) as u8,
+                (size >> 12) as u8,
+            ]);
+        }
+        out.extend(&self.literals);
+
+        // sequences section
+        let count = self.sequences.len() as u32;
+        if count < 128 {
+            out.push(count as u8);
+        }
+        else if count < 0x7F00 {
+            out.extend(&[(count >> 8) as u8 + 128, count as u8]);
+        }
+        else {
+            out.extend(&[0xFF, (count - 0x7F00) as u8, ((count - 0x7F00) >> 8) as u8]);
+        }
+        // predefined mode for all three tables
+        out.push(0);
+
+        // the decoder reads the sequences backwards, starting with the states of the first
+        // sequence, so the last sequence is encoded first
+        let mut writer = BitWriter {
+            out,
+            container: 0,
+            bits: 0,
+        };
+        let mut states = None;
+        for sequence in self.sequences.iter().rev() {
+            let literal_length_code = sequence.literal_length_code();
+            let match_length_code = sequence.match_length_code();
+            let offset_code = highbit(sequence.offset_value());
+
+            match states {
+                None => {
+                    states = Some((
+                        self.literal_lengths.initial_state(literal_length_code),
+                        self.match_lengths.initial_state(match_length_code),
+                        self.offsets.initial_state(offset_code),
+                    ));
+                },
+                Some((ref mut ll, ref mut ml, ref mut of)) => {
+                    self.offsets.encode(&mut writer, of, offset_code);
+                    self.match_lengths
+                        .encode(&mut writer, ml, match_length_code);
+                    self.literal_lengths
+                        .encode(&mut writer, ll, literal_length_code);
+                },
+            }
+
+            writer.add(
+                sequence.literal_length - LITERAL_LENGTH_BASELINE[literal_length_code as usize],
+                LITERAL_LENGTH_BITS[literal_length_code as usize],
+            );
+            writer.add(
+                sequence.match_length - MATCH_LENGTH_BASELINE[match_length_code as usize],
+                MATCH_LENGTH_BITS[match_length_code as usize],
+            );
+            writer.add(sequence.offset_value() - (1 << offset_code), offset_code);
+        }
+        let (ll, ml, of) = states.unwrap();
+        self.match_lengths.flush(&mut writer, ml);
+        self.offsets.flush(&mut writer, of);
+        self.literal_lengths.flush(&mut writer, ll);
+        writer.close();
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use zstd;
+    use zstd_encoder::{Encoder, BLOCK_SIZE};
+
+    fn random_bytes(length: usize, seed: u32) -> Vec<u8> {
+        let mut x = seed;
+        (0..length)
+            .map(|_| {
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                x as u8
+            })
+            .collect()
+    }
+
+    fn compress(encoder: &mut Encoder, blocks: &[&[u8]]) -> Vec<u8> {
+        let mut out = Vec::new();
+        Encoder::write_frame_header(&mut out);
+        for (i, block) in blocks.iter().enumerate() {
+            encoder.compress_block(block, i == blocks.len() - 1, &mut out);
+        }
+        out
+    }
+
+    /// Decompress with the bundled decoder, as restore_state does
+    fn decompress(frame: &[u8], length: usize) -> Vec<u8> {
+        unsafe {
+            let ctx = zstd::zstd_create_ctx(frame.len() as u32);
+            std::ptr::copy_nonoverlapping(frame.as_ptr(), zstd::zstd_get_src_ptr(ctx), frame.len());
+            let ptr = zstd::zstd_read(ctx, length as u32);
+            assert!(!ptr.is_null());
+            let result = std::slice::from_raw_parts(ptr, length).to_vec();
+            zstd::zstd_read_free(ptr, length as u32);
+            zstd::zstd_free_ctx(ctx);
+            result
+        }
+    }
+
+    fn round_trip(encoder: &mut Encoder, blocks: &[&[u8]]) -> Vec<u8> {
+        let frame = compress(encoder, blocks);
+        let data = blocks.concat();
+        assert!(decompress(&frame, data.len()) == data);
+        frame
+    }
+
+    #[test]
+    fn blocks() {
+        let mut encoder = Encoder::new();
+        let mut out = Vec::new();
+        Encoder::write_frame_header(&mut out);
+        assert_eq!(out, [0x28, 0xB5, 0x2F, 0xFD, 0, 0x38]);
+        let header_length = out.len();
+
+        // rle block
+        let frame = round_trip(&mut encoder, &[&vec![0; BLOCK_SIZE]]);
+        assert_eq!(
+            frame[header_length..],
+            [
+                (1 | 1 << 1 | BLOCK_SIZE << 3) as u8,
+                (BLOCK_SIZE >> 5) as u8,
+                (BLOCK_SIZE >> 13) as u8,
+                0
+            ]
+        );
+
+        // doesn't compress: raw block
+        let random = random_bytes(1000, 1);
+        let frame = round_trip(&mut encoder, &[&random]);
+        assert_eq!(frame.len(), header_length + 3 + random.len());
+        assert_eq!(frame[header_length] & 7, 1);
+
+        // compressed block
+        let mut data = random.clone();
+        data.extend(&random);
+        data.extend(&vec![0xAB; 300]);
+        let frame = round_trip(&mut encoder, &[&data]);
+        assert_eq!(frame[header_length] & 7, 2 << 1 | 1);
+        assert!(frame.len() < header_length + random.len() + 100);
+
+        // all kinds in one frame
+        round_trip(&mut encoder, &[&vec![0; 4096], &random, &data, &[], &[7]]);
+    }
+
+    #[test]
+    fn long_sequences() {
+        let mut encoder = Encoder::new();
+        let random = random_bytes(BLOCK_SIZE, 2);
+
+        // more than 4095 literals, matches of up to 64K and of all offsets
+        let mut block = Vec::new();
+        let mut length = 4;
+        while block.len() + 2 * length + 5000 < BLOCK_SIZE {
+            block.extend(&random[..5000]);
+            block.extend(&vec![block.len() as u8; length]);
+            let start = block.len() / 2;
+            block.extend_from_within(start..start + length);
+            length = length * 3 / 2;
+        }
+        let frame = round_trip(&mut encoder, &[&block]);
+        assert!(frame.len() < block.len() / 2);
+
+        // more than 127 sequences: short repeats separated by literals
+        let mut block = Vec::new();
+        for (i, chunk) in random.chunks(3).enumerate() {
+            if block.len() + 11 > BLOCK_SIZE {
+                break;
+            }
+            block.extend(&[0x90, 0x90, 0xEB, i as u8 | 1]);
+            block.extend(chunk);
+            block.extend(&[0x90, 0x90, 0xEB, i as u8 | 1]);
+        }
+        round_trip(&mut encoder, &[&block]);
+
+        // several blocks with state carried over in the encoder
+        let blocks: Vec<Vec<u8>> = (0..4)
+            .map(|i| {
+                let mut block = random_bytes(BLOCK_SIZE / 2, 3 + i);
+                block.extend(&random[..BLOCK_SIZE / 2]);
+                block
+            })
+            .collect();
+        let blocks: Vec<&[u8]> = blocks.iter().map(|b| &b[..]).collect();
+        round_trip(&mut encoder, &blocks);
+    }
+}
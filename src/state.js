@@ -23,6 +23,9 @@ var STATE_INFO_BLOCK_START = 16;
 
 const ZSTD_MAGIC = 0xFD2FB528;
 
+// Must match BLOCK_SIZE in zstd_encoder.rs
+const ZSTD_COMPRESS_BLOCK_SIZE = 128 * 1024;
+
 /** @constructor */
 function StateLoadError(msg)
 {
@@ -120,13 +123,26 @@ function restore_buffers(obj, buffers)
     dbg_assert(constructor, "Unkown type: " + type);
 
     const buffer = buffers[obj["buffer_id"]];
+
+    if(ArrayBuffer.isView(buffer))
+    {
+        // shared with the state, see restore_state
+        return new constructor(buffer.buffer, buffer.byteOffset, buffer.byteLength / constructor.BYTES_PER_ELEMENT);
+    }
+
     return new constructor(buffer);
 }
 
-CPU.prototype.save_state = function()
+/**
+ * @param {boolean=} incremental Only save the memory that changed since the last state was saved
+ *                               or restored. Falls back to a full state if there is none.
+ */
+CPU.prototype.save_state = function(incremental)
 {
+    this.save_incremental_state = !!incremental;
     var saved_buffers = [];
     var state = save_object(this, saved_buffers);
+    this.save_incremental_state = false;
 
     var buffer_infos = [];
     var total_buffer_size = 0;
@@ -159,6 +175,37 @@ CPU.prototype.save_state = function()
     //console.log("State: json_size=" + Math.ceil(buffer_block_start / 1024 / 1024) + "MB " +
     //               "buffer_size=" + Math.ceil(total_buffer_size / 1024 / 1024) + "MB");
 
+    function fill_header_block(header_block)
+    {
+        header_block[STATE_INDEX_MAGIC] = STATE_MAGIC;
+        header_block[STATE_INDEX_VERSION] = STATE_VERSION;
+        header_block[STATE_INDEX_TOTAL_LEN] = total_size;
+        header_block[STATE_INDEX_INFO_LEN] = info_block.length;
+    }
+
+    if(this.compress_saved_state)
+    {
+        // Stream the same bytes as below through the compressor, without creating the
+        // uncompressed state
+        const header_block = new Int32Array(STATE_INFO_BLOCK_START / 4);
+        fill_header_block(header_block);
+
+        const parts = [new Uint8Array(header_block.buffer), info_block];
+        let position = STATE_INFO_BLOCK_START + info_block.length;
+
+        for(let i = 0; i < saved_buffers.length; i++)
+        {
+            const offset = buffer_block_start + buffer_infos[i].offset;
+            parts.push(new Uint8Array(offset - position));
+            parts.push(saved_buffers[i]);
+            position = offset + saved_buffers[i].length;
+        }
+
+        parts.push(new Uint8Array(total_size - position));
+
+        return this.zstd_compress_parts(parts);
+    }
+
     var result = new ArrayBuffer(total_size);
 
     var header_block = new Int32Array(
@@ -172,10 +219,7 @@ CPU.prototype.save_state = function()
         buffer_block_start
     );
 
-    header_block[STATE_INDEX_MAGIC] = STATE_MAGIC;
-    header_block[STATE_INDEX_VERSION] = STATE_VERSION;
-    header_block[STATE_INDEX_TOTAL_LEN] = total_size;
-    header_block[STATE_INDEX_INFO_LEN] = info_block.length;
+    fill_header_block(header_block);
 
     for(var i = 0; i < saved_buffers.length; i++)
     {
@@ -190,6 +234,63 @@ CPU.prototype.save_state = function()
     return result;
 };
 
+/**
+ * Compress the concatenation of the given parts to a zstd frame, one block at a time
+ * @param {Array<Uint8Array>} parts
+ * @return {ArrayBuffer}
+ */
+CPU.prototype.zstd_compress_parts = function(parts)
+{
+    const ctx = this.zstd_create_cctx();
+    const src_ptr = this.zstd_get_cctx_src_ptr(ctx) >>> 0;
+    // grows by doubling, so that each block is copied only once or twice on average
+    let output = new Uint8Array(ZSTD_COMPRESS_BLOCK_SIZE);
+    let output_length = 0;
+    let src_length = 0;
+
+    const compress = last => {
+        const length = this.zstd_compress(ctx, src_length, last);
+        const dst_ptr = this.zstd_get_cctx_dst_ptr(ctx) >>> 0;
+
+        if(output_length + length > output.length)
+        {
+            const new_output = new Uint8Array(Math.max(2 * output.length, output_length + length));
+            new_output.set(output.subarray(0, output_length));
+            output = new_output;
+        }
+
+        output.set(new Uint8Array(this.wasm_memory.buffer, dst_ptr, length), output_length);
+        output_length += length;
+        src_length = 0;
+    };
+
+    for(const part of parts)
+    {
+        let offset = 0;
+
+        while(offset < part.length)
+        {
+            const count = Math.min(part.length - offset, ZSTD_COMPRESS_BLOCK_SIZE - src_length);
+            new Uint8Array(this.wasm_memory.buffer, src_ptr + src_length, count)
+                .set(part.subarray(offset, offset + count));
+            src_length += count;
+            offset += count;
+
+            if(src_length === ZSTD_COMPRESS_BLOCK_SIZE)
+            {
+                compress(false);
+            }
+        }
+    }
+
+    compress(true);
+    this.zstd_free_cctx(ctx);
+
+    dbg_log("State: Compressed size " + (output_length >> 10) + "k");
+
+    return output.buffer.slice(0, output_length);
+};
+
 CPU.prototype.restore_state = function(state)
 {
     state = new Uint8Array(state);
@@ -253,14 +354,28 @@ CPU.prototype.restore_state = function(state)
         const buffer_infos = info_block_obj["buffer_infos"];
         const buffers = [];
 
+        // With lazy memory, the memory image is decompressed while the guest is running (see
+        // decode_lazy_memory), which is possible if it's the last buffer in the state
+        const memory_buffer_id = this.lazy_memory && !state_object[84] && state_object[85] ?
+            state_object[85]["buffer_id"] : -1;
+        let lazy_memory_buffer = null;
+
         let position = STATE_INFO_BLOCK_START + info_block_len;
 
-        for(const buffer_info of buffer_infos)
+        for(const [i, buffer_info] of buffer_infos.entries())
         {
             const front_padding = (position + 3 & ~3) - position;
             const CHUNK_SIZE = 1 * 1024 * 1024;
 
-            if(buffer_info.length > CHUNK_SIZE)
+            if(i === memory_buffer_id && i === buffer_infos.length - 1)
+            {
+                const ptr = this.zstd_read(ctx, front_padding);
+                this.zstd_read_free(ptr, front_padding);
+
+                lazy_memory_buffer = new Uint8Array(buffer_info.length);
+                buffers.push(lazy_memory_buffer);
+            }
+            else if(buffer_info.length > CHUNK_SIZE)
             {
                 const ptr = this.zstd_read(ctx, front_padding);
                 this.zstd_read_free(ptr, front_padding);
@@ -296,7 +411,16 @@ CPU.prototype.restore_state = function(state)
         state_object = restore_buffers(state_object, buffers);
         this.set_state(state_object);
 
-        this.zstd_free_ctx(ctx);
+        if(lazy_memory_buffer && lazy_memory_buffer.length)
+        {
+            // set_state has made it the lazy memory image
+            dbg_assert(this.lazy_memory_image.buffer === lazy_memory_buffer.buffer);
+            this.lazy_memory_decoder = { ctx, buffer: lazy_memory_buffer, decoded: 0 };
+        }
+        else
+        {
+            this.zstd_free_ctx(ctx);
+        }
     }
     else
     {
@@ -314,8 +438,18 @@ CPU.prototype.restore_state = function(state)
         let buffer_block_start = STATE_INFO_BLOCK_START + info_block_len;
         buffer_block_start = buffer_block_start + 3 & ~3;
 
-        const buffers = buffer_infos.map(buffer_info => {
+        // With lazy memory, the memory image isn't copied, but pages are read from the state
+        // when they're accessed first (see set_lazy_memory)
+        const memory_buffer_id = this.lazy_memory ? (state_object[85] || state_object[77])["buffer_id"] : -1;
+
+        const buffers = buffer_infos.map((buffer_info, i) => {
             const offset = buffer_block_start + buffer_info.offset;
+
+            if(i === memory_buffer_id)
+            {
+                return state.subarray(offset, offset + buffer_info.length);
+            }
+
             return state.buffer.slice(offset, offset + buffer_info.length);
         });
 
@@ -29,6 +29,19 @@ const config_sync_cdrom = {
     log_level: 0,
 };
 
+const config_compressed = {
+    bios: { url: __dirname + "/../../bios/seabios.bin" },
+    vga_bios: { url: __dirname + "/../../bios/vgabios.bin" },
+    cdrom: { url: __dirname + "/../../images/linux4.iso", async: false },
+    autostart: true,
+    memory_size: 32 * 1024 * 1024,
+    filesystem: {},
+    compress_state: true,
+    // restore decompresses the memory image while the guest is running
+    lazy_memory: true,
+    log_level: 0,
+};
+
 const config_filesystem = {
     bios: { url: __dirname + "/../../bios/seabios.bin" },
     vga_bios: { url: __dirname + "/../../bios/vgabios.bin" },
@@ -41,6 +54,14 @@ const config_filesystem = {
     log_level: 0,
 };
 
+function get_memory(emulator)
+{
+    const cpu = emulator.v86.cpu;
+    // pages of a lazily restored state may not have been copied yet
+    cpu.materialize_all_pages();
+    return cpu.mem8.slice();
+}
+
 function run_test(name, config, done)
 {
     const emulator = new V86(config);
@@ -56,28 +77,93 @@ function run_test(name, config, done)
                         assert(false);
                     }
 
+                    if(config.compress_state)
+                    {
+                        const ZSTD_MAGIC = [0x28, 0xB5, 0x2F, 0xFD];
+                        assert.deepEqual(Array.from(new Uint8Array(state, 0, 4)), ZSTD_MAGIC);
+                    }
+
+                    const expected_memory = get_memory(emulator);
+
                     setTimeout(function()
                         {
                             console.log("Restoring: %s", name);
                             emulator.restore_state(state);
+                            assert(Buffer.compare(get_memory(emulator), expected_memory) === 0, "Memory differs after restoring state");
 
                             setTimeout(function()
                                 {
-                                    console.log("Done: %s", name);
-                                    emulator.stop();
-                                    done && done();
+                                    run_incremental_test(name, emulator, function()
+                                        {
+                                            console.log("Done: %s", name);
+                                            emulator.stop();
+                                            done && done();
+                                        });
                                 }, 1000);
                         }, 1000);
                 });
         }, 5000);
 }
 
+// Somewhere in the middle of the guest's memory, written between the base state and the
+// incremental state
+const MARKER_ADDRESS = 0x1234560;
+const MARKER = new Uint8Array(64).map((_, i) => i * 37 + 11);
+
+function run_incremental_test(name, emulator, done)
+{
+    // The guest doesn't run while the marker is checked
+    emulator.stop();
+
+    // Dirty pages aren't tracked yet, so this saves a full state
+    console.log("Saving incremental base: %s", name);
+    emulator.save_state_incremental(function(error, base_state)
+        {
+            if(error)
+            {
+                console.error(error);
+                assert(false);
+            }
+
+            emulator.v86.cpu.write_blob(MARKER, MARKER_ADDRESS);
+
+            console.log("Saving incremental: %s", name);
+            emulator.save_state_incremental(function(error, state)
+                {
+                    if(error)
+                    {
+                        console.error(error);
+                        assert(false);
+                    }
+
+                    assert(state.byteLength < base_state.byteLength);
+
+                    const expected_memory = get_memory(emulator);
+                    assert.deepEqual(expected_memory.subarray(MARKER_ADDRESS, MARKER_ADDRESS + MARKER.length), MARKER);
+
+                    console.log("Restoring incremental: %s", name);
+                    emulator.restore_state(base_state);
+                    emulator.restore_state(state);
+
+                    const memory = get_memory(emulator);
+                    assert.deepEqual(memory.subarray(MARKER_ADDRESS, MARKER_ADDRESS + MARKER.length), MARKER);
+                    assert(Buffer.compare(memory, expected_memory) === 0, "Memory differs after restoring incremental state");
+
+                    emulator.run();
+                    setTimeout(done, 1000);
+                });
+        });
+}
+
 run_test("async cdrom", config_async_cdrom, function()
     {
         run_test("sync cdrom", config_sync_cdrom, function()
         {
             run_test("filesystem", config_filesystem, function()
             {
+                run_test("compressed", config_compressed, function()
+                {
+                });
             });
         });
     });
@@ -2,6 +2,7 @@
 "use strict";
 
 const BENCH_COLLECT_STATS = +process.env.BENCH_COLLECT_STATS;
+const BENCH_WASM = process.env.BENCH_WASM;
 
 const V86 = require(`../../build/${BENCH_COLLECT_STATS ? "libv86-debug" : "libv86"}.js`).V86;
 const print_stats = require("../../build/libv86.js").print_stats;
@@ -13,6 +14,7 @@ const emulator = new V86({
     bios: { url: path.join(V86_ROOT, "/bios/seabios.bin") },
     vga_bios: { url: path.join(V86_ROOT, "/bios/vgabios.bin") },
     autostart: true,
+    wasm_path: BENCH_WASM,
     memory_size: 512 * 1024 * 1024,
     vga_memory_size: 8 * 1024 * 1024,
     network_relay_url: "<UNUSED>",
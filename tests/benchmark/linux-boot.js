@@ -2,6 +2,7 @@
 "use strict";
 
 const BENCH_COLLECT_STATS = +process.env.BENCH_COLLECT_STATS;
+const BENCH_WASM = process.env.BENCH_WASM;
 
 const V86 = require(`../../build/${BENCH_COLLECT_STATS ? "libv86-debug" : "libv86"}.js`).V86;
 const print_stats = require("../../build/libv86.js").print_stats;
@@ -19,6 +20,7 @@ if(true)
         cdrom: { url: __dirname + "/../../images/linux3.iso" },
         autostart: true,
         memory_size: 32 * 1024 * 1024,
+        wasm_path: BENCH_WASM,
         log_level: 0,
     });
 }
@@ -20,13 +20,14 @@
   (type $t18 (func (param i32 i64 i32)))
   (type $t19 (func (param i32 i64 i32) (result i32)))
   (type $t20 (func (param i32 i64 i64 i32) (result i32)))
+  (type $t21 (func (param i32 i64 i32 i64 i32)))
   (import "e" "safe_write32_slow_jit" (func $e.safe_write32_slow_jit (type $t16)))
   (import "e" "safe_read32s_slow_jit" (func $e.safe_read32s_slow_jit (type $t7)))
   (import "e" "get_phys_eip_slow_jit" (func $e.get_phys_eip_slow_jit (type $t6)))
-  (import "e" "jit_find_cache_entry_in_page" (func $e.jit_find_cache_entry_in_page (type $t16)))
   (import "e" "instr_F4" (func $e.instr_F4 (type $t0)))
   (import "e" "trigger_fault_end_jit" (func $e.trigger_fault_end_jit (type $t0)))
   (import "e" "m" (memory $e.m 128))
+  (import "e" "t" (table $e.t 0 anyfunc))
   (func $f (export "f") (type $t1) (param $p0 i32)
     (local $l0 i32) (local $l1 i32) (local $l2 i32) (local $l3 i32) (local $l4 i32) (local $l5 i32) (local $l6 i32) (local $l7 i32) (local $l8 i32) (local $l9 i32) (local $l10 i32) (local $l11 i32) (local $l12 i32)
     (set_local $l0
@@ -68,7 +69,7 @@
                 (br_if $B4
                   (i32.eq
                     (get_local $p0)
-                    (i32.const 0))))
+                    (i32.const 1))))
               (set_local $l8
                 (i32.add
                   (get_local $l8)
@@ -103,7 +104,7 @@
                                 (get_local $l11)
                                 (i32.const 12))
                               (i32.const 2))))
-                        (i32.const 4075))
+                        (i32.const 4011))
                       (i32.const 1))
                     (i32.le_s
                       (i32.and
@@ -199,7 +200,7 @@
                                 (get_local $l9)
                                 (i32.const 12))
                               (i32.const 2))))
-                        (i32.const 4041))
+                        (i32.const 3977))
                       (i32.const 1))
                     (i32.le_s
                       (i32.and
@@ -251,18 +252,128 @@
                       (call $e.get_phys_eip_slow_jit
                         (get_local $l9)))
                     (i32.const 1))))
-              (br_if $L2
-                (i32.ge_s
-                  (tee_local $p0
-                    (call $e.jit_find_cache_entry_in_page
-                      (i32.xor
-                        (i32.and
-                          (get_local $l10)
-                          (i32.const -4096))
-                        (get_local $l9))
-                      (i32.const 899)
-                      (i32.const 3)))
-                  (i32.const 0)))
+              (set_local $l10
+                (i32.shl
+                  (i32.shr_u
+                    (i32.mul
+                      (tee_local $l9
+                        (i32.xor
+                          (i32.and
+                            (get_local $l10)
+                            (i32.const -4096))
+                          (get_local $l9)))
+                      (i32.const -1640531527))
+                    (i32.const 30))
+                  (i32.const 3)))
+              (block $B10
+                (loop $L11
+                  (br_if $B10
+                    (i32.eq
+                      (tee_local $l11
+                        (i32.load offset={normalised output}
+                          (get_local $l10)))
+                      (i32.const -1)))
+                  (if $I12
+                    (i32.eq
+                      (get_local $l11)
+                      (get_local $l9))
+                    (then
+                      (set_local $p0
+                        (i32.load offset={normalised output}
+                          (get_local $l10)))
+                      (br $L2)))
+                  (set_local $l10
+                    (i32.and
+                      (i32.add
+                        (get_local $l10)
+                        (i32.const 8))
+                      (i32.const 24)))
+                  (br $L11)))
+              (block $B13
+                (br_if $B13
+                  (i32.ne
+                    (get_local $l9)
+                    (i32.load offset={normalised output}
+                      (i32.const 0))))
+                (br_if $B13
+                  (i32.ge_u
+                    (tee_local $l10
+                      (i32.load
+                        (i32.const 632)))
+                    (i32.const 8)))
+                (i32.store
+                  (i32.const 560)
+                  (i32.load
+                    (i32.const 556)))
+                (i32.store
+                  (i32.const 64)
+                  (get_local $l0))
+                (i32.store
+                  (i32.const 68)
+                  (get_local $l1))
+                (i32.store
+                  (i32.const 72)
+                  (get_local $l2))
+                (i32.store
+                  (i32.const 76)
+                  (get_local $l3))
+                (i32.store
+                  (i32.const 80)
+                  (get_local $l4))
+                (i32.store
+                  (i32.const 84)
+                  (get_local $l5))
+                (i32.store
+                  (i32.const 88)
+                  (get_local $l6))
+                (i32.store
+                  (i32.const 92)
+                  (get_local $l7))
+                (i32.store
+                  (i32.const 664)
+                  (i32.add
+                    (i32.load
+                      (i32.const 664))
+                    (get_local $l8)))
+                (set_local $l11
+                  (i32.load
+                    (i32.const 664)))
+                (i32.store
+                  (i32.const 632)
+                  (i32.add
+                    (get_local $l10)
+                    (i32.const 1)))
+                (call_indirect (type $t1)
+                  (i32.shr_u
+                    (tee_local $l12
+                      (i32.load offset={normalised output}
+                        (i32.const 0)))
+                    (i32.const 16))
+                  (i32.add
+                    (i32.and
+                      (get_local $l12)
+                      (i32.const 65535))
+                    (i32.const 1024)))
+                (i32.store
+                  (i32.const 632)
+                  (get_local $l10))
+                (if $I14
+                  (i32.eqz
+                    (get_local $l10))
+                  (then
+                    (i32.store
+                      (i32.const 652)
+                      (i32.add
+                        (i32.load
+                          (i32.const 652))
+                        (i32.sub
+                          (i32.load
+                            (i32.const 664))
+                          (get_local $l11))))))
+                (return))
+              (i32.store
+                (i32.const 628)
+                (i32.const 58916864))
               (br $B0))
             (set_local $l8
               (i32.add
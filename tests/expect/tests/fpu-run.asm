@@ -0,0 +1,5 @@
+BITS 32
+    fld qword [eax]
+    fadd qword [eax + 8]
+    fstp qword [eax + 16]
+    hlt
@@ -0,0 +1,751 @@
+(module
+  (type $t0 (func))
+  (type $t1 (func (param i32)))
+  (type $t2 (func (param i32 i32)))
+  (type $t3 (func (param i32 i32 i32)))
+  (type $t4 (func (result i32)))
+  (type $t5 (func (result i64)))
+  (type $t6 (func (param i32) (result i32)))
+  (type $t7 (func (param i32 i32) (result i32)))
+  (type $t8 (func (param i32) (result i64)))
+  (type $t9 (func (param f32) (result i32)))
+  (type $t10 (func (param f64) (result i32)))
+  (type $t11 (func (param i32 i64)))
+  (type $t12 (func (param i64 i32)))
+  (type $t13 (func (param i64 i32) (result i32)))
+  (type $t14 (func (param i64 i32) (result i64)))
+  (type $t15 (func (param f32 i32)))
+  (type $t16 (func (param i32 i32 i32) (result i32)))
+  (type $t17 (func (param i64 i32 i32)))
+  (type $t18 (func (param i32 i64 i32)))
+  (type $t19 (func (param i32 i64 i32) (result i32)))
+  (type $t20 (func (param i32 i64 i64 i32) (result i32)))
+  (type $t21 (func (param i32 i64 i32 i64 i32)))
+  (import "e" "trigger_gp_jit" (func $e.trigger_gp_jit (type $t2)))
+  (import "e" "safe_read64s_slow_jit" (func $e.safe_read64s_slow_jit (type $t7)))
+  (import "e" "f64_to_f80" (func $e.f64_to_f80 (type $t11)))
+  (import "e" "fpu_add" (func $e.fpu_add (type $t21)))
+  (import "e" "f80_to_f64" (func $e.f80_to_f64 (type $t14)))
+  (import "e" "safe_write64_slow_jit" (func $e.safe_write64_slow_jit (type $t19)))
+  (import "e" "task_switch_test_jit" (func $e.task_switch_test_jit (type $t1)))
+  (import "e" "fpu_push" (func $e.fpu_push (type $t12)))
+  (import "e" "fpu_fadd" (func $e.fpu_fadd (type $t18)))
+  (import "e" "fpu_get_sti" (func $e.fpu_get_sti (type $t2)))
+  (import "e" "fpu_pop" (func $e.fpu_pop (type $t0)))
+  (import "e" "instr_F4" (func $e.instr_F4 (type $t0)))
+  (import "e" "trigger_fault_end_jit" (func $e.trigger_fault_end_jit (type $t0)))
+  (import "e" "m" (memory $e.m 128))
+  (func $f (export "f") (type $t1) (param $p0 i32)
+    (local $l0 i32) (local $l1 i32) (local $l2 i32) (local $l3 i32) (local $l4 i32) (local $l5 i32) (local $l6 i32) (local $l7 i32) (local $l8 i32) (local $l9 i32) (local $l10 i32) (local $l11 i32) (local $l12 i64) (local $l13 i32) (local $l14 i64)
+    (set_local $l0
+      (i32.load
+        (i32.const 64)))
+    (set_local $l1
+      (i32.load
+        (i32.const 68)))
+    (set_local $l2
+      (i32.load
+        (i32.const 72)))
+    (set_local $l3
+      (i32.load
+        (i32.const 76)))
+    (set_local $l4
+      (i32.load
+        (i32.const 80)))
+    (set_local $l5
+      (i32.load
+        (i32.const 84)))
+    (set_local $l6
+      (i32.load
+        (i32.const 88)))
+    (set_local $l7
+      (i32.load
+        (i32.const 92)))
+    (set_local $l8
+      (i32.const 0))
+    (block $B0
+      (block $B1
+        (loop $L2
+          (br_if $B0
+            (i32.ge_u
+              (get_local $l8)
+              (i32.const 100003)))
+          (block $B3
+            (block $B4
+            )
+            (set_local $l8
+              (i32.add
+                (get_local $l8)
+                (i32.const 4)))
+            (set_local $l9
+              (i32.load8_u
+                (i32.const 1032)))
+            (if $I5
+              (i32.and
+                (i32.eqz
+                  (i32.and
+                    (i32.load8_u
+                      (i32.const 580))
+                    (i32.const 12)))
+                (i32.eqz
+                  (i32.and
+                    (i32.xor
+                      (i32.load8_u
+                        (i32.const 816))
+                      (i32.and
+                        (i32.shr_u
+                          (i32.shl
+                            (i32.const 32896)
+                            (get_local $l9))
+                          (i32.const 8))
+                        (i32.const 255)))
+                    (i32.and
+                      (i32.shr_u
+                        (i32.shl
+                          (i32.const 32896)
+                          (get_local $l9))
+                        (i32.const 8))
+                      (i32.const 255)))))
+              (then
+                (block $B6
+                  (block $B7
+                    (i32.const 1136)
+                    (get_local $l0)
+                    (if $I8
+                      (i32.load8_u
+                        (i32.const 727))
+                      (then
+                        (call $e.trigger_gp_jit
+                          (i32.const 0)
+                          (i32.const 4096))
+                        (br $B7)))
+                    (i32.load
+                      (i32.const 748))
+                    (i32.add)
+                    (set_local $l10)
+                    (block $B9
+                      (br_if $B9
+                        (i32.and
+                          (i32.eq
+                            (i32.and
+                              (tee_local $l11
+                                (i32.load offset=323504
+                                  (i32.shl
+                                    (i32.shr_u
+                                      (get_local $l10)
+                                      (i32.const 12))
+                                    (i32.const 2))))
+                              (i32.const 3977))
+                            (i32.const 1))
+                          (i32.le_s
+                            (i32.and
+                              (get_local $l10)
+                              (i32.const 4095))
+                            (i32.const 4088))))
+                      (br_if $B7
+                        (i32.and
+                          (tee_local $l11
+                            (call $e.safe_read64s_slow_jit
+                              (get_local $l10)
+                              (i32.const 0)))
+                          (i32.const 1))))
+                    (i64.load align=1
+                      (i32.add
+                        (i32.xor
+                          (i32.and
+                            (get_local $l11)
+                            (i32.const -4096))
+                          (get_local $l10))
+                        (i32.const 18247680)))
+                    (call $e.f64_to_f80)
+                    (i64.load
+                      (i32.const 1136))
+                    (set_local $l10
+                      (i32.load16_u
+                        (i32.const 1144)))
+                    (set_local $l12)
+                    (br $B6))
+                  (br $B1))
+                (block $B10
+                  (block $B11
+                    (i32.const 1136)
+                    (get_local $l12)
+                    (get_local $l10)
+                    (i32.const 1136)
+                    (i32.add
+                      (get_local $l0)
+                      (i32.const 8))
+                    (if $I12
+                      (i32.load8_u
+                        (i32.const 727))
+                      (then
+                        (call $e.trigger_gp_jit
+                          (i32.const 0)
+                          (i32.const 4098))
+                        (br $B11)))
+                    (i32.load
+                      (i32.const 748))
+                    (i32.add)
+                    (set_local $l11)
+                    (block $B13
+                      (br_if $B13
+                        (i32.and
+                          (i32.eq
+                            (i32.and
+                              (tee_local $l13
+                                (i32.load offset=323504
+                                  (i32.shl
+                                    (i32.shr_u
+                                      (get_local $l11)
+                                      (i32.const 12))
+                                    (i32.const 2))))
+                              (i32.const 3977))
+                            (i32.const 1))
+                          (i32.le_s
+                            (i32.and
+                              (get_local $l11)
+                              (i32.const 4095))
+                            (i32.const 4088))))
+                      (br_if $B11
+                        (i32.and
+                          (tee_local $l13
+                            (call $e.safe_read64s_slow_jit
+                              (get_local $l11)
+                              (i32.const 2)))
+                          (i32.const 1))))
+                    (i64.load align=1
+                      (i32.add
+                        (i32.xor
+                          (i32.and
+                            (get_local $l13)
+                            (i32.const -4096))
+                          (get_local $l11))
+                        (i32.const 18247680)))
+                    (call $e.f64_to_f80)
+                    (i64.load
+                      (i32.const 1136))
+                    (i32.load16_u
+                      (i32.const 1144))
+                    (call $e.fpu_add)
+                    (i64.load
+                      (i32.const 1136))
+                    (set_local $l10
+                      (i32.load16_u
+                        (i32.const 1144)))
+                    (set_local $l12)
+                    (br $B10))
+                  (i64.store offset=1152
+                    (i32.shl
+                      (i32.and
+                        (i32.add
+                          (get_local $l9)
+                          (i32.const 7))
+                        (i32.const 7))
+                      (i32.const 4))
+                    (get_local $l12))
+                  (i32.store16 offset=1160 align=1
+                    (i32.shl
+                      (i32.and
+                        (i32.add
+                          (get_local $l9)
+                          (i32.const 7))
+                        (i32.const 7))
+                      (i32.const 4))
+                    (get_local $l10))
+                  (i32.store8
+                    (i32.const 1032)
+                    (i32.and
+                      (i32.add
+                        (get_local $l9)
+                        (i32.const 7))
+                      (i32.const 7)))
+                  (i32.store8
+                    (i32.const 816)
+                    (i32.and
+                      (i32.load8_u
+                        (i32.const 816))
+                      (i32.xor
+                        (i32.and
+                          (i32.shr_u
+                            (i32.shl
+                              (i32.const 32896)
+                              (get_local $l9))
+                            (i32.const 8))
+                          (i32.const 255))
+                        (i32.const -1))))
+                  (i32.store16 align=1
+                    (i32.const 1040)
+                    (i32.and
+                      (i32.load16_u
+                        (i32.const 1040))
+                      (i32.const -513)))
+                  (br $B1))
+                (block $B14
+                  (block $B15
+                    (i32.add
+                      (get_local $l0)
+                      (i32.const 16))
+                    (if $I16
+                      (i32.load8_u
+                        (i32.const 727))
+                      (then
+                        (call $e.trigger_gp_jit
+                          (i32.const 0)
+                          (i32.const 4101))
+                        (br $B15)))
+                    (i32.load
+                      (i32.const 748))
+                    (i32.add)
+                    (set_local $l11)
+                    (set_local $l14
+                      (call $e.f80_to_f64
+                        (get_local $l12)
+                        (get_local $l10)))
+                    (block $B17
+                      (br_if $B17
+                        (i32.and
+                          (i32.eq
+                            (i32.and
+                              (tee_local $l13
+                                (i32.load offset=323504
+                                  (i32.shl
+                                    (i32.shr_u
+                                      (get_local $l11)
+                                      (i32.const 12))
+                                    (i32.const 2))))
+                              (i32.const 4011))
+                            (i32.const 1))
+                          (i32.le_s
+                            (i32.and
+                              (get_local $l11)
+                              (i32.const 4095))
+                            (i32.const 4088))))
+                      (br_if $B15
+                        (i32.and
+                          (tee_local $l13
+                            (call $e.safe_write64_slow_jit
+                              (get_local $l11)
+                              (get_local $l14)
+                              (i32.const 5)))
+                          (i32.const 1))))
+                    (i64.store align=1
+                      (i32.add
+                        (i32.xor
+                          (i32.and
+                            (get_local $l13)
+                            (i32.const -4096))
+                          (get_local $l11))
+                        (i32.const 18247680))
+                      (get_local $l14))
+                    (br $B14))
+                  (i64.store offset=1152
+                    (i32.shl
+                      (i32.and
+                        (i32.add
+                          (get_local $l9)
+                          (i32.const 7))
+                        (i32.const 7))
+                      (i32.const 4))
+                    (get_local $l12))
+                  (i32.store16 offset=1160 align=1
+                    (i32.shl
+                      (i32.and
+                        (i32.add
+                          (get_local $l9)
+                          (i32.const 7))
+                        (i32.const 7))
+                      (i32.const 4))
+                    (get_local $l10))
+                  (i32.store8
+                    (i32.const 1032)
+                    (i32.and
+                      (i32.add
+                        (get_local $l9)
+                        (i32.const 7))
+                      (i32.const 7)))
+                  (i32.store8
+                    (i32.const 816)
+                    (i32.and
+                      (i32.load8_u
+                        (i32.const 816))
+                      (i32.xor
+                        (i32.and
+                          (i32.shr_u
+                            (i32.shl
+                              (i32.const 32896)
+                              (get_local $l9))
+                            (i32.const 8))
+                          (i32.const 255))
+                        (i32.const -1))))
+                  (i32.store16 align=1
+                    (i32.const 1040)
+                    (i32.and
+                      (i32.load16_u
+                        (i32.const 1040))
+                      (i32.const -513)))
+                  (br $B1))
+                (i64.store offset=1152
+                  (i32.shl
+                    (i32.and
+                      (i32.add
+                        (get_local $l9)
+                        (i32.const 7))
+                      (i32.const 7))
+                    (i32.const 4))
+                  (get_local $l12))
+                (i32.store16 offset=1160 align=1
+                  (i32.shl
+                    (i32.and
+                      (i32.add
+                        (get_local $l9)
+                        (i32.const 7))
+                      (i32.const 7))
+                    (i32.const 4))
+                  (get_local $l10))
+                (i32.store8
+                  (i32.const 816)
+                  (i32.or
+                    (i32.load8_u
+                      (i32.const 816))
+                    (i32.and
+                      (i32.shr_u
+                        (i32.shl
+                          (i32.const 32896)
+                          (get_local $l9))
+                        (i32.const 8))
+                      (i32.const 255))))
+                (i32.store16 align=1
+                  (i32.const 1040)
+                  (i32.and
+                    (i32.load16_u
+                      (i32.const 1040))
+                    (i32.const -513))))
+              (else
+                (if $I18
+                  (i32.and
+                    (i32.load8_u
+                      (i32.const 580))
+                    (i32.const 12))
+                  (then
+                    (call $e.task_switch_test_jit
+                      (i32.const 4096))
+                    (br $B1)))
+                (i32.const 1136)
+                (get_local $l0)
+                (if $I19
+                  (i32.load8_u
+                    (i32.const 727))
+                  (then
+                    (call $e.trigger_gp_jit
+                      (i32.const 0)
+                      (i32.const 4096))
+                    (br $B1)))
+                (i32.load
+                  (i32.const 748))
+                (i32.add)
+                (set_local $l10)
+                (block $B20
+                  (br_if $B20
+                    (i32.and
+                      (i32.eq
+                        (i32.and
+                          (tee_local $l11
+                            (i32.load offset=323504
+                              (i32.shl
+                                (i32.shr_u
+                                  (get_local $l10)
+                                  (i32.const 12))
+                                (i32.const 2))))
+                          (i32.const 3977))
+                        (i32.const 1))
+                      (i32.le_s
+                        (i32.and
+                          (get_local $l10)
+                          (i32.const 4095))
+                        (i32.const 4088))))
+                  (br_if $B1
+                    (i32.and
+                      (tee_local $l11
+                        (call $e.safe_read64s_slow_jit
+                          (get_local $l10)
+                          (i32.const 0)))
+                      (i32.const 1))))
+                (i64.load align=1
+                  (i32.add
+                    (i32.xor
+                      (i32.and
+                        (get_local $l11)
+                        (i32.const -4096))
+                      (get_local $l10))
+                    (i32.const 18247680)))
+                (call $e.f64_to_f80)
+                (call $e.fpu_push
+                  (i64.load
+                    (i32.const 1136))
+                  (i32.load16_u
+                    (i32.const 1144)))
+                (if $I21
+                  (i32.and
+                    (i32.load8_u
+                      (i32.const 580))
+                    (i32.const 12))
+                  (then
+                    (call $e.task_switch_test_jit
+                      (i32.const 4098))
+                    (br $B1)))
+                (i32.const 0)
+                (i32.const 1136)
+                (i32.add
+                  (get_local $l0)
+                  (i32.const 8))
+                (if $I22
+                  (i32.load8_u
+                    (i32.const 727))
+                  (then
+                    (call $e.trigger_gp_jit
+                      (i32.const 0)
+                      (i32.const 4098))
+                    (br $B1)))
+                (i32.load
+                  (i32.const 748))
+                (i32.add)
+                (set_local $l10)
+                (block $B23
+                  (br_if $B23
+                    (i32.and
+                      (i32.eq
+                        (i32.and
+                          (tee_local $l11
+                            (i32.load offset=323504
+                              (i32.shl
+                                (i32.shr_u
+                                  (get_local $l10)
+                                  (i32.const 12))
+                                (i32.const 2))))
+                          (i32.const 3977))
+                        (i32.const 1))
+                      (i32.le_s
+                        (i32.and
+                          (get_local $l10)
+                          (i32.const 4095))
+                        (i32.const 4088))))
+                  (br_if $B1
+                    (i32.and
+                      (tee_local $l11
+                        (call $e.safe_read64s_slow_jit
+                          (get_local $l10)
+                          (i32.const 2)))
+                      (i32.const 1))))
+                (i64.load align=1
+                  (i32.add
+                    (i32.xor
+                      (i32.and
+                        (get_local $l11)
+                        (i32.const -4096))
+                      (get_local $l10))
+                    (i32.const 18247680)))
+                (call $e.f64_to_f80)
+                (i64.load
+                  (i32.const 1136))
+                (i32.load16_u
+                  (i32.const 1144))
+                (call $e.fpu_fadd)
+                (if $I24
+                  (i32.and
+                    (i32.load8_u
+                      (i32.const 580))
+                    (i32.const 12))
+                  (then
+                    (call $e.task_switch_test_jit
+                      (i32.const 4101))
+                    (br $B1)))
+                (i32.add
+                  (get_local $l0)
+                  (i32.const 16))
+                (if $I25
+                  (i32.load8_u
+                    (i32.const 727))
+                  (then
+                    (call $e.trigger_gp_jit
+                      (i32.const 0)
+                      (i32.const 4101))
+                    (br $B1)))
+                (i32.load
+                  (i32.const 748))
+                (i32.add)
+                (set_local $l10)
+                (call $e.fpu_get_sti
+                  (i32.const 1136)
+                  (i32.const 0))
+                (set_local $l12
+                  (call $e.f80_to_f64
+                    (i64.load
+                      (i32.const 1136))
+                    (i32.load16_u
+                      (i32.const 1144))))
+                (block $B26
+                  (br_if $B26
+                    (i32.and
+                      (i32.eq
+                        (i32.and
+                          (tee_local $l11
+                            (i32.load offset=323504
+                              (i32.shl
+                                (i32.shr_u
+                                  (get_local $l10)
+                                  (i32.const 12))
+                                (i32.const 2))))
+                          (i32.const 4011))
+                        (i32.const 1))
+                      (i32.le_s
+                        (i32.and
+                          (get_local $l10)
+                          (i32.const 4095))
+                        (i32.const 4088))))
+                  (br_if $B1
+                    (i32.and
+                      (tee_local $l11
+                        (call $e.safe_write64_slow_jit
+                          (get_local $l10)
+                          (get_local $l12)
+                          (i32.const 5)))
+                      (i32.const 1))))
+                (i64.store align=1
+                  (i32.add
+                    (i32.xor
+                      (i32.and
+                        (get_local $l11)
+                        (i32.const -4096))
+                      (get_local $l10))
+                    (i32.const 18247680))
+                  (get_local $l12))
+                (call $e.fpu_pop)))
+            (i32.store
+              (i32.const 560)
+              (i32.or
+                (i32.and
+                  (i32.load
+                    (i32.const 556))
+                  (i32.const -4096))
+                (i32.const 8)))
+            (i32.store
+              (i32.const 556)
+              (i32.or
+                (i32.and
+                  (i32.load
+                    (i32.const 556))
+                  (i32.const -4096))
+                (i32.const 9)))
+            (i32.store
+              (i32.const 64)
+              (get_local $l0))
+            (i32.store
+              (i32.const 68)
+              (get_local $l1))
+            (i32.store
+              (i32.const 72)
+              (get_local $l2))
+            (i32.store
+              (i32.const 76)
+              (get_local $l3))
+            (i32.store
+              (i32.const 80)
+              (get_local $l4))
+            (i32.store
+              (i32.const 84)
+              (get_local $l5))
+            (i32.store
+              (i32.const 88)
+              (get_local $l6))
+            (i32.store
+              (i32.const 92)
+              (get_local $l7))
+            (call $e.instr_F4)
+            (set_local $l0
+              (i32.load
+                (i32.const 64)))
+            (set_local $l1
+              (i32.load
+                (i32.const 68)))
+            (set_local $l2
+              (i32.load
+                (i32.const 72)))
+            (set_local $l3
+              (i32.load
+                (i32.const 76)))
+            (set_local $l4
+              (i32.load
+                (i32.const 80)))
+            (set_local $l5
+              (i32.load
+                (i32.const 84)))
+            (set_local $l6
+              (i32.load
+                (i32.const 88)))
+            (set_local $l7
+              (i32.load
+                (i32.const 92)))
+            (br $B0))
+          (unreachable)))
+      (i32.store
+        (i32.const 64)
+        (get_local $l0))
+      (i32.store
+        (i32.const 68)
+        (get_local $l1))
+      (i32.store
+        (i32.const 72)
+        (get_local $l2))
+      (i32.store
+        (i32.const 76)
+        (get_local $l3))
+      (i32.store
+        (i32.const 80)
+        (get_local $l4))
+      (i32.store
+        (i32.const 84)
+        (get_local $l5))
+      (i32.store
+        (i32.const 88)
+        (get_local $l6))
+      (i32.store
+        (i32.const 92)
+        (get_local $l7))
+      (call $e.trigger_fault_end_jit)
+      (i32.store
+        (i32.const 664)
+        (i32.add
+          (i32.load
+            (i32.const 664))
+          (get_local $l8)))
+      (return))
+    (i32.store
+      (i32.const 64)
+      (get_local $l0))
+    (i32.store
+      (i32.const 68)
+      (get_local $l1))
+    (i32.store
+      (i32.const 72)
+      (get_local $l2))
+    (i32.store
+      (i32.const 76)
+      (get_local $l3))
+    (i32.store
+      (i32.const 80)
+      (get_local $l4))
+    (i32.store
+      (i32.const 84)
+      (get_local $l5))
+    (i32.store
+      (i32.const 88)
+      (get_local $l6))
+    (i32.store
+      (i32.const 92)
+      (get_local $l7))
+    (i32.store
+      (i32.const 664)
+      (i32.add
+        (i32.load
+          (i32.const 664))
+        (get_local $l8)))))
@@ -20,6 +20,7 @@
   (type $t18 (func (param i32 i64 i32)))
   (type $t19 (func (param i32 i64 i32) (result i32)))
   (type $t20 (func (param i32 i64 i64 i32) (result i32)))
+  (type $t21 (func (param i32 i64 i32 i64 i32)))
   (import "e" "trigger_gp_jit" (func $e.trigger_gp_jit (type $t2)))
   (import "e" "safe_read32s_slow_jit" (func $e.safe_read32s_slow_jit (type $t7)))
   (import "e" "instr_F4" (func $e.instr_F4 (type $t0)))
@@ -94,7 +95,7 @@
                               (get_local $l9)
                               (i32.const 12))
                             (i32.const 2))))
-                      (i32.const 4041))
+                      (i32.const 3977))
                     (i32.const 1))
                   (i32.le_s
                     (i32.and
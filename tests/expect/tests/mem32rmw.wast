@@ -20,6 +20,7 @@
   (type $t18 (func (param i32 i64 i32)))
   (type $t19 (func (param i32 i64 i32) (result i32)))
   (type $t20 (func (param i32 i64 i64 i32) (result i32)))
+  (type $t21 (func (param i32 i64 i32 i64 i32)))
   (import "e" "trigger_gp_jit" (func $e.trigger_gp_jit (type $t2)))
   (import "e" "safe_read_write32s_slow_jit" (func $e.safe_read_write32s_slow_jit (type $t7)))
   (import "e" "safe_write32_slow_jit" (func $e.safe_write32_slow_jit (type $t16)))
@@ -97,7 +98,7 @@
                                 (get_local $l9)
                                 (i32.const 12))
                               (i32.const 2))))
-                        (i32.const 4075))
+                        (i32.const 4011))
                       (i32.const 1))
                     (i32.le_s
                       (i32.and
@@ -20,10 +20,11 @@
   (type $t18 (func (param i32 i64 i32)))
   (type $t19 (func (param i32 i64 i32) (result i32)))
   (type $t20 (func (param i32 i64 i64 i32) (result i32)))
-  (import "e" "instr_F4" (func $e.instr_F4 (type $t0)))
+  (type $t21 (func (param i32 i64 i32 i64 i32)))
   (import "e" "instr_FB_without_fault" (func $e.instr_FB_without_fault (type $t4)))
   (import "e" "trigger_gp_jit" (func $e.trigger_gp_jit (type $t2)))
   (import "e" "handle_irqs" (func $e.handle_irqs (type $t0)))
+  (import "e" "instr_F4" (func $e.instr_F4 (type $t0)))
   (import "e" "trigger_fault_end_jit" (func $e.trigger_fault_end_jit (type $t0)))
   (import "e" "m" (memory $e.m 128))
   (func $f (export "f") (type $t1) (param $p0 i32)
@@ -72,8 +73,14 @@
                 (i32.add
                   (get_local $l8)
                   (i32.const 2)))
-              (set_local $l0
-                (i32.const 53535353))
+              (if $I6
+                (i32.eqz
+                  (call $e.instr_FB_without_fault))
+                (then
+                  (call $e.trigger_gp_jit
+                    (i32.const 0)
+                    (i32.const 4096))
+                  (br $B1)))
               (i32.store
                 (i32.const 560)
                 (i32.or
@@ -81,7 +88,7 @@
                     (i32.load
                       (i32.const 556))
                     (i32.const -4096))
-                  (i32.const 11)))
+                  (i32.const 1)))
               (i32.store
                 (i32.const 556)
                 (i32.or
@@ -89,7 +96,9 @@
                     (i32.load
                       (i32.const 556))
                     (i32.const -4096))
-                  (i32.const 12)))
+                  (i32.const 6)))
+              (set_local $l0
+                (i32.const 42424242))
               (i32.store
                 (i32.const 64)
                 (get_local $l0))
@@ -114,44 +123,20 @@
               (i32.store
                 (i32.const 92)
                 (get_local $l7))
-              (call $e.instr_F4)
-              (set_local $l0
-                (i32.load
-                  (i32.const 64)))
-              (set_local $l1
-                (i32.load
-                  (i32.const 68)))
-              (set_local $l2
-                (i32.load
-                  (i32.const 72)))
-              (set_local $l3
-                (i32.load
-                  (i32.const 76)))
-              (set_local $l4
-                (i32.load
-                  (i32.const 80)))
-              (set_local $l5
-                (i32.load
-                  (i32.const 84)))
-              (set_local $l6
-                (i32.load
-                  (i32.const 88)))
-              (set_local $l7
-                (i32.load
-                  (i32.const 92)))
-              (br $B0))
+              (call $e.handle_irqs)
+              (i32.store
+                (i32.const 664)
+                (i32.add
+                  (i32.load
+                    (i32.const 664))
+                  (get_local $l8)))
+              (return))
             (set_local $l8
               (i32.add
                 (get_local $l8)
                 (i32.const 2)))
-            (if $I6
-              (i32.eqz
-                (call $e.instr_FB_without_fault))
-              (then
-                (call $e.trigger_gp_jit
-                  (i32.const 0)
-                  (i32.const 4096))
-                (br $B1)))
+            (set_local $l0
+              (i32.const 53535353))
             (i32.store
               (i32.const 560)
               (i32.or
@@ -159,7 +144,7 @@
                   (i32.load
                     (i32.const 556))
                   (i32.const -4096))
-                (i32.const 1)))
+                (i32.const 11)))
             (i32.store
               (i32.const 556)
               (i32.or
@@ -167,9 +152,7 @@
                   (i32.load
                     (i32.const 556))
                   (i32.const -4096))
-                (i32.const 6)))
-            (set_local $l0
-              (i32.const 42424242))
+                (i32.const 12)))
             (i32.store
               (i32.const 64)
               (get_local $l0))
@@ -194,14 +177,32 @@
             (i32.store
               (i32.const 92)
               (get_local $l7))
-            (call $e.handle_irqs)
-            (i32.store
-              (i32.const 664)
-              (i32.add
-                (i32.load
-                  (i32.const 664))
-                (get_local $l8)))
-            (return))
+            (call $e.instr_F4)
+            (set_local $l0
+              (i32.load
+                (i32.const 64)))
+            (set_local $l1
+              (i32.load
+                (i32.const 68)))
+            (set_local $l2
+              (i32.load
+                (i32.const 72)))
+            (set_local $l3
+              (i32.load
+                (i32.const 76)))
+            (set_local $l4
+              (i32.load
+                (i32.const 80)))
+            (set_local $l5
+              (i32.load
+                (i32.const 84)))
+            (set_local $l6
+              (i32.load
+                (i32.const 88)))
+            (set_local $l7
+              (i32.load
+                (i32.const 92)))
+            (br $B0))
           (unreachable)))
       (i32.store
         (i32.const 64)
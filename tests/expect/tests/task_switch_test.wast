@@ -20,6 +20,7 @@
   (type $t18 (func (param i32 i64 i32)))
   (type $t19 (func (param i32 i64 i32) (result i32)))
   (type $t20 (func (param i32 i64 i64 i32) (result i32)))
+  (type $t21 (func (param i32 i64 i32 i64 i32)))
   (import "e" "task_switch_test_jit" (func $e.task_switch_test_jit (type $t1)))
   (import "e" "fpu_get_sti" (func $e.fpu_get_sti (type $t2)))
   (import "e" "fpu_fadd" (func $e.fpu_fadd (type $t18)))
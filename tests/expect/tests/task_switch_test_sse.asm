@@ -1,3 +1,3 @@
 BITS 32
-    andpd xmm0, xmm1
+    addsd xmm0, xmm1
     hlt
@@ -20,8 +20,9 @@
   (type $t18 (func (param i32 i64 i32)))
   (type $t19 (func (param i32 i64 i32) (result i32)))
   (type $t20 (func (param i32 i64 i64 i32) (result i32)))
+  (type $t21 (func (param i32 i64 i32 i64 i32)))
   (import "e" "task_switch_test_mmx_jit" (func $e.task_switch_test_mmx_jit (type $t1)))
-  (import "e" "instr_660F54" (func $e.instr_660F54 (type $t2)))
+  (import "e" "instr_F20F58" (func $e.instr_F20F58 (type $t12)))
   (import "e" "instr_F4" (func $e.instr_F4 (type $t0)))
   (import "e" "trigger_fault_end_jit" (func $e.trigger_fault_end_jit (type $t0)))
   (import "e" "m" (memory $e.m 128))
@@ -76,16 +77,9 @@
                 (call $e.task_switch_test_mmx_jit
                   (i32.const 4096))
                 (br $B1)))
-            (i64.store
-              (i32.const 1136)
+            (call $e.instr_F20F58
               (i64.load
-                (i32.const 848)))
-            (i64.store
-              (i32.const 1144)
-              (i64.load
-                (i32.const 856)))
-            (call $e.instr_660F54
-              (i32.const 1136)
+                (i32.const 848))
               (i32.const 0))
             (i32.store
               (i32.const 560)
@@ -20,11 +20,12 @@
   (type $t18 (func (param i32 i64 i32)))
   (type $t19 (func (param i32 i64 i32) (result i32)))
   (type $t20 (func (param i32 i64 i64 i32) (result i32)))
+  (type $t21 (func (param i32 i64 i32 i64 i32)))
   (import "e" "instr_F4" (func $e.instr_F4 (type $t0)))
   (import "e" "trigger_fault_end_jit" (func $e.trigger_fault_end_jit (type $t0)))
   (import "e" "m" (memory $e.m 128))
   (func $f (export "f") (type $t1) (param $p0 i32)
-    (local $l0 i32) (local $l1 i32) (local $l2 i32) (local $l3 i32) (local $l4 i32) (local $l5 i32) (local $l6 i32) (local $l7 i32) (local $l8 i32)
+    (local $l0 i32) (local $l1 i32) (local $l2 i32) (local $l3 i32) (local $l4 i32) (local $l5 i32) (local $l6 i32) (local $l7 i32) (local $l8 i32) (local $l9 i32) (local $l10 i32) (local $l11 i32)
     (set_local $l0
       (i32.load
         (i32.const 64)))
@@ -51,6 +52,12 @@
         (i32.const 92)))
     (set_local $l8
       (i32.const 0))
+    (set_local $l9
+      (i32.const 0))
+    (set_local $l10
+      (i32.const 0))
+    (set_local $l11
+      (i32.const 0))
     (block $B0
       (block $B1
         (loop $L2
@@ -79,43 +86,46 @@
                   (i32.add
                     (get_local $l8)
                     (i32.const 2)))
-                (i32.store
-                  (i32.const 112)
+                (set_local $l10
                   (i32.sub
                     (get_local $l0)
                     (i32.const 10)))
-                (i32.store
-                  (i32.const 96)
+                (set_local $l9
                   (get_local $l0))
-                (i32.store
-                  (i32.const 104)
-                  (i32.const 31))
-                (i32.store
-                  (i32.const 116)
+                (set_local $l11
                   (i32.const -2147481387))
-                (br_if $B5
+                (if $I7
                   (i32.eqz
-                    (i32.load
-                      (i32.const 112))))
+                    (get_local $l10))
+                  (then
+                    (i32.store
+                      (i32.const 96)
+                      (get_local $l9))
+                    (i32.store
+                      (i32.const 112)
+                      (get_local $l10))
+                    (i32.store
+                      (i32.const 104)
+                      (i32.const 31))
+                    (i32.store
+                      (i32.const 116)
+                      (get_local $l11))
+                    (set_local $l11
+                      (i32.const 0))
+                    (br $B5)))
                 (set_local $l8
                   (i32.add
                     (get_local $l8)
                     (i32.const 2)))
-                (i32.store
-                  (i32.const 96)
+                (set_local $l9
                   (get_local $l3))
                 (set_local $l3
                   (i32.add
                     (get_local $l3)
                     (i32.const 1)))
-                (i32.store
-                  (i32.const 112)
+                (set_local $l10
                   (get_local $l3))
-                (i32.store
-                  (i32.const 104)
-                  (i32.const 31))
-                (i32.store
-                  (i32.const 116)
+                (set_local $l11
                   (i32.const 2261))
                 (br $L6)))
             (set_local $l8
@@ -189,6 +199,23 @@
                 (i32.const 92)))
             (br $B0))
           (unreachable)))
+      (if $I8
+        (get_local $l11)
+        (then
+          (i32.store
+            (i32.const 96)
+            (get_local $l9))
+          (i32.store
+            (i32.const 112)
+            (get_local $l10))
+          (i32.store
+            (i32.const 104)
+            (i32.const 31))
+          (i32.store
+            (i32.const 116)
+            (get_local $l11))
+          (set_local $l11
+            (i32.const 0))))
       (i32.store
         (i32.const 64)
         (get_local $l0))
@@ -221,6 +248,23 @@
             (i32.const 664))
           (get_local $l8)))
       (return))
+    (if $I9
+      (get_local $l11)
+      (then
+        (i32.store
+          (i32.const 96)
+          (get_local $l9))
+        (i32.store
+          (i32.const 112)
+          (get_local $l10))
+        (i32.store
+          (i32.const 104)
+          (i32.const 31))
+        (i32.store
+          (i32.const 116)
+          (get_local $l11))
+        (set_local $l11
+          (i32.const 0))))
     (i32.store
       (i32.const 64)
       (get_local $l0))
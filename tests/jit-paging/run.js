@@ -64,7 +64,7 @@ emulator.add_listener("serial0-output-char", function(chr)
                 emulator.stop();
                 if(err) throw err;
                 let result = Buffer.from(data).toString();
-                if(result !== "test_shared passed\ntest_consecutive_written passed\n")
+                if(result !== "test_shared passed\ntest_consecutive_written passed\ntest_rep_movs_stos passed\ntest_rep_movsd_jit passed\ntest_self_modifying_block passed\n")
                 {
                     console.error("[!] Error. Result was:\n" + result);
                     process.exit(1);
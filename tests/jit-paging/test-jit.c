@@ -1,7 +1,11 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <ucontext.h>
 #include <sys/mman.h>
 #include <sys/user.h>
 #include <unistd.h>
@@ -192,6 +196,317 @@ void test_consecutive_written()
     printf("test_consecutive_written passed\n");
 }
 
+static void rep_movsb(void *dst, const void *src, uint32_t count)
+{
+    __asm__ volatile("rep movsb" : "+D"(dst), "+S"(src), "+c"(count) : : "memory");
+}
+
+static void rep_movsb_backwards(void *dst, const void *src, uint32_t count)
+{
+    __asm__ volatile("std\n rep movsb\n cld" : "+D"(dst), "+S"(src), "+c"(count) : : "memory");
+}
+
+// not inlined, so that all callers use the same generated code
+__attribute__((noinline)) static void rep_movsd(void *dst, const void *src, uint32_t count)
+{
+    __asm__ volatile("rep movsl" : "+D"(dst), "+S"(src), "+c"(count) : : "memory");
+}
+
+static void rep_stosw(void *dst, uint16_t value, uint32_t count)
+{
+    __asm__ volatile("rep stosw" : "+D"(dst), "+c"(count) : "a"(value) : "memory");
+}
+
+static void rep_stosd(void *dst, uint32_t value, uint32_t count)
+{
+    __asm__ volatile("rep stosl" : "+D"(dst), "+c"(count) : "a"(value) : "memory");
+}
+
+// Map `count` pages that are unlikely to be physically contiguous, touching them if `touch` is
+// set (otherwise the first access faults)
+static uint8_t *map_pages(int count, int touch)
+{
+    uint8_t *const pages = mmap(NULL,
+            count * PAGE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(pages == MAP_FAILED)
+    {
+        fatal("mmap");
+    }
+
+    for(int i = 0; touch && i < count; i++)
+    {
+        // throwaway mmap between the pages, see test_consecutive
+        uint8_t *const throwaway = mmap(NULL,
+                PAGE_SIZE, PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(throwaway == MAP_FAILED)
+        {
+            fatal("mmap");
+        }
+        pages[(count - 1 - i) * PAGE_SIZE] = 0;
+        throwaway[0] = 0;
+    }
+
+    return pages;
+}
+
+static void fill_pattern(uint8_t *buffer, uint32_t length, uint32_t seed)
+{
+    for(uint32_t i = 0; i < length; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        buffer[i] = seed >> 16;
+    }
+}
+
+static sigjmp_buf fault_jmp;
+static volatile uint32_t fault_ecx;
+static volatile uintptr_t fault_edi;
+
+static void fault_handler(int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = context;
+    fault_ecx = uc->uc_mcontext.gregs[REG_ECX];
+    fault_edi = uc->uc_mcontext.gregs[REG_EDI];
+    siglongjmp(fault_jmp, 1);
+}
+
+// Copy `count` bytes with rep movsb into memory that faults at `fault_page`, and check that
+// the registers at the fault point to the first byte of that page
+static void check_fault(uint8_t *dst, const uint8_t *src, uint32_t count, uint8_t *fault_page,
+        int use_movsd)
+{
+    struct sigaction action = { 0 }, old_action;
+    action.sa_sigaction = fault_handler;
+    action.sa_flags = SA_SIGINFO;
+    sigaction(SIGSEGV, &action, &old_action);
+
+    if(sigsetjmp(fault_jmp, 1) == 0)
+    {
+        if(use_movsd)
+        {
+            rep_movsd(dst, src, count / 4);
+        }
+        else
+        {
+            rep_movsb(dst, src, count);
+        }
+        fatal("no fault");
+    }
+
+    sigaction(SIGSEGV, &old_action, NULL);
+
+    uint32_t done = fault_page - dst;
+    if(fault_edi != (uintptr_t)fault_page || fault_ecx != (count - done) / (use_movsd ? 4 : 1))
+    {
+        fatal("registers at fault");
+    }
+    if(memcmp(dst, src, done) != 0)
+    {
+        fatal("data before fault");
+    }
+}
+
+void test_rep_movs_stos()
+{
+    const uint32_t size = 5 * PAGE_SIZE;
+    uint8_t *const src = map_pages(6, 1);
+    uint8_t *const dst = map_pages(6, 1);
+    uint8_t *const expected = malloc(size);
+
+    // forwards and backwards across several physically non-contiguous pages
+    fill_pattern(src, size, 1);
+    rep_movsb(dst + 123, src + 45, 4 * PAGE_SIZE + 99);
+    if(memcmp(dst + 123, src + 45, 4 * PAGE_SIZE + 99) != 0)
+    {
+        fatal("rep movsb");
+    }
+
+    fill_pattern(src, size, 2);
+    rep_movsd(dst + 2, src + 1, PAGE_SIZE + 7);
+    if(memcmp(dst + 2, src + 1, 4 * (PAGE_SIZE + 7)) != 0)
+    {
+        fatal("rep movsl");
+    }
+
+    fill_pattern(src, size, 3);
+    rep_movsb_backwards(dst + 3 * PAGE_SIZE + 17, src + 4 * PAGE_SIZE + 5, 3 * PAGE_SIZE);
+    if(memcmp(dst + 18, src + PAGE_SIZE + 6, 3 * PAGE_SIZE) != 0)
+    {
+        fatal("std; rep movsb");
+    }
+
+    // values whose bytes are all equal are filled with memset, others aren't
+    uint32_t values[] = { 0, 0xABABABAB, 0xFFFFFFFF, 0x12345678, 0xFF0000FF };
+    for(int i = 0; i < 5; i++)
+    {
+        rep_stosd(dst + 1, values[i], PAGE_SIZE + 3);
+        for(uint32_t j = 0; j < PAGE_SIZE + 3; j++)
+        {
+            if(((uint32_t *)(dst + 1))[j] != values[i])
+            {
+                fatal("rep stosl");
+            }
+        }
+
+        rep_stosw(dst + 2 * PAGE_SIZE - 1, values[i], 3 * PAGE_SIZE / 2);
+        for(uint32_t j = 0; j < 3 * PAGE_SIZE / 2; j++)
+        {
+            if(((uint16_t *)(dst + 2 * PAGE_SIZE - 1))[j] != (uint16_t)values[i])
+            {
+                fatal("rep stosw");
+            }
+        }
+    }
+
+    // Overlapping source and destination are copied byte by byte: With dst = src + 1 the first
+    // byte is repeated, with dst < src it's the same as memmove
+    fill_pattern(dst, size, 4);
+    memcpy(expected, dst, size);
+    rep_movsb(dst + 101, dst + 100, 2 * PAGE_SIZE);
+    for(uint32_t i = 0; i < 2 * PAGE_SIZE; i++)
+    {
+        expected[101 + i] = expected[100 + i];
+    }
+    if(memcmp(dst, expected, size) != 0)
+    {
+        fatal("rep movsb with dst = src + 1");
+    }
+
+    rep_movsb(dst + PAGE_SIZE - 50, dst + PAGE_SIZE + 10, 2 * PAGE_SIZE);
+    memmove(expected + PAGE_SIZE - 50, expected + PAGE_SIZE + 10, 2 * PAGE_SIZE);
+    if(memcmp(dst, expected, size) != 0)
+    {
+        fatal("rep movsb with dst < src");
+    }
+
+    // pages that haven't been touched yet fault in the middle of the copy, and the instruction
+    // continues after the kernel mapped them
+    uint8_t *const lazy = map_pages(4, 0);
+    lazy[0] = 0;
+    fill_pattern(src, size, 5);
+    rep_movsb(lazy + PAGE_SIZE / 2, src, 3 * PAGE_SIZE);
+    if(memcmp(lazy + PAGE_SIZE / 2, src, 3 * PAGE_SIZE) != 0)
+    {
+        fatal("rep movsb into pages that aren't present");
+    }
+
+    // a fault that isn't resolved leaves the registers at the faulting page
+    uint8_t *const protected = map_pages(3, 1);
+    if(mprotect(protected + 2 * PAGE_SIZE, PAGE_SIZE, PROT_NONE) != 0)
+    {
+        fatal("mprotect");
+    }
+    check_fault(protected + 100, src, 2 * PAGE_SIZE, protected + 2 * PAGE_SIZE, 0);
+    check_fault(protected + 8, src, 2 * PAGE_SIZE, protected + 2 * PAGE_SIZE, 1);
+
+    // writes into code across a page boundary: overwrite the first 8 incs with nops
+    uint8_t *const code = map_pages(2, 1);
+    uint8_t *ptr = code + PAGE_SIZE - 8;
+    *ptr++ = 0x31; // xor eax, eax
+    *ptr++ = 0xc0;
+    memset(ptr, 0x40, 16); // inc eax
+    ptr[16] = 0xC3; // ret
+
+    int (*fun_pointer)() = (void*)(code + PAGE_SIZE - 8);
+    for(int i = 0; i < 15000; i++)
+    {
+        if(fun_pointer() != 16)
+        {
+            fatal("rep movsb into code");
+        }
+    }
+
+    uint8_t nops[8];
+    memset(nops, 0x90, sizeof nops);
+    rep_movsb(ptr, nops, sizeof nops);
+    if(fun_pointer() != 8)
+    {
+        fatal("rep movsb into code after overwrite");
+    }
+
+    free(expected);
+    munmap(src, 6 * PAGE_SIZE);
+    munmap(dst, 6 * PAGE_SIZE);
+    munmap(lazy, 4 * PAGE_SIZE);
+    munmap(protected, 3 * PAGE_SIZE);
+    munmap(code, 2 * PAGE_SIZE);
+
+    printf("test_rep_movs_stos passed\n");
+}
+
+// rep movsd with small counts is copied by generated code, once this loop is compiled
+void test_rep_movsd_jit()
+{
+    uint8_t *const src = map_pages(2, 1);
+    uint8_t *const dst = map_pages(2, 1);
+
+    fill_pattern(src, 2 * PAGE_SIZE, 6);
+    for(int i = 0; i < 15000; i++)
+    {
+        uint32_t count = i % 17;
+        uint32_t offset = PAGE_SIZE - 4 * (i % 9) - (i & 3);
+        rep_movsd(dst + offset, src + offset + (i & 7), count);
+        if(memcmp(dst + offset, src + offset + (i & 7), 4 * count) != 0)
+        {
+            fatal("small rep movsd");
+        }
+    }
+
+    uint8_t *const lazy = map_pages(2, 0);
+    lazy[0] = 0;
+    rep_movsd(lazy + PAGE_SIZE - 12, src, 16);
+    if(memcmp(lazy + PAGE_SIZE - 12, src, 64) != 0)
+    {
+        fatal("small rep movsd into a page that isn't present");
+    }
+
+    if(mprotect(dst + PAGE_SIZE, PAGE_SIZE, PROT_NONE) != 0)
+    {
+        fatal("mprotect");
+    }
+    check_fault(dst + PAGE_SIZE - 24, src, 64, dst + PAGE_SIZE, 1);
+
+    munmap(src, 2 * PAGE_SIZE);
+    munmap(dst, 2 * PAGE_SIZE);
+    munmap(lazy, 2 * PAGE_SIZE);
+
+    printf("test_rep_movsd_jit passed\n");
+}
+
+// An instruction that overwrites the next instruction of the same block: The cached decoding
+// or compiled code of the block must not run the old instruction
+void test_self_modifying_block()
+{
+    uint8_t *const code = map_pages(1, 1);
+    uint8_t *ptr = code;
+    *ptr++ = 0x31; // xor eax, eax
+    *ptr++ = 0xC0;
+    *ptr++ = 0xC6; // mov byte [target], 0x40
+    *ptr++ = 0x05;
+    uint8_t *const target_pointer = ptr;
+    ptr += 4;
+    *ptr++ = 0x40;
+    uint8_t *const target = ptr;
+    uint32_t target_address = (uintptr_t)target;
+    memcpy(target_pointer, &target_address, 4);
+    *ptr++ = 0x90; // nop, becomes inc eax
+    *ptr++ = 0xC3; // ret
+
+    int (*fun_pointer)() = (void*)code;
+    for(int i = 0; i < 15000; i++)
+    {
+        *target = 0x90;
+        if(fun_pointer() != 1)
+        {
+            fatal("test_self_modifying_block");
+        }
+    }
+
+    munmap(code, PAGE_SIZE);
+
+    printf("test_self_modifying_block passed\n");
+}
+
 int main()
 {
     test_shared();
@@ -201,5 +516,9 @@ int main()
 
     test_consecutive_written();
 
+    test_rep_movs_stos();
+    test_rep_movsd_jit();
+    test_self_modifying_block();
+
     return 0;
 }
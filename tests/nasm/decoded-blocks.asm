@@ -0,0 +1,62 @@
+global _start
+
+section .data
+	align 16
+mydata:
+	dd	0x01234567, 0x89abcdef, 0xfedcba98, 0x76543210
+	dd	0x0f0f0f0f, 0xf0f0f0f0, 0x80000001, 0x7ffffffe
+
+%include "header.inc"
+
+	; Run the loop often enough for its page to be run from pre-decoded blocks (see
+	; interpreter_cache.rs): Immediates of each size, two immediates, and each form of memory
+	; operand, which the decoder has to read like the interpreter
+	mov	ebp, 300
+next:
+	add	eax, 0x12345678
+	adc	ebx, byte -3
+	xor	ecx, eax
+	rol	edx, 5
+	imul	esi, eax, 0x1234567
+	imul	edi, ebx, -7
+	xor	al, 0x5a
+	add	ax, bx
+
+	add	[esp], eax
+	sub	edx, [esp+4]
+	mov	dword [esp+8], 0xdeadbeef
+	add	dword [esp+12], byte 5
+	xor	dword [esp+16], 0x10203
+	add	bl, [esp+16]
+	mov	[esp+20], cl
+	add	ecx, [mydata]
+	mov	edi, ebx
+	and	edi, 7
+	add	eax, [mydata+edi*4]
+	xor	[esp+edi*4], edx
+	sub	esi, [esp+edi*2+2]
+
+	movzx	esi, byte [esp+1]
+	shld	eax, ebx, 7
+	shrd	edx, esi, 3
+	test	edi, 0x40000
+	cmovc	ecx, [esp+4]
+	bt	dword [esp+8], 3
+	setnz	byte [esp+24]
+	xchg	eax, edx
+	neg	esi
+
+	push	dword 0x1234
+	pop	edi
+	push	byte -1
+	add	[esp], esi
+	pop	esi
+	enter	12, 0
+	mov	[ebp-4], eax
+	add	edx, [ebp-4]
+	leave
+
+	dec	ebp
+	jnz	next
+
+%include "footer.inc"
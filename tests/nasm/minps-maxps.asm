@@ -0,0 +1,44 @@
+global _start
+
+section .data
+	align 16
+floats0:
+	dd	1.0
+	dd	-0.0
+	dd	0x7fc00000			; qnan
+	dd	2.0
+floats1:
+	dd	0.0
+	dd	0.0
+	dd	3.0
+	dd	0xffc00001			; qnan
+doubles0:
+	dq	0x7ff8000000000001		; qnan
+	dq	-1.5
+doubles1:
+	dq	-0.0
+	dq	0x7ff4000000000000		; snan
+
+%include "header.inc"
+
+	; If either operand is nan or both are zero, the source is returned. This is what
+	; f32x4.pmin and friends do with their operands swapped
+	movaps		xmm0, [floats0]
+	movaps		xmm1, [floats0]
+	movaps		xmm2, [floats1]
+	movaps		xmm3, [floats1]
+	movapd		xmm4, [doubles0]
+	movapd		xmm5, [doubles0]
+	movapd		xmm6, [doubles1]
+	movapd		xmm7, [doubles1]
+
+	minps		xmm0, xmm2
+	maxps		xmm1, [floats1]
+	minps		xmm2, [floats0]
+	maxps		xmm3, xmm1
+	minpd		xmm4, xmm6
+	maxpd		xmm5, [doubles1]
+	minpd		xmm6, [doubles0]
+	maxpd		xmm7, xmm4
+
+%include "footer.inc"
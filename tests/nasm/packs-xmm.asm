@@ -0,0 +1,35 @@
+global _start
+
+section .data
+	align 16
+words0:
+	dw	0x7fff, 0x8000, 0x0080, 0xff7f, 0x0100, 0xffff, 0x007f, 0xff80
+words1:
+	dw	0x00ff, 0xff00, 0x0000, 0x0001, 0x7f00, 0x8001, 0x00fe, 0xfffe
+dwords0:
+	dd	0x7fffffff, 0x80000000, 0x00008000, 0xffff7fff
+dwords1:
+	dd	0x00007fff, 0xffff8000, 0x00010000, 0xfffeffff
+
+%include "header.inc"
+
+	; values outside of the range of the smaller type saturate
+	movdqa		xmm0, [words0]
+	movdqa		xmm1, [words0]
+	movdqa		xmm2, [words1]
+	movdqa		xmm3, [words1]
+	movdqa		xmm4, [dwords0]
+	movdqa		xmm5, [dwords0]
+	movdqa		xmm6, [dwords1]
+	movdqa		xmm7, [words0]
+
+	packsswb	xmm0, xmm2
+	packuswb	xmm1, [words1]
+	packsswb	xmm2, [words0]
+	packuswb	xmm3, xmm3
+	packssdw	xmm4, xmm6
+	packssdw	xmm5, [dwords1]
+	packssdw	xmm6, xmm6
+	packuswb	xmm7, xmm7
+
+%include "footer.inc"
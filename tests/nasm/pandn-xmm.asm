@@ -0,0 +1,33 @@
+global _start
+
+section .data
+	align 16
+dq0:
+	dq	0x70ad80ad7fffffff
+	dq	0xf100808080f0ff42
+dq1:
+	dq	0x71ae01ff0f00ffbe
+	dq	0x00adbeefc0de00ce
+
+%include "header.inc"
+
+	; dest = ~dest & source, the operands of v128.andnot are the other way around
+	movdqa		xmm0, [dq0]
+	movdqa		xmm1, [dq0]
+	movdqa		xmm2, [dq1]
+	movdqa		xmm3, [dq1]
+	movdqa		xmm4, [dq0]
+	movdqa		xmm5, [dq0]
+	movdqa		xmm6, [dq1]
+	movdqa		xmm7, [dq1]
+
+	pandn		xmm0, xmm2
+	pandn		xmm1, [dq1]
+	pandn		xmm2, [dq0]
+	pandn		xmm3, xmm3
+	andnps		xmm4, xmm6
+	andnps		xmm5, [dq1]
+	andnpd		xmm6, [dq0]
+	andnpd		xmm7, xmm5
+
+%include "footer.inc"
@@ -0,0 +1,32 @@
+global _start
+
+section .data
+	align 16
+dq0:
+	dq	0x8000ff0180017fff
+	dq	0x00ff7f80fffe0000
+dq1:
+	dq	0x7fff00fe8000ffff
+	dq	0xff00807f0001ffff
+
+%include "header.inc"
+
+	movdqa		xmm0, [dq0]
+	movdqa		xmm1, [dq0]
+	movdqa		xmm2, [dq0]
+	movdqa		xmm3, [dq0]
+	movdqa		xmm4, [dq1]
+	movdqa		xmm5, [dq1]
+	movdqa		xmm6, [dq1]
+	movdqa		xmm7, [dq1]
+
+	pminub		xmm0, xmm4
+	pmaxub		xmm1, [dq1]
+	pminsw		xmm2, [dq1]
+	pmaxsw		xmm3, xmm5
+	pminub		xmm4, [dq0]
+	pmaxub		xmm5, xmm2
+	pminsw		xmm6, xmm1
+	pmaxsw		xmm7, [dq0]
+
+%include "footer.inc"
@@ -0,0 +1,41 @@
+global _start
+
+section .data
+	align 16
+mydq0:
+	dq	0xad0000ceadad00ff
+	dq	0xff00dadaec0000da
+mydq1:
+	dq	0x8102030485060708
+	dq	0x090a0b0c8d0e0f10
+
+%include "header.inc"
+
+	; counts of at least the element size clear the element, or fill it with the sign bit for
+	; psraw and psrad, while wasm takes them modulo the element size
+	movdqa		xmm0, [mydq0]
+	movdqa		xmm1, [mydq0]
+	movdqa		xmm2, [mydq0]
+	movdqa		xmm3, [mydq0]
+	movdqa		xmm4, [mydq1]
+	movdqa		xmm5, [mydq1]
+	movdqa		xmm6, [mydq1]
+	movdqa		xmm7, [mydq1]
+
+	psrlw		xmm0, 15
+	psrlw		xmm1, 16
+	psraw		xmm2, 17
+	psraw		xmm3, 255
+	psllw		xmm4, 16
+	psrad		xmm5, 31
+	psrad		xmm6, 32
+	pslld		xmm7, 33
+
+	movdqa		xmm0, [mydq0]
+	psrld		xmm0, 200
+	movdqu		[esp], xmm0
+	movdqa		xmm0, [mydq0]
+	psllw		xmm0, 0
+	movdqu		[esp+16], xmm0
+
+%include "footer.inc"
@@ -0,0 +1,40 @@
+global _start
+
+section .data
+	align 16
+mydq0:
+	dq	0xad0000ceadad00ff
+	dq	0xff00dadaec0000da
+mydq1:
+	dq	0x8102030485060708
+	dq	0x090a0b0c8d0e0f10
+
+%include "header.inc"
+
+	movdqa		xmm0, [mydq0]
+	movdqa		xmm1, [mydq0]
+	movdqa		xmm2, [mydq0]
+	movdqa		xmm3, [mydq0]
+	movdqa		xmm4, [mydq1]
+	movdqa		xmm5, [mydq1]
+	movdqa		xmm6, [mydq1]
+	movdqa		xmm7, [mydq1]
+
+	psrlq		xmm0, 63
+	psrlq		xmm1, 64
+	psllq		xmm2, 1
+	psllq		xmm3, 128
+	psrldq		xmm4, 1
+	psrldq		xmm5, 15
+	pslldq		xmm6, 16
+	pslldq		xmm7, 200
+
+	movdqa		xmm0, [mydq0]
+	psrldq		xmm0, 0
+	pslldq		xmm0, 7
+	movdqu		[esp], xmm0
+	movdqa		xmm0, [mydq1]
+	psrldq		xmm0, 255
+	movdqu		[esp+16], xmm0
+
+%include "footer.inc"
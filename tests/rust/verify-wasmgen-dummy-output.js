@@ -27,8 +27,33 @@ function foo(arg) {
     foo_recd_arg = arg;
 }
 
-const i = new WebAssembly.Instance(wm, { "e": { m: mem, baz, foo } });
+// called by the exported function after it has called the first function of the module
+let bar_called = false;
+function bar() {
+    bar_called = true;
+}
+
+// Functions can only be put into a table as wasm functions, so qux is wrapped by a module that
+// re-exports it
+let qux_recd_arg;
+function qux(arg) {
+    qux_recd_arg = arg;
+}
+const qux_module = new WebAssembly.Module(new Uint8Array([
+    0x00, 0x61, 0x73, 0x6D, 0x01, 0x00, 0x00, 0x00,
+    0x01, 0x05, 0x01, 0x60, 0x01, 0x7F, 0x00, // type 0: (i32) -> ()
+    0x02, 0x07, 0x01, 0x01, 0x65, 0x01, 0x66, 0x00, 0x00, // import "e" "f", type 0
+    0x07, 0x05, 0x01, 0x01, 0x67, 0x00, 0x00, // export "g", function 0
+]));
+const qux_instance = new WebAssembly.Instance(qux_module, { "e": { f: qux } });
+
+const table = new WebAssembly.Table({ element: "anyfunc", initial: 2 });
+table.set(1, qux_instance.exports.g);
+
+const i = new WebAssembly.Instance(wm, { "e": { m: mem, baz, foo, bar, t: table } });
 i.exports.f();
 
 assert(baz_recd_arg === 2, `baz returned: "${baz_recd_arg}"`);
 assert(foo_recd_arg === 456, `foo returned: "${foo_recd_arg}"`);
+assert(qux_recd_arg === 0, `qux returned: "${qux_recd_arg}"`);
+assert(bar_called, "bar wasn't called");